@@ -0,0 +1,4070 @@
+#include "Benchmarks.h"
+#include "DXCore.h"
+#include "Helpers.h"
+#include "ObjImporter.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "Bounds.h"
+#include "TransformStore.h"
+#include "JobSystem.h"
+#include "TangentGenerator.h"
+#include "NullRenderDevice.h"
+#include "MeshletBuilder.h"
+#include "MeshletCuller.h"
+#include "FrustumCuller.h"
+#include "Bvh.h"
+#include "OcclusionCuller.h"
+#include "TriangleBvh.h"
+#include "Registry.h"
+#include "Renderable.h"
+#include "Cam.h"
+#include "InstanceBatcher.h"
+#include "RenderQueue.h"
+#include "CommandBuffer.h"
+#include "StateCacheRenderDevice.h"
+#include "FrameConstants.h"
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace DirectX;
+using namespace std;
+using namespace Microsoft::WRL;
+
+namespace
+{
+	/// <returns>Seconds on the performance counter</returns>
+	double Now()
+	{
+		LARGE_INTEGER counter = {};
+		LARGE_INTEGER frequency = {};
+		QueryPerformanceCounter(&counter);
+		QueryPerformanceFrequency(&frequency);
+		return (double)counter.QuadPart / (double)frequency.QuadPart;
+	}
+
+	/// <returns>A float from low to high out of rand(), so srand() keeps runs repeatable</returns>
+	float Random(float low, float high)
+	{
+		return low + (high - low) * (float)rand() / RAND_MAX;
+	}
+
+	/// <summary>
+	/// Prints each check a bench makes and counts the ones that fail
+	/// </summary>
+	struct Checks
+	{
+		int failures = 0;
+
+		void operator()(const char* what, bool pass)
+		{
+			printf("  %-60s %s\n", what, pass ? "ok" : "FAIL");
+			if (!pass) failures++;
+		}
+	};
+
+	/// <summary>
+	/// Buffers are created on the software device so no GPU is needed
+	/// </summary>
+	/// <returns>A WARP device, or null after saying why there isn't one</returns>
+	ComPtr<ID3D11Device> CreateWarpDevice()
+	{
+		ComPtr<ID3D11Device> device;
+		HRESULT hr = D3D11CreateDevice(0, D3D_DRIVER_TYPE_WARP, 0, 0, 0, 0, D3D11_SDK_VERSION,
+			device.GetAddressOf(), 0, 0);
+		if (FAILED(hr))
+			printf("Couldn't create a WARP device\n");
+		return device;
+	}
+
+	/// <summary>
+	/// The getline/sscanf_s loader Mesh used before ObjImporter, kept as the baseline to measure against
+	/// </summary>
+	void LoadObjReference(const wchar_t* fileName, vector<Vertex>& verts, vector<unsigned int>& indices)
+	{
+		// Author: Chris Cascioli
+		// THE OBJECT LOADING CODE BELOW IS NOT MINE, IT WAS DESIGNED BY CHRIS CASCIOLI
+		// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
+		std::ifstream obj(fileName);
+		if (!obj.is_open())
+			return;
+
+		std::vector<XMFLOAT3> positions;
+		std::vector<XMFLOAT3> normals;
+		std::vector<XMFLOAT2> uvs;
+		unsigned int indexCounter = 0;
+		char chars[100];
+
+		while (obj.good())
+		{
+			obj.getline(chars, 100);
+			if (chars[0] == 'v' && chars[1] == 'n')
+			{
+				XMFLOAT3 norm;
+				sscanf_s(chars, "vn %f %f %f", &norm.x, &norm.y, &norm.z);
+				normals.push_back(norm);
+			}
+			else if (chars[0] == 'v' && chars[1] == 't')
+			{
+				XMFLOAT2 uv;
+				sscanf_s(chars, "vt %f %f", &uv.x, &uv.y);
+				uvs.push_back(uv);
+			}
+			else if (chars[0] == 'v')
+			{
+				XMFLOAT3 pos;
+				sscanf_s(chars, "v %f %f %f", &pos.x, &pos.y, &pos.z);
+				positions.push_back(pos);
+			}
+			else if (chars[0] == 'f')
+			{
+				unsigned int i[12];
+				int numbersRead = sscanf_s(
+					chars,
+					"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
+					&i[0], &i[1], &i[2],
+					&i[3], &i[4], &i[5],
+					&i[6], &i[7], &i[8],
+					&i[9], &i[10], &i[11]);
+
+				Vertex v[4];
+				for (int c = 0; c < 4 && c * 3 < numbersRead; c++)
+				{
+					v[c].Position = positions[i[c * 3] - 1];
+					v[c].UV = uvs[i[c * 3 + 1] - 1];
+					v[c].Normal = normals[i[c * 3 + 2] - 1];
+					v[c].UV.y = 1.0f - v[c].UV.y;
+					v[c].Position.z *= -1.0f;
+					v[c].Normal.z *= -1.0f;
+				}
+
+				verts.push_back(v[0]);
+				verts.push_back(v[2]);
+				verts.push_back(v[1]);
+				indices.push_back(indexCounter++);
+				indices.push_back(indexCounter++);
+				indices.push_back(indexCounter++);
+				if (numbersRead == 12)
+				{
+					verts.push_back(v[0]);
+					verts.push_back(v[3]);
+					verts.push_back(v[2]);
+					indices.push_back(indexCounter++);
+					indices.push_back(indexCounter++);
+					indices.push_back(indexCounter++);
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// The scalar tangent code Mesh used before TangentGenerator, kept as the baseline to measure and check against
+	/// </summary>
+	void CalculateTangentsReference(Vertex* verts, int numVerts, const unsigned int* indices, int numIndices)
+	{
+		// Author: Chris Cascioli
+		// Code originally adapted from: http://www.terathon.com/code/tangent.html
+		//   - Updated version now found here: http://foundationsofgameenginedev.com/FGED2-sample.pdf
+		//   - See listing 7.4 in section 7.5 (page 9 of the PDF)
+
+		// Reset tangents
+		for (int i = 0; i < numVerts; i++)
+		{
+			verts[i].Tangent = XMFLOAT4(0, 0, 0, 1);
+		}
+
+		// Calculate tangents one whole triangle at a time
+		for (int i = 0; i < numIndices;)
+		{
+			// Grab indices and vertices of first triangle
+			unsigned int i1 = indices[i++];
+			unsigned int i2 = indices[i++];
+			unsigned int i3 = indices[i++];
+			Vertex* v1 = &verts[i1];
+			Vertex* v2 = &verts[i2];
+			Vertex* v3 = &verts[i3];
+
+			// Calculate vectors relative to triangle positions
+			float x1 = v2->Position.x - v1->Position.x;
+			float y1 = v2->Position.y - v1->Position.y;
+			float z1 = v2->Position.z - v1->Position.z;
+
+			float x2 = v3->Position.x - v1->Position.x;
+			float y2 = v3->Position.y - v1->Position.y;
+			float z2 = v3->Position.z - v1->Position.z;
+
+			// Do the same for vectors relative to triangle uv's
+			float s1 = v2->UV.x - v1->UV.x;
+			float t1 = v2->UV.y - v1->UV.y;
+
+			float s2 = v3->UV.x - v1->UV.x;
+			float t2 = v3->UV.y - v1->UV.y;
+
+			// Create vectors for tangent calculation
+			float r = 1.0f / (s1 * t2 - s2 * t1);
+
+			float tx = (t2 * x1 - t1 * x2) * r;
+			float ty = (t2 * y1 - t1 * y2) * r;
+			float tz = (t2 * z1 - t1 * z2) * r;
+
+			// Adjust tangents of each vert of the triangle
+			v1->Tangent.x += tx;
+			v1->Tangent.y += ty;
+			v1->Tangent.z += tz;
+
+			v2->Tangent.x += tx;
+			v2->Tangent.y += ty;
+			v2->Tangent.z += tz;
+
+			v3->Tangent.x += tx;
+			v3->Tangent.y += ty;
+			v3->Tangent.z += tz;
+		}
+
+		// Ensure all of the tangents are orthogonal to the normals
+		for (int i = 0; i < numVerts; i++)
+		{
+			// Grab the two vectors
+			XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
+			XMVECTOR tangent = XMLoadFloat4(&verts[i].Tangent);
+
+			// Use Gram-Schmidt orthonormalize to ensure
+			// the normal and tangent are exactly 90 degrees apart
+			tangent = XMVector3Normalize(
+				tangent - normal * XMVector3Dot(normal, tangent));
+
+			// Store the tangent
+			XMStoreFloat4(&verts[i].Tangent, XMVectorSetW(tangent, 1));
+		}
+	}
+
+	/// <summary>
+	/// Write a wavy grid of quads as an OBJ, with lines short enough for the reference loader
+	/// </summary>
+	/// <param name="fileName">- where to write it</param>
+	/// <param name="quadCount">- roughly how many quad faces to write</param>
+	/// <returns>Size of the file in bytes, 0 if it couldn't be written</returns>
+	size_t WriteGridObj(const wchar_t* fileName, int quadCount)
+	{
+		FILE* file = 0;
+		if (_wfopen_s(&file, fileName, L"wb") != 0 || !file)
+			return 0;
+
+		int side = (int)ceil(sqrt((double)quadCount));
+		char line[128];
+		size_t bytes = 0;
+		for (int z = 0; z <= side; z++)
+		{
+			for (int x = 0; x <= side; x++)
+			{
+				float height = 0.25f * sinf(x * 0.37f) * cosf(z * 0.21f);
+				bytes += fwrite(line, 1, snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x * 0.01f, height, z * 0.01f), file);
+				bytes += fwrite(line, 1, snprintf(line, sizeof(line), "vt %.6f %.6f\n", (float)x / side, (float)z / side), file);
+			}
+		}
+		bytes += fwrite(line, 1, snprintf(line, sizeof(line), "vn 0.000000 1.000000 0.000000\n"), file);
+		for (int z = 0; z < side; z++)
+		{
+			for (int x = 0; x < side; x++)
+			{
+				int a = z * (side + 1) + x + 1;
+				int b = a + 1;
+				int c = a + side + 2;
+				int d = a + side + 1;
+				bytes += fwrite(line, 1, snprintf(line, sizeof(line), "f %d/%d/1 %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, b, b, c, c, d, d), file);
+			}
+		}
+		fclose(file);
+		return bytes;
+	}
+
+	/// <summary>
+	/// "-bench obj [quads]": OBJ parse throughput of ObjImporter vs the old getline/sscanf_s loader
+	/// </summary>
+	int BenchmarkObjImport(const char* args)
+	{
+		int quadCount = atoi(args);
+		if (quadCount <= 0) quadCount = 2000000;
+		const int runs = 3;
+
+		wstring fileName = FixPath(L"bench_grid.obj");
+		printf("Writing %d quad OBJ...\n", quadCount);
+		size_t bytes = WriteGridObj(fileName.c_str(), quadCount);
+		if (bytes == 0)
+		{
+			printf("Couldn't write %ls\n", fileName.c_str());
+			return 1;
+		}
+		double megabytes = bytes / (1024.0 * 1024.0);
+		printf("%.1f MB\n\n", megabytes);
+
+		// Neither side builds tangents or GPU buffers, ObjImporter also welds duplicate vertices
+		vector<Vertex> referenceVerts;
+		vector<unsigned int> referenceIndices;
+		double best = 1e30;
+		for (int r = 0; r < runs; r++)
+		{
+			referenceVerts.clear();
+			referenceIndices.clear();
+			double start = Now();
+			LoadObjReference(fileName.c_str(), referenceVerts, referenceIndices);
+			double seconds = Now() - start;
+			if (seconds < best) best = seconds;
+		}
+		printf("  %-24s %8.1f ms %8.1f MB/s\n", "getline + sscanf_s", best * 1000.0, megabytes / best);
+
+		// Single threaded first, then one thread per core
+		unsigned int cores = thread::hardware_concurrency();
+		vector<unsigned int> threadCounts = { 1 };
+		if (cores > 1) threadCounts.push_back(cores);
+		for (unsigned int threads : threadCounts)
+		{
+			vector<Vertex> verts;
+			vector<unsigned int> indices;
+			best = 1e30;
+			for (int r = 0; r < runs; r++)
+			{
+				double start = Now();
+				ObjImporter::Load(fileName.c_str(), verts, indices, threads);
+				double seconds = Now() - start;
+				if (seconds < best) best = seconds;
+			}
+
+			// Check every corner still reads the same thing the old loader did after welding
+			float maxError = 0.0f;
+			bool sameCount = indices.size() == referenceVerts.size();
+			for (size_t i = 0; sameCount && i < indices.size(); i++)
+			{
+				const float* a = &verts[indices[i]].Position.x;
+				const float* b = &referenceVerts[i].Position.x;
+				for (int f = 0; f < 8; f++)
+					maxError = fmaxf(maxError, fabsf(a[f] - b[f]));
+			}
+
+			char label[64];
+			snprintf(label, sizeof(label), "ObjImporter, %u thread%s", threads, threads == 1 ? "" : "s");
+			printf("  %-24s %8.1f ms %8.1f MB/s  (%s, max error %g)\n", label, best * 1000.0, megabytes / best,
+				sameCount ? "matches old loader" : "CORNER COUNT MISMATCH", maxError);
+		}
+		DeleteFileW(fileName.c_str());
+
+		// Bad lines are skipped rather than failing the load, bad indices still fail it
+		printf("\n");
+		Checks check;
+		const char* skipped =
+			"v 0 0 0\nv 1 0 0\nv oops\nv 0 1 0\nvt 0 0\n"
+			"f 1/1 2/1 4/1\nf 1/1 99999999999/1 4/1\nf 1/1 2/1\n";
+		ObjData obj;
+		ObjImporter::Parse(skipped, strlen(skipped), obj, 1);
+		check("malformed v and f lines are skipped and counted", obj.skippedLines == 2);
+		check("skipped v line keeps its slot", obj.positions.size() == 4 && obj.positions[2].x == 0.0f);
+		check("only the good face is kept", obj.corners.size() == 3 && obj.corners[1].position == 3);
+
+		const char* relative = "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\nf -3/-2/-1 -2/-1/-1 -1/-1/-1\n";
+		ObjImporter::Parse(relative, strlen(relative), obj, 1);
+		vector<Vertex> verts;
+		vector<unsigned int> indices;
+		check("uv index before the file start fails the weld", !ObjImporter::WeldVertices(obj, verts, indices));
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// "-bench weld": how many vertices welding saves on every model in Assets/Models
+	/// </summary>
+	int BenchmarkWeld(const char*)
+	{
+		wstring folder = FixPath(L"../../Assets/Models/");
+		WIN32_FIND_DATAW found = {};
+		HANDLE search = FindFirstFileW((folder + L"*.obj").c_str(), &found);
+		if (search == INVALID_HANDLE_VALUE)
+		{
+			printf("No models found in %ls\n", folder.c_str());
+			return 1;
+		}
+
+		printf("  %-24s %10s %10s %10s %12s\n", "Model", "Corners", "Vertices", "Reduction", "VB KB");
+		do
+		{
+			vector<Vertex> verts;
+			vector<unsigned int> indices;
+			if (!ObjImporter::Load((folder + found.cFileName).c_str(), verts, indices) || indices.empty())
+			{
+				printf("  %-24ls failed to load\n", found.cFileName);
+				continue;
+			}
+
+			// Before welding every corner had its own vertex
+			printf("  %-24ls %10zu %10zu %9.1f%% %5.1f -> %.1f\n", found.cFileName, indices.size(), verts.size(),
+				100.0 * (1.0 - (double)verts.size() / indices.size()),
+				indices.size() * sizeof(Vertex) / 1024.0, verts.size() * sizeof(Vertex) / 1024.0);
+		} while (FindNextFileW(search, &found));
+		FindClose(search);
+		return 0;
+	}
+
+	/// <summary>
+	/// "-bench meshload": Mesh construction time when importing the OBJ vs mapping the .meshcache
+	/// </summary>
+	int BenchmarkMeshLoad(const char*)
+	{
+		Checks check;
+
+		ComPtr<ID3D11Device> device = CreateWarpDevice();
+		if (!device)
+			return 1;
+		shared_ptr<RenderDevice> renderDevice = make_shared<NullRenderDevice>();
+
+		const wchar_t* models[] = { L"sphere.obj", L"cube.obj", L"helix.obj" };
+		const int runs = 10;
+		printf("  %-12s %16s %16s\n", "Model", "Import+write ms", "From cache ms");
+		bool sameBounds = true;
+		bool sameBvh = true;
+		for (const wchar_t* model : models)
+		{
+			wstring path = FixPath(L"../../Assets/Models/") + model;
+			wstring cacheName = path + L".meshcache";
+
+			// First load imports and writes the cache, every load after that maps it
+			DeleteFileW(cacheName.c_str());
+			Bounds imported;
+			vector<BvhNode> importedNodes;
+			size_t importedTriangles = 0;
+			double start = Now();
+			{
+				Mesh mesh(path.c_str(), device, renderDevice);
+				imported = mesh.GetBounds();
+				importedNodes = mesh.GetTriangleBvh().GetNodes();
+				importedTriangles = mesh.GetTriangleBvh().GetTriangleCount();
+			}
+			double import = Now() - start;
+
+			double cached = 1e30;
+			for (int r = 0; r < runs; r++)
+			{
+				start = Now();
+				{
+					Mesh mesh(path.c_str(), device, renderDevice);
+				}
+				double seconds = Now() - start;
+				if (seconds < cached) cached = seconds;
+			}
+			printf("  %-12ls %16.3f %16.3f\n", model, import * 1000.0, cached * 1000.0);
+
+			Mesh mesh(path.c_str(), device, renderDevice);
+			sameBounds = sameBounds && memcmp(&mesh.GetBounds(), &imported, sizeof(Bounds)) == 0;
+			const TriangleBvh& triangleBvh = mesh.GetTriangleBvh();
+			sameBvh = sameBvh && triangleBvh.GetTriangleCount() == importedTriangles &&
+				triangleBvh.GetNodeCount() == importedNodes.size() &&
+				memcmp(triangleBvh.GetNodes().data(), importedNodes.data(), importedNodes.size() * sizeof(BvhNode)) == 0;
+		}
+		printf("\n");
+		check("meshes from the cache have the bounds they were imported with", sameBounds);
+		check("meshes from the cache have the picking tree they were imported with", sameBvh);
+
+		// A source that can't be stamped can't prove the cache is current, only null asks for the cache on its own
+		wstring path = FixPath(L"../../Assets/Models/") + models[0];
+		wstring cacheName = path + L".meshcache";
+		wstring missing = FixPath(L"../../Assets/Models/missing.obj");
+		MeshCache cache;
+		check("cache opens against its source", cache.Open(cacheName.c_str(), path.c_str()));
+		check("cache opens on its own with no source", cache.Open(cacheName.c_str(), 0));
+		check("cache is rejected when its source can't be stamped", !cache.Open(cacheName.c_str(), missing.c_str()));
+		cache.Close();
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// "-bench meshopt": post-transform cache efficiency of every model in Assets/Models before and after MeshOptimizer
+	/// </summary>
+	int BenchmarkMeshOptimizer(const char*)
+	{
+		wstring folder = FixPath(L"../../Assets/Models/");
+		WIN32_FIND_DATAW found = {};
+		HANDLE search = FindFirstFileW((folder + L"*.obj").c_str(), &found);
+		if (search == INVALID_HANDLE_VALUE)
+		{
+			printf("No models found in %ls\n", folder.c_str());
+			return 1;
+		}
+
+		printf("  ACMR = transformed vertices per triangle, ATVR = per unique vertex (FIFO cache of 16 / 32)\n\n");
+		printf("  %-24s %21s %21s %21s %21s %10s\n", "Model", "ACMR before", "ACMR after", "ATVR before", "ATVR after", "Time ms");
+		do
+		{
+			vector<Vertex> verts;
+			vector<unsigned int> indices;
+			if (!ObjImporter::Load((folder + found.cFileName).c_str(), verts, indices) || indices.empty())
+			{
+				printf("  %-24ls failed to load\n", found.cFileName);
+				continue;
+			}
+
+			VertexCacheStats before16 = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), verts.size(), 16);
+			VertexCacheStats before32 = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), verts.size(), 32);
+			double start = Now();
+			MeshOptimizer::Optimize(verts, indices);
+			double seconds = Now() - start;
+			VertexCacheStats after16 = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), verts.size(), 16);
+			VertexCacheStats after32 = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), verts.size(), 32);
+
+			printf("  %-24ls %10.3f /%9.3f %10.3f /%9.3f %10.3f /%9.3f %10.3f /%9.3f %10.3f\n", found.cFileName,
+				before16.acmr, before32.acmr, after16.acmr, after32.acmr,
+				before16.atvr, before32.atvr, after16.atvr, after32.atvr, seconds * 1000.0);
+		} while (FindNextFileW(search, &found));
+		FindClose(search);
+		return 0;
+	}
+
+	/// <returns>Angle between two directions in degrees</returns>
+	float AngleDegrees(FXMVECTOR va, FXMVECTOR vb)
+	{
+		// atan2 stays accurate for tiny angles where acos of a float dot product can't
+		float sine = XMVectorGetX(XMVector3Length(XMVector3Cross(va, vb)));
+		float cosine = XMVectorGetX(XMVector3Dot(va, vb));
+		return XMConvertToDegrees(atan2f(sine, cosine));
+	}
+
+	/// <summary>
+	/// "-bench vertexpack": PackedVertex size, speed and worst case error against the expected bounds for Assets/Models
+	/// </summary>
+	int BenchmarkVertexPacking(const char*)
+	{
+		wstring folder = FixPath(L"../../Assets/Models/");
+		WIN32_FIND_DATAW found = {};
+		HANDLE search = FindFirstFileW((folder + L"*.obj").c_str(), &found);
+		if (search == INVALID_HANDLE_VALUE)
+		{
+			printf("No models found in %ls\n", folder.c_str());
+			return 1;
+		}
+
+		// Half of one quantization step for positions, half an ulp for half floats,
+		// and the worst case of the octahedral mapping at 16 bits with some room for rounding
+		const float positionSteps = 0.5f / 65535.0f;
+		const float uvRelative = 1.0f / 2048.0f;
+		const float maxAngle = 0.01f;
+
+		printf("  %u bytes per vertex instead of %u\n\n", (unsigned)sizeof(PackedVertex), (unsigned)sizeof(Vertex));
+		printf("  %-24s %8s %14s %12s %12s %12s %10s %10s %6s\n", "Model", "Vertices", "Position err", "UV err", "Normal deg", "Tangent deg", "Pack M/s", "Unpack M/s", "");
+		int failures = 0;
+		do
+		{
+			vector<Vertex> verts;
+			vector<unsigned int> indices;
+			if (!ObjImporter::Load((folder + found.cFileName).c_str(), verts, indices) || indices.empty())
+			{
+				printf("  %-24ls failed to load\n", found.cFileName);
+				continue;
+			}
+			TangentGenerator::Generate(verts, indices);
+
+			int count = (int)verts.size();
+			XMFLOAT3 boundsMin, boundsMax;
+			BoundingVolumes::ComputeBox(verts.data(), count, boundsMin, boundsMax);
+			vector<PackedVertex> packed(count);
+			vector<Vertex> unpacked(count);
+
+			// Models are small, so repeat until the timings mean something
+			int runs = 2000000 / count;
+			if (runs < 1) runs = 1;
+			double start = Now();
+			for (int r = 0; r < runs; r++)
+				VertexPacking::Pack(verts.data(), count, boundsMin, boundsMax, packed.data());
+			double packSeconds = Now() - start;
+			start = Now();
+			for (int r = 0; r < runs; r++)
+				VertexPacking::Unpack(packed.data(), count, boundsMin, boundsMax, unpacked.data());
+			double unpackSeconds = Now() - start;
+
+			// Position error is reported as a fraction of the bounds so models of any size compare
+			XMFLOAT3 extent(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z);
+			float positionError = 0, uvError = 0, normalError = 0, tangentError = 0;
+			bool pass = true;
+			for (int i = 0; i < count; i++)
+			{
+				const Vertex& a = verts[i];
+				const Vertex& b = unpacked[i];
+				const float* pa = &a.Position.x;
+				const float* pb = &b.Position.x;
+				const float* e = &extent.x;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					float error = fabsf(pa[axis] - pb[axis]);
+					if (e[axis] > 0) positionError = fmaxf(positionError, error / e[axis]);
+					pass &= error <= e[axis] * positionSteps * 1.01f + 1e-6f;
+				}
+
+				const float* ua = &a.UV.x;
+				const float* ub = &b.UV.x;
+				for (int axis = 0; axis < 2; axis++)
+				{
+					float error = fabsf(ua[axis] - ub[axis]);
+					uvError = fmaxf(uvError, error);
+					pass &= error <= fabsf(ua[axis]) * uvRelative + 1e-7f;
+				}
+
+				float normal = AngleDegrees(XMLoadFloat3(&a.Normal), XMLoadFloat3(&b.Normal));
+				normalError = fmaxf(normalError, normal);
+				pass &= normal <= maxAngle;
+
+				// Degenerate UVs leave NaN tangents behind, those have nothing to compare against
+				pass &= (a.Tangent.w < 0) == (b.Tangent.w < 0);
+				if (XMVector3IsNaN(XMLoadFloat4(&a.Tangent)))
+					continue;
+				float tangent = AngleDegrees(XMLoadFloat4(&a.Tangent), XMLoadFloat4(&b.Tangent));
+				tangentError = fmaxf(tangentError, tangent);
+				pass &= tangent <= maxAngle;
+			}
+			if (!pass) failures++;
+
+			double vertexMillions = (double)count * runs / 1e6;
+			printf("  %-24ls %8d %14.3g %12.3g %12.5f %12.5f %10.1f %10.1f %6s\n", found.cFileName, count,
+				positionError, uvError, normalError, tangentError,
+				vertexMillions / packSeconds, vertexMillions / unpackSeconds, pass ? "ok" : "FAIL");
+		} while (FindNextFileW(search, &found));
+		FindClose(search);
+
+		// Zero length and NaN directions get a fallback instead of encoding garbage
+		printf("\n");
+		Checks check;
+		Vertex degenerate[2] = {};
+		degenerate[1].Normal = XMFLOAT3(1, 0, 0);
+		degenerate[1].Tangent = XMFLOAT4(NAN, NAN, NAN, -1);
+		PackedVertex packedDegenerate[2];
+		Vertex unpackedDegenerate[2];
+		XMFLOAT3 zero(0, 0, 0);
+		VertexPacking::Pack(degenerate, 2, zero, zero, packedDegenerate);
+		VertexPacking::Unpack(packedDegenerate, 2, zero, zero, unpackedDegenerate);
+		check("zero normal packs as +Z", AngleDegrees(XMLoadFloat3(&unpackedDegenerate[0].Normal), g_XMIdentityR2) <= maxAngle);
+		check("bitangent sign survives packing", unpackedDegenerate[0].Tangent.w == 1 && unpackedDegenerate[1].Tangent.w == -1);
+		for (const Vertex& v : unpackedDegenerate)
+		{
+			float dot = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&v.Normal), XMLoadFloat4(&v.Tangent)));
+			check("missing tangent packs perpendicular to the normal", fabsf(dot) < 1e-3f);
+		}
+		return failures > 0 || check.failures > 0 ? 1 : 0;
+	}
+
+	/// <summary>
+	/// Compare tangents from TangentGenerator against the old scalar code
+	/// </summary>
+	/// <param name="expected">- vertices run through CalculateTangentsReference()</param>
+	/// <param name="actual">- the same vertices run through TangentGenerator</param>
+	/// <param name="maxAngle">- largest difference in degrees</param>
+	/// <returns>How many tangents are bit-identical, NaN matching NaN included</returns>
+	size_t CompareTangents(const vector<Vertex>& expected, const vector<Vertex>& actual, float& maxAngle)
+	{
+		size_t identical = 0;
+		maxAngle = 0;
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			XMVECTOR a = XMLoadFloat4(&expected[i].Tangent);
+			XMVECTOR b = XMLoadFloat4(&actual[i].Tangent);
+			bool aNaN = XMVector3IsNaN(a);
+			bool bNaN = XMVector3IsNaN(b);
+			if (aNaN || bNaN)
+			{
+				if (aNaN && bNaN) identical++;
+				else maxAngle = 180.0f;
+				continue;
+			}
+			if (memcmp(&expected[i].Tangent, &actual[i].Tangent, sizeof(XMFLOAT3)) == 0) identical++;
+			else maxAngle = fmaxf(maxAngle, AngleDegrees(a, b));
+		}
+		return identical;
+	}
+
+	/// <summary>
+	/// "-bench tangents [quads]": TangentGenerator vs the old scalar tangents, checked on Assets/Models and timed on a generated grid
+	/// </summary>
+	int BenchmarkTangents(const char* args)
+	{
+		int quadCount = atoi(args);
+		if (quadCount <= 0) quadCount = 500000;
+		const int runs = 3;
+		unsigned int cores = thread::hardware_concurrency();
+
+		wstring folder = FixPath(L"../../Assets/Models/");
+		WIN32_FIND_DATAW found = {};
+		HANDLE search = FindFirstFileW((folder + L"*.obj").c_str(), &found);
+		if (search != INVALID_HANDLE_VALUE)
+		{
+			printf("  %-24s %10s %22s %22s\n", "Model", "Vertices", "Identical, 1 thread", "Identical, all");
+			do
+			{
+				vector<Vertex> verts;
+				vector<unsigned int> indices;
+				if (!ObjImporter::Load((folder + found.cFileName).c_str(), verts, indices) || indices.empty())
+					continue;
+
+				vector<Vertex> expected = verts;
+				CalculateTangentsReference(expected.data(), (int)expected.size(), indices.data(), (int)indices.size());
+				vector<Vertex> single = verts;
+				vector<unsigned int> singleIndices = indices;
+				TangentGenerator::Generate(single, singleIndices, 1);
+				vector<Vertex> all = verts;
+				vector<unsigned int> allIndices = indices;
+				TangentGenerator::Generate(all, allIndices, cores);
+
+				float singleAngle, allAngle;
+				size_t singleSame = CompareTangents(expected, single, singleAngle);
+				size_t allSame = CompareTangents(expected, all, allAngle);
+				printf("  %-24ls %10zu %10zu (%5.3g deg) %10zu (%5.3g deg)\n", found.cFileName, verts.size(),
+					singleSame, singleAngle, allSame, allAngle);
+			} while (FindNextFileW(search, &found));
+			FindClose(search);
+		}
+
+		// Two quads sharing an edge with u mirrored across it, the way symmetric models reuse half a texture.
+		// Vertices 1 and 4 sit on the shared edge and are used by both sides
+		printf("\n");
+		Checks check;
+		vector<Vertex> mirrored(6);
+		for (int i = 0; i < 6; i++)
+		{
+			float x = (float)(i % 3 - 1);
+			mirrored[i].Position = XMFLOAT3(x, (float)(i / 3), 0);
+			mirrored[i].UV = XMFLOAT2(fabsf(x), (float)(1 - i / 3));
+			mirrored[i].Normal = XMFLOAT3(0, 0, -1);
+		}
+		const vector<unsigned int> mirroredIndices = { 0, 3, 4, 0, 4, 1, 1, 4, 5, 1, 5, 2 };
+		for (unsigned int threads : { 1u, cores })
+		{
+			vector<Vertex> split = mirrored;
+			vector<unsigned int> splitIndices = mirroredIndices;
+			TangentGenerator::Generate(split, splitIndices, threads);
+			check("mirrored uvs split both shared vertices", split.size() == 8);
+
+			bool opposite = split.size() == 8;
+			for (size_t s = 6; opposite && s < 8; s++)
+			{
+				const Vertex& original = split[s == 6 ? 1 : 4];
+				opposite = memcmp(&original.Position, &split[s].Position, sizeof(XMFLOAT3)) == 0 &&
+					original.Tangent.w == -split[s].Tangent.w;
+			}
+			check("split copies have the opposite bitangent sign", opposite);
+
+			// The first two triangles are the left quad, where u runs along -x
+			bool follows = split.size() == 8;
+			for (size_t i = 0; follows && i < splitIndices.size(); i++)
+			{
+				const XMFLOAT4& tangent = split[splitIndices[i]].Tangent;
+				const XMFLOAT4& first = split[splitIndices[i - i % 3]].Tangent;
+				follows = tangent.w == first.w && tangent.x * (i < 6 ? -1 : 1) > 0.99f;
+			}
+			check("each side keeps its own tangent and sign", follows);
+		}
+
+		// A welded grid big enough that tangents used to dominate import
+		wstring fileName = FixPath(L"bench_grid.obj");
+		printf("\nWriting %d quad OBJ...\n", quadCount);
+		vector<Vertex> verts;
+		vector<unsigned int> indices;
+		bool loaded = WriteGridObj(fileName.c_str(), quadCount) > 0 && ObjImporter::Load(fileName.c_str(), verts, indices);
+		DeleteFileW(fileName.c_str());
+		if (!loaded)
+		{
+			printf("Couldn't write or load %ls\n", fileName.c_str());
+			return 1;
+		}
+		size_t triangleCount = indices.size() / 3;
+		printf("%zu vertices, %zu triangles\n\n", verts.size(), triangleCount);
+
+		vector<Vertex> expected = verts;
+		double best = 1e30;
+		for (int r = 0; r < runs; r++)
+		{
+			double start = Now();
+			CalculateTangentsReference(expected.data(), (int)expected.size(), indices.data(), (int)indices.size());
+			double seconds = Now() - start;
+			if (seconds < best) best = seconds;
+		}
+		printf("  %-28s %8.1f ms %8.1f M tris/s\n", "Scalar CalculateTangents", best * 1000.0, triangleCount / best / 1e6);
+
+		vector<unsigned int> threadCounts = { 1 };
+		if (cores > 1) threadCounts.push_back(cores);
+		for (unsigned int threads : threadCounts)
+		{
+			vector<Vertex> actual;
+			best = 1e30;
+			for (int r = 0; r < runs; r++)
+			{
+				actual = verts;
+				vector<unsigned int> splitIndices = indices;
+				double start = Now();
+				TangentGenerator::Generate(actual, splitIndices, threads);
+				double seconds = Now() - start;
+				if (seconds < best) best = seconds;
+			}
+
+			float maxAngle;
+			size_t identical = CompareTangents(expected, actual, maxAngle);
+			char label[64];
+			snprintf(label, sizeof(label), "TangentGenerator, %u thread%s", threads, threads == 1 ? "" : "s");
+			printf("  %-28s %8.1f ms %8.1f M tris/s  (%zu/%zu identical, max %g deg)\n", label, best * 1000.0,
+				triangleCount / best / 1e6, identical, actual.size(), maxAngle);
+		}
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// "-bench lod [entities]": LOD chains of the demo models, then triangles drawn with and without LODs
+	/// in the demo scene and in a stress scene the camera walks through
+	/// </summary>
+	int BenchmarkLod(const char* args)
+	{
+		int entityCount = atoi(args);
+		if (entityCount <= 0) entityCount = 10000;
+		const float screenHeight = 720;
+		const float aspectRatio = 1280.0f / 720.0f;
+
+		ComPtr<ID3D11Device> device = CreateWarpDevice();
+		if (!device)
+			return 1;
+		shared_ptr<RenderDevice> renderDevice = make_shared<NullRenderDevice>();
+
+		// Import fresh so the LODs are built, not read from an older cache
+		const wchar_t* models[] = { L"sphere.obj", L"cube.obj", L"helix.obj" };
+		shared_ptr<Mesh> meshes[3];
+		printf("  %-12s %4s %10s %10s %12s\n", "Model", "LOD", "Triangles", "Ratio", "Error/radius");
+		for (int m = 0; m < 3; m++)
+		{
+			wstring path = FixPath(L"../../Assets/Models/") + models[m];
+			DeleteFileW((path + L".meshcache").c_str());
+			double start = Now();
+			meshes[m] = make_shared<Mesh>(path.c_str(), device, renderDevice);
+			double seconds = Now() - start;
+			for (int l = 0; l < meshes[m]->GetLodCount(); l++)
+			{
+				MeshLod lod = meshes[m]->GetLod(l);
+				printf("  %-12ls %4d %10u %9.1f%% %12.4f\n", l == 0 ? models[m] : L"", l, lod.indexCount / 3,
+					100.0 * lod.indexCount / meshes[m]->GetLod(0).indexCount, lod.error / meshes[m]->GetBounds().radius);
+			}
+			printf("  %-12s import with LODs %.1f ms\n", "", seconds * 1000.0);
+		}
+
+		// The demo scene as Game::Init lays it out, seen from the starting camera
+		Registry scene;
+		for (int i = 0; i < 7; i++)
+		{
+			Transform* tf = scene.Get<Transform>(scene.Create(Transform(), Renderable(meshes[i % 3 == 0 ? 0 : i % 2 == 0 ? 1 : 2], 0)));
+			tf->SetPosition((float)i, 1, 0);
+			tf->SetScale(0.25f, 0.25f, 0.25f);
+		}
+		for (int i = 0; i < 15; i++)
+		{
+			for (int j = 0; j < 15; j++)
+				scene.Get<Transform>(scene.Create(Transform(), Renderable(meshes[1], 0)))->SetPosition((i * 2.0f) - 10, -2.0f, (j * 2.0f) - 10);
+		}
+		shared_ptr<Cam> cam = make_shared<Cam>(aspectRatio, XMFLOAT3(3, 0, 5), XMFLOAT3(0, XM_PI, 0), 70.0f);
+		size_t fullTriangles = 0, lodTriangles = 0;
+		scene.Each<Transform, Renderable>([&](Entity, Transform& tf, Renderable& e)
+		{
+			tf.UpdateMatrices();
+			e.UpdateLod(tf, cam, screenHeight);
+			fullTriangles += e.GetMesh()->GetLod(0).indexCount / 3;
+			lodTriangles += e.GetMesh()->GetLod(e.GetLod()).indexCount / 3;
+		});
+		printf("\n  Demo scene, %zu ents: %zu triangles without LODs, %zu with (%.1f%% fewer)\n", scene.GetEntityCount(),
+			fullTriangles, lodTriangles, 100.0 * (1.0 - (double)lodTriangles / fullTriangles));
+
+		// Stress scene: ents scattered over a square, the camera walks through the middle
+		// while bobbing back and forth a little, the case hysteresis is there for
+		srand(1);
+		float side = sqrtf((float)entityCount) * 4.0f;
+		Registry stressScene;
+		vector<Transform*> stressTransforms(entityCount);
+		vector<Renderable*> stress(entityCount);
+		for (int i = 0; i < entityCount; i++)
+		{
+			Entity e = stressScene.Create(Transform(), Renderable(meshes[rand() % 3], 0));
+			stressTransforms[i] = stressScene.Get<Transform>(e);
+			stress[i] = stressScene.Get<Renderable>(e);
+			float scale = 0.25f + 1.75f * rand() / RAND_MAX;
+			stressTransforms[i]->SetPosition(side * ((float)rand() / RAND_MAX - 0.5f), 0, side * ((float)rand() / RAND_MAX - 0.5f));
+			stressTransforms[i]->SetScale(scale, scale, scale);
+			stressTransforms[i]->UpdateMatrices();
+		}
+
+		const int frames = 600;
+		vector<int> plainLods(entityCount, 0);
+		vector<int> hysteresisLods(entityCount, 0);
+		size_t plainSwitches = 0, hysteresisSwitches = 0;
+		double full = 0, plain = 0, hysteresis = 0, selectSeconds = 0;
+		for (int f = 0; f < frames; f++)
+		{
+			float z = side * ((float)f / frames - 0.5f) + 0.5f * sinf(f * 0.8f);
+			cam = make_shared<Cam>(aspectRatio, XMFLOAT3(0, 2, z), XMFLOAT3(0, 0, 0), 70.0f);
+			double start = Now();
+			stressScene.Each<Transform, Renderable>([&](Entity, Transform& tf, Renderable& e)
+			{
+				e.UpdateLod(tf, cam, screenHeight);
+			});
+			selectSeconds += Now() - start;
+
+			for (int i = 0; i < entityCount; i++)
+			{
+				// Without hysteresis: always the coarsest LOD under the limit, no matter what was drawn before
+				shared_ptr<Mesh> mesh = stress[i]->GetMesh();
+				int lod = mesh->SelectLod(stress[i]->GetPixelsPerUnit(*stressTransforms[i], cam, screenHeight), mesh->GetLodCount() - 1);
+				if (f > 0 && lod != plainLods[i]) plainSwitches++;
+				if (f > 0 && stress[i]->GetLod() != hysteresisLods[i]) hysteresisSwitches++;
+				plainLods[i] = lod;
+				hysteresisLods[i] = stress[i]->GetLod();
+				full += mesh->GetLod(0).indexCount / 3;
+				plain += mesh->GetLod(lod).indexCount / 3;
+				hysteresis += mesh->GetLod(stress[i]->GetLod()).indexCount / 3;
+			}
+		}
+		printf("\n  Stress scene, %d ents over %d frames (average triangles per frame)\n", entityCount, frames);
+		printf("  %-22s %14.0f\n", "No LODs", full / frames);
+		printf("  %-22s %14.0f %9.1f%% fewer, %zu LOD switches\n", "LODs, no hysteresis", plain / frames,
+			100.0 * (1.0 - plain / full), plainSwitches);
+		printf("  %-22s %14.0f %9.1f%% fewer, %zu LOD switches\n", "LODs, hysteresis", hysteresis / frames,
+			100.0 * (1.0 - hysteresis / full), hysteresisSwitches);
+		printf("  LOD selection %.3f ms per frame\n", selectSeconds * 1000.0 / frames);
+		return 0;
+	}
+
+	/// <summary>
+	/// "-bench meshlets [views]": meshlet sizes for Assets/Models and how many triangles meshlet culling rejects
+	/// from cameras all around each model, checked triangle by triangle to be conservative
+	/// </summary>
+	int BenchmarkMeshlets(const char* args)
+	{
+		int viewCount = atoi(args);
+		if (viewCount <= 0) viewCount = 256;
+
+		wstring folder = FixPath(L"../../Assets/Models/");
+		WIN32_FIND_DATAW found = {};
+		HANDLE search = FindFirstFileW((folder + L"*.obj").c_str(), &found);
+		if (search == INVALID_HANDLE_VALUE)
+		{
+			printf("No models found in %ls\n", folder.c_str());
+			return 1;
+		}
+
+		printf("  %-24s %9s %8s %9s %7s %13s %8s %9s %9s %9s %9s %6s\n", "Model", "Triangles", "Meshlets", "Tris/mlet", "Cones",
+			"ACMR", "Build ms", "Frustum", "Backface", "Ideal", "ns/mlet", "");
+		int failures = 0;
+		do
+		{
+			vector<Vertex> verts;
+			vector<unsigned int> indices;
+			if (!ObjImporter::Load((folder + found.cFileName).c_str(), verts, indices) || indices.empty())
+			{
+				printf("  %-24ls failed to load\n", found.cFileName);
+				continue;
+			}
+			MeshOptimizer::Optimize(verts, indices);
+			float acmrBefore = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), verts.size()).acmr;
+			vector<Meshlet> meshlets;
+			double start = Now();
+			MeshletBuilder::Build(verts.data(), verts.size(), indices.data(), 0, (unsigned int)indices.size(), meshlets);
+			double buildSeconds = Now() - start;
+			float acmrAfter = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), verts.size()).acmr;
+			size_t cones = 0;
+			for (const Meshlet& m : meshlets)
+				if (m.coneCutoff > 0) cones++;
+
+			XMFLOAT3 boundsMin, boundsMax;
+			BoundingVolumes::ComputeBox(verts.data(), (int)verts.size(), boundsMin, boundsMax);
+			XMVECTOR center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&boundsMin), XMLoadFloat3(&boundsMax)), 0.5f);
+			float radius = 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&boundsMax), XMLoadFloat3(&boundsMin))));
+			XMFLOAT4X4 world, proj;
+			XMStoreFloat4x4(&world, XMMatrixIdentity());
+			XMStoreFloat4x4(&proj, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, 100.0f * radius));
+
+			// Cameras spread evenly around the model, looking past its center by up to a radius so it is often cut by the frustum
+			MeshletCullStats stats = {};
+			vector<IndexRange> visible;
+			vector<unsigned char> drawn(indices.size() / 3);
+			size_t idealCulled = 0, wrongCulls = 0;
+			double cullSeconds = 0;
+			for (int v = 0; v < viewCount; v++)
+			{
+				float y = 1 - 2 * (v + 0.5f) / viewCount;
+				float ring = sqrtf(1 - y * y);
+				float angle = v * 2.39996323f;
+				XMVECTOR direction = XMVectorSet(ring * cosf(angle), y, ring * sinf(angle), 0);
+				XMVECTOR eye = XMVectorAdd(center, XMVectorScale(direction, radius * (1.5f + 2.0f * (v % 4))));
+				XMVECTOR offset = XMVectorScale(XMVectorSet(cosf(angle * 3), sinf(angle * 5), cosf(angle * 7), 0), radius * (v % 3) * 0.5f);
+				XMVECTOR up = fabsf(y) > 0.99f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+				XMFLOAT4X4 view;
+				XMStoreFloat4x4(&view, XMMatrixLookAtLH(eye, XMVectorAdd(center, offset), up));
+				XMFLOAT3 camPos;
+				XMStoreFloat3(&camPos, eye);
+
+				MeshletCullView cullView = MeshletCuller::MakeView(world, view, proj, camPos);
+				start = Now();
+				MeshletCuller::Cull(cullView, meshlets.data(), meshlets.size(), visible, &stats);
+				cullSeconds += Now() - start;
+
+				// Every triangle left out has to be facing away or entirely outside one plane
+				fill(drawn.begin(), drawn.end(), 0);
+				for (const IndexRange& range : visible)
+					for (unsigned int t = range.indexOffset / 3; t < (range.indexOffset + range.indexCount) / 3; t++) drawn[t] = 1;
+				for (size_t t = 0; t < drawn.size(); t++)
+				{
+					XMVECTOR p[3];
+					for (int c = 0; c < 3; c++)
+						p[c] = XMLoadFloat3(&verts[indices[t * 3 + c]].Position);
+					XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p[1], p[0]), XMVectorSubtract(p[2], p[0]));
+					bool invisible = XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(p[0], eye))) >= 0;
+					for (int i = 0; i < 6 && !invisible; i++)
+					{
+						XMVECTOR plane = XMLoadFloat4(&cullView.planes[i]);
+						invisible = XMVectorGetX(XMPlaneDotCoord(plane, p[0])) < 0 &&
+							XMVectorGetX(XMPlaneDotCoord(plane, p[1])) < 0 && XMVectorGetX(XMPlaneDotCoord(plane, p[2])) < 0;
+					}
+					if (invisible) idealCulled++;
+					if (!drawn[t] && !invisible) wrongCulls++;
+				}
+			}
+
+			double triangles = (double)stats.triangles;
+			bool pass = wrongCulls == 0;
+			if (!pass) failures++;
+			printf("  %-24ls %9zu %8zu %9.1f %6.0f%% %6.3f>%6.3f %8.2f %8.1f%% %8.1f%% %8.1f%% %9.1f %6s\n", found.cFileName, indices.size() / 3, meshlets.size(),
+				indices.size() / 3.0 / meshlets.size(), 100.0 * cones / meshlets.size(), acmrBefore, acmrAfter, buildSeconds * 1000.0,
+				100.0 * stats.frustumTriangles / triangles, 100.0 * stats.backfaceTriangles / triangles, 100.0 * idealCulled / triangles,
+				cullSeconds * 1e9 / stats.meshlets, pass ? "ok" : "FAIL");
+		} while (FindNextFileW(search, &found));
+		FindClose(search);
+
+		printf("\n  Cones: meshlets narrow enough for backface culling, ACMR: vertex cache misses per triangle before > after building\n");
+		printf("  Frustum/Backface: share of triangles each meshlet test rejected over %d views\n", viewCount);
+		printf("  Ideal: share a per-triangle test would reject, the most meshlet culling could reach\n");
+		return failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// "-bench bounds [entities]": mesh bounds for Assets/Models against a plain scalar loop, then world
+	/// bounds for a crowd of ents, checked to contain every transformed vertex
+	/// </summary>
+	int BenchmarkBounds(const char* args)
+	{
+		int entityCount = atoi(args);
+		if (entityCount <= 0) entityCount = 100000;
+
+		wstring folder = FixPath(L"../../Assets/Models/");
+		WIN32_FIND_DATAW found = {};
+		HANDLE search = FindFirstFileW((folder + L"*.obj").c_str(), &found);
+		if (search == INVALID_HANDLE_VALUE)
+		{
+			printf("No models found in %ls\n", folder.c_str());
+			return 1;
+		}
+
+		printf("  %-24s %8s %14s %14s %12s %6s\n", "Model", "Vertices", "Scalar ns/vtx", "Box ns/vtx", "Sphere/box", "");
+		vector<vector<Vertex>> models;
+		vector<Bounds> modelBounds;
+		int failures = 0;
+		do
+		{
+			vector<Vertex> verts;
+			vector<unsigned int> indices;
+			if (!ObjImporter::Load((folder + found.cFileName).c_str(), verts, indices) || verts.empty())
+			{
+				printf("  %-24ls failed to load\n", found.cFileName);
+				continue;
+			}
+			int count = (int)verts.size();
+
+			// Models are small, so repeat until the timings mean something
+			int runs = 20000000 / count;
+			if (runs < 1) runs = 1;
+			XMFLOAT3 scalarMin, scalarMax;
+			double start = Now();
+			for (int r = 0; r < runs; r++)
+			{
+				scalarMin = scalarMax = verts[0].Position;
+				for (int i = 1; i < count; i++)
+				{
+					const XMFLOAT3& p = verts[i].Position;
+					scalarMin = XMFLOAT3(fminf(scalarMin.x, p.x), fminf(scalarMin.y, p.y), fminf(scalarMin.z, p.z));
+					scalarMax = XMFLOAT3(fmaxf(scalarMax.x, p.x), fmaxf(scalarMax.y, p.y), fmaxf(scalarMax.z, p.z));
+				}
+			}
+			double scalarSeconds = Now() - start;
+
+			XMFLOAT3 boxMin, boxMax;
+			start = Now();
+			for (int r = 0; r < runs; r++)
+				BoundingVolumes::ComputeBox(verts.data(), count, boxMin, boxMax);
+			double boxSeconds = Now() - start;
+
+			// The sphere has to reach every vertex, and the box has to match the scalar one exactly
+			Bounds bounds = BoundingVolumes::Compute(verts.data(), count);
+			bool pass = memcmp(&boxMin, &scalarMin, sizeof(XMFLOAT3)) == 0 && memcmp(&boxMax, &scalarMax, sizeof(XMFLOAT3)) == 0;
+			for (const Vertex& v : verts)
+			{
+				float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&v.Position), XMLoadFloat3(&bounds.center))));
+				if (distance > bounds.radius * 1.0001f + 1e-6f) pass = false;
+			}
+			if (!pass) failures++;
+			float boxRadius = 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&boxMax), XMLoadFloat3(&boxMin))));
+			printf("  %-24ls %8d %14.3f %14.3f %11.1f%% %6s\n", found.cFileName, count, scalarSeconds * 1e9 / runs / count,
+				boxSeconds * 1e9 / runs / count, boxRadius > 0 ? 100.0 * bounds.radius / boxRadius : 100.0, pass ? "ok" : "FAIL");
+			models.push_back(verts);
+			modelBounds.push_back(bounds);
+		} while (FindNextFileW(search, &found));
+		FindClose(search);
+		if (models.empty())
+			return 1;
+		printf("\n  Sphere/box: radius of the sphere around the vertices against the sphere around the box\n");
+
+		// A crowd of ents with random meshes, positions, rotations and uneven scales
+		srand(1);
+		vector<int> entModel(entityCount);
+		vector<Transform> transforms(entityCount);
+		vector<XMFLOAT4X4> worlds(entityCount);
+		vector<Bounds> local(entityCount);
+		for (int i = 0; i < entityCount; i++)
+		{
+			entModel[i] = rand() % (int)models.size();
+			local[i] = modelBounds[entModel[i]];
+			transforms[i].SetPosition(100.0f * rand() / RAND_MAX, 100.0f * rand() / RAND_MAX, 100.0f * rand() / RAND_MAX);
+			transforms[i].SetOrientation(XM_2PI * rand() / RAND_MAX, XM_2PI * rand() / RAND_MAX, XM_2PI * rand() / RAND_MAX);
+			transforms[i].SetScale(0.25f + 2.0f * rand() / RAND_MAX, 0.25f + 2.0f * rand() / RAND_MAX, 0.25f + 2.0f * rand() / RAND_MAX);
+			transforms[i].UpdateMatrices();
+			worlds[i] = transforms[i].GetWorldMatrix();
+		}
+
+		const int runs = 20;
+		vector<Bounds> world(entityCount), batched(entityCount);
+		double best = 1e30, batchedBest = 1e30;
+		for (int r = 0; r < runs; r++)
+		{
+			double start = Now();
+			for (int i = 0; i < entityCount; i++)
+				world[i] = BoundingVolumes::ToWorld(local[i], worlds[i]);
+			best = fmin(best, Now() - start);
+			start = Now();
+			BoundingVolumes::ToWorld(local.data(), worlds.data(), entityCount, batched.data());
+			batchedBest = fmin(batchedBest, Now() - start);
+		}
+
+		// Lanes may fuse multiplies and adds differently, so the batch only has to agree to rounding
+		float batchedError = 0;
+		for (int i = 0; i < entityCount; i++)
+		{
+			const float* a = &world[i].boxMin.x;
+			const float* b = &batched[i].boxMin.x;
+			for (int f = 0; f < 10; f++)
+				batchedError = fmaxf(batchedError, fabsf(a[f] - b[f]) / (1.0f + fabsf(a[f])));
+		}
+		if (batchedError > 1e-5f) failures++;
+
+		// Every transformed vertex of a sample of the crowd has to land inside both world volumes
+		int checked = entityCount < 1000 ? entityCount : 1000;
+		size_t outside = 0;
+		for (int i = 0; i < checked; i++)
+		{
+			XMMATRIX matrix = XMLoadFloat4x4(&worlds[i]);
+			const Bounds& b = world[i];
+			float slack = 1e-4f * (1.0f + b.radius);
+			XMVECTOR slackVector = XMVectorReplicate(slack);
+			for (const Vertex& v : models[entModel[i]])
+			{
+				XMVECTOR p = XMVector3Transform(XMLoadFloat3(&v.Position), matrix);
+				bool inBox = XMVector3GreaterOrEqual(p, XMVectorSubtract(XMLoadFloat3(&b.boxMin), slackVector)) &&
+					XMVector3LessOrEqual(p, XMVectorAdd(XMLoadFloat3(&b.boxMax), slackVector));
+				bool inSphere = XMVectorGetX(XMVector3Length(XMVectorSubtract(p, XMLoadFloat3(&b.center)))) <= b.radius + slack;
+				if (!inBox || !inSphere) outside++;
+			}
+		}
+		if (outside > 0) failures++;
+
+		printf("\n  World bounds for %d ents\n", entityCount);
+		printf("  %-22s %10.2f ns/ent\n", "ToWorld", best * 1e9 / entityCount);
+		printf("  %-22s %10.2f ns/ent  %.1fx, largest relative difference %g %s\n", "ToWorld batched", batchedBest * 1e9 / entityCount,
+			best / batchedBest, batchedError, batchedError <= 1e-5f ? "ok" : "FAIL");
+		printf("  %d ents checked vertex by vertex: %s\n", checked, outside == 0 ? "ok" : "FAIL");
+		return failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// World and inverse transpose matrices of a transform in doubles, the reference both float paths are measured against
+	/// </summary>
+	void ReferenceMatrices(Transform& transform, double world[16], double inverseTranspose[16])
+	{
+		XMFLOAT3 p = transform.GetPosition();
+		XMFLOAT4 q = transform.GetOrientation();
+		XMFLOAT3 scale = transform.GetScale();
+		double x = q.x, y = q.y, z = q.z, w = q.w;
+		double r[3][3] =
+		{
+			{ 1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w) },
+			{ 2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w) },
+			{ 2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y) },
+		};
+		double s[3] = { scale.x, scale.y, scale.z };
+		double t[3] = { p.x, p.y, p.z };
+		for (int row = 0; row < 3; row++)
+		{
+			for (int col = 0; col < 3; col++)
+			{
+				world[row * 4 + col] = r[row][col] * s[row];
+				inverseTranspose[row * 4 + col] = r[row][col] / s[row];
+			}
+			world[row * 4 + 3] = 0;
+			inverseTranspose[row * 4 + 3] = -(r[row][0] * t[0] + r[row][1] * t[1] + r[row][2] * t[2]) / s[row];
+			world[12 + row] = t[row];
+			inverseTranspose[12 + row] = 0;
+		}
+		world[15] = inverseTranspose[15] = 1;
+	}
+
+	/// <returns>Largest difference between a transform's matrices and the double reference, relative to each element's size</returns>
+	double MatrixError(const XMFLOAT4X4& world, const XMFLOAT4X4& inverseTranspose, const double* expectedWorld, const double* expectedInverse)
+	{
+		double error = 0;
+		for (int e = 0; e < 16; e++)
+		{
+			error = fmax(error, fabs((&world._11)[e] - expectedWorld[e]) / fmax(1.0, fabs(expectedWorld[e])));
+			error = fmax(error, fabs((&inverseTranspose._11)[e] - expectedInverse[e]) / fmax(1.0, fabs(expectedInverse[e])));
+		}
+		return error;
+	}
+
+	/// <summary>
+	/// "-bench transforms [count]": world and inverse transpose matrices one Transform at a time against one
+	/// TransformStore pass, at 1k, 100k and 1M transforms unless a count is given, checked against each other.
+	/// Then the same store with only some of its transforms moving, updated through dirty tracking
+	/// </summary>
+	int BenchmarkTransforms(const char* args)
+	{
+		vector<int> counts = { 1000, 100000, 1000000 };
+		if (atoi(args) > 0) counts.assign(1, atoi(args));
+#ifdef _XM_AVX_INTRINSICS_
+		printf("  Batched path: AVX, 8 transforms per instruction\n\n");
+#else
+		printf("  Batched path: XMVECTOR, 4 transforms per instruction\n\n");
+#endif
+
+		printf("  %10s %16s %16s %9s %11s %11s %6s\n", "Transforms", "One at a time", "TransformStore", "Speedup", "Old error", "Store error", "");
+		int failures = 0;
+		srand(1);
+		for (int count : counts)
+		{
+			TransformStore store;
+			store.SetJobs(0); // one thread, like the path it is compared with
+			vector<Transform> transforms;
+			transforms.reserve(count);
+			for (int i = 0; i < count; i++)
+			{
+				transforms.emplace_back(store);
+				transforms[i].SetPosition(100.0f * rand() / RAND_MAX, 100.0f * rand() / RAND_MAX, 100.0f * rand() / RAND_MAX);
+				transforms[i].SetOrientation(XM_2PI * rand() / RAND_MAX, XM_2PI * rand() / RAND_MAX, XM_2PI * rand() / RAND_MAX);
+				transforms[i].SetScale(0.25f + 2.0f * rand() / RAND_MAX, 0.25f + 2.0f * rand() / RAND_MAX, 0.25f + 2.0f * rand() / RAND_MAX);
+			}
+
+			// Enough runs that the small counts are measurable too
+			int runs = 10000000 / count;
+			if (runs < 3) runs = 3;
+			double singleBest = 1e30, batchedBest = 1e30;
+			for (int r = 0; r < runs; r++)
+			{
+				double start = Now();
+				for (Transform& t : transforms)
+					t.UpdateMatrices();
+				singleBest = fmin(singleBest, Now() - start);
+			}
+			vector<XMFLOAT4X4> worlds(count), inverseTransposes(count);
+			for (int i = 0; i < count; i++)
+			{
+				worlds[i] = transforms[i].GetWorldMatrix();
+				inverseTransposes[i] = transforms[i].GetWorldInverseTransposeMatrix();
+			}
+			for (int r = 0; r < runs; r++)
+			{
+				double start = Now();
+				store.UpdateAllMatrices();
+				batchedBest = fmin(batchedBest, Now() - start);
+			}
+
+			// Both are measured against doubles, the batched path has to be at least as close as the old one
+			double singleError = 0, batchedError = 0;
+			for (int i = 0; i < count; i++)
+			{
+				double expectedWorld[16], expectedInverse[16];
+				ReferenceMatrices(transforms[i], expectedWorld, expectedInverse);
+				singleError = fmax(singleError, MatrixError(worlds[i], inverseTransposes[i], expectedWorld, expectedInverse));
+				batchedError = fmax(batchedError, MatrixError(transforms[i].GetWorldMatrix(), transforms[i].GetWorldInverseTransposeMatrix(),
+					expectedWorld, expectedInverse));
+			}
+			bool pass = batchedError <= fmax(singleError, 1e-5);
+			if (!pass) failures++;
+			printf("  %10d %13.2f ns %13.2f ns %8.1fx %11.2g %11.2g %6s\n", count, singleBest * 1e9 / count, batchedBest * 1e9 / count,
+				singleBest / batchedBest, singleError, batchedError, pass ? "ok" : "FAIL");
+		}
+		printf("\n  Times are per transform, world and inverse transpose matrices together\n");
+		printf("  Errors: largest difference from matrices built in doubles, relative to each element's size\n");
+
+		// Frames where only some transforms move, as in a scene that's mostly static
+		int count = counts.back();
+		TransformStore store;
+		store.SetJobs(0); // one thread, like the path it is compared with
+		vector<Transform> transforms;
+		transforms.reserve(count);
+		for (int i = 0; i < count; i++)
+		{
+			transforms.emplace_back(store);
+			transforms[i].SetPosition(100.0f * rand() / RAND_MAX, 100.0f * rand() / RAND_MAX, 100.0f * rand() / RAND_MAX);
+			transforms[i].SetOrientation(XM_2PI * rand() / RAND_MAX, XM_2PI * rand() / RAND_MAX, XM_2PI * rand() / RAND_MAX);
+		}
+		store.UpdateAllMatrices();
+		const int frames = 20;
+		double allBest = 1e30;
+		for (int f = 0; f < frames; f++)
+		{
+			double start = Now();
+			store.UpdateAllMatrices();
+			allBest = fmin(allBest, Now() - start);
+		}
+
+		printf("\n  %d transforms, some moving every frame\n", count);
+		printf("  %-14s %12s %12s %9s %10s %6s\n", "Moving", "Changed", "Update ms", "Speedup", "Skipped", "");
+		printf("  %-14s %12d %12.3f %9s %10s\n", "all, forced", count, allBest * 1000.0, "1.0x", "0%");
+		struct { int percent; bool together; } cases[] = { { 0, false }, { 1, false }, { 10, false }, { 10, true }, { 100, false } };
+		for (auto c : cases)
+		{
+			// Scattered movers are the worst case for groups, since a group with one mover is redone whole
+			int percent = c.percent;
+			vector<int> movers;
+			for (int i = 0; i < count; i++)
+				if (c.together ? i < count / 100 * percent : rand() % 100 < percent) movers.push_back(i);
+
+			double best = 1e30;
+			size_t changed = 0;
+			unsigned int before = store.GetFrame();
+			for (int f = 0; f < frames; f++)
+			{
+				for (int i : movers)
+					transforms[i].MoveAbsolute(0, 0.01f, 0);
+				double start = Now();
+				store.UpdateMatrices();
+				best = fmin(best, Now() - start);
+				changed = store.GetChangedSlots().size();
+			}
+
+			// Only movers may report a change, and their matrices must match a full rebuild exactly
+			size_t reported = 0;
+			for (Transform& t : transforms)
+				if (t.HasChangedSince(before)) reported++;
+			vector<XMFLOAT4X4> tracked(count);
+			for (int i = 0; i < count; i++)
+				tracked[i] = transforms[i].GetWorldMatrix();
+			store.UpdateAllMatrices();
+			bool pass = reported == movers.size();
+			for (int i = 0; i < count && pass; i++)
+			{
+				XMFLOAT4X4 world = transforms[i].GetWorldMatrix();
+				pass = memcmp(&world, &tracked[i], sizeof(XMFLOAT4X4)) == 0;
+			}
+			if (!pass) failures++;
+
+			char label[32], speedup[32];
+			snprintf(label, sizeof(label), "%d%%%s", percent, c.together ? ", together" : "");
+			if (allBest / best < 1000) snprintf(speedup, sizeof(speedup), "%.1fx", allBest / best);
+			else snprintf(speedup, sizeof(speedup), ">1000x");
+			printf("  %-14s %12zu %12.3f %9s %9.1f%% %6s\n", label, changed, best * 1000.0, speedup,
+				100.0 * (count - changed) / count, pass ? "ok" : "FAIL");
+		}
+		printf("\n  Changed: transforms reported by GetChangedSlots(), Skipped: transforms left alone\n");
+
+		// A flattened transform has no inverse, its inverse transpose row has to stay finite
+		printf("\n");
+		Checks check;
+		TransformStore flatStore;
+		flatStore.SetJobs(0);
+		vector<Transform> flat;
+		flat.reserve(TRANSFORM_STORE_GROUP);
+		for (int i = 0; i < TRANSFORM_STORE_GROUP; i++)
+		{
+			flat.emplace_back(flatStore);
+			flat[i].SetScale(1.0f, i == 0 ? 0.0f : 1.0f, 1.0f);
+		}
+		flatStore.UpdateAllMatrices();
+		XMFLOAT4X4 flatInverse = flat[0].GetWorldInverseTransposeMatrix();
+		bool finite = true;
+		for (int i = 0; i < 16; i++)
+			finite &= isfinite(flatInverse.m[i / 4][i % 4]) != 0;
+		check("zero scale leaves a finite inverse transpose", finite && flatInverse._22 == 0.0f);
+		check("zero scale doesn't touch the rest of its group", flat[1].GetWorldInverseTransposeMatrix()._22 == 1.0f);
+		return failures == 0 && check.failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// World matrices of a tree built the naive way, recursing up to the root in doubles, the reference the
+	/// breadth-first propagation is checked against. Memoized only so deep trees finish
+	/// </summary>
+	const double* NaiveWorld(int node, const vector<int>& parentOf, vector<Transform*>& transforms, vector<double>& worlds, vector<unsigned char>& done)
+	{
+		double* result = &worlds[node * 16];
+		if (done[node])
+			return result;
+		double local[16], inverseTranspose[16];
+		ReferenceMatrices(*transforms[node], local, inverseTranspose);
+		if (parentOf[node] < 0)
+			memcpy(result, local, sizeof(local));
+		else
+		{
+			const double* parent = NaiveWorld(parentOf[node], parentOf, transforms, worlds, done);
+			for (int row = 0; row < 4; row++)
+				for (int col = 0; col < 4; col++)
+					result[row * 4 + col] = local[row * 4] * parent[col] + local[row * 4 + 1] * parent[4 + col] +
+						local[row * 4 + 2] * parent[8 + col] + local[row * 4 + 3] * parent[12 + col];
+		}
+		done[node] = 1;
+		return result;
+	}
+
+	/// <summary>
+	/// "-bench hierarchy [nodes]": Transform hierarchies shaped deep, wide and random, propagated breadth-first
+	/// level by level against a depth-first recursion, checked against naive recursive composition in doubles,
+	/// also after re-parenting
+	/// </summary>
+	int BenchmarkHierarchy(const char* args)
+	{
+		int nodeCount = atoi(args);
+		if (nodeCount <= 0) nodeCount = 100000;
+		unsigned int cores = JobSystem::Shared().GetThreadCount();
+
+		printf("  %-8s %8s %7s %12s %12s %12s %11s %11s %10s %6s\n", "Tree", "Nodes", "Levels", "Recursive", "1 thread",
+			"Threads", "Root moved", "Reparent", "Max error", "");
+		int failures = 0;
+		for (int shape = 0; shape < 3; shape++)
+		{
+			// Parents always come before their children here, but slots are handed out in a random order
+			srand(1);
+			vector<int> parentOf(nodeCount);
+			const char* name = shape == 0 ? "deep" : shape == 1 ? "wide" : "random";
+			int chains = 100;
+			int roots = 10;
+			int wideChildren = (int)sqrtf((float)nodeCount / roots);
+			for (int i = 0; i < nodeCount; i++)
+			{
+				if (shape == 0) parentOf[i] = i < chains ? -1 : i - chains; // 100 chains side by side
+				else if (shape == 1) parentOf[i] = i < roots ? -1 : i < roots + roots * wideChildren ? (i - roots) / wideChildren : roots + (i - roots) % (roots * wideChildren);
+				else parentOf[i] = i == 0 ? -1 : rand() % i;
+			}
+
+			TransformStore store;
+			store.SetJobs(0);
+			vector<Transform> slots;
+			slots.reserve(nodeCount);
+			for (int i = 0; i < nodeCount; i++)
+				slots.emplace_back(store);
+			vector<Transform*> transforms(nodeCount);
+			for (int i = 0; i < nodeCount; i++)
+				transforms[i] = &slots[i];
+			for (int i = nodeCount - 1; i > 0; i--)
+				swap(transforms[i], transforms[rand() % (i + 1)]);
+
+			// Scales close to 1 so even a thousand levels stay in range
+			for (int i = 0; i < nodeCount; i++)
+			{
+				Transform& t = *transforms[i];
+				t.SetPosition((float)rand() / RAND_MAX - 0.5f, (float)rand() / RAND_MAX - 0.5f, (float)rand() / RAND_MAX - 0.5f);
+				t.SetOrientation(0.2f * rand() / RAND_MAX, 0.2f * rand() / RAND_MAX, 0.2f * rand() / RAND_MAX);
+				float scale = 0.99f + 0.02f * rand() / RAND_MAX;
+				t.SetScale(scale, scale, scale);
+				if (parentOf[i] >= 0) t.SetParent(transforms[parentOf[i]]);
+			}
+			store.UpdateAllMatrices();
+
+			// The classic depth-first recursion over child lists, on the same local matrices
+			vector<vector<int>> children(nodeCount);
+			vector<XMFLOAT4X4> locals(nodeCount), localInverses(nodeCount), recursiveWorlds(nodeCount), recursiveInverses(nodeCount);
+			for (int i = 0; i < nodeCount; i++)
+			{
+				if (parentOf[i] >= 0) children[parentOf[i]].push_back(i);
+				double local[16], inverseTranspose[16];
+				ReferenceMatrices(*transforms[i], local, inverseTranspose);
+				for (int e = 0; e < 16; e++)
+				{
+					(&locals[i]._11)[e] = (float)local[e];
+					(&localInverses[i]._11)[e] = (float)inverseTranspose[e];
+				}
+			}
+			auto recurse = [&](auto& self, int node, FXMMATRIX parentWorld, CXMMATRIX parentInverse) -> void
+			{
+				XMMATRIX world = XMMatrixMultiply(XMLoadFloat4x4(&locals[node]), parentWorld);
+				XMMATRIX inverse = XMMatrixMultiply(XMLoadFloat4x4(&localInverses[node]), parentInverse);
+				XMStoreFloat4x4(&recursiveWorlds[node], world);
+				XMStoreFloat4x4(&recursiveInverses[node], inverse);
+				for (int child : children[node])
+					self(self, child, world, inverse);
+			};
+
+			const int runs = 5;
+			double recursiveBest = 1e30, singleBest = 1e30, threadedBest = 1e30, rootBest = 1e30;
+			for (int r = 0; r < runs; r++)
+			{
+				double start = Now();
+				for (int i = 0; i < nodeCount; i++)
+					if (parentOf[i] < 0) recurse(recurse, i, XMMatrixIdentity(), XMMatrixIdentity());
+				recursiveBest = fmin(recursiveBest, Now() - start);
+
+				store.SetJobs(0);
+				start = Now();
+				store.UpdateAllMatrices();
+				singleBest = fmin(singleBest, Now() - start);
+
+				store.SetJobs(&JobSystem::Shared());
+				start = Now();
+				store.UpdateAllMatrices();
+				threadedBest = fmin(threadedBest, Now() - start);
+
+				// Only the first root's subtree has to be redone
+				transforms[0]->MoveAbsolute(0, 0.001f, 0);
+				start = Now();
+				store.UpdateMatrices();
+				rootBest = fmin(rootBest, Now() - start);
+			}
+
+			// Re-parent 1% of the nodes to random nodes that aren't below them, then check everything again
+			int moves = nodeCount / 100;
+			for (int m = 0; m < moves; m++)
+			{
+				int node = 1 + rand() % (nodeCount - 1);
+				int parent = rand() % nodeCount;
+				if (transforms[node]->SetParent(transforms[parent])) parentOf[node] = parent;
+			}
+			double start = Now();
+			store.UpdateMatrices();
+			double reparentSeconds = Now() - start;
+
+			vector<double> expected(nodeCount * 16);
+			vector<unsigned char> done(nodeCount, 0);
+			double maxError = 0;
+			for (int i = 0; i < nodeCount; i++)
+			{
+				const double* world = NaiveWorld(i, parentOf, transforms, expected, done);
+				XMFLOAT4X4 actual = transforms[i]->GetWorldMatrix();
+				for (int e = 0; e < 16; e++)
+					maxError = fmax(maxError, fabs((&actual._11)[e] - world[e]) / fmax(1.0, fabs(world[e])));
+			}
+			bool pass = maxError < 1e-3;
+			if (!pass) failures++;
+			printf("  %-8s %8d %7zu %9.2f ms %9.2f ms %9.2f ms %8.3f ms %8.2f ms %10.2g %6s\n", name, nodeCount, store.GetLevelCount(),
+				recursiveBest * 1000.0, singleBest * 1000.0, threadedBest * 1000.0, rootBest * 1000.0, reparentSeconds * 1000.0, maxError,
+				pass ? "ok" : "FAIL");
+		}
+		printf("\n  Recursive: depth-first over child lists, 1 thread/Threads: TransformStore with everything rebuilt, on the calling thread/%u workers\n", cores);
+		printf("  Root moved: one root moved, only its subtree redone, Reparent: update right after re-parenting 1%% of the nodes\n");
+		printf("  Max error: against naive recursive composition in doubles, after re-parenting, relative to each element's size\n");
+		return failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// What entities used to be: a Transform and two shared_ptrs in one object, plus what the benchmark moves them by
+	/// </summary>
+	struct FatEntity
+	{
+		Transform tf;
+		shared_ptr<Mesh> mesh;
+		shared_ptr<Material> mat;
+		XMFLOAT3 velocity;
+		FatEntity(TransformStore& store, XMFLOAT3 velocity) : tf(store), velocity(velocity) {}
+	};
+
+	/// <summary>
+	/// Component the entities benchmark moves entities by, with the entity's creation order to check it survives being moved around
+	/// </summary>
+	struct Velocity
+	{
+		XMFLOAT3 velocity;
+		unsigned int id;
+	};
+
+	/// <summary>
+	/// Component the entities benchmark keeps adding and removing
+	/// </summary>
+	struct Spin
+	{
+		float speed;
+	};
+
+	/// <summary>
+	/// "-bench entities [count]": creating, updating and destroying entities in a Registry vs a vector of fat objects,
+	/// adding/removing components and destroying at random, with generations and component values checked
+	/// </summary>
+	int BenchmarkEntities(const char* args)
+	{
+		int count = atoi(args);
+		if (count <= 0) count = 1000000;
+		const float deltaTime = 1.0f / 60.0f;
+		const int frames = 10;
+		Checks check;
+		srand(1);
+		vector<XMFLOAT3> velocities(count);
+		for (XMFLOAT3& v : velocities)
+			v = XMFLOAT3((float)rand() / RAND_MAX - 0.5f, (float)rand() / RAND_MAX - 0.5f, (float)rand() / RAND_MAX - 0.5f);
+
+		printf("  %-18s %12s %16s %12s\n", "Storage", "Create", "Update (frame)", "Destroy");
+		{
+			TransformStore store;
+			double start = Now();
+			vector<FatEntity> fat;
+			for (int i = 0; i < count; i++)
+				fat.emplace_back(store, velocities[i]);
+			double create = Now() - start;
+
+			start = Now();
+			for (int f = 0; f < frames; f++)
+			{
+				for (FatEntity& e : fat)
+					e.tf.MoveAbsolute(e.velocity.x * deltaTime, e.velocity.y * deltaTime, e.velocity.z * deltaTime);
+				store.UpdateMatrices();
+			}
+			double update = (Now() - start) / frames;
+
+			start = Now();
+			vector<FatEntity>().swap(fat);
+			double destroy = Now() - start;
+			printf("  %-18s %9.1f ms %13.2f ms %9.1f ms\n", "vector<fat ent>", create * 1000.0, update * 1000.0, destroy * 1000.0);
+		}
+
+		TransformStore store;
+		Registry registry;
+		vector<Entity> entities(count);
+		double start = Now();
+		for (int i = 0; i < count; i++)
+			entities[i] = registry.Create(Transform(store), Renderable(), Velocity{ velocities[i], (unsigned int)i });
+		double create = Now() - start;
+
+		start = Now();
+		for (int f = 0; f < frames; f++)
+		{
+			registry.Each<Transform, Velocity>([&](Entity, Transform& tf, Velocity& v)
+			{
+				tf.MoveAbsolute(v.velocity.x * deltaTime, v.velocity.y * deltaTime, v.velocity.z * deltaTime);
+			});
+			store.UpdateMatrices();
+		}
+		double update = (Now() - start) / frames;
+
+		// Every entity moved the same number of frames, so each position is its velocity times the time gone by
+		bool moved = true;
+		registry.Each<Transform, Velocity>([&](Entity e, Transform& tf, Velocity& v)
+		{
+			XMFLOAT3 p = tf.GetPosition();
+			moved = moved && e == entities[v.id] && fabsf(p.x - v.velocity.x * deltaTime * frames) < 1e-4f && fabsf(p.z - v.velocity.z * deltaTime * frames) < 1e-4f;
+		});
+
+		// Half the entities get a Spin, then half of those lose it again, all in random order
+		vector<int> order(count);
+		for (int i = 0; i < count; i++) order[i] = i;
+		for (int i = count - 1; i > 0; i--) swap(order[i], order[rand() % (i + 1)]);
+		start = Now();
+		for (int i = 0; i < count / 2; i++)
+			registry.Add(entities[order[i]], Spin{ (float)order[i] });
+		for (int i = 0; i < count / 4; i++)
+			registry.Remove<Spin>(entities[order[i]]);
+		double churn = (Now() - start) / (count / 2 + count / 4);
+
+		// A query only walks the chunks of archetypes that have everything it asked for
+		size_t spinning = 0, spinChunks = 0;
+		bool spinsKept = true;
+		start = Now();
+		registry.EachChunk<Spin>([&](size_t n, const Entity*, Spin* spins)
+		{
+			spinning += n;
+			spinChunks++;
+			for (size_t i = 0; i < n; i++)
+				spinsKept = spinsKept && spins[i].speed >= 0;
+		});
+		double spinQuery = Now() - start;
+		size_t expectedSpinning = count / 2 - count / 4;
+
+		// Destroy a tenth at random and make as many new ones, the new ones reuse the indices with the next generation
+		int replaced = count / 10;
+		vector<Entity> destroyed(replaced);
+		start = Now();
+		for (int i = 0; i < replaced; i++)
+		{
+			int which = order[count - 1 - i];
+			destroyed[i] = entities[which];
+			registry.Destroy(entities[which]);
+			entities[which] = registry.Create(Transform(store), Velocity{ velocities[which], (unsigned int)which });
+		}
+		double replace = (Now() - start) / replaced;
+
+		bool generations = true;
+		for (int i = 0; i < replaced; i++)
+		{
+			Entity now = entities[order[count - 1 - i]];
+			generations = generations && !registry.IsAlive(destroyed[i]) && !registry.Get<Velocity>(destroyed[i]) &&
+				registry.IsAlive(now) && now.index == destroyed[i].index && now.generation != destroyed[i].generation;
+		}
+		bool valuesKept = true;
+		for (int i = 0; i < count; i++)
+		{
+			Velocity* v = registry.Get<Velocity>(entities[i]);
+			Spin* spin = registry.Get<Spin>(entities[i]);
+			valuesKept = valuesKept && v && v->id == (unsigned int)i && (!spin || spin->speed == (float)i);
+		}
+		size_t archetypes = registry.GetArchetypeCount(), chunks = registry.GetChunkCount();
+
+		// Half by handle, which after all the shuffling above lands on random rows and Transform slots, the rest at once
+		start = Now();
+		for (int i = 0; i < count; i += 2)
+			registry.Destroy(entities[i]);
+		double destroyEach = (Now() - start) / ((count + 1) / 2);
+		bool halfLeft = registry.GetEntityCount() == (size_t)(count / 2) && !registry.IsAlive(entities[0]) && (count < 2 || registry.IsAlive(entities[1]));
+		start = Now();
+		registry.Clear();
+		double clear = Now() - start;
+		printf("  %-18s %9.1f ms %13.2f ms %9.1f ms\n", "Registry", create * 1000.0, update * 1000.0, (destroyEach * ((count + 1) / 2) + clear) * 1000.0);
+		printf("\n  %d entities, %zu archetypes, %zu chunks of %d bytes\n", count, archetypes, chunks, REGISTRY_CHUNK_BYTES);
+		printf("  Destroy by handle        %8.1f ns each, Clear() %.1f ns each\n", destroyEach * 1e9, clear * 1e9 / (count / 2));
+		printf("  Add/Remove a component   %8.1f ns each\n", churn * 1e9);
+		printf("  Destroy + create         %8.1f ns each\n", replace * 1e9);
+		printf("  Query for Spin           %8.3f ms, %zu entities in %zu chunks\n\n", spinQuery * 1000.0, spinning, spinChunks);
+
+		check("moving entities through a query", moved);
+		check("only entities with a Spin visited by its query", spinning == expectedSpinning && spinsKept);
+		check("destroyed handles dead, their indices reused with a new generation", generations);
+		check("components kept through add, remove and destroy moving them", valuesKept);
+		check("destroying half by handle leaves the other half", halfLeft);
+		check("every entity destroyed", registry.GetEntityCount() == 0 && !registry.IsAlive(entities[count - 1]));
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// "-bench jobs [threads]": JobSystem correctness (every index once, dependencies and children respected,
+	/// jobs from outside threads), then job overhead and real work scaling from 1 thread up to one per core
+	/// </summary>
+	int BenchmarkJobs(const char* args)
+	{
+		unsigned int maxThreads = (unsigned int)atoi(args);
+		if (maxThreads == 0) maxThreads = JobSystem::Shared().GetThreadCount();
+		Checks check;
+
+		{
+			JobSystem jobs(maxThreads < 4 ? 4 : maxThreads);
+
+			// Every index exactly once, whatever the grain
+			bool once = true;
+			for (size_t count : { (size_t)1, (size_t)7, (size_t)1000, (size_t)1000003 })
+			{
+				vector<atomic<int>> hits(count);
+				for (atomic<int>& h : hits) h = 0;
+				jobs.ParallelFor(count, 1, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++) hits[i]++;
+				});
+				for (atomic<int>& h : hits) once = once && h == 1;
+			}
+			check("ParallelFor visits every index exactly once", once);
+
+			// A diamond A -> B, C -> D then a chain, over and over, every job checking what it depends on ran first
+			bool ordered = true;
+			for (int round = 0; round < 200; round++)
+			{
+				atomic<int> order(0);
+				int a = -1, b = -1, c = -1, d = -1;
+				Job* jobA = jobs.Create([&]() { a = order++; });
+				Job* jobB = jobs.Create([&]() { b = order++; });
+				Job* jobC = jobs.Create([&]() { c = order++; });
+				Job* jobD = jobs.Create([&]() { d = order++; });
+				jobs.AddDependency(jobA, jobB);
+				jobs.AddDependency(jobA, jobC);
+				jobs.AddDependency(jobB, jobD);
+				jobs.AddDependency(jobC, jobD);
+				const int chainLength = 64;
+				int chain[chainLength];
+				Job* links[chainLength];
+				for (int i = 0; i < chainLength; i++)
+				{
+					links[i] = jobs.Create([&chain, &order, i]() { chain[i] = order++; });
+					jobs.AddDependency(i == 0 ? jobD : links[i - 1], links[i]);
+				}
+				for (int i = chainLength - 1; i >= 0; i--) jobs.Run(links[i]);
+				jobs.Run(jobD);
+				jobs.Run(jobC);
+				jobs.Run(jobB);
+				jobs.Run(jobA);
+				jobs.Wait(links[chainLength - 1]);
+				ordered = ordered && a < b && a < c && b < d && c < d && d < chain[0];
+				for (int i = 1; i < chainLength; i++) ordered = ordered && chain[i - 1] < chain[i];
+			}
+			check("dependencies run before the jobs that depend on them", ordered);
+
+			// A parent only finishes once every child has, children making children of their own
+			atomic<int> ran(0);
+			Job* parent = jobs.Create([&]() { ran++; });
+			for (int i = 0; i < 100; i++)
+			{
+				Job* child = jobs.Create([&, parent]()
+				{
+					ran++;
+					jobs.Run(jobs.Create([&]() { this_thread::yield(); ran++; }, parent));
+				}, parent);
+				jobs.Run(child);
+			}
+			jobs.Run(parent);
+			jobs.Wait(parent);
+			check("waiting on a parent waits for all its children", ran == 201 && jobs.IsFinished(parent));
+
+			// Threads that aren't workers queue their jobs on the shared queue and help while they wait
+			atomic<size_t> outsideSum(0);
+			thread outside([&]()
+			{
+				jobs.ParallelFor(100000, 1, [&](size_t begin, size_t end)
+				{
+					size_t sum = 0;
+					for (size_t i = begin; i < end; i++) sum += i;
+					outsideSum += sum;
+				});
+				Job* job = jobs.Create([&]() { outsideSum += 1; });
+				jobs.Run(job);
+				jobs.Wait(job);
+			});
+			outside.join();
+			check("jobs made on a thread outside the system", outsideSum == (size_t)100000 * 99999 / 2 + 1);
+
+			// Pools grow by a whole block, every job in it should sit on its own cache line
+			bool aligned = true;
+			Job* block = jobs.Create([]() {});
+			for (int i = 0; i < JOB_POOL_SIZE + 1; i++)
+			{
+				Job* job = jobs.Create([]() {}, block);
+				aligned = aligned && ((uintptr_t)job & 63) == 0 && ((uintptr_t)job->data & 15) == 0;
+				jobs.Run(job);
+			}
+			jobs.Run(block);
+			jobs.Wait(block);
+			check("jobs are cache line aligned, their data 16 byte aligned", aligned);
+		}
+
+		// Scaling: the same work with 1, 2, 4 ... workers
+		const int emptyJobs = 100000;
+		const size_t mathCount = 4000000;
+		const int transformCount = 1000000;
+		vector<float> values(mathCount);
+		vector<Bounds> localBounds(transformCount), worldBounds(transformCount);
+		srand(1);
+		for (Bounds& b : localBounds)
+		{
+			b.boxMin = XMFLOAT3(-(float)rand() / RAND_MAX, -1, -1);
+			b.boxMax = XMFLOAT3(1, (float)rand() / RAND_MAX, 1);
+			b.center = XMFLOAT3(0, 0, 0);
+			b.radius = 1.8f;
+		}
+		TransformStore store;
+		vector<Transform> transforms;
+		transforms.reserve(transformCount);
+		for (int i = 0; i < transformCount; i++)
+		{
+			transforms.emplace_back(store);
+			transforms.back().SetPosition((float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
+			transforms.back().SetOrientation((float)rand() / RAND_MAX, (float)rand() / RAND_MAX, 0);
+		}
+
+		vector<unsigned int> threadCounts;
+		for (unsigned int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+		threadCounts.push_back(maxThreads);
+		printf("\n  %-8s %14s %16s %18s %18s\n", "Threads", "Empty job", "ParallelFor math", "1M transforms", "1M world bounds");
+		double baseMath = 0, baseTransforms = 0, baseBounds = 0;
+		for (unsigned int threads : threadCounts)
+		{
+			JobSystem jobs(threads);
+			store.SetJobs(&jobs);
+			const int runs = 5;
+			double emptyBest = 1e30, mathBest = 1e30, transformBest = 1e30, boundsBest = 1e30;
+			for (int r = 0; r < runs; r++)
+			{
+				// Overhead: jobs that do nothing, made by jobs so every worker is making some
+				double start = Now();
+				Job* root = jobs.Create([]() {});
+				jobs.ParallelFor(emptyJobs / 100, 1, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+						for (int j = 0; j < 100; j++)
+							jobs.Run(jobs.Create([]() {}, root));
+				});
+				jobs.Run(root);
+				jobs.Wait(root);
+				emptyBest = fmin(emptyBest, Now() - start);
+
+				start = Now();
+				jobs.ParallelFor(mathCount, 1024, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+						values[i] = sqrtf((float)i) * sinf((float)i * 0.001f) + cosf((float)i * 0.002f);
+				});
+				mathBest = fmin(mathBest, Now() - start);
+
+				start = Now();
+				store.UpdateAllMatrices();
+				transformBest = fmin(transformBest, Now() - start);
+
+				// Moving bounds into the world, the first step of culling
+				const XMFLOAT4X4* worlds = store.GetWorldMatrices();
+				start = Now();
+				jobs.ParallelFor(transformCount, 4096, [&](size_t begin, size_t end)
+				{
+					BoundingVolumes::ToWorld(&localBounds[begin], &worlds[begin], end - begin, &worldBounds[begin]);
+				});
+				boundsBest = fmin(boundsBest, Now() - start);
+			}
+			store.SetJobs(0);
+			if (threads == 1)
+			{
+				baseMath = mathBest;
+				baseTransforms = transformBest;
+				baseBounds = boundsBest;
+			}
+			printf("  %-8u %11.1f ns %8.2f ms %5.2fx %10.2f ms %5.2fx %10.2f ms %5.2fx\n", threads, emptyBest * 1e9 / emptyJobs,
+				mathBest * 1000.0, baseMath / mathBest, transformBest * 1000.0, baseTransforms / transformBest, boundsBest * 1000.0, baseBounds / boundsBest);
+		}
+		printf("\n  Empty job: made, run and finished, per job. Speedups against 1 thread, %u cores here\n", thread::hardware_concurrency());
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// Whether 27 points spread over a box are all off screen, what every box the culler rejects has to satisfy
+	/// </summary>
+	bool SampledPointsOutside(const Bounds& box, FXMMATRIX viewProj)
+	{
+		for (int i = 0; i <= 26; i++)
+		{
+			// Corners, edge middles, face middles and the center: every mix of min, middle and max
+			float t[3] = { (i % 3) * 0.5f, (i / 3 % 3) * 0.5f, (i / 9 % 3) * 0.5f };
+			XMVECTOR point = XMVectorSet(box.boxMin.x + (box.boxMax.x - box.boxMin.x) * t[0], box.boxMin.y + (box.boxMax.y - box.boxMin.y) * t[1],
+				box.boxMin.z + (box.boxMax.z - box.boxMin.z) * t[2], 1.0f);
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector4Transform(point, viewProj));
+			// Points within rounding of an edge of the clip volume could land either side, only ones clearly inside count
+			float inner = clip.w * (1.0f - 1e-4f);
+			if (clip.w > 0 && fabsf(clip.x) < inner && fabsf(clip.y) < inner && clip.z > clip.w * 1e-4f && clip.z < inner)
+				return false;
+		}
+		return true;
+	}
+
+	int BenchmarkFrustum(const char* args)
+	{
+		int objectCount = atoi(args);
+		if (objectCount <= 0) objectCount = 100000;
+		Checks check;
+
+		// Boxes of all sizes scattered over a big flat world, cameras in the middle looking out in different directions
+		srand(1);
+		vector<Bounds> bounds(objectCount);
+		for (Bounds& b : bounds)
+		{
+			XMFLOAT3 center(Random(-1000, 1000), Random(-20, 20), Random(-1000, 1000));
+			XMFLOAT3 half(Random(0.25f, 5), Random(0.25f, 5), Random(0.25f, 5));
+			b.boxMin = XMFLOAT3(center.x - half.x, center.y - half.y, center.z - half.z);
+			b.boxMax = XMFLOAT3(center.x + half.x, center.y + half.y, center.z + half.z);
+			b.center = center;
+			b.radius = sqrtf(half.x * half.x + half.y * half.y + half.z * half.z);
+		}
+		double start = Now();
+		CullBoxes boxes;
+		for (const Bounds& b : bounds)
+			boxes.Add(b);
+		double gatherTime = Now() - start;
+
+		const int viewCount = 8;
+		XMFLOAT4X4 views[viewCount], viewProjs[viewCount];
+		Frustum frustums[viewCount];
+		XMFLOAT4X4 proj;
+		XMStoreFloat4x4(&proj, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 500.0f));
+		for (int v = 0; v < viewCount; v++)
+		{
+			float yaw = v * XM_2PI / viewCount;
+			XMStoreFloat4x4(&views[v], XMMatrixLookToLH(XMVectorSet(Random(-100, 100), 10, Random(-100, 100), 1),
+				XMVectorSet(sinf(yaw), -0.1f, cosf(yaw), 0), XMVectorSet(0, 1, 0, 0)));
+			XMStoreFloat4x4(&viewProjs[v], XMLoadFloat4x4(&views[v]) * XMLoadFloat4x4(&proj));
+			frustums[v] = FrustumCuller::MakeFrustum(views[v], proj);
+		}
+
+		// The SIMD lanes, the jobs and the one-box test all have to agree exactly
+		vector<unsigned int> scalar, simd, threaded;
+		bool sameSimd = true, sameThreaded = true, conservative = true;
+		FrustumCullStats stats = {};
+		size_t rejectedChecked = 0;
+		for (int v = 0; v < viewCount; v++)
+		{
+			scalar.clear();
+			for (size_t i = 0; i < bounds.size(); i++)
+				if (FrustumCuller::IsVisible(frustums[v], bounds[i]))
+					scalar.push_back((unsigned int)i);
+			FrustumCuller::Cull(frustums[v], boxes, simd, 0, &stats);
+			FrustumCuller::Cull(frustums[v], boxes, threaded, &JobSystem::Shared());
+			sameSimd = sameSimd && simd == scalar;
+			sameThreaded = sameThreaded && threaded == scalar;
+
+			XMMATRIX viewProj = XMLoadFloat4x4(&viewProjs[v]);
+			size_t next = 0;
+			for (size_t i = 0; i < bounds.size(); i++)
+			{
+				if (next < scalar.size() && scalar[next] == i)
+				{
+					next++;
+					continue;
+				}
+				conservative = conservative && SampledPointsOutside(bounds[i], viewProj);
+				rejectedChecked++;
+			}
+		}
+		check("SIMD lanes keep the same boxes as testing them one at a time", sameSimd);
+		check("culling on the job system keeps the same boxes, in order", sameThreaded);
+		check("no rejected box has a corner, edge or face middle on screen", conservative);
+		check("stats count every box tested and every box kept", stats.tested == (unsigned int)(objectCount * viewCount) &&
+			stats.visible > 0 && stats.visible < stats.tested);
+
+		// Runs that don't start or end on a whole set of lanes
+		bool tails = true;
+		scalar.clear();
+		for (size_t i = 0; i < bounds.size(); i++)
+			if (FrustumCuller::IsVisible(frustums[0], bounds[i]))
+				scalar.push_back((unsigned int)i);
+		for (size_t first : { (size_t)0, (size_t)3, (size_t)13 })
+		{
+			for (size_t count : { (size_t)0, (size_t)1, (size_t)7, (size_t)1001 })
+			{
+				if (first + count > boxes.GetCount())
+					continue;
+				vector<unsigned int> part(count);
+				part.resize(FrustumCuller::Cull(frustums[0], boxes, first, count, part.data()));
+				vector<unsigned int> expected;
+				for (unsigned int i : scalar)
+					if (i >= first && i < first + count)
+						expected.push_back(i);
+				tails = tails && part == expected;
+			}
+		}
+		check("runs of any start and length", tails);
+
+		// Speed, best of several runs over every view
+		const int runs = 5;
+		auto time = [&](auto cull)
+		{
+			double best = 1e30;
+			for (int r = 0; r < runs; r++)
+			{
+				double runStart = Now();
+				for (int v = 0; v < viewCount; v++)
+					cull(v);
+				best = fmin(best, (Now() - runStart) / viewCount);
+			}
+			return best;
+		};
+		double scalarTime = time([&](int v)
+		{
+			scalar.clear();
+			for (size_t i = 0; i < bounds.size(); i++)
+				if (FrustumCuller::IsVisible(frustums[v], bounds[i]))
+					scalar.push_back((unsigned int)i);
+		});
+		double simdTime = time([&](int v) { FrustumCuller::Cull(frustums[v], boxes, simd, 0); });
+
+		printf("\n  %d boxes, %d views, %.1f%% visible on average, %u lanes\n", objectCount, viewCount,
+			100.0 * stats.visible / stats.tested, FrustumCuller::GetLaneCount());
+		printf("  %-28s %10.3f ms\n", "Gathering CullBoxes", gatherTime * 1000.0);
+		printf("  %-28s %10.3f ms %8.1f M boxes/s\n", "One Bounds at a time", scalarTime * 1000.0, objectCount / scalarTime / 1e6);
+		printf("  %-28s %10.3f ms %8.1f M boxes/s %6.2fx\n", "SIMD, calling thread only", simdTime * 1000.0, objectCount / simdTime / 1e6, scalarTime / simdTime);
+		unsigned int maxThreads = JobSystem::Shared().GetThreadCount();
+		vector<unsigned int> threadCounts;
+		for (unsigned int t = 2; t < maxThreads; t *= 2) threadCounts.push_back(t);
+		threadCounts.push_back(maxThreads);
+		for (unsigned int threads : threadCounts)
+		{
+			JobSystem jobs(threads);
+			double jobsTime = time([&](int v) { FrustumCuller::Cull(frustums[v], boxes, threaded, &jobs); });
+			char label[64];
+			snprintf(label, sizeof(label), "SIMD, %u job thread%s", threads, threads == 1 ? "" : "s");
+			printf("  %-28s %10.3f ms %8.1f M boxes/s %6.2fx\n", label, jobsTime * 1000.0, objectCount / jobsTime / 1e6, scalarTime / jobsTime);
+		}
+		printf("\n  Times per view, speedups against one Bounds at a time, %u cores here\n", thread::hardware_concurrency());
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkShadows(const char* args)
+	{
+		int objectCount = atoi(args);
+		if (objectCount <= 0) objectCount = 100000;
+		Checks check;
+
+		// A floor of tiles with objects of all sizes standing on it, some tall enough to throw long shadows
+		srand(1);
+		const float worldSize = 2000.0f, tileSize = 20.0f;
+		vector<Bounds> bounds;
+		for (float x = -worldSize / 2; x < worldSize / 2; x += tileSize)
+			for (float z = -worldSize / 2; z < worldSize / 2; z += tileSize)
+				bounds.push_back({ XMFLOAT3(x, -1, z), XMFLOAT3(x + tileSize, 0, z + tileSize), XMFLOAT3(x + tileSize / 2, -0.5f, z + tileSize / 2), tileSize });
+		size_t tileCount = bounds.size();
+		for (int i = 0; i < objectCount; i++)
+		{
+			XMFLOAT3 base(Random(-worldSize / 2, worldSize / 2), 0, Random(-worldSize / 2, worldSize / 2));
+			XMFLOAT3 half(Random(0.25f, 3), rand() % 50 == 0 ? Random(10, 40) : Random(0.25f, 3), Random(0.25f, 3));
+			bounds.push_back({ XMFLOAT3(base.x - half.x, 0, base.z - half.z), XMFLOAT3(base.x + half.x, half.y * 2, base.z + half.z),
+				XMFLOAT3(base.x, half.y, base.z), sqrtf(half.x * half.x + half.y * half.y + half.z * half.z) });
+		}
+		CullBoxes boxes;
+		for (const Bounds& b : bounds)
+			boxes.Add(b);
+
+		// Game's light direction with one shadow map over the whole world, and a tighter one that follows the camera
+		XMVECTOR lightDirection = XMVector3Normalize(XMVectorSet(0, -1, -0.5f, 0));
+		struct ShadowMap { const char* name; float size; bool followCamera; };
+		const ShadowMap maps[] = { { "whole world", worldSize * 1.5f, false }, { "200 units around camera", 200.0f, true } };
+		const int viewCount = 8;
+		XMFLOAT4X4 proj;
+		XMStoreFloat4x4(&proj, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 500.0f));
+
+		printf("  %zu boxes, %zu floor tiles, %d views\n\n", bounds.size(), tileCount, viewCount);
+		printf("  %-26s %10s %12s %16s %18s %18s %10s\n", "Shadow map", "On screen", "All casters", "Light volume", "Receiver-aware", "Camera, trimmed", "Cull ms");
+		bool everyReceiver = true, conservative = true, insideLight = true, cameraReceivers = true, trimmedMatch = true;
+		vector<unsigned int> receivers, lightVolume, casters, cameraCasters, trimmed;
+		for (const ShadowMap& map : maps)
+		{
+			double onScreen = 0, inLight = 0, kept = 0, keptTrimmed = 0, cullTime = 0;
+			for (int v = 0; v < viewCount; v++)
+			{
+				float yaw = v * XM_2PI / viewCount;
+				XMVECTOR eye = XMVectorSet(Random(-300, 300), 15, Random(-300, 300), 1);
+				XMFLOAT4X4 view, lightView, lightProj;
+				XMStoreFloat4x4(&view, XMMatrixLookToLH(eye, XMVectorSet(sinf(yaw), -0.2f, cosf(yaw), 0), XMVectorSet(0, 1, 0, 0)));
+				XMVECTOR lightTarget = map.followCamera ? XMVectorSetY(eye, 0) : XMVectorZero();
+				XMStoreFloat4x4(&lightView, XMMatrixLookToLH(XMVectorSubtract(lightTarget, XMVectorScale(lightDirection, worldSize)), lightDirection, XMVectorSet(0, 1, 0, 0)));
+				XMStoreFloat4x4(&lightProj, XMMatrixOrthographicLH(map.size, map.size, 1.0f, worldSize * 2));
+
+				FrustumCuller::Cull(FrustumCuller::MakeFrustum(view, proj), boxes, receivers, &JobSystem::Shared());
+				FrustumCuller::Cull(FrustumCuller::MakeFrustum(lightView, lightProj), boxes, lightVolume, &JobSystem::Shared());
+				double start = Now();
+				Frustum casterFrustum;
+				if (FrustumCuller::MakeCasterFrustum(lightView, lightProj, boxes, receivers, casterFrustum))
+					FrustumCuller::Cull(casterFrustum, boxes, casters, &JobSystem::Shared());
+				else
+					casters.clear();
+				cullTime += Now() - start;
+				onScreen += receivers.size();
+				inLight += lightVolume.size();
+				kept += casters.size();
+
+				// Game asks for casters of everything the camera can see before it knows the receivers, then trims them with the receivers' volume
+				Frustum cameraFrustum;
+				if (FrustumCuller::MakeCasterFrustum(lightView, lightProj, view, proj, cameraFrustum))
+					FrustumCuller::Cull(cameraFrustum, boxes, cameraCasters, &JobSystem::Shared());
+				else
+					cameraCasters.clear();
+				trimmed = cameraCasters;
+				if (casters.empty())
+					trimmed.clear();
+				trimmed.resize(FrustumCuller::CullList(casterFrustum, boxes, trimmed.data(), trimmed.size(), trimmed.data()));
+				vector<unsigned int> both;
+				set_intersection(cameraCasters.begin(), cameraCasters.end(), casters.begin(), casters.end(), back_inserter(both));
+				trimmedMatch = trimmedMatch && trimmed == both;
+				keptTrimmed += trimmed.size();
+
+				// Light clip space boxes of everything, where "can shadow" is just overlapping ranges
+				XMFLOAT4X4 lightClip;
+				XMStoreFloat4x4(&lightClip, XMLoadFloat4x4(&lightView) * XMLoadFloat4x4(&lightProj));
+				vector<Bounds> clipBoxes(bounds.size());
+				for (size_t i = 0; i < bounds.size(); i++)
+					clipBoxes[i] = BoundingVolumes::ToWorld(bounds[i], lightClip);
+				const float e = 1e-4f;
+				auto inMap = [&](const Bounds& c)
+				{
+					return c.boxMax.x > -1 + e && c.boxMin.x < 1 - e && c.boxMax.y > -1 + e && c.boxMin.y < 1 - e && c.boxMax.z > e && c.boxMin.z < 1 - e;
+				};
+
+				vector<char> isCaster(bounds.size(), 0), isLit(bounds.size(), 0);
+				for (unsigned int i : casters) isCaster[i] = 1;
+				for (unsigned int i : lightVolume) isLit[i] = 1;
+				// The plane test lets some boxes by a frustum's corners through without touching it, the camera's caster
+				// volume may leave those out, but only if they miss the light clip space box around the camera's frustum
+				XMVECTOR cameraMin = XMVectorReplicate(FLT_MAX), cameraMax = XMVectorReplicate(-FLT_MAX);
+				XMMATRIX fromCameraClip = XMMatrixInverse(0, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+				for (int corner = 0; corner < 8; corner++)
+				{
+					XMVECTOR clip = XMVectorSet(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : 0.0f, 1.0f);
+					XMVECTOR light = XMVector3Transform(XMVector3TransformCoord(clip, fromCameraClip), XMLoadFloat4x4(&lightClip));
+					cameraMin = XMVectorMin(cameraMin, light);
+					cameraMax = XMVectorMax(cameraMax, light);
+				}
+				vector<char> isCameraCaster(bounds.size(), 0);
+				for (unsigned int i : cameraCasters) isCameraCaster[i] = 1;
+				for (unsigned int i : receivers)
+				{
+					everyReceiver = everyReceiver && (isCaster[i] || !inMap(clipBoxes[i]));
+					bool touchesCamera = XMVector3LessOrEqual(XMLoadFloat3(&clipBoxes[i].boxMin), cameraMax) &&
+						XMVector3GreaterOrEqual(XMLoadFloat3(&clipBoxes[i].boxMax), cameraMin);
+					cameraReceivers = cameraReceivers && (isCameraCaster[i] || !inMap(clipBoxes[i]) || !touchesCamera);
+				}
+				for (unsigned int i : casters)
+					insideLight = insideLight && isLit[i];
+
+				// Some rejected boxes against every receiver: none may be in the map, over a receiver and nearer the light than its far side
+				vector<unsigned int> mapReceivers;
+				for (unsigned int i : receivers)
+					if (inMap(clipBoxes[i]))
+						mapReceivers.push_back(i);
+				int sampled = 0;
+				for (size_t i = 0; i < bounds.size() && sampled < 2000; i += 7)
+				{
+					if (isCaster[i] || !inMap(clipBoxes[i]))
+						continue;
+					sampled++;
+					const Bounds& c = clipBoxes[i];
+					for (unsigned int r : mapReceivers)
+					{
+						const Bounds& b = clipBoxes[r];
+						if (c.boxMax.x > b.boxMin.x + e && c.boxMin.x < b.boxMax.x - e && c.boxMax.y > b.boxMin.y + e && c.boxMin.y < b.boxMax.y - e &&
+							c.boxMin.z < b.boxMax.z - e)
+							conservative = false;
+					}
+				}
+			}
+			printf("  %-26s %10.0f %12zu %9.0f %5.1f%% %11.0f %5.1f%% %11.0f %5.1f%% %10.3f\n", map.name, onScreen / viewCount, bounds.size(),
+				inLight / viewCount, 100.0 * inLight / viewCount / bounds.size(), kept / viewCount, 100.0 * kept / viewCount / bounds.size(),
+				keptTrimmed / viewCount, 100.0 * keptTrimmed / viewCount / bounds.size(), cullTime * 1000.0 / viewCount);
+		}
+		printf("\n  Average shadow map draw calls per view, share of drawing every caster\n");
+		printf("  Cull ms: building the receiver-aware volume and culling against it\n\n");
+		check("every receiver inside the shadow map is drawn into it", everyReceiver);
+		check("no rejected caster could shadow a receiver", conservative);
+		check("receiver-aware casters are all inside the light volume", insideLight);
+		check("camera caster volume keeps every receiver it sees in the map", cameraReceivers);
+		check("trimming a list keeps what culling everything keeps from it", trimmedMatch);
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkBvh(const char* args)
+	{
+		int objectCount = atoi(args);
+		if (objectCount <= 0) objectCount = 100000;
+		Checks check;
+
+		// Clusters of objects over a big world with empty space between, like a level, a few large objects spanning many clusters
+		srand(1);
+		const float worldSize = 2000.0f;
+		vector<XMFLOAT3> clusters(200);
+		for (XMFLOAT3& c : clusters)
+			c = XMFLOAT3(Random(-worldSize / 2, worldSize / 2), Random(0, 50), Random(-worldSize / 2, worldSize / 2));
+		vector<Bounds> bounds(objectCount);
+		auto place = [&](Bounds& b, XMFLOAT3 center, XMFLOAT3 half)
+		{
+			b.boxMin = XMFLOAT3(center.x - half.x, center.y - half.y, center.z - half.z);
+			b.boxMax = XMFLOAT3(center.x + half.x, center.y + half.y, center.z + half.z);
+			b.center = center;
+			b.radius = sqrtf(half.x * half.x + half.y * half.y + half.z * half.z);
+		};
+		for (Bounds& b : bounds)
+		{
+			const XMFLOAT3& c = clusters[rand() % clusters.size()];
+			float size = rand() % 500 == 0 ? Random(20, 100) : Random(0.25f, 3);
+			place(b, XMFLOAT3(c.x + Random(-60, 60), c.y + Random(-20, 20), c.z + Random(-60, 60)), XMFLOAT3(size, size, size));
+		}
+
+		// Build
+		Bvh bvh;
+		const int runs = 5;
+		double buildBest = 1e30;
+		for (int r = 0; r < runs; r++)
+		{
+			double start = Now();
+			bvh.Build(bounds.data(), bounds.size());
+			buildBest = fmin(buildBest, Now() - start);
+		}
+		float builtCost = bvh.GetCost();
+		printf("  %d objects: %zu nodes, depth %u, SAH cost %.1f box tests per query\n\n", objectCount, bvh.GetNodeCount(), bvh.GetDepth(), builtCost);
+		printf("  %-40s %10.2f ms\n", "SAH build", buildBest * 1000.0);
+
+		// Queries against brute force, results compared as sets
+		auto sameSet = [](vector<unsigned int> a, vector<unsigned int> b)
+		{
+			sort(a.begin(), a.end());
+			sort(b.begin(), b.end());
+			return a == b;
+		};
+		const int sphereCount = 10000, boxCount = 10000, rayCount = 10000, bruteCount = 200;
+		vector<XMFLOAT4> spheres(sphereCount);
+		vector<Bounds> queryBoxes(boxCount);
+		vector<BvhRay> rays(rayCount);
+		for (XMFLOAT4& sphere : spheres)
+		{
+			const XMFLOAT3& c = clusters[rand() % clusters.size()];
+			sphere = XMFLOAT4(c.x + Random(-80, 80), c.y + Random(-20, 20), c.z + Random(-80, 80), Random(1, 20));
+		}
+		for (Bounds& b : queryBoxes)
+		{
+			const XMFLOAT3& c = clusters[rand() % clusters.size()];
+			place(b, XMFLOAT3(c.x + Random(-80, 80), c.y + Random(-20, 20), c.z + Random(-80, 80)), XMFLOAT3(Random(1, 15), Random(1, 15), Random(1, 15)));
+		}
+		for (BvhRay& ray : rays)
+		{
+			ray.origin = XMFLOAT3(Random(-worldSize / 2, worldSize / 2), Random(0, 60), Random(-worldSize / 2, worldSize / 2));
+			XMStoreFloat3(&ray.direction, XMVector3Normalize(XMVectorSet(Random(-1, 1), Random(-0.3f, 0.3f), Random(-1, 1), 0)));
+			ray.maxDistance = Random(100, 2000);
+		}
+		auto bruteSphere = [&](const XMFLOAT4& s, vector<unsigned int>& found)
+		{
+			found.clear();
+			for (size_t i = 0; i < bounds.size(); i++)
+			{
+				const Bounds& b = bounds[i];
+				float x = s.x - fmaxf(b.boxMin.x, fminf(s.x, b.boxMax.x)), y = s.y - fmaxf(b.boxMin.y, fminf(s.y, b.boxMax.y)), z = s.z - fmaxf(b.boxMin.z, fminf(s.z, b.boxMax.z));
+				if (x * x + y * y + z * z <= s.w * s.w)
+					found.push_back((unsigned int)i);
+			}
+		};
+		auto bruteBox = [&](const Bounds& q, vector<unsigned int>& found)
+		{
+			found.clear();
+			for (size_t i = 0; i < bounds.size(); i++)
+			{
+				const Bounds& b = bounds[i];
+				if (q.boxMin.x <= b.boxMax.x && q.boxMax.x >= b.boxMin.x && q.boxMin.y <= b.boxMax.y && q.boxMax.y >= b.boxMin.y &&
+					q.boxMin.z <= b.boxMax.z && q.boxMax.z >= b.boxMin.z)
+					found.push_back((unsigned int)i);
+			}
+		};
+		auto bruteRay = [&](const BvhRay& ray)
+		{
+			// Slabs against every box, keeping the nearest one entered
+			BvhHit hit = { BVH_NO_ITEM, ray.maxDistance };
+			const float* o = &ray.origin.x;
+			float inverse[3] = { 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+			for (size_t i = 0; i < bounds.size(); i++)
+			{
+				const float* lo = &bounds[i].boxMin.x;
+				const float* hi = &bounds[i].boxMax.x;
+				float entry = 0, exit = ray.maxDistance;
+				for (int a = 0; a < 3; a++)
+				{
+					float t1 = (lo[a] - o[a]) * inverse[a], t2 = (hi[a] - o[a]) * inverse[a];
+					entry = fmaxf(entry, fminf(t1, t2));
+					exit = fminf(exit, fmaxf(t1, t2));
+				}
+				if (entry <= exit && entry < hit.distance)
+					hit = { (unsigned int)i, entry };
+			}
+			return hit;
+		};
+
+		vector<unsigned int> results, offsets, found, expected;
+		vector<BvhHit> hits(rayCount);
+		bool spheresMatch = true, boxesMatch = true, raysMatch = true, raySetsMatch = true, frustumsMatch = true;
+		bvh.QuerySpheres(spheres.data(), sphereCount, results, offsets, &JobSystem::Shared());
+		for (int q = 0; q < bruteCount; q++)
+		{
+			bruteSphere(spheres[q], expected);
+			spheresMatch = spheresMatch && sameSet(vector<unsigned int>(results.begin() + offsets[q], results.begin() + offsets[q + 1]), expected);
+		}
+		bvh.QueryBoxes(queryBoxes.data(), boxCount, results, offsets, &JobSystem::Shared());
+		for (int q = 0; q < bruteCount; q++)
+		{
+			bruteBox(queryBoxes[q], expected);
+			boxesMatch = boxesMatch && sameSet(vector<unsigned int>(results.begin() + offsets[q], results.begin() + offsets[q + 1]), expected);
+		}
+		bvh.Raycast(rays.data(), rayCount, hits.data(), &JobSystem::Shared());
+		for (int q = 0; q < bruteCount; q++)
+		{
+			BvhHit expectedHit = bruteRay(rays[q]);
+			raysMatch = raysMatch && (hits[q].item == BVH_NO_ITEM) == (expectedHit.item == BVH_NO_ITEM) &&
+				fabsf(hits[q].distance - expectedHit.distance) <= 1e-3f * fmaxf(1.0f, expectedHit.distance);
+
+			// Every box along the ray, the nearest hit among them
+			bvh.QueryRay(rays[q], found);
+			raySetsMatch = raySetsMatch && (hits[q].item == BVH_NO_ITEM ? found.empty() : find(found.begin(), found.end(), hits[q].item) != found.end());
+		}
+
+		const int viewCount = 8;
+		Frustum frustums[viewCount];
+		XMFLOAT4X4 proj;
+		XMStoreFloat4x4(&proj, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 500.0f));
+		CullBoxes boxes;
+		for (const Bounds& b : bounds)
+			boxes.Add(b);
+		for (int v = 0; v < viewCount; v++)
+		{
+			float yaw = v * XM_2PI / viewCount;
+			XMFLOAT4X4 view;
+			XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(Random(-300, 300), 20, Random(-300, 300), 1), XMVectorSet(sinf(yaw), -0.1f, cosf(yaw), 0), XMVectorSet(0, 1, 0, 0)));
+			frustums[v] = FrustumCuller::MakeFrustum(view, proj);
+			bvh.QueryFrustum(frustums[v], found);
+			FrustumCuller::Cull(frustums[v], boxes, expected);
+			frustumsMatch = frustumsMatch && sameSet(found, expected);
+		}
+		bool frustumBatchMatches = true;
+		bvh.QueryFrustums(frustums, viewCount, results, offsets, &JobSystem::Shared());
+		for (int v = 0; v < viewCount; v++)
+		{
+			bvh.QueryFrustum(frustums[v], found);
+			frustumBatchMatches = frustumBatchMatches && sameSet(vector<unsigned int>(results.begin() + offsets[v], results.begin() + offsets[v + 1]), found);
+		}
+		check("sphere queries find what testing every box finds", spheresMatch);
+		check("box queries find what testing every box finds", boxesMatch);
+		check("raycasts hit the nearest box testing every box hits", raysMatch);
+		check("ray queries find the boxes crossed, nearest hit among them", raySetsMatch);
+		check("frustum queries keep what FrustumCuller keeps", frustumsMatch);
+		check("batched frustum queries find what single ones find", frustumBatchMatches);
+
+		// Throughput, brute force measured on fewer queries and scaled up
+		auto timeBest = [&](auto work)
+		{
+			double best = 1e30;
+			for (int r = 0; r < runs; r++)
+			{
+				double start = Now();
+				work();
+				best = fmin(best, Now() - start);
+			}
+			return best;
+		};
+		double sphereBrute = timeBest([&]() { for (int q = 0; q < bruteCount; q++) bruteSphere(spheres[q], expected); }) / bruteCount;
+		double sphereOne = timeBest([&]() { bvh.QuerySpheres(spheres.data(), sphereCount, results, offsets); }) / sphereCount;
+		double sphereJobs = timeBest([&]() { bvh.QuerySpheres(spheres.data(), sphereCount, results, offsets, &JobSystem::Shared()); }) / sphereCount;
+		double boxBrute = timeBest([&]() { for (int q = 0; q < bruteCount; q++) bruteBox(queryBoxes[q], expected); }) / bruteCount;
+		double boxOne = timeBest([&]() { bvh.QueryBoxes(queryBoxes.data(), boxCount, results, offsets); }) / boxCount;
+		double boxJobs = timeBest([&]() { bvh.QueryBoxes(queryBoxes.data(), boxCount, results, offsets, &JobSystem::Shared()); }) / boxCount;
+		double rayBrute = timeBest([&]() { for (int q = 0; q < bruteCount; q++) hits[q] = bruteRay(rays[q]); }) / bruteCount;
+		double rayOne = timeBest([&]() { bvh.Raycast(rays.data(), rayCount, hits.data()); }) / rayCount;
+		double rayJobs = timeBest([&]() { bvh.Raycast(rays.data(), rayCount, hits.data(), &JobSystem::Shared()); }) / rayCount;
+		double frustumBrute = timeBest([&]() { for (int v = 0; v < viewCount; v++) FrustumCuller::Cull(frustums[v], boxes, expected); }) / viewCount;
+		double frustumBvh = timeBest([&]() { for (int v = 0; v < viewCount; v++) bvh.QueryFrustum(frustums[v], found); }) / viewCount;
+
+		printf("\n  %-22s %14s %14s %9s %14s %9s\n", "Query", "Brute force", "BVH", "Speedup", "BVH + jobs", "Speedup");
+		auto row = [](const char* name, double brute, double one, double jobs)
+		{
+			printf("  %-22s %11.2f us %11.2f us %8.0fx", name, brute * 1e6, one * 1e6, brute / one);
+			if (jobs > 0)
+				printf(" %11.2f us %8.0fx", jobs * 1e6, brute / jobs);
+			printf("\n");
+		};
+		row("Sphere", sphereBrute, sphereOne, sphereJobs);
+		row("Box", boxBrute, boxOne, boxJobs);
+		row("Nearest ray hit", rayBrute, rayOne, rayJobs);
+		row("Frustum (SIMD brute)", frustumBrute, frustumBvh, 0);
+
+		// Motion: a tenth of the objects drift every frame, refitting keeps queries right but loosens the tree until Update() rebuilds
+		printf("\n  %-8s %12s %12s %10s %10s\n", "Frame", "Refit ms", "Full refit", "SAH cost", "Rebuilt");
+		vector<unsigned int> moved;
+		vector<XMFLOAT3> drift(objectCount);
+		for (XMFLOAT3& d : drift)
+			d = XMFLOAT3(Random(-2, 2), Random(-0.2f, 0.2f), Random(-2, 2));
+		int rebuilds = 0;
+		double refitTotal = 0;
+		const int frames = 100;
+		bool movedMatch = true;
+		for (int frame = 1; frame <= frames; frame++)
+		{
+			moved.clear();
+			for (int i = frame % 10; i < objectCount; i += 10)
+			{
+				Bounds& b = bounds[i];
+				b.boxMin.x += drift[i].x; b.boxMax.x += drift[i].x; b.center.x += drift[i].x;
+				b.boxMin.y += drift[i].y; b.boxMax.y += drift[i].y; b.center.y += drift[i].y;
+				b.boxMin.z += drift[i].z; b.boxMax.z += drift[i].z; b.center.z += drift[i].z;
+				moved.push_back((unsigned int)i);
+			}
+			double start = Now();
+			bool rebuilt = bvh.Update(bounds.data(), bounds.size(), moved.data(), moved.size());
+			double refitTime = Now() - start;
+			refitTotal += refitTime;
+			rebuilds += rebuilt;
+			if (frame % 20 == 0 || rebuilt)
+			{
+				Bvh full;
+				full.Build(bounds.data(), bounds.size());
+				double fullStart = Now();
+				full.Refit(bounds.data());
+				double fullTime = Now() - fullStart;
+				printf("  %-8d %12.3f %12.3f %10.1f %10s\n", frame, refitTime * 1000.0, fullTime * 1000.0, bvh.GetCost(), rebuilt ? "yes" : "");
+			}
+			if (frame % 25 == 0)
+			{
+				for (int q = 0; q < 20; q++)
+				{
+					bvh.QuerySphere(XMFLOAT3(spheres[q].x, spheres[q].y, spheres[q].z), spheres[q].w, found);
+					bruteSphere(spheres[q], expected);
+					movedMatch = movedMatch && sameSet(found, expected);
+				}
+			}
+		}
+		printf("\n  %d frames moving %d objects each: %.3f ms per Update() on average, %d rebuilds, built cost %.1f\n\n",
+			frames, objectCount / 10, refitTotal * 1000.0 / frames, rebuilds, builtCost);
+		check("queries stay right while objects move", movedMatch);
+		// How fast drifting loosens the tree depends on the world's scale, so this scatters objects until it's loose enough
+		if (objectCount >= 1000)
+		{
+			check("refitting loosens the tree until Update() rebuilds it", [&]()
+			{
+				vector<Bounds> scattered = bounds;
+				Bvh loose;
+				loose.Build(scattered.data(), scattered.size());
+				if (loose.Update(scattered.data(), scattered.size(), 0, 0))
+					return false;
+				for (int round = 0; round < 8 && !loose.NeedsRebuild(); round++)
+				{
+					// Each object jumps to where another one was, so every leaf ends up spanning the world
+					for (size_t i = 0; i < scattered.size(); i++)
+					{
+						const Bounds& to = bounds[rand() % bounds.size()];
+						XMFLOAT3 jump(to.center.x - scattered[i].center.x, to.center.y - scattered[i].center.y, to.center.z - scattered[i].center.z);
+						Bounds& b = scattered[i];
+						b.boxMin.x += jump.x; b.boxMax.x += jump.x; b.center.x += jump.x;
+						b.boxMin.y += jump.y; b.boxMax.y += jump.y; b.center.y += jump.y;
+						b.boxMin.z += jump.z; b.boxMax.z += jump.z; b.center.z += jump.z;
+					}
+					loose.Refit(scattered.data());
+				}
+				return loose.NeedsRebuild() && loose.Update(scattered.data(), scattered.size(), 0, 0) && !loose.NeedsRebuild();
+			}());
+		}
+		check("the rebuild check is the same at any world scale", [&]()
+		{
+			// Powers of two scale exactly, so the same world a thousand times smaller or larger builds the same tree
+			vector<Bounds> scattered = bounds;
+			for (size_t i = 0; i < scattered.size(); i++)
+				scattered[i] = bounds[rand() % bounds.size()];
+			auto scaled = [](vector<Bounds> world, float scale)
+			{
+				for (Bounds& b : world)
+				{
+					XMStoreFloat3(&b.boxMin, XMVectorScale(XMLoadFloat3(&b.boxMin), scale));
+					XMStoreFloat3(&b.boxMax, XMVectorScale(XMLoadFloat3(&b.boxMax), scale));
+				}
+				return world;
+			};
+			Bvh reference;
+			reference.Build(bounds.data(), bounds.size());
+			reference.Refit(scattered.data());
+			for (float scale : { 1.0f / 1024.0f, 1024.0f })
+			{
+				vector<Bounds> world = scaled(bounds, scale), moved = scaled(scattered, scale);
+				Bvh tree;
+				tree.Build(world.data(), world.size());
+				tree.Refit(moved.data());
+				if (fabsf(tree.GetCost() - reference.GetCost()) > 1e-4f * reference.GetCost() || tree.NeedsRebuild() != reference.NeedsRebuild())
+					return false;
+			}
+			return true;
+		}());
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkOcclusion(const char* args)
+	{
+		int objectCount = atoi(args);
+		if (objectCount <= 0) objectCount = 20000;
+		Checks check;
+
+		XMFLOAT4X4 proj;
+		XMStoreFloat4x4(&proj, XMMatrixPerspectiveFovLH(XM_PI / 3, 16.0f / 9.0f, 0.1f, 500.0f));
+
+		// A unit box seen square on from each side has its near face's depth in the middle of the buffer
+		{
+			OccluderMesh box = OcclusionCuller::MakeBox(XMFLOAT3(-0.5f, -0.5f, -0.5f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+			XMFLOAT4X4 identity;
+			XMStoreFloat4x4(&identity, XMMatrixIdentity());
+			OcclusionCuller culler;
+			const XMVECTOR directions[6] = { XMVectorSet(1, 0, 0, 0), XMVectorSet(-1, 0, 0, 0), XMVectorSet(0, 1, 0, 0),
+				XMVectorSet(0, -1, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 0, -1, 0) };
+			bool frontFaces = true;
+			for (XMVECTOR direction : directions)
+			{
+				XMVECTOR up = fabsf(XMVectorGetY(direction)) > 0.5f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+				XMFLOAT4X4 view;
+				XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorScale(direction, -5), direction, up));
+				culler.Begin(view, proj);
+				culler.AddOccluder(box, identity);
+				culler.Rasterize();
+				XMVECTOR face = XMVector3TransformCoord(XMVectorScale(direction, -0.5f), XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+				float depth = culler.GetDepth(culler.GetWidth() / 2, culler.GetHeight() / 2);
+				frontFaces = frontFaces && culler.GetTriangleCount() == 2 && fabsf(depth - XMVectorGetZ(face)) < 1e-4f;
+			}
+			check("boxes draw only their faces toward the camera", frontFaces);
+		}
+
+		// City blocks with streets between them, and small objects scattered everywhere on the ground
+		srand(2);
+		const float worldSize = 400.0f, blockSize = 20.0f, streetWidth = 6.0f;
+		vector<Bounds> bounds;
+		auto addBox = [&](XMFLOAT3 boxMin, XMFLOAT3 boxMax)
+		{
+			XMFLOAT3 half((boxMax.x - boxMin.x) / 2, (boxMax.y - boxMin.y) / 2, (boxMax.z - boxMin.z) / 2);
+			bounds.push_back({ boxMin, boxMax, XMFLOAT3(boxMin.x + half.x, boxMin.y + half.y, boxMin.z + half.z), sqrtf(half.x * half.x + half.y * half.y + half.z * half.z) });
+		};
+		addBox(XMFLOAT3(-worldSize / 2, -1, -worldSize / 2), XMFLOAT3(worldSize / 2, 0, worldSize / 2));
+		for (float x = -worldSize / 2; x < worldSize / 2; x += blockSize)
+			for (float z = -worldSize / 2; z < worldSize / 2; z += blockSize)
+				if (rand() % 10 != 0)
+					addBox(XMFLOAT3(x + streetWidth / 2, 0, z + streetWidth / 2), XMFLOAT3(x + blockSize - streetWidth / 2, Random(4, 30), z + blockSize - streetWidth / 2));
+		size_t occluderCount = bounds.size();
+		for (int i = 0; i < objectCount; i++)
+		{
+			XMFLOAT3 base(Random(-worldSize / 2, worldSize / 2), 0, Random(-worldSize / 2, worldSize / 2));
+			XMFLOAT3 half(Random(0.25f, 1.5f), Random(0.25f, 1.5f), Random(0.25f, 1.5f));
+			addBox(XMFLOAT3(base.x - half.x, 0, base.z - half.z), XMFLOAT3(base.x + half.x, half.y * 2, base.z + half.z));
+		}
+		CullBoxes boxes;
+		for (const Bounds& b : bounds)
+			boxes.Add(b);
+		vector<OccluderMesh> occluders;
+		for (size_t i = 0; i < occluderCount; i++)
+			occluders.push_back(OcclusionCuller::MakeBox(bounds[i].boxMin, bounds[i].boxMax));
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+		// The occluders' boxes again, to ray cast the exact depth of every pixel with
+		Bvh occluderBvh;
+		occluderBvh.Build(bounds.data(), occluderCount);
+
+		const int viewCount = 16;
+		JobSystem& jobs = JobSystem::Shared();
+		OcclusionCuller threaded, single;
+		printf("  %zu occluders (%zu triangles), %d objects, %d views, %ux%u buffer, %u threads\n\n", occluderCount, occluderCount * 12,
+			objectCount, viewCount, threaded.GetWidth(), threaded.GetHeight(), jobs.GetThreadCount());
+		printf("  %-5s %10s %10s %8s %10s %10s %12s %12s %10s\n", "View", "In frustum", "Occluded", "Share", "Exact", "Triangles", "Raster ms", "1 thread ms", "Test ms");
+
+		bool conservativeDepth = true, conservativeCull = true, threadsAgree = true, emptyKeepsAll = true;
+		double totalFrustum = 0, totalOccluded = 0, totalExact = 0, totalRaster = 0, totalSingle = 0, totalTest = 0;
+		vector<unsigned int> candidates, visible, visibleSingle;
+		vector<float> exactDepth(threaded.GetWidth() * threaded.GetHeight());
+		for (int v = 0; v < viewCount; v++)
+		{
+			// Eye height in a street, looking along it or across the blocks
+			float street = floorf(Random(-worldSize / 2, worldSize / 2) / blockSize) * blockSize + Random(-1, 1);
+			XMVECTOR eye = v % 2 ? XMVectorSet(street, 1.7f, Random(-150, 150), 1) : XMVectorSet(Random(-150, 150), 1.7f, street, 1);
+			float yaw = Random(0, XM_2PI);
+			XMFLOAT4X4 view, viewProj;
+			XMStoreFloat4x4(&view, XMMatrixLookToLH(eye, XMVectorSet(sinf(yaw), -0.05f, cosf(yaw), 0), XMVectorSet(0, 1, 0, 0)));
+			XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+			FrustumCuller::Cull(FrustumCuller::MakeFrustum(view, proj), boxes, candidates, &jobs);
+
+			if (v == 0)
+			{
+				threaded.Begin(view, proj);
+				threaded.Rasterize(&jobs);
+				visible = candidates;
+				threaded.Cull(boxes, visible, &jobs);
+				emptyKeepsAll = visible == candidates;
+			}
+
+			double start = Now();
+			threaded.Begin(view, proj);
+			for (const OccluderMesh& occluder : occluders)
+				threaded.AddOccluder(occluder, identity);
+			threaded.Rasterize(&jobs);
+			double rasterTime = Now() - start;
+			start = Now();
+			visible = candidates;
+			OcclusionStats stats = {};
+			threaded.Cull(boxes, visible, &jobs, &stats);
+			double testTime = Now() - start;
+
+			start = Now();
+			single.Begin(view, proj);
+			for (const OccluderMesh& occluder : occluders)
+				single.AddOccluder(occluder, identity);
+			single.Rasterize();
+			double singleTime = Now() - start;
+			visibleSingle = candidates;
+			single.Cull(boxes, visibleSingle);
+			threadsAgree = threadsAgree && visible == visibleSingle;
+
+			// Ray cast every pixel center from the near plane, the buffer may never be nearer than what the ray hits
+			unsigned int width = threaded.GetWidth(), height = threaded.GetHeight();
+			XMMATRIX toWorld = XMMatrixInverse(0, XMLoadFloat4x4(&viewProj));
+			XMMATRIX toClip = XMLoadFloat4x4(&viewProj);
+			auto castDepth = [&](float x, float y)
+			{
+				float ndcX = x / width * 2 - 1, ndcY = 1 - y / height * 2;
+				XMVECTOR from = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0, 1), toWorld);
+				XMVECTOR to = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1, 1), toWorld);
+				BvhRay ray;
+				XMStoreFloat3(&ray.origin, from);
+				XMStoreFloat3(&ray.direction, XMVectorSubtract(to, from));
+				ray.maxDistance = 1.0f;
+				BvhHit hit = occluderBvh.Raycast(ray);
+				if (hit.item == BVH_NO_ITEM)
+					return 1.0f;
+				return XMVectorGetZ(XMVector3TransformCoord(XMVectorAdd(from, XMVectorScale(XMVectorSubtract(to, from), hit.distance)), toClip));
+			};
+			for (unsigned int y = 0; y < height; y++)
+			{
+				for (unsigned int x = 0; x < width; x++)
+				{
+					// Centers right on an edge can come out on either side of it, so only fail if rays a little way off agree
+					float depth = castDepth(x + 0.5f, y + 0.5f);
+					const float offsets[4][2] = { { 0.05f, 0 }, { -0.05f, 0 }, { 0, 0.05f }, { 0, -0.05f } };
+					for (int o = 0; o < 4 && threaded.GetDepth(x, y) < depth - 1e-5f; o++)
+						depth = min(depth, castDepth(x + 0.5f + offsets[o][0], y + 0.5f + offsets[o][1]));
+					if (threaded.GetDepth(x, y) < depth - 1e-5f)
+						conservativeDepth = false;
+					exactDepth[y * width + x] = depth;
+				}
+			}
+
+			// Every culled box has to be behind the exact depth across its whole screen rectangle
+			vector<char> kept(bounds.size(), 0);
+			for (unsigned int i : visible) kept[i] = 1;
+			unsigned int exactHidden = 0;
+			for (unsigned int i : candidates)
+			{
+				const Bounds& b = bounds[i];
+				float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+				bool crossesNear = false;
+				for (int corner = 0; corner < 8; corner++)
+				{
+					XMFLOAT4 clip;
+					XMStoreFloat4(&clip, XMVector3Transform(XMVectorSet(corner & 1 ? b.boxMax.x : b.boxMin.x,
+						corner & 2 ? b.boxMax.y : b.boxMin.y, corner & 4 ? b.boxMax.z : b.boxMin.z, 1), toClip));
+					crossesNear = crossesNear || clip.z < 0;
+					minX = min(minX, (clip.x / clip.w * 0.5f + 0.5f) * width), maxX = max(maxX, (clip.x / clip.w * 0.5f + 0.5f) * width);
+					minY = min(minY, (0.5f - clip.y / clip.w * 0.5f) * height), maxY = max(maxY, (0.5f - clip.y / clip.w * 0.5f) * height);
+					nearest = min(nearest, clip.z / clip.w);
+				}
+				bool hidden = !crossesNear;
+				for (int y = max(0, (int)floorf(minY)); hidden && y < min((int)height, (int)ceilf(maxY)); y++)
+					for (int x = max(0, (int)floorf(minX)); hidden && x < min((int)width, (int)ceilf(maxX)); x++)
+						hidden = nearest > exactDepth[y * width + x];
+				exactHidden += hidden;
+				if (!kept[i] && !hidden)
+					conservativeCull = false;
+			}
+
+			unsigned int occluded = stats.tested - stats.visible;
+			printf("  %-5d %10u %10u %7.1f%% %10u %10u %12.3f %12.3f %10.3f\n", v, stats.tested, occluded, 100.0 * occluded / max(1u, stats.tested),
+				exactHidden, stats.triangles, rasterTime * 1000.0, singleTime * 1000.0, testTime * 1000.0);
+			totalFrustum += stats.tested, totalOccluded += occluded, totalExact += exactHidden;
+			totalRaster += rasterTime, totalSingle += singleTime, totalTest += testTime;
+		}
+		printf("  %-5s %10.0f %10.0f %7.1f%% %10.0f %10s %12.3f %12.3f %10.3f\n\n", "avg", totalFrustum / viewCount, totalOccluded / viewCount,
+			100.0 * totalOccluded / max(1.0, totalFrustum), totalExact / viewCount, "", totalRaster * 1000.0 / viewCount, totalSingle * 1000.0 / viewCount, totalTest * 1000.0 / viewCount);
+		printf("  Occluded: boxes the buffer hid of those in the frustum, Exact: what a per-pixel exact depth buffer would hide\n");
+		printf("  Raster ms: setting up and drawing every occluder, Test ms: testing the boxes in the frustum\n\n");
+		check("nothing is culled with no occluders", emptyKeepsAll);
+		check("the buffer is never nearer than the ray cast occluders", conservativeDepth);
+		check("every culled box is hidden by the exact depth", conservativeCull);
+		check("one thread and many cull the same boxes", threadsAgree);
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkPicking(const char* args)
+	{
+		int rayCount = atoi(args);
+		if (rayCount <= 0) rayCount = 1 << 20;
+		Checks check;
+
+		// Every model, and a bumpy terrain big enough that the tree's shape matters
+		struct PickMesh
+		{
+			string name;
+			vector<Vertex> vertices;
+			vector<unsigned int> indices;
+			Bounds bounds;
+			TriangleBvh bvh;
+		};
+		vector<PickMesh> meshes;
+		wstring folder = FixPath(L"../../Assets/Models/");
+		WIN32_FIND_DATAW found = {};
+		HANDLE search = FindFirstFileW((folder + L"*.obj").c_str(), &found);
+		if (search != INVALID_HANDLE_VALUE)
+		{
+			do
+			{
+				PickMesh mesh;
+				if (!ObjImporter::Load((folder + found.cFileName).c_str(), mesh.vertices, mesh.indices) || mesh.indices.empty())
+					continue;
+				char name[64];
+				snprintf(name, sizeof(name), "%ls", found.cFileName);
+				mesh.name = name;
+				meshes.push_back(move(mesh));
+			} while (FindNextFileW(search, &found));
+			FindClose(search);
+		}
+		{
+			const int size = 512;
+			PickMesh terrain;
+			terrain.name = "terrain (generated)";
+			for (int z = 0; z <= size; z++)
+			{
+				for (int x = 0; x <= size; x++)
+				{
+					Vertex v = {};
+					v.Position = XMFLOAT3(x - size / 2.0f, 4 * sinf(x * 0.05f) * cosf(z * 0.07f) + 0.5f * sinf(x * 0.9f + z * 0.4f), z - size / 2.0f);
+					terrain.vertices.push_back(v);
+				}
+			}
+			for (int z = 0; z < size; z++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					unsigned int corner = z * (size + 1) + x;
+					unsigned int quad[6] = { corner, corner + size + 1, corner + 1, corner + 1, corner + size + 1, corner + size + 2 };
+					terrain.indices.insert(terrain.indices.end(), quad, quad + 6);
+				}
+			}
+			meshes.push_back(move(terrain));
+		}
+
+		srand(3);
+		auto randomDirection = [&]()
+		{
+			XMVECTOR d;
+			do d = XMVectorSet(Random(-1, 1), Random(-1, 1), Random(-1, 1), 0);
+			while (XMVectorGetX(XMVector3LengthSq(d)) > 1 || XMVectorGetX(XMVector3LengthSq(d)) < 1e-4f);
+			return XMVector3Normalize(d);
+		};
+
+		// A camera's rays, neighbouring pixels next to each other in blocks of 4 x 2 like a tiled frame would be traced
+		auto cameraRays = [&](XMVECTOR eye, XMVECTOR target, float maxDistance, vector<BvhRay>& rays)
+		{
+			int width = ((int)sqrtf((float)rays.size()) + 3) / 4 * 4;
+			XMVECTOR forward = XMVector3Normalize(XMVectorSubtract(target, eye));
+			XMVECTOR right = XMVector3Normalize(XMVector3Cross(XMVectorSet(0, 1, 0, 0), forward));
+			XMVECTOR up = XMVector3Cross(forward, right);
+			float tanHalf = tanf(XM_PI / 6);
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				size_t tile = i / 8, within = i % 8;
+				float x = (float)(tile % (width / 4) * 4 + within % 4) + 0.5f;
+				float y = (float)(tile / (width / 4) * 2 + within / 4) + 0.5f;
+				XMVECTOR direction = XMVectorAdd(forward, XMVectorAdd(XMVectorScale(right, (x / width * 2 - 1) * tanHalf), XMVectorScale(up, (1 - y / width * 2) * tanHalf)));
+				XMStoreFloat3(&rays[i].origin, eye);
+				XMStoreFloat3(&rays[i].direction, direction);
+				rays[i].maxDistance = maxDistance;
+			}
+		};
+
+		// Every triangle one after another, the same sums as the tree's
+		auto bruteRaycast = [](const PickMesh& mesh, const BvhRay& ray)
+		{
+			BvhHit hit = { BVH_NO_ITEM, ray.maxDistance };
+			for (size_t t = 0; t < mesh.indices.size() / 3; t++)
+			{
+				const XMFLOAT3& a = mesh.vertices[mesh.indices[t * 3]].Position;
+				const XMFLOAT3& b = mesh.vertices[mesh.indices[t * 3 + 1]].Position;
+				const XMFLOAT3& c = mesh.vertices[mesh.indices[t * 3 + 2]].Position;
+				XMFLOAT3 e1(b.x - a.x, b.y - a.y, b.z - a.z), e2(c.x - a.x, c.y - a.y, c.z - a.z);
+				const XMFLOAT3& d = ray.direction;
+				float px = d.y * e2.z - d.z * e2.y, py = d.z * e2.x - d.x * e2.z, pz = d.x * e2.y - d.y * e2.x;
+				float inverseDet = 1.0f / (e1.x * px + e1.y * py + e1.z * pz);
+				float sx = ray.origin.x - a.x, sy = ray.origin.y - a.y, sz = ray.origin.z - a.z;
+				float u = (sx * px + sy * py + sz * pz) * inverseDet;
+				float qx = sy * e1.z - sz * e1.y, qy = sz * e1.x - sx * e1.z, qz = sx * e1.y - sy * e1.x;
+				float v = (d.x * qx + d.y * qy + d.z * qz) * inverseDet;
+				float distance = (e2.x * qx + e2.y * qy + e2.z * qz) * inverseDet;
+				if (u >= 0 && v >= 0 && u + v <= 1 && distance >= 0 && distance < hit.distance)
+					hit = { (unsigned int)t, distance };
+			}
+			return hit;
+		};
+		// Rays that graze a shared edge can hit either triangle at the same distance, so hits are compared by distance
+		auto sameDistance = [](bool hitA, float a, bool hitB, float b, float tolerance = 1e-5f)
+		{
+			return hitA == hitB && (!hitA || fabsf(a - b) <= tolerance * max(1.0f, fabsf(a)));
+		};
+		auto sameHit = [&](const BvhHit& a, const BvhHit& b)
+		{
+			return sameDistance(a.item != BVH_NO_ITEM, a.distance, b.item != BVH_NO_ITEM, b.distance);
+		};
+		auto sameRayHit = [&](const RayHit& a, const RayHit& b)
+		{
+			return sameDistance(a.target != BVH_NO_ITEM, a.distance, b.target != BVH_NO_ITEM, b.distance);
+		};
+		auto mraysPerSecond = [&](size_t count, double seconds) { return count / seconds / 1e6; };
+
+		JobSystem& jobs = JobSystem::Shared();
+		const int bruteCount = 1000;
+		vector<BvhRay> coherent(rayCount), incoherent(rayCount);
+		vector<BvhHit> single(rayCount), packets(rayCount), threaded(rayCount);
+		printf("  %d rays per test, packets of %d, %u threads. Rates in millions of rays a second\n\n", rayCount, TriangleBvh::GetPacketWidth(), jobs.GetThreadCount());
+		printf("  %-22s %9s %8s %9s %6s %8s %8s %8s %6s %8s %8s %8s\n", "Mesh", "Triangles", "Nodes", "Build ms",
+			"Hit", "Single", "Packets", "Threads", "Hit", "Single", "Packets", "Threads");
+		printf("  %-22s %9s %8s %9s %32s %33s\n", "", "", "", "", "-------- camera rays --------", "------ incoherent rays ------");
+		bool meshPacketsMatch = true, meshThreadsMatch = true, meshBruteMatch = true;
+		for (PickMesh& mesh : meshes)
+		{
+			double buildBest = 1e30;
+			for (int r = 0; r < 3; r++)
+			{
+				double start = Now();
+				mesh.bvh.Build(mesh.vertices.data(), mesh.indices.data(), mesh.indices.size());
+				buildBest = fmin(buildBest, Now() - start);
+			}
+			mesh.bounds = BoundingVolumes::Compute(mesh.vertices.data(), (int)mesh.vertices.size());
+			XMVECTOR center = XMLoadFloat3(&mesh.bounds.center);
+			float radius = mesh.bounds.radius;
+
+			// Looking down at the whole mesh from a little way off, and rays from all around it through random points inside
+			cameraRays(XMVectorAdd(center, XMVectorScale(XMVector3Normalize(XMVectorSet(0.4f, 0.6f, -1, 0)), radius * 1.8f)), center, FLT_MAX, coherent);
+			for (BvhRay& ray : incoherent)
+			{
+				XMVECTOR origin = XMVectorAdd(center, XMVectorScale(randomDirection(), radius * 1.5f));
+				XMVECTOR target = XMVectorSet(Random(mesh.bounds.boxMin.x, mesh.bounds.boxMax.x), Random(mesh.bounds.boxMin.y, mesh.bounds.boxMax.y),
+					Random(mesh.bounds.boxMin.z, mesh.bounds.boxMax.z), 0);
+				XMStoreFloat3(&ray.origin, origin);
+				XMStoreFloat3(&ray.direction, XMVectorSubtract(target, origin));
+				ray.maxDistance = FLT_MAX;
+			}
+
+			printf("  %-22s %9zu %8zu %9.2f", mesh.name.c_str(), mesh.bvh.GetTriangleCount(), mesh.bvh.GetNodeCount(), buildBest * 1000.0);
+			for (const vector<BvhRay>* rays : { &coherent, &incoherent })
+			{
+				double start = Now();
+				for (int i = 0; i < rayCount; i++)
+					single[i] = mesh.bvh.Raycast((*rays)[i]);
+				double singleTime = Now() - start;
+				start = Now();
+				mesh.bvh.Raycast(rays->data(), rays->size(), packets.data());
+				double packetTime = Now() - start;
+				start = Now();
+				mesh.bvh.Raycast(rays->data(), rays->size(), threaded.data(), &jobs);
+				double threadedTime = Now() - start;
+
+				size_t hits = 0;
+				for (int i = 0; i < rayCount; i++)
+				{
+					hits += single[i].item != BVH_NO_ITEM;
+					meshPacketsMatch = meshPacketsMatch && sameHit(single[i], packets[i]);
+					meshThreadsMatch = meshThreadsMatch && packets[i].item == threaded[i].item && packets[i].distance == threaded[i].distance;
+				}
+				for (int i = 0; i < min(rayCount, bruteCount); i++)
+					meshBruteMatch = meshBruteMatch && sameHit(single[i * (rayCount / min(rayCount, bruteCount))], bruteRaycast(mesh, (*rays)[i * (rayCount / min(rayCount, bruteCount))]));
+				printf(" %5.1f%% %8.2f %8.2f %8.2f", 100.0 * hits / rayCount, mraysPerSecond(rayCount, singleTime),
+					mraysPerSecond(rayCount, packetTime), mraysPerSecond(rayCount, threadedTime));
+			}
+			printf("\n");
+		}
+		printf("\n  Single: one Raycast() per ray, Packets: the batch Raycast() on this thread, Threads: the batch across the job system\n\n");
+
+		// Instances of every mesh over the terrain, picked through a tree over their world bounds then each mesh's own tree
+		const int instanceCount = 2000;
+		vector<RayTarget> targets(instanceCount);
+		vector<Bounds> worldBounds(instanceCount);
+		vector<unsigned int> instanceMeshes(instanceCount);
+		for (int i = 0; i < instanceCount; i++)
+		{
+			// The first instance is the terrain, the rest are models standing on it
+			instanceMeshes[i] = i == 0 ? (unsigned int)meshes.size() - 1 : rand() % max(1, (int)meshes.size() - 1);
+			const PickMesh& mesh = meshes[instanceMeshes[i]];
+			XMMATRIX world = i == 0 ? XMMatrixIdentity() : XMMatrixScaling(Random(1, 4), Random(1, 4), Random(1, 4)) *
+				XMMatrixRotationRollPitchYaw(Random(0, XM_2PI), Random(0, XM_2PI), Random(0, XM_2PI)) *
+				XMMatrixTranslation(Random(-200, 200), Random(0, 20), Random(-200, 200));
+			XMFLOAT4X4 worldMatrix;
+			XMStoreFloat4x4(&worldMatrix, world);
+			XMStoreFloat4x4(&targets[i].worldToObject, XMMatrixInverse(0, world));
+			targets[i].triangles = &mesh.bvh;
+			worldBounds[i] = BoundingVolumes::ToWorld(mesh.bounds, worldMatrix);
+		}
+		Bvh scene;
+		scene.Build(worldBounds.data(), worldBounds.size());
+
+		// Segments between random points for line of sight, most pass over or between the instances and some are blocked
+		vector<BvhRay> segments(rayCount);
+		cameraRays(XMVectorSet(0, 40, -260, 0), XMVectorSet(0, 0, 0, 0), FLT_MAX, coherent);
+		for (int i = 0; i < rayCount; i++)
+		{
+			XMVECTOR from = XMVectorSet(Random(-200, 200), Random(5, 40), Random(-200, 200), 0);
+			XMVECTOR to = XMVectorSet(Random(-200, 200), Random(5, 40), Random(-200, 200), 0);
+			XMStoreFloat3(&incoherent[i].origin, from);
+			XMStoreFloat3(&incoherent[i].direction, XMVector3Normalize(XMVectorSubtract(to, from)));
+			incoherent[i].maxDistance = FLT_MAX;
+			XMStoreFloat3(&segments[i].origin, from);
+			XMStoreFloat3(&segments[i].direction, XMVectorSubtract(to, from));
+			segments[i].maxDistance = 1.0f;
+		}
+
+		vector<RayHit> sceneSingle(rayCount), scenePackets(rayCount), sceneThreaded(rayCount);
+		unique_ptr<bool[]> clear(new bool[rayCount]), clearThreaded(new bool[rayCount]);
+		bool scenePacketsMatch = true, sceneThreadsMatch = true, sceneBruteMatch = true, sightMatches = true;
+		printf("  %d instances, scene tree of %zu nodes\n\n", instanceCount, scene.GetNodeCount());
+		printf("  %-22s %6s %8s %8s %8s\n", "Scene rays", "Hit", "Single", "Packets", "Threads");
+		const char* rayNames[3] = { "camera rays", "incoherent rays", "line of sight" };
+		const vector<BvhRay>* rayLists[3] = { &coherent, &incoherent, &segments };
+		for (int list = 0; list < 3; list++)
+		{
+			const vector<BvhRay>& rays = *rayLists[list];
+			double start = Now();
+			for (int i = 0; i < rayCount; i++)
+				sceneSingle[i] = TriangleBvh::RaycastScene(scene, targets.data(), rays[i]);
+			double singleTime = Now() - start;
+			double packetTime, threadedTime;
+			if (list < 2)
+			{
+				start = Now();
+				TriangleBvh::RaycastScene(scene, targets.data(), rays.data(), rays.size(), scenePackets.data());
+				packetTime = Now() - start;
+				start = Now();
+				TriangleBvh::RaycastScene(scene, targets.data(), rays.data(), rays.size(), sceneThreaded.data(), &jobs);
+				threadedTime = Now() - start;
+				for (int i = 0; i < rayCount; i++)
+				{
+					scenePacketsMatch = scenePacketsMatch && sameRayHit(sceneSingle[i], scenePackets[i]);
+					sceneThreadsMatch = sceneThreadsMatch && scenePackets[i].target == sceneThreaded[i].target && scenePackets[i].distance == sceneThreaded[i].distance;
+				}
+			}
+			else
+			{
+				start = Now();
+				TriangleBvh::LineOfSight(scene, targets.data(), rays.data(), rays.size(), clear.get());
+				packetTime = Now() - start;
+				start = Now();
+				TriangleBvh::LineOfSight(scene, targets.data(), rays.data(), rays.size(), clearThreaded.get(), &jobs);
+				threadedTime = Now() - start;
+				// A segment ending right on a surface can come out either way
+				for (int i = 0; i < rayCount; i++)
+					sightMatches = sightMatches && (clear[i] == (sceneSingle[i].target == BVH_NO_ITEM) || fabsf(sceneSingle[i].distance - 1.0f) < 1e-5f) &&
+						clear[i] == clearThreaded[i];
+			}
+
+			// Every instance one after another on a few of the rays
+			for (int i = 0; i < min(rayCount, bruteCount); i++)
+			{
+				const BvhRay& ray = rays[i * (rayCount / min(rayCount, bruteCount))];
+				RayHit nearest = { BVH_NO_ITEM, BVH_NO_ITEM, ray.maxDistance };
+				for (int t = 0; t < instanceCount; t++)
+				{
+					BvhRay local = ray;
+					XMMATRIX toObject = XMLoadFloat4x4(&targets[t].worldToObject);
+					XMStoreFloat3(&local.origin, XMVector3TransformCoord(XMLoadFloat3(&ray.origin), toObject));
+					XMStoreFloat3(&local.direction, XMVector3TransformNormal(XMLoadFloat3(&ray.direction), toObject));
+					local.maxDistance = nearest.distance;
+					BvhHit hit = targets[t].triangles->Raycast(local);
+					if (hit.item != BVH_NO_ITEM)
+						nearest = { (unsigned int)t, hit.item, hit.distance };
+				}
+				// XMVector3TransformCoord() rounds differently, which shows far from the origin
+				const RayHit& hit = sceneSingle[i * (rayCount / min(rayCount, bruteCount))];
+				sceneBruteMatch = sceneBruteMatch && sameDistance(hit.target != BVH_NO_ITEM, hit.distance, nearest.target != BVH_NO_ITEM, nearest.distance, 1e-4f);
+			}
+
+			size_t hits = 0;
+			for (int i = 0; i < rayCount; i++)
+				hits += sceneSingle[i].target != BVH_NO_ITEM;
+			printf("  %-22s %5.1f%% %8.2f %8.2f %8.2f\n", rayNames[list], 100.0 * hits / rayCount, mraysPerSecond(rayCount, singleTime),
+				mraysPerSecond(rayCount, packetTime), mraysPerSecond(rayCount, threadedTime));
+		}
+		printf("\n  Line of sight stops at the first thing in the way, Single there is the nearest hit for comparison\n\n");
+		check("packets hit what single rays hit on every mesh", meshPacketsMatch);
+		check("one thread and many agree on every mesh", meshThreadsMatch);
+		check("the tree finds the nearest of every triangle", meshBruteMatch);
+		check("scene packets hit what single scene rays hit", scenePacketsMatch);
+		check("one thread and many agree on the scene", sceneThreadsMatch);
+		check("the scene tree finds the nearest of every instance", sceneBruteMatch);
+		check("line of sight is blocked exactly when a ray hits something", sightMatches);
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkInstancing(const char* args)
+	{
+		int entityCount = atoi(args);
+		if (entityCount <= 0) entityCount = 10000;
+		Checks check;
+
+		ComPtr<ID3D11Device> device = CreateWarpDevice();
+		if (!device)
+			return 1;
+		shared_ptr<NullRenderDevice> renderDevice = make_shared<NullRenderDevice>();
+		const wchar_t* models[] = { L"sphere.obj", L"cube.obj", L"helix.obj" };
+		shared_ptr<Mesh> meshes[3];
+		for (int m = 0; m < 3; m++)
+			meshes[m] = make_shared<Mesh>((FixPath(L"../../Assets/Models/") + models[m]).c_str(), device, renderDevice);
+		shared_ptr<Material> mats[4];
+		for (int m = 0; m < 4; m++)
+			mats[m] = make_shared<Material>(XMFLOAT4(1, 1, 1, 1), nullptr, nullptr);
+
+		// Ents of every mesh and material scattered in front of the camera, each at the LOD its distance asks for
+		srand(1);
+		float side = sqrtf((float)entityCount) * 4.0f;
+		shared_ptr<Cam> cam = make_shared<Cam>(1280.0f / 720.0f, XMFLOAT3(0, 2, -side * 0.5f), XMFLOAT3(0, 0, 0), 70.0f);
+		Registry scene;
+		vector<Transform*> transforms(entityCount);
+		vector<Renderable*> renderables(entityCount);
+		vector<unsigned int> entities(entityCount);
+		for (int i = 0; i < entityCount; i++)
+		{
+			Entity e = scene.Create(Transform(), Renderable(meshes[rand() % 3], mats[rand() % 4]));
+			transforms[i] = scene.Get<Transform>(e);
+			renderables[i] = scene.Get<Renderable>(e);
+			entities[i] = i;
+			float scale = 0.25f + 1.75f * rand() / RAND_MAX;
+			transforms[i]->SetPosition(side * ((float)rand() / RAND_MAX - 0.5f), 0, side * ((float)rand() / RAND_MAX - 0.5f));
+			transforms[i]->SetOrientation(0, XM_2PI * rand() / RAND_MAX, 0);
+			transforms[i]->SetScale(scale, scale, scale);
+			transforms[i]->UpdateMatrices();
+			renderables[i]->UpdateLod(*transforms[i], cam, 720);
+		}
+
+		// Bytes of the constant buffers Game fills: the camera and light once a frame, the shadow and main vertex
+		// shaders' world matrices for each draw without instancing (with it they move to the instance buffer), and
+		// the pixel shader's tint
+		const UINT frameBytes = sizeof(FrameData);
+		const UINT shadowBytes = 64, mainBytes = 2 * 64;
+		const UINT pixelBytes = 16;
+
+		// What Game::Draw sends for a shadow pass and a main pass over every entity, one entity at a time or in groups
+		auto perEntity = [&]()
+		{
+			renderDevice->UpdateConstantBuffer(0, 0, frameBytes);
+			for (int i = 0; i < entityCount; i++)
+			{
+				renderDevice->UpdateConstantBuffer(0, 0, shadowBytes);
+				renderables[i]->GetMesh()->Draw(renderables[i]->GetLod());
+			}
+			for (int i = 0; i < entityCount; i++)
+			{
+				renderDevice->UpdateConstantBuffer(0, 0, mainBytes);
+				renderDevice->UpdateConstantBuffer(0, 0, pixelBytes);
+				renderables[i]->GetMesh()->Draw(renderables[i]->GetLod());
+			}
+		};
+		InstanceBatcher batcher(device, renderDevice);
+		vector<InstanceGroup> shadowGroups, mainGroups;
+		auto instanced = [&]()
+		{
+			batcher.Clear();
+			batcher.Gather(entities, renderables.data(), transforms.data(), false, shadowGroups);
+			batcher.Gather(entities, renderables.data(), transforms.data(), true, mainGroups);
+			batcher.Upload();
+			renderDevice->UpdateConstantBuffer(0, 0, frameBytes);
+			for (const InstanceGroup& group : shadowGroups)
+				group.mesh->DrawInstanced(group.lod, batcher.GetBuffer(), group.firstInstance, group.instanceCount);
+			Material* mat = 0;
+			for (const InstanceGroup& group : mainGroups)
+			{
+				if (group.mat != mat)
+				{
+					mat = group.mat;
+					renderDevice->UpdateConstantBuffer(0, 0, pixelBytes);
+				}
+				group.mesh->DrawInstanced(group.lod, batcher.GetBuffer(), group.firstInstance, group.instanceCount);
+			}
+		};
+
+		const int repeats = 20;
+		RenderStats stats[2];
+		double best[2] = { DBL_MAX, DBL_MAX };
+		for (int r = 0; r < repeats; r++)
+		{
+			for (int way = 0; way < 2; way++)
+			{
+				renderDevice->ResetStats();
+				double start = Now();
+				if (way == 0) perEntity();
+				else instanced();
+				best[way] = min(best[way], Now() - start);
+				stats[way] = renderDevice->GetStats();
+			}
+		}
+
+		auto callCount = [](const RenderStats& s)
+		{
+			unsigned int total = 0;
+			for (int c = 0; c < RENDER_CALL_COUNT; c++)
+				total += s.calls[c];
+			return total;
+		};
+		printf("  %d ents, %zu shadow groups, %zu main groups, both passes\n\n", entityCount, shadowGroups.size(), mainGroups.size());
+		printf("  %-12s %12s %10s %10s %12s %10s\n", "", "Device calls", "Draws", "Uploads", "Bytes", "CPU");
+		const char* names[2] = { "Per entity", "Instanced" };
+		for (int way = 0; way < 2; way++)
+		{
+			printf("  %-12s %12u %10u %10u %12u %7.3f ms\n", names[way], callCount(stats[way]), stats[way].drawCalls,
+				stats[way].calls[RENDER_CALL_UPDATE_CONSTANT_BUFFER] + stats[way].calls[RENDER_CALL_UPDATE_BUFFER], stats[way].bytesUploaded,
+				best[way] * 1000.0);
+		}
+		printf("\n  CPU: best of %d, instanced includes sorting and filling the instance buffer, the null device only counts calls\n\n", repeats);
+
+		// The entities as the batcher should have laid them out: sorted by material, mesh, LOD and then entity
+		auto grouped = [&](const vector<InstanceGroup>& groups, size_t instanceStart, bool byMaterial)
+		{
+			vector<unsigned int> expected = entities;
+			sort(expected.begin(), expected.end(), [&](unsigned int a, unsigned int b)
+			{
+				unsigned int matA = byMaterial ? renderables[a]->GetMat()->GetSortId() : 0;
+				unsigned int matB = byMaterial ? renderables[b]->GetMat()->GetSortId() : 0;
+				if (matA != matB) return matA < matB;
+				if (renderables[a]->GetMesh() != renderables[b]->GetMesh()) return renderables[a]->GetMesh()->GetSortId() < renderables[b]->GetMesh()->GetSortId();
+				if (renderables[a]->GetLod() != renderables[b]->GetLod()) return renderables[a]->GetLod() < renderables[b]->GetLod();
+				return a < b;
+			});
+			const vector<InstanceData>& instances = batcher.GetInstances();
+			size_t next = instanceStart;
+			for (size_t g = 0; g < groups.size(); g++)
+			{
+				const InstanceGroup& group = groups[g];
+				if (group.firstInstance != next || group.instanceCount == 0 || next + group.instanceCount > instanceStart + expected.size())
+					return false;
+				if (g > 0 && group.mat == groups[g - 1].mat && group.mesh == groups[g - 1].mesh && group.lod == groups[g - 1].lod)
+					return false;
+				for (unsigned int k = 0; k < group.instanceCount; k++, next++)
+				{
+					unsigned int e = expected[next - instanceStart];
+					XMFLOAT4X4 world = transforms[e]->GetWorldMatrix();
+					XMFLOAT4X4 worldIT = transforms[e]->GetWorldInverseTransposeMatrix();
+					if (renderables[e]->GetMesh().get() != group.mesh || renderables[e]->GetLod() != group.lod ||
+						(byMaterial ? renderables[e]->GetMat().get() : 0) != group.mat ||
+						memcmp(&instances[next].world, &world, sizeof(world)) != 0 ||
+						memcmp(&instances[next].worldInverseTranspose, &worldIT, sizeof(worldIT)) != 0)
+						return false;
+				}
+			}
+			return next == instanceStart + expected.size();
+		};
+		check("shadow groups hold every entity once, by mesh and LOD", grouped(shadowGroups, 0, false));
+		check("main groups hold every entity once, by material, mesh and LOD", grouped(mainGroups, entities.size(), true));
+		check("both ways submit the same indices", stats[0].indices == stats[1].indices);
+		check("one draw per group", stats[1].drawCalls == shadowGroups.size() + mainGroups.size());
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkRenderQueue(const char* args)
+	{
+		int drawCount = atoi(args);
+		if (drawCount <= 0) drawCount = 100000;
+		Checks check;
+
+		// Draws of a busy frame in the order entities were made: every material belongs to one of a few shaders,
+		// and each draw is one of a few dozen meshes at some LOD and distance
+		const unsigned int shaderCount = 4, materialCount = 64, meshCount = 32;
+		srand(1);
+		vector<RenderQueueEntry> draws(drawCount);
+		for (int i = 0; i < drawCount; i++)
+		{
+			unsigned int material = rand() % materialCount;
+			draws[i] = { RenderQueue::MakeKey(RENDER_PASS_OPAQUE, material % shaderCount, material, rand() % meshCount, rand() % 4,
+				(float)rand() / RAND_MAX), (unsigned int)i };
+		}
+
+		// State changes as Submit() counts them, for draws in any order
+		struct Changes { unsigned int shader, material, mesh; };
+		auto countChanges = [](const vector<RenderQueueEntry>& entries)
+		{
+			const unsigned int meshShift = RENDER_QUEUE_DEPTH_BITS + RENDER_QUEUE_LOD_BITS;
+			const unsigned int materialShift = meshShift + RENDER_QUEUE_MESH_BITS;
+			const unsigned int shaderShift = materialShift + RENDER_QUEUE_MATERIAL_BITS;
+			Changes changes = {};
+			for (size_t i = 0; i < entries.size(); i++)
+			{
+				uint64_t key = entries[i].key, previous = i > 0 ? entries[i - 1].key : 0;
+				changes.shader += i == 0 || (key >> shaderShift) != (previous >> shaderShift);
+				changes.material += i == 0 || (key >> materialShift) != (previous >> materialShift);
+				changes.mesh += i == 0 || (key >> meshShift) != (previous >> meshShift);
+			}
+			return changes;
+		};
+
+		const int repeats = 20;
+		RenderQueue queue;
+		double radixBest = DBL_MAX, stdBest = DBL_MAX;
+		vector<RenderQueueEntry> stdSorted;
+		for (int r = 0; r < repeats; r++)
+		{
+			queue.Clear();
+			for (const RenderQueueEntry& draw : draws)
+				queue.Add(draw.key, draw.item);
+			double start = Now();
+			queue.Sort();
+			radixBest = min(radixBest, Now() - start);
+
+			stdSorted = draws;
+			start = Now();
+			stable_sort(stdSorted.begin(), stdSorted.end(), [](const RenderQueueEntry& a, const RenderQueueEntry& b) { return a.key < b.key; });
+			stdBest = min(stdBest, Now() - start);
+		}
+		vector<unsigned int> submitted;
+		unsigned int submitShaderChanges = 0, submitMeshChanges = 0;
+		queue.Submit(RENDER_PASS_OPAQUE, [&](unsigned int item, unsigned int changes)
+		{
+			submitted.push_back(item);
+			submitShaderChanges += (changes & RENDER_CHANGE_SHADER) != 0;
+			submitMeshChanges += (changes & RENDER_CHANGE_MESH) != 0;
+		});
+		RenderQueueStats stats = queue.GetStats();
+
+		Changes unsorted = countChanges(draws);
+		printf("  %d draws, %u shaders, %u materials, %u meshes\n\n", drawCount, shaderCount, materialCount, meshCount);
+		printf("  %-22s %10s %10s %10s %10s\n", "", "Shaders", "Materials", "Meshes", "Sort");
+		printf("  %-22s %10u %10u %10u %10s\n", "Insertion order", unsorted.shader, unsorted.material, unsorted.mesh, "");
+		printf("  %-22s %10u %10u %10u %7.3f ms\n", "Radix sort", stats.shaderChanges, stats.materialChanges, stats.meshChanges, radixBest * 1000.0);
+		printf("  %-22s %10s %10s %10s %7.3f ms\n", "std::stable_sort", "", "", "", stdBest * 1000.0);
+		printf("\n  Sort: best of %d, the radix sort skips the digits every key shares (the pass here)\n\n", repeats);
+
+		bool sameOrder = queue.GetEntries().size() == stdSorted.size();
+		for (size_t i = 0; sameOrder && i < stdSorted.size(); i++)
+			sameOrder = queue.GetEntries()[i].key == stdSorted[i].key && queue.GetEntries()[i].item == stdSorted[i].item;
+		vector<unsigned int> seen(drawCount, 0);
+		for (unsigned int item : submitted)
+			seen[item]++;
+		Changes sorted = countChanges(stdSorted);
+		check("radix sort matches std::stable_sort, equal keys in order", sameOrder);
+		check("every draw submitted once", submitted.size() == (size_t)drawCount && count(seen.begin(), seen.end(), 1u) == drawCount);
+		check("submit reports the changes between sorted keys", stats.shaderChanges == sorted.shader && stats.materialChanges == sorted.material &&
+			stats.meshChanges == sorted.mesh && submitShaderChanges == sorted.shader && submitMeshChanges == sorted.mesh);
+		check("nothing of another pass is submitted", [&]()
+		{
+			unsigned int other = 0;
+			queue.Submit(RENDER_PASS_SHADOW, [&](unsigned int, unsigned int) { other++; });
+			return other == 0;
+		}());
+		check("depth is clamped and sorts front to back", RenderQueue::MakeKey(0, 0, 0, 0, 0, -1) == RenderQueue::MakeKey(0, 0, 0, 0, 0, 0) &&
+			RenderQueue::MakeKey(0, 0, 0, 0, 0, 2) == RenderQueue::MakeKey(0, 0, 0, 0, 0, 1) &&
+			RenderQueue::MakeKey(0, 0, 0, 0, 0, 0.25f) < RenderQueue::MakeKey(0, 0, 0, 0, 0, 0.5f));
+		check("sort ids of destroyed owners are reused and always fit the key", []()
+		{
+			struct Owner {};
+			const unsigned int bits = 4;
+			bool fits = true;
+			for (int round = 0; round < 8; round++)
+			{
+				vector<SortId<Owner, bits>> live(1u << bits);
+				vector<unsigned int> ids(live.begin(), live.end());
+				sort(ids.begin(), ids.end());
+				fits = fits && unique(ids.begin(), ids.end()) == ids.end() && ids.back() < (1u << bits);
+			}
+			return fits;
+		}());
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// Null device that also folds what reaches it into a hash: constant data, index buffers and draw ranges
+	/// </summary>
+	class HashingRenderDevice : public NullRenderDevice
+	{
+	private:
+		uint64_t hash = 14695981039346656037ull;
+		void Mix(const void* data, size_t size)
+		{
+			const unsigned char* bytes = (const unsigned char*)data;
+			for (size_t i = 0; i < size; i++)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+	public:
+		uint64_t GetHash() { return hash; }
+		void ResetHash() { hash = 14695981039346656037ull; }
+		void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+		{
+			NullRenderDevice::IASetIndexBuffer(buffer, format, offset);
+			Mix(&buffer, sizeof(buffer));
+		}
+		void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+		{
+			NullRenderDevice::UpdateConstantBuffer(buffer, data, size);
+			Mix(data, size);
+		}
+		void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+		{
+			NullRenderDevice::DrawIndexed(indexCount, startIndex, baseVertex);
+			UINT args[3] = { indexCount, startIndex, (UINT)baseVertex };
+			Mix(args, sizeof(args));
+		}
+	};
+
+	int BenchmarkCommands(const char* args)
+	{
+		int drawCount = atoi(args);
+		if (drawCount <= 0) drawCount = 20000;
+		Checks check;
+
+		// Meshes are stand-in buffers with a few LODs, drawn the way Mesh::Draw() draws, so nothing here needs a
+		// D3D device and the bench runs wherever the null backend does
+		struct StandInMesh
+		{
+			ID3D11Buffer* vertexBuffer;
+			ID3D11Buffer* indexBuffer;
+			MeshLod lods[4];
+		};
+		static char bufferNames[6];
+		const unsigned int meshCount = 3;
+		StandInMesh meshes[meshCount];
+		for (unsigned int m = 0; m < meshCount; m++)
+		{
+			meshes[m].vertexBuffer = (ID3D11Buffer*)(bufferNames + m * 2);
+			meshes[m].indexBuffer = (ID3D11Buffer*)(bufferNames + m * 2 + 1);
+			unsigned int offset = 0;
+			for (unsigned int lod = 0; lod < 4; lod++)
+			{
+				unsigned int count = (2880 * (m + 1)) >> lod;
+				meshes[m].lods[lod] = { offset, count, 0, 0, 0 };
+				offset += count;
+			}
+		}
+		auto drawMesh = [](RenderDevice& target, const StandInMesh& mesh, unsigned int lod, bool bind)
+		{
+			if (bind)
+			{
+				UINT stride = sizeof(Vertex), offset = 0;
+				target.IASetVertexBuffers(0, 1, &mesh.vertexBuffer, &stride, &offset);
+				target.IASetIndexBuffer(mesh.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			}
+			target.DrawIndexed(mesh.lods[lod].indexCount, mesh.lods[lod].indexOffset, 0);
+		};
+		shared_ptr<HashingRenderDevice> renderDevice = make_shared<HashingRenderDevice>();
+
+		// A main pass's sorted draws, each with its own world matrices, and materials each with a tint
+		const unsigned int shaderCount = 4, materialCount = 64;
+		srand(1);
+		vector<XMFLOAT4X4> worlds(drawCount);
+		vector<unsigned int> drawMaterials(drawCount), drawMeshes(drawCount), drawLods(drawCount);
+		vector<XMFLOAT4> tints(materialCount);
+		RenderQueue queue;
+		for (int i = 0; i < drawCount; i++)
+		{
+			drawMaterials[i] = rand() % materialCount;
+			drawMeshes[i] = rand() % meshCount;
+			drawLods[i] = rand() % 4;
+			XMStoreFloat4x4(&worlds[i], XMMatrixScaling(1.0f + i % 7, 1, 1) * XMMatrixTranslation((float)i, (float)(rand() % 100), 0));
+			queue.Add(RenderQueue::MakeKey(RENDER_PASS_OPAQUE, drawMaterials[i] % shaderCount, drawMaterials[i], drawMeshes[i],
+				drawLods[i], (float)rand() / RAND_MAX), (unsigned int)i);
+		}
+		for (unsigned int m = 0; m < materialCount; m++)
+			tints[m] = XMFLOAT4((float)m, 1, 1, 1);
+		queue.Sort();
+		size_t begin, end;
+		queue.GetPass(RENDER_PASS_OPAQUE, begin, end);
+
+		// What Game's main pass sends for a piece of the draws, onto the device directly or a command buffer:
+		// the world matrices for every draw, and the tint when the material changes
+		const UINT vsBytes = 2 * 64, psBytes = 16;
+		auto submit = [&](RenderDevice& target, size_t first, size_t last)
+		{
+			return queue.SubmitRange(first, last, [&](unsigned int i, unsigned int changes)
+			{
+				if (changes & RENDER_CHANGE_SHADER)
+				{
+					target.VSSetShader(0);
+					target.PSSetShader(0);
+				}
+				if (changes & RENDER_CHANGE_MATERIAL)
+				{
+					unsigned char psData[psBytes] = {};
+					memcpy(psData, &tints[drawMaterials[i]], sizeof(XMFLOAT4));
+					target.UpdateConstantBuffer(0, psData, psBytes);
+					target.PSSetShaderResources(0, 0, 0);
+				}
+				unsigned char vsData[vsBytes] = {};
+				memcpy(vsData, &worlds[i], sizeof(XMFLOAT4X4));
+				target.UpdateConstantBuffer(0, vsData, vsBytes);
+				drawMesh(target, meshes[drawMeshes[i]], drawLods[i], (changes & RENDER_CHANGE_MESH) != 0);
+			});
+		};
+
+		// Recording into pieces, on one thread or all of them, then replaying them in order
+		JobSystem& jobs = JobSystem::Shared();
+		size_t pieces = max((size_t)jobs.GetThreadCount(), (size_t)4);
+		vector<CommandBuffer> buffers(pieces);
+		vector<const CommandBuffer*> bufferList(pieces);
+		for (size_t p = 0; p < pieces; p++)
+			bufferList[p] = &buffers[p];
+		auto pieceBegin = [&](size_t p) { return begin + (end - begin) * p / pieces; };
+		auto record = [&](size_t first, size_t last)
+		{
+			for (size_t p = first; p < last; p++)
+			{
+				buffers[p].Reset();
+				submit(buffers[p], pieceBegin(p), pieceBegin(p + 1));
+			}
+		};
+
+		const int repeats = 20;
+		double direct = DBL_MAX, recordOne = DBL_MAX, recordAll = DBL_MAX, replay = DBL_MAX;
+		for (int r = 0; r < repeats; r++)
+		{
+			double start = Now();
+			for (size_t p = 0; p < pieces; p++)
+				submit(*renderDevice, pieceBegin(p), pieceBegin(p + 1));
+			direct = min(direct, Now() - start);
+
+			start = Now();
+			record(0, pieces);
+			recordOne = min(recordOne, Now() - start);
+
+			start = Now();
+			jobs.ParallelFor(pieces, 1, record);
+			recordAll = min(recordAll, Now() - start);
+
+			start = Now();
+			renderDevice->ExecuteCommandBuffers(bufferList.data(), pieces, &jobs);
+			replay = min(replay, Now() - start);
+		}
+
+		size_t commands = 0, bytes = 0;
+		for (const CommandBuffer& buffer : buffers)
+		{
+			commands += buffer.GetCommandCount();
+			bytes += buffer.GetByteCount();
+		}
+		printf("  %zu draws in %zu pieces, %u threads\n\n", end - begin, pieces, jobs.GetThreadCount());
+		printf("  %-32s %8.3f ms\n", "Direct onto the device", direct * 1000.0);
+		printf("  %-32s %8.3f ms\n", "Record, one thread", recordOne * 1000.0);
+		printf("  %-32s %8.3f ms\n", "Record, every thread", recordAll * 1000.0);
+		printf("  %-32s %8.3f ms\n", "Replay", replay * 1000.0);
+		printf("  %zu commands, %zu bytes, %.1f bytes per draw\n", commands, bytes, (double)bytes / (end - begin));
+		printf("\n  CPU: best of %d, the null device only counts and hashes calls\n\n", repeats);
+
+		// The same pieces straight onto the device, against recorded on every thread and replayed
+		auto capture = [&](bool recorded, vector<RenderCallType>& calls, RenderStats& stats, uint64_t& hash)
+		{
+			renderDevice->ResetStats();
+			renderDevice->ResetHash();
+			renderDevice->ClearRecordedCalls();
+			renderDevice->SetRecording(true);
+			if (recorded)
+			{
+				jobs.ParallelFor(pieces, 1, record);
+				renderDevice->ExecuteCommandBuffers(bufferList.data(), pieces, &jobs);
+			}
+			else
+			{
+				for (size_t p = 0; p < pieces; p++)
+					submit(*renderDevice, pieceBegin(p), pieceBegin(p + 1));
+			}
+			renderDevice->SetRecording(false);
+			calls = renderDevice->GetRecordedCalls();
+			stats = renderDevice->GetStats();
+			hash = renderDevice->GetHash();
+		};
+		vector<RenderCallType> directCalls, replayedCalls;
+		RenderStats directStats, replayedStats;
+		uint64_t directHash, replayedHash;
+		capture(false, directCalls, directStats, directHash);
+		capture(true, replayedCalls, replayedStats, replayedHash);
+
+		RenderQueueStats recordedStats = {};
+		for (size_t p = 0; p < pieces; p++)
+		{
+			RenderQueueStats piece = queue.SubmitRange(pieceBegin(p), pieceBegin(p + 1), [](unsigned int, unsigned int) {});
+			recordedStats.draws += piece.draws;
+			recordedStats.shaderChanges += piece.shaderChanges;
+		}
+		RenderStats bufferStats = {};
+		for (CommandBuffer& buffer : buffers)
+		{
+			RenderStats s = buffer.GetStats();
+			bufferStats.drawCalls += s.drawCalls;
+			bufferStats.indices += s.indices;
+		}
+		check("replay makes the same calls in the same order", directCalls == replayedCalls);
+		check("replay draws the same indices and uploads the same bytes", directStats.drawCalls == replayedStats.drawCalls &&
+			directStats.indices == replayedStats.indices && directStats.bytesUploaded == replayedStats.bytesUploaded);
+		check("replay uploads the same constant data and draws the same ranges", directHash == replayedHash);
+		check("every piece starts by binding its shaders", recordedStats.draws == end - begin && recordedStats.shaderChanges >= pieces);
+		check("buffers count what they record", bufferStats.drawCalls == recordedStats.draws && bufferStats.indices == directStats.indices);
+		check("recording again after Reset() records the same", [&]()
+		{
+			size_t before = buffers[0].GetByteCount();
+			buffers[0].Reset();
+			bool empty = buffers[0].GetCommandCount() == 0 && buffers[0].GetByteCount() == 0;
+			submit(buffers[0], pieceBegin(0), pieceBegin(1));
+			return empty && buffers[0].GetByteCount() == before;
+		}());
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	/// <summary>
+	/// Null device that keeps what's bound the way a context would, and folds the state and constants each draw sees into a hash
+	/// </summary>
+	class PipelineRenderDevice : public NullRenderDevice
+	{
+	private:
+		struct State
+		{
+			void* objects[9]; // shaders, layout, rasterizer and depth states, targets, vertex and index buffer
+			UINT values[6]; // topology, stride, offset, index format and offset, stencil ref
+			ID3D11Buffer* vsBuffers[4];
+			ID3D11Buffer* psBuffers[4];
+			ID3D11ShaderResourceView* psResources[8];
+			ID3D11SamplerState* psSamplers[4];
+			D3D11_VIEWPORT viewport;
+		};
+		State state;
+		unordered_map<ID3D11Buffer*, vector<unsigned char>> constants;
+		uint64_t hash = 14695981039346656037ull;
+		void Mix(const void* data, size_t size)
+		{
+			const unsigned char* bytes = (const unsigned char*)data;
+			for (size_t i = 0; i < size; i++)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		template<typename T, size_t N>
+		void Bind(T* (&slots)[N], UINT start, UINT count, T* const* values)
+		{
+			for (UINT i = 0; i < count; i++)
+				if (start + i < N) slots[start + i] = values[i];
+		}
+		void DrawState()
+		{
+			Mix(&state, sizeof(state));
+			for (ID3D11Buffer* buffer : state.vsBuffers)
+				if (buffer) Mix(constants[buffer].data(), constants[buffer].size());
+			for (ID3D11Buffer* buffer : state.psBuffers)
+				if (buffer) Mix(constants[buffer].data(), constants[buffer].size());
+		}
+	public:
+		UINT lastResourceStart = 0, lastResourceCount = 0;
+		PipelineRenderDevice() { memset(&state, 0, sizeof(state)); }
+		uint64_t GetHash() { return hash; }
+		void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) { NullRenderDevice::IASetPrimitiveTopology(topology); state.values[0] = topology; }
+		void IASetInputLayout(ID3D11InputLayout* layout) { NullRenderDevice::IASetInputLayout(layout); state.objects[2] = layout; }
+		void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+		{
+			NullRenderDevice::IASetVertexBuffers(startSlot, numBuffers, buffers, strides, offsets);
+			state.objects[7] = buffers[0];
+			state.values[1] = strides[0];
+			state.values[2] = offsets[0];
+		}
+		void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+		{
+			NullRenderDevice::IASetIndexBuffer(buffer, format, offset);
+			state.objects[8] = buffer;
+			state.values[3] = format;
+			state.values[4] = offset;
+		}
+		void VSSetShader(ID3D11VertexShader* shader) { NullRenderDevice::VSSetShader(shader); state.objects[0] = shader; }
+		void PSSetShader(ID3D11PixelShader* shader) { NullRenderDevice::PSSetShader(shader); state.objects[1] = shader; }
+		void VSSetConstantBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers)
+		{
+			NullRenderDevice::VSSetConstantBuffers(start, count, buffers);
+			Bind(state.vsBuffers, start, count, buffers);
+		}
+		void PSSetConstantBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers)
+		{
+			NullRenderDevice::PSSetConstantBuffers(start, count, buffers);
+			Bind(state.psBuffers, start, count, buffers);
+		}
+		void PSSetShaderResources(UINT start, UINT count, ID3D11ShaderResourceView* const* views)
+		{
+			NullRenderDevice::PSSetShaderResources(start, count, views);
+			Bind(state.psResources, start, count, views);
+			lastResourceStart = start;
+			lastResourceCount = count;
+		}
+		void PSSetSamplers(UINT start, UINT count, ID3D11SamplerState* const* samplers)
+		{
+			NullRenderDevice::PSSetSamplers(start, count, samplers);
+			Bind(state.psSamplers, start, count, samplers);
+		}
+		void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+		{
+			NullRenderDevice::UpdateConstantBuffer(buffer, data, size);
+			constants[buffer].assign((const unsigned char*)data, (const unsigned char*)data + size);
+		}
+		void RSSetState(ID3D11RasterizerState* rs) { NullRenderDevice::RSSetState(rs); state.objects[3] = rs; }
+		void RSSetViewports(UINT count, const D3D11_VIEWPORT* viewports) { NullRenderDevice::RSSetViewports(count, viewports); state.viewport = viewports[0]; }
+		void OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+		{
+			NullRenderDevice::OMSetRenderTargets(count, rtvs, dsv);
+			state.objects[5] = count ? rtvs[0] : 0;
+			state.objects[6] = dsv;
+		}
+		void OMSetDepthStencilState(ID3D11DepthStencilState* dss, UINT stencilRef)
+		{
+			NullRenderDevice::OMSetDepthStencilState(dss, stencilRef);
+			state.objects[4] = dss;
+			state.values[5] = stencilRef;
+		}
+		void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+		{
+			NullRenderDevice::DrawIndexed(indexCount, startIndex, baseVertex);
+			DrawState();
+			UINT args[3] = { indexCount, startIndex, (UINT)baseVertex };
+			Mix(args, sizeof(args));
+		}
+	};
+
+	int BenchmarkStateCache(const char* args)
+	{
+		int entityCount = atoi(args);
+		if (entityCount <= 0) entityCount = 10000;
+		Checks check;
+
+		ComPtr<ID3D11Device> device = CreateWarpDevice();
+		if (!device)
+			return 1;
+		shared_ptr<NullRenderDevice> loadDevice = make_shared<NullRenderDevice>();
+		const wchar_t* models[] = { L"sphere.obj", L"cube.obj", L"helix.obj" };
+		shared_ptr<Mesh> meshes[3];
+		for (int m = 0; m < 3; m++)
+			meshes[m] = make_shared<Mesh>((FixPath(L"../../Assets/Models/") + models[m]).c_str(), device, loadDevice);
+
+		// Stand-ins for the shaders, states, targets and textures, only ever compared, never dereferenced
+		static char objects[64];
+		auto fake = [](int k) { return (void*)(objects + k); };
+		ID3D11Buffer* shadowBuffer = (ID3D11Buffer*)fake(0);
+		ID3D11Buffer* vsBuffer = (ID3D11Buffer*)fake(1);
+		ID3D11Buffer* psBuffer = (ID3D11Buffer*)fake(2);
+		ID3D11RenderTargetView* rtv = (ID3D11RenderTargetView*)fake(3);
+		ID3D11DepthStencilView* dsv = (ID3D11DepthStencilView*)fake(4);
+		ID3D11DepthStencilView* shadowDSV = (ID3D11DepthStencilView*)fake(5);
+		ID3D11RasterizerState* shadowRasterizer = (ID3D11RasterizerState*)fake(6);
+		ID3D11SamplerState* samplers[2] = { (ID3D11SamplerState*)fake(7), (ID3D11SamplerState*)fake(8) };
+		ID3D11InputLayout* layout = (ID3D11InputLayout*)fake(9);
+		ID3D11VertexShader* shadowVS = (ID3D11VertexShader*)fake(10);
+		ID3D11VertexShader* vs = (ID3D11VertexShader*)fake(11);
+		ID3D11PixelShader* ps = (ID3D11PixelShader*)fake(12);
+		ID3D11ShaderResourceView* shadowSRV = (ID3D11ShaderResourceView*)fake(13);
+		const int materialCount = 4;
+		ID3D11ShaderResourceView* textures[materialCount][4];
+		for (int m = 0; m < materialCount; m++)
+			for (int t = 0; t < 4; t++)
+				textures[m][t] = (ID3D11ShaderResourceView*)fake(16 + m * 4 + t);
+
+		srand(1);
+		vector<int> entityMeshes(entityCount), entityMaterials(entityCount), entityLods(entityCount);
+		vector<XMFLOAT4X4> worlds(entityCount);
+		for (int i = 0; i < entityCount; i++)
+		{
+			entityMeshes[i] = rand() % 3;
+			entityMaterials[i] = rand() % materialCount;
+			entityLods[i] = rand() % 4;
+			XMStoreFloat4x4(&worlds[i], XMMatrixTranslation((float)i, (float)(rand() % 100), 0));
+		}
+
+		// A frame the way each entity used to be drawn on its own: every draw sets its shaders, constant buffers,
+		// textures and samplers whether or not the draw before it already did
+		D3D11_VIEWPORT shadowViewport = { 0, 0, 2048, 2048, 0, 1 };
+		D3D11_VIEWPORT viewport = { 0, 0, 1280, 720, 0, 1 };
+		auto frame = [&](RenderDevice& target)
+		{
+			target.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			target.RSSetState(shadowRasterizer);
+			ID3D11RenderTargetView* nullRTV = 0;
+			target.OMSetRenderTargets(1, &nullRTV, shadowDSV);
+			target.RSSetViewports(1, &shadowViewport);
+			for (int i = 0; i < entityCount; i++)
+			{
+				target.IASetInputLayout(layout);
+				target.VSSetShader(shadowVS);
+				target.VSSetConstantBuffers(0, 1, &shadowBuffer);
+				target.PSSetShader(0);
+				target.UpdateConstantBuffer(shadowBuffer, &worlds[i], sizeof(XMFLOAT4X4));
+				meshes[entityMeshes[i]]->Draw(entityLods[i], true, &target);
+			}
+
+			target.RSSetState(0);
+			target.RSSetViewports(1, &viewport);
+			target.OMSetRenderTargets(1, &rtv, dsv);
+			for (int i = 0; i < entityCount; i++)
+			{
+				int m = entityMaterials[i];
+				target.IASetInputLayout(layout);
+				target.VSSetShader(vs);
+				target.VSSetConstantBuffers(0, 1, &vsBuffer);
+				target.PSSetShader(ps);
+				target.PSSetConstantBuffers(0, 1, &psBuffer);
+				target.UpdateConstantBuffer(vsBuffer, &worlds[i], sizeof(XMFLOAT4X4));
+				XMFLOAT4 tint((float)m, 1, 1, 1);
+				target.UpdateConstantBuffer(psBuffer, &tint, sizeof(tint));
+				for (int t = 0; t < 4; t++)
+					target.PSSetShaderResources(t, 1, &textures[m][t]);
+				target.PSSetShaderResources(4, 1, &shadowSRV);
+				target.PSSetSamplers(0, 2, samplers);
+				meshes[entityMeshes[i]]->Draw(entityLods[i], true, &target);
+			}
+
+			ID3D11ShaderResourceView* nullSRVs[128] = {};
+			target.PSSetShaderResources(0, 128, nullSRVs);
+		};
+
+		auto callCount = [](const RenderStats& s, bool filtered)
+		{
+			unsigned int total = 0;
+			for (int c = 0; c < RENDER_CALL_COUNT; c++)
+				total += filtered ? s.filtered[c] : s.calls[c];
+			return total;
+		};
+
+		const int repeats = 20;
+		double best[2] = { DBL_MAX, DBL_MAX };
+		RenderStats direct = {}, cached = {}, reached = {};
+		uint64_t directHash = 0, cachedHash = 0;
+		for (int r = 0; r < repeats; r++)
+		{
+			PipelineRenderDevice directDevice;
+			double start = Now();
+			frame(directDevice);
+			best[0] = min(best[0], Now() - start);
+			direct = directDevice.GetStats();
+			directHash = directDevice.GetHash();
+
+			shared_ptr<PipelineRenderDevice> cachedDevice = make_shared<PipelineRenderDevice>();
+			StateCacheRenderDevice cache(cachedDevice);
+			start = Now();
+			frame(cache);
+			best[1] = min(best[1], Now() - start);
+			cached = cache.GetStats();
+			reached = cachedDevice->GetStats();
+			cachedHash = cachedDevice->GetHash();
+		}
+
+		printf("  %d ents, shadow and main pass drawn one entity at a time\n\n", entityCount);
+		printf("  %-10s %12s %10s %12s %10s\n", "", "Device calls", "Filtered", "Bytes", "CPU");
+		printf("  %-10s %12u %10u %12u %7.3f ms\n", "Direct", callCount(direct, false), 0u, direct.bytesUploaded, best[0] * 1000.0);
+		printf("  %-10s %12u %10u %12u %7.3f ms\n", "Cached", callCount(reached, false), callCount(cached, true), reached.bytesUploaded, best[1] * 1000.0);
+		const char* names[RENDER_CALL_COUNT] = { "topology", "input layout", "vertex buffers", "index buffer", "VS shader", "PS shader",
+			"VS constant buffers", "PS constant buffers", "VS resources", "PS resources", "VS samplers", "PS samplers", "constant uploads" };
+		printf("\n  Filtered by call:");
+		for (int c = 0; c < RENDER_CALL_UPDATE_BUFFER; c++)
+		{
+			if (cached.filtered[c])
+				printf(" %s %u,", names[c], cached.filtered[c]);
+		}
+		printf("\n\n  CPU: best of %d, the null device only counts and tracks calls, on D3D the dropped calls are the saving\n\n", repeats);
+
+		check("every draw sees the same state and constants through the cache", directHash == cachedHash);
+		check("same draws and indices", direct.drawCalls == reached.drawCalls && direct.indices == reached.indices);
+		check("every call either reaches the device or is counted as filtered",
+			callCount(reached, false) + callCount(cached, true) == callCount(direct, false) && callCount(cached, false) == callCount(reached, false));
+		check("redundant binds and uploads are dropped", callCount(cached, true) > 0 && callCount(reached, false) < callCount(direct, false));
+		check("disabled, every call goes through", [&]()
+		{
+			shared_ptr<PipelineRenderDevice> passDevice = make_shared<PipelineRenderDevice>();
+			StateCacheRenderDevice cache(passDevice);
+			cache.SetEnabled(false);
+			frame(cache);
+			return callCount(passDevice->GetStats(), false) == callCount(direct, false) && passDevice->GetHash() == directHash &&
+				callCount(cache.GetStats(), true) == 0;
+		}());
+		check("Invalidate() lets the next bind through", [&]()
+		{
+			shared_ptr<PipelineRenderDevice> invalidated = make_shared<PipelineRenderDevice>();
+			StateCacheRenderDevice cache(invalidated);
+			cache.VSSetShader(vs);
+			cache.VSSetShader(vs);
+			cache.Invalidate();
+			cache.VSSetShader(vs);
+			return invalidated->GetStats().calls[RENDER_CALL_VS_SET_SHADER] == 2 && cache.GetStats().filtered[RENDER_CALL_VS_SET_SHADER] == 1;
+		}());
+		check("slot ranges are cut down to the slots that change", [&]()
+		{
+			shared_ptr<PipelineRenderDevice> ranged = make_shared<PipelineRenderDevice>();
+			StateCacheRenderDevice cache(ranged);
+			cache.PSSetShaderResources(0, 4, textures[0]);
+			ID3D11ShaderResourceView* changed[4] = { textures[0][0], textures[0][1], textures[1][2], textures[0][3] };
+			cache.PSSetShaderResources(0, 4, changed);
+			return ranged->lastResourceStart == 2 && ranged->lastResourceCount == 1;
+		}());
+		check("new render targets forget what resources are bound", [&]()
+		{
+			shared_ptr<PipelineRenderDevice> targets = make_shared<PipelineRenderDevice>();
+			StateCacheRenderDevice cache(targets);
+			cache.PSSetShaderResources(0, 1, &shadowSRV);
+			cache.OMSetRenderTargets(1, &rtv, shadowDSV);
+			cache.PSSetShaderResources(0, 1, &shadowSRV);
+			cache.OMSetRenderTargets(1, &rtv, shadowDSV);
+			cache.PSSetShaderResources(0, 1, &shadowSRV);
+			return targets->GetStats().calls[RENDER_CALL_PS_SET_SHADER_RESOURCES] == 2 && cache.GetStats().filtered[RENDER_CALL_OM_SET_RENDER_TARGETS] == 1;
+		}());
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	int BenchmarkConstants(const char* args)
+	{
+		int entityCount = atoi(args);
+		if (entityCount <= 0) entityCount = 10000;
+		Checks check;
+
+		ComPtr<ID3D11Device> device = CreateWarpDevice();
+		if (!device)
+			return 1;
+		shared_ptr<NullRenderDevice> renderDevice = make_shared<NullRenderDevice>();
+		const wchar_t* models[] = { L"sphere.obj", L"cube.obj", L"helix.obj" };
+		shared_ptr<Mesh> meshes[3];
+		for (int m = 0; m < 3; m++)
+			meshes[m] = make_shared<Mesh>((FixPath(L"../../Assets/Models/") + models[m]).c_str(), device, renderDevice);
+		const unsigned int materialCount = 16;
+
+		// Every entity in both passes, sorted the way Game's render queue sorts them
+		srand(1);
+		vector<int> entityMeshes(entityCount), entityLods(entityCount);
+		vector<unsigned int> entityMaterials(entityCount);
+		RenderQueue queue;
+		for (int i = 0; i < entityCount; i++)
+		{
+			entityMeshes[i] = rand() % 3;
+			entityMaterials[i] = rand() % materialCount;
+			entityLods[i] = rand() % 4;
+			float depth = (float)rand() / RAND_MAX;
+			queue.Add(RenderQueue::MakeKey(RENDER_PASS_SHADOW, 0, 0, meshes[entityMeshes[i]]->GetSortId(), entityLods[i], depth), (unsigned int)i);
+			queue.Add(RenderQueue::MakeKey(RENDER_PASS_OPAQUE, 0, entityMaterials[i], meshes[entityMeshes[i]]->GetSortId(), entityLods[i], depth), (unsigned int)i);
+		}
+		queue.Sort();
+
+		// Bytes each shader's buffers held when every one carried the camera and light: the shadow vertex shader's world,
+		// view, projection and light matrices, the main one's world, worldIT, view, proj and light matrices, and the pixel
+		// shader's tint, camPos and light. Split up, the vertex shaders keep only their world matrices and the pixel
+		// shader its tint, the rest goes up once in FrameData
+		const UINT oldShadowBytes = 5 * 64, oldVertexBytes = 6 * 64, oldPixelBytes = 96;
+		const UINT shadowBytes = 64, vertexBytes = 2 * 64, pixelBytes = 16;
+		FrameConstants frameConstants(device, renderDevice);
+		FrameData frameData = {};
+
+		// Game::Draw's shadow and main passes, uploading each buffer when what's in it changes
+		unsigned int materialChanges = 0;
+		auto frame = [&](bool split)
+		{
+			materialChanges = 0;
+			if (split)
+				frameConstants.Update(frameData);
+			queue.Submit(RENDER_PASS_SHADOW, [&](unsigned int i, unsigned int changes)
+			{
+				if (changes & RENDER_CHANGE_SHADER)
+					renderDevice->VSSetConstantBuffers(0, 1, 0);
+				renderDevice->UpdateConstantBuffer(0, 0, split ? shadowBytes : oldShadowBytes);
+				meshes[entityMeshes[i]]->Draw(entityLods[i], (changes & RENDER_CHANGE_MESH) != 0);
+			});
+			queue.Submit(RENDER_PASS_OPAQUE, [&](unsigned int i, unsigned int changes)
+			{
+				if (changes & RENDER_CHANGE_SHADER)
+				{
+					renderDevice->VSSetConstantBuffers(0, 1, 0);
+					renderDevice->PSSetConstantBuffers(1, 1, 0);
+				}
+				if (changes & RENDER_CHANGE_MATERIAL)
+				{
+					renderDevice->UpdateConstantBuffer(0, 0, split ? pixelBytes : oldPixelBytes);
+					materialChanges++;
+				}
+				renderDevice->UpdateConstantBuffer(0, 0, split ? vertexBytes : oldVertexBytes);
+				meshes[entityMeshes[i]]->Draw(entityLods[i], (changes & RENDER_CHANGE_MESH) != 0);
+			});
+		};
+
+		const int repeats = 20;
+		RenderStats stats[2];
+		double best[2] = { DBL_MAX, DBL_MAX };
+		for (int r = 0; r < repeats; r++)
+		{
+			for (int way = 0; way < 2; way++)
+			{
+				renderDevice->ResetStats();
+				double start = Now();
+				frame(way == 1);
+				best[way] = min(best[way], Now() - start);
+				stats[way] = renderDevice->GetStats();
+			}
+		}
+
+		printf("  %d ents, %u materials, shadow and main pass, %u material changes a frame\n\n", entityCount, materialCount, materialChanges);
+		printf("  %-12s %10s %12s %12s %10s\n", "", "Uploads", "Bytes", "Bytes/draw", "CPU");
+		const char* names[2] = { "Every shader", "Split" };
+		for (int way = 0; way < 2; way++)
+		{
+			printf("  %-12s %10u %12u %12.1f %7.3f ms\n", names[way], stats[way].calls[RENDER_CALL_UPDATE_CONSTANT_BUFFER],
+				stats[way].bytesUploaded, (double)stats[way].bytesUploaded / stats[way].drawCalls, best[way] * 1000.0);
+		}
+		printf("\n  CPU: best of %d, the null device only counts calls, on D3D the bytes are what the driver copies\n\n", repeats);
+
+		check("FrameData packs like PerFrame in PerFrame.hlsli", sizeof(FrameData) == 336 && offsetof(FrameData, camPos) == 256 &&
+			offsetof(FrameData, dir) == 272);
+		check("same draws and indices", stats[0].drawCalls == stats[1].drawCalls && stats[0].indices == stats[1].indices);
+		check("the per-frame buffer is uploaded and bound once", stats[1].calls[RENDER_CALL_UPDATE_CONSTANT_BUFFER] ==
+			stats[0].calls[RENDER_CALL_UPDATE_CONSTANT_BUFFER] + 1 &&
+			stats[1].calls[RENDER_CALL_VS_SET_CONSTANT_BUFFERS] == stats[0].calls[RENDER_CALL_VS_SET_CONSTANT_BUFFERS] + 1 &&
+			stats[1].calls[RENDER_CALL_PS_SET_CONSTANT_BUFFERS] == stats[0].calls[RENDER_CALL_PS_SET_CONSTANT_BUFFERS] + 1);
+		check("fewer bytes uploaded a frame", stats[1].bytesUploaded < stats[0].bytesUploaded);
+		return check.failures == 0 ? 0 : 1;
+	}
+
+	struct Benchmark
+	{
+		const char* name;
+		int (*run)(const char* args);
+		const char* usage;
+	};
+
+	const Benchmark benchmarks[] =
+	{
+		{ "obj", BenchmarkObjImport, "obj [quads]      OBJ import MB/s vs the old loader on a generated grid" },
+		{ "weld", BenchmarkWeld, "weld             vertex count before and after welding for Assets/Models" },
+		{ "meshload", BenchmarkMeshLoad, "meshload         Mesh load time from OBJ vs from the binary cache" },
+		{ "meshopt", BenchmarkMeshOptimizer, "meshopt          ACMR/ATVR before and after MeshOptimizer for Assets/Models" },
+		{ "tangents", BenchmarkTangents, "tangents [quads] TangentGenerator vs the old scalar tangents, speed and match" },
+		{ "vertexpack", BenchmarkVertexPacking, "vertexpack       PackedVertex error bounds and speed for Assets/Models" },
+		{ "lod", BenchmarkLod, "lod [entities]   LOD chains and triangles drawn with and without LODs, demo and stress scene" },
+		{ "meshlets", BenchmarkMeshlets, "meshlets [views] meshlet sizes and triangles rejected by meshlet culling for Assets/Models" },
+		{ "bounds", BenchmarkBounds, "bounds [entities] mesh bounds speed and tightness, world bounds cost" },
+		{ "transforms", BenchmarkTransforms, "transforms [count] matrix updates one Transform at a time vs TransformStore, 1k/100k/1M, dirty tracking" },
+		{ "hierarchy", BenchmarkHierarchy, "hierarchy [nodes] deep, wide and random Transform trees vs recursion, checked against naive composition" },
+		{ "entities", BenchmarkEntities, "entities [count] Registry create/update/destroy vs a vector of fat entities, component churn" },
+		{ "jobs", BenchmarkJobs, "jobs [threads]   JobSystem correctness, job overhead and scaling from 1 thread to one per core" },
+		{ "frustum", BenchmarkFrustum, "frustum [boxes]  SIMD frustum culling vs one box at a time, single and multi-threaded, checked conservative" },
+		{ "shadows", BenchmarkShadows, "shadows [objects] shadow casters drawn with no culling, light volume culling and receiver-aware culling" },
+		{ "bvh", BenchmarkBvh, "bvh [objects]    BVH build, refit and sphere/box/ray/frustum queries vs brute force, rebuilds as objects move" },
+		{ "occlusion", BenchmarkOcclusion, "occlusion [objects] software occlusion culling of a city, checked against ray cast depth, thread scaling" },
+		{ "picking", BenchmarkPicking, "picking [rays]   mesh triangle BVH builds, single rays vs packets vs threads, scene picking and line of sight" },
+		{ "instancing", BenchmarkInstancing, "instancing [entities] per-entity draws vs instanced groups: device calls, draws, bytes uploaded, CPU time" },
+		{ "renderqueue", BenchmarkRenderQueue, "renderqueue [draws] radix sorted render queue keys vs std::stable_sort, state changes before and after" },
+		{ "commands", BenchmarkCommands, "commands [draws] main pass draws direct vs recorded into command buffers on every thread and replayed" },
+		{ "statecache", BenchmarkStateCache, "statecache [entities] calls a frame drawn one entity at a time makes with and without the redundant state filter" },
+		{ "constants", BenchmarkConstants, "constants [entities] constant bytes uploaded a frame with every shader carrying the camera and light vs a shared per-frame buffer" },
+	};
+}
+
+int RunBenchmark(const char* commandLine)
+{
+	// Print to the terminal we were started from if there is one (so scripts can capture
+	// the output), otherwise open a console and keep it up until the results are read
+	bool ownConsole = false;
+	if (AttachConsole(ATTACH_PARENT_PROCESS))
+	{
+		FILE* stream;
+		freopen_s(&stream, "CONOUT$", "w", stdout);
+		freopen_s(&stream, "CONOUT$", "w", stderr);
+	}
+	else if (!GetConsoleWindow())
+	{
+		DXCore::CreateConsoleWindow(500, 120, 32, 120);
+		ownConsole = true;
+	}
+
+	// First word picks the benchmark, the rest is its arguments
+	while (*commandLine == ' ') commandLine++;
+	size_t nameLength = strcspn(commandLine, " ");
+	int result = 1;
+	bool found = false;
+	for (const Benchmark& benchmark : benchmarks)
+	{
+		if (strlen(benchmark.name) == nameLength && strncmp(benchmark.name, commandLine, nameLength) == 0)
+		{
+			result = benchmark.run(commandLine + nameLength);
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+	{
+		printf("Usage: -bench <name> [args]\n");
+		for (const Benchmark& benchmark : benchmarks)
+			printf("  %s\n", benchmark.usage);
+	}
+
+	if (ownConsole)
+	{
+		printf("\nPress enter to exit\n");
+		getchar();
+	}
+	return result;
+}
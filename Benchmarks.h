@@ -0,0 +1,9 @@
+#pragma once
+
+/// <summary>
+/// <para>Runs one of the CPU benchmarks, picked with "-bench name [args]" on the command line</para>
+/// None of them need a window or GPU, results are printed to a console
+/// </summary>
+/// <param name="commandLine">- everything after "-bench"</param>
+/// <returns>Process exit code</returns>
+int RunBenchmark(const char* commandLine);
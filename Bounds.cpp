@@ -0,0 +1,225 @@
+#include "Bounds.h"
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	/// <summary>
+	/// Load a vertex position as x, y, z and whatever follows it in w
+	/// </summary>
+	inline XMVECTOR LoadPosition(const Vertex& vertex)
+	{
+		// Position is followed by the UV, so one unaligned 16 byte load stays inside the vertex
+		return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&vertex.Position));
+	}
+
+	/// <summary>
+	/// Move a box and sphere by one matrix, already loaded
+	/// </summary>
+	inline void TransformBounds(const Bounds& local, FXMMATRIX world, Bounds& result)
+	{
+		// The box's center moves like a point, its half size grows by how far each axis reaches along each world axis
+		XMVECTOR boxMin = XMLoadFloat3(&local.boxMin);
+		XMVECTOR boxMax = XMLoadFloat3(&local.boxMax);
+		XMVECTOR boxCenter = XMVectorScale(XMVectorAdd(boxMin, boxMax), 0.5f);
+		XMVECTOR halfSize = XMVectorScale(XMVectorSubtract(boxMax, boxMin), 0.5f);
+		XMVECTOR worldBoxCenter = XMVector3Transform(boxCenter, world);
+		XMVECTOR worldHalfSize = XMVectorMultiply(XMVectorSplatX(halfSize), XMVectorAbs(world.r[0]));
+		worldHalfSize = XMVectorMultiplyAdd(XMVectorSplatY(halfSize), XMVectorAbs(world.r[1]), worldHalfSize);
+		worldHalfSize = XMVectorMultiplyAdd(XMVectorSplatZ(halfSize), XMVectorAbs(world.r[2]), worldHalfSize);
+		XMStoreFloat3(&result.boxMin, XMVectorSubtract(worldBoxCenter, worldHalfSize));
+		XMStoreFloat3(&result.boxMax, XMVectorAdd(worldBoxCenter, worldHalfSize));
+
+		// The sphere stays a sphere if its radius grows by the largest axis scale
+		XMVECTOR scaleSq = XMVectorMax(XMVector3LengthSq(world.r[0]), XMVectorMax(XMVector3LengthSq(world.r[1]), XMVector3LengthSq(world.r[2])));
+		XMStoreFloat3(&result.center, XMVector3Transform(XMLoadFloat3(&local.center), world));
+		result.radius = local.radius * sqrtf(XMVectorGetX(scaleSq));
+	}
+
+	static_assert(sizeof(Bounds) == 10 * sizeof(float), "TransformBounds4 reads and writes Bounds as 10 packed floats");
+
+	/// <summary>
+	/// Swap four objects' copies of four floats into one vector per float, or back
+	/// </summary>
+	inline void Transpose4(XMVECTOR* v)
+	{
+		XMMATRIX m = XMMatrixTranspose(XMMATRIX(v[0], v[1], v[2], v[3]));
+		for (int i = 0; i < 4; i++)
+			v[i] = m.r[i];
+	}
+
+	/// <summary>
+	/// <para>TransformBounds for four objects at once</para>
+	/// Each vector holds one value of all four objects, so the box and sphere math is the scalar version's with no swizzles
+	/// </summary>
+	inline void TransformBounds4(const Bounds* local, const XMFLOAT4X4* worlds, Bounds* result)
+	{
+		// Bounds are 10 floats: boxMin, boxMax, center, radius. Three transposes turn them into lanes
+		XMVECTOR b[12];
+		for (int i = 0; i < 4; i++)
+		{
+			const float* f = &local[i].boxMin.x;
+			b[i] = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(f));
+			b[4 + i] = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(f + 4));
+			b[8 + i] = XMLoadFloat2(reinterpret_cast<const XMFLOAT2*>(f + 8));
+		}
+		Transpose4(b);
+		Transpose4(b + 4);
+		Transpose4(b + 8);
+		XMVECTOR boxMin[3] = { b[0], b[1], b[2] };
+		XMVECTOR boxMax[3] = { b[3], b[4], b[5] };
+		XMVECTOR center[3] = { b[6], b[7], b[8] };
+		XMVECTOR radius = b[9];
+
+		// m[row][col] holds element (row, col) of all four matrices
+		XMVECTOR m[4][4];
+		for (int row = 0; row < 4; row++)
+		{
+			for (int i = 0; i < 4; i++)
+				m[row][i] = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&worlds[i].m[row][0]));
+			Transpose4(m[row]);
+		}
+
+		// Same as the scalar version, one world axis at a time
+		XMVECTOR half = XMVectorReplicate(0.5f);
+		XMVECTOR boxCenter[3], halfSize[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			boxCenter[axis] = XMVectorMultiply(XMVectorAdd(boxMin[axis], boxMax[axis]), half);
+			halfSize[axis] = XMVectorMultiply(XMVectorSubtract(boxMax[axis], boxMin[axis]), half);
+		}
+		XMVECTOR out[12];
+		for (int col = 0; col < 3; col++)
+		{
+			XMVECTOR worldBoxCenter = XMVectorMultiplyAdd(boxCenter[2], m[2][col], m[3][col]);
+			worldBoxCenter = XMVectorMultiplyAdd(boxCenter[1], m[1][col], worldBoxCenter);
+			worldBoxCenter = XMVectorMultiplyAdd(boxCenter[0], m[0][col], worldBoxCenter);
+			XMVECTOR worldHalfSize = XMVectorMultiply(halfSize[0], XMVectorAbs(m[0][col]));
+			worldHalfSize = XMVectorMultiplyAdd(halfSize[1], XMVectorAbs(m[1][col]), worldHalfSize);
+			worldHalfSize = XMVectorMultiplyAdd(halfSize[2], XMVectorAbs(m[2][col]), worldHalfSize);
+			out[col] = XMVectorSubtract(worldBoxCenter, worldHalfSize);
+			out[3 + col] = XMVectorAdd(worldBoxCenter, worldHalfSize);
+
+			XMVECTOR worldCenter = XMVectorMultiplyAdd(center[2], m[2][col], m[3][col]);
+			worldCenter = XMVectorMultiplyAdd(center[1], m[1][col], worldCenter);
+			out[6 + col] = XMVectorMultiplyAdd(center[0], m[0][col], worldCenter);
+		}
+		XMVECTOR scaleSq[3];
+		for (int row = 0; row < 3; row++)
+		{
+			scaleSq[row] = XMVectorMultiply(m[row][0], m[row][0]);
+			scaleSq[row] = XMVectorMultiplyAdd(m[row][1], m[row][1], scaleSq[row]);
+			scaleSq[row] = XMVectorMultiplyAdd(m[row][2], m[row][2], scaleSq[row]);
+		}
+		out[9] = XMVectorMultiply(radius, XMVectorSqrt(XMVectorMax(scaleSq[0], XMVectorMax(scaleSq[1], scaleSq[2]))));
+		out[10] = out[11] = XMVectorZero();
+
+		Transpose4(out);
+		Transpose4(out + 4);
+		Transpose4(out + 8);
+		for (int i = 0; i < 4; i++)
+		{
+			float* f = &result[i].boxMin.x;
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(f), out[i]);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(f + 4), out[4 + i]);
+			XMStoreFloat2(reinterpret_cast<XMFLOAT2*>(f + 8), out[8 + i]);
+		}
+	}
+}
+
+/// <summary>
+/// Smallest box around vertex positions
+/// </summary>
+/// <param name="vertices">- the points to bound</param>
+/// <param name="vertexCount">- number of vertices, an empty set gets a box at the origin</param>
+/// <param name="boxMin">- output, lowest x, y and z</param>
+/// <param name="boxMax">- output, highest x, y and z</param>
+void BoundingVolumes::ComputeBox(const Vertex* vertices, int vertexCount, XMFLOAT3& boxMin, XMFLOAT3& boxMax)
+{
+	if (vertexCount <= 0)
+	{
+		boxMin = boxMax = XMFLOAT3(0, 0, 0);
+		return;
+	}
+
+	// Four independent min/max chains so the loop isn't waiting on the previous vertex's result
+	XMVECTOR vMin[4], vMax[4];
+	for (int k = 0; k < 4; k++)
+		vMin[k] = vMax[k] = LoadPosition(vertices[0]);
+	int i = 1;
+	for (; i + 4 <= vertexCount; i += 4)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			XMVECTOR p = LoadPosition(vertices[i + k]);
+			vMin[k] = XMVectorMin(vMin[k], p);
+			vMax[k] = XMVectorMax(vMax[k], p);
+		}
+	}
+	for (; i < vertexCount; i++)
+	{
+		XMVECTOR p = LoadPosition(vertices[i]);
+		vMin[0] = XMVectorMin(vMin[0], p);
+		vMax[0] = XMVectorMax(vMax[0], p);
+	}
+	XMStoreFloat3(&boxMin, XMVectorMin(XMVectorMin(vMin[0], vMin[1]), XMVectorMin(vMin[2], vMin[3])));
+	XMStoreFloat3(&boxMax, XMVectorMax(XMVectorMax(vMax[0], vMax[1]), XMVectorMax(vMax[2], vMax[3])));
+}
+
+/// <summary>
+/// <para>Box and sphere around vertex positions</para>
+/// The sphere is centered on the box and reaches exactly to the farthest vertex, which is never
+/// larger than the sphere around the box and usually a good deal smaller
+/// </summary>
+/// <param name="vertices">- the points to bound</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <returns>Bounds in the vertices' space</returns>
+Bounds BoundingVolumes::Compute(const Vertex* vertices, int vertexCount)
+{
+	Bounds bounds;
+	ComputeBox(vertices, vertexCount, bounds.boxMin, bounds.boxMax);
+	XMVECTOR center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&bounds.boxMin), XMLoadFloat3(&bounds.boxMax)), 0.5f);
+	XMStoreFloat3(&bounds.center, center);
+
+	XMVECTOR radiusSq[4] = { XMVectorZero(), XMVectorZero(), XMVectorZero(), XMVectorZero() };
+	int i = 0;
+	for (; i + 4 <= vertexCount; i += 4)
+		for (int k = 0; k < 4; k++)
+			radiusSq[k] = XMVectorMax(radiusSq[k], XMVector3LengthSq(XMVectorSubtract(LoadPosition(vertices[i + k]), center)));
+	for (; i < vertexCount; i++)
+		radiusSq[0] = XMVectorMax(radiusSq[0], XMVector3LengthSq(XMVectorSubtract(LoadPosition(vertices[i]), center)));
+	bounds.radius = sqrtf(XMVectorGetX(XMVectorMax(XMVectorMax(radiusSq[0], radiusSq[1]), XMVectorMax(radiusSq[2], radiusSq[3]))));
+	return bounds;
+}
+
+/// <summary>
+/// Move bounds into the world
+/// </summary>
+/// <param name="local">- object space bounds, such as Mesh::GetBounds()</param>
+/// <param name="world">- the object's world matrix</param>
+/// <returns>World space box and sphere around the transformed object</returns>
+Bounds BoundingVolumes::ToWorld(const Bounds& local, const XMFLOAT4X4& world)
+{
+	Bounds result;
+	TransformBounds(local, XMLoadFloat4x4(&world), result);
+	return result;
+}
+
+/// <summary>
+/// <para>Move the bounds of many objects into the world at once</para>
+/// Four objects go through together in SIMD lanes, whatever's left over goes one at a time
+/// </summary>
+/// <param name="local">- object space bounds, one per object</param>
+/// <param name="worlds">- world matrices, one per object</param>
+/// <param name="count">- number of objects</param>
+/// <param name="world">- output, count long, may not overlap local</param>
+void BoundingVolumes::ToWorld(const Bounds* local, const XMFLOAT4X4* worlds, size_t count, Bounds* world)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		TransformBounds4(local + i, worlds + i, world + i);
+	for (; i < count; i++)
+		TransformBounds(local[i], XMLoadFloat4x4(&worlds[i]), world[i]);
+}
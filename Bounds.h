@@ -0,0 +1,27 @@
+#pragma once
+#include <DirectXMath.h>
+#include "Vertex.h"
+
+/// <summary>
+/// A box and a sphere around the same points, in whatever space the points were in
+/// </summary>
+struct Bounds
+{
+	DirectX::XMFLOAT3 boxMin;
+	DirectX::XMFLOAT3 boxMax;
+	DirectX::XMFLOAT3 center; // sphere
+	float radius;
+};
+
+/// <summary>
+/// <para>Builds bounding volumes around vertices and moves them into the world</para>
+/// Transformed bounds are conservative: they always contain the transformed points, though they can be looser
+/// </summary>
+class BoundingVolumes
+{
+public:
+	static void ComputeBox(const Vertex* vertices, int vertexCount, DirectX::XMFLOAT3& boxMin, DirectX::XMFLOAT3& boxMax);
+	static Bounds Compute(const Vertex* vertices, int vertexCount);
+	static Bounds ToWorld(const Bounds& local, const DirectX::XMFLOAT4X4& world);
+	static void ToWorld(const Bounds* local, const DirectX::XMFLOAT4X4* worlds, size_t count, Bounds* world);
+};
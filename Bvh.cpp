@@ -0,0 +1,757 @@
+#include "Bvh.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	/// <returns>Half a box's surface area, all the SAH needs since only ratios of areas matter</returns>
+	inline float HalfArea(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)
+	{
+		float x = boxMax.x - boxMin.x, y = boxMax.y - boxMin.y, z = boxMax.z - boxMin.z;
+		return x * y + y * z + z * x;
+	}
+
+	inline float HalfArea(FXMVECTOR boxMin, FXMVECTOR boxMax)
+	{
+		XMFLOAT3 low, high;
+		XMStoreFloat3(&low, boxMin);
+		XMStoreFloat3(&high, boxMax);
+		return HalfArea(low, high);
+	}
+
+	/// <summary>
+	/// Test a box against the planes a traversal is still straddling
+	/// </summary>
+	/// <param name="planes">- bit per plane left to test, planes the box is entirely in front of are cleared</param>
+	/// <returns>False if the box is entirely behind one of the planes</returns>
+	inline bool ClipBox(const Frustum& frustum, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, unsigned int& planes)
+	{
+		float cx = (boxMin.x + boxMax.x) * 0.5f, cy = (boxMin.y + boxMax.y) * 0.5f, cz = (boxMin.z + boxMax.z) * 0.5f;
+		float ex = (boxMax.x - boxMin.x) * 0.5f, ey = (boxMax.y - boxMin.y) * 0.5f, ez = (boxMax.z - boxMin.z) * 0.5f;
+		for (unsigned int p = 0; p < 6; p++)
+		{
+			if (!(planes & (1u << p)))
+				continue;
+			const XMFLOAT4& plane = frustum.planes[p];
+			float distance = cx * plane.x + cy * plane.y + cz * plane.z + plane.w;
+			float reach = ex * fabsf(plane.x) + ey * fabsf(plane.y) + ez * fabsf(plane.z);
+			if (distance + reach < 0.0f)
+				return false;
+			if (distance - reach >= 0.0f)
+				planes &= ~(1u << p);
+		}
+		return true;
+	}
+
+	inline bool SphereTouchesBox(const XMFLOAT3& center, float radiusSq, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)
+	{
+		float x = center.x - fmaxf(boxMin.x, fminf(center.x, boxMax.x));
+		float y = center.y - fmaxf(boxMin.y, fminf(center.y, boxMax.y));
+		float z = center.z - fmaxf(boxMin.z, fminf(center.z, boxMax.z));
+		return x * x + y * y + z * z <= radiusSq;
+	}
+
+	inline bool BoxesOverlap(const XMFLOAT3& aMin, const XMFLOAT3& aMax, const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+	{
+		return aMin.x <= bMax.x && aMax.x >= bMin.x && aMin.y <= bMax.y && aMax.y >= bMin.y && aMin.z <= bMax.z && aMax.z >= bMin.z;
+	}
+
+	/// <summary>
+	/// Slab test, with the ray's direction already inverted. Axes the ray runs parallel to come out as infinities that fminf/fmaxf sort out
+	/// </summary>
+	/// <param name="enter">- output, how far along the ray it enters the box, 0 if it starts inside</param>
+	/// <returns>Whether the ray enters the box before maxDistance</returns>
+	inline bool RayHitsBox(const XMFLOAT3& origin, const XMFLOAT3& inverse, float maxDistance, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, float& enter)
+	{
+		float x1 = (boxMin.x - origin.x) * inverse.x, x2 = (boxMax.x - origin.x) * inverse.x;
+		float y1 = (boxMin.y - origin.y) * inverse.y, y2 = (boxMax.y - origin.y) * inverse.y;
+		float z1 = (boxMin.z - origin.z) * inverse.z, z2 = (boxMax.z - origin.z) * inverse.z;
+		float entry = fmaxf(fmaxf(fminf(x1, x2), fminf(y1, y2)), fmaxf(fminf(z1, z2), 0.0f));
+		float exit = fminf(fminf(fmaxf(x1, x2), fmaxf(y1, y2)), fminf(fmaxf(z1, z2), maxDistance));
+		enter = entry;
+		return entry <= exit;
+	}
+
+	inline XMFLOAT3 Inverse(const XMFLOAT3& direction)
+	{
+		return XMFLOAT3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	}
+}
+
+/// <summary>
+/// Build the tree from scratch, the items are the indices of bounds
+/// </summary>
+/// <param name="bounds">- world bounds of each item, only the boxes are used</param>
+/// <param name="count">- number of items</param>
+void Bvh::Build(const Bounds* bounds, size_t count)
+{
+	nodes.clear();
+	dirty.clear();
+	items.resize(count);
+	itemSlots.resize(count);
+	itemLeaves.resize(count);
+	weightedArea = 0;
+	builtCost = 0;
+	cullBoxes.Clear();
+	if (count == 0)
+	{
+		itemBoxes.clear();
+		parents.clear();
+		isDirty.clear();
+		return;
+	}
+
+	// Boxes stay in item order while the build shuffles slots around, then they're put in slot order
+	vector<Box> boxes(count);
+	vector<XMFLOAT3> centroids(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		items[i] = (unsigned int)i;
+		boxes[i] = { bounds[i].boxMin, bounds[i].boxMax };
+		XMStoreFloat3(&centroids[i], XMVectorScale(XMVectorAdd(XMLoadFloat3(&bounds[i].boxMin), XMLoadFloat3(&bounds[i].boxMax)), 0.5f));
+	}
+	itemBoxes.swap(boxes);
+	nodes.reserve(count * 2);
+	BuildNode(centroids, 0, count, 0);
+	itemBoxes.swap(boxes);
+	itemBoxes.resize(count);
+	for (size_t slot = 0; slot < count; slot++)
+	{
+		itemBoxes[slot] = boxes[items[slot]];
+		itemSlots[items[slot]] = (unsigned int)slot;
+		cullBoxes.Add(bounds[items[slot]]);
+	}
+
+	parents.resize(nodes.size());
+	parents[0] = 0;
+	for (unsigned int n = 0; n < nodes.size(); n++)
+	{
+		const BvhNode& node = nodes[n];
+		if (node.count)
+		{
+			for (unsigned int slot = node.index; slot < node.index + node.count; slot++)
+				itemLeaves[items[slot]] = n;
+		}
+		else
+		{
+			parents[n + 1] = n;
+			parents[node.index] = n;
+		}
+		weightedArea += NodeCost(n);
+	}
+	isDirty.assign(nodes.size(), 0);
+	builtCost = GetCost();
+}
+
+/// <summary>
+/// <para>Make the node for slots [begin, end) and everything under it</para>
+/// Centroids are binned along each axis and the split with the lowest surface area cost wins, if it beats
+/// leaving the items in a leaf. Past BVH_MAX_SAH_DEPTH splits go at the median so the depth stays bounded
+/// </summary>
+/// <returns>The node's index</returns>
+unsigned int Bvh::BuildNode(vector<XMFLOAT3>& centroids, size_t begin, size_t end, unsigned int depth)
+{
+	unsigned int index = (unsigned int)nodes.size();
+	nodes.push_back({});
+	XMVECTOR boxMin = XMVectorReplicate(FLT_MAX), boxMax = XMVectorReplicate(-FLT_MAX);
+	XMVECTOR centerMin = boxMin, centerMax = boxMax;
+	for (size_t slot = begin; slot < end; slot++)
+	{
+		unsigned int item = items[slot];
+		boxMin = XMVectorMin(boxMin, XMLoadFloat3(&itemBoxes[item].boxMin));
+		boxMax = XMVectorMax(boxMax, XMLoadFloat3(&itemBoxes[item].boxMax));
+		XMVECTOR centroid = XMLoadFloat3(&centroids[item]);
+		centerMin = XMVectorMin(centerMin, centroid);
+		centerMax = XMVectorMax(centerMax, centroid);
+	}
+	XMStoreFloat3(&nodes[index].boxMin, boxMin);
+	XMStoreFloat3(&nodes[index].boxMax, boxMax);
+	XMFLOAT3 low, high;
+	XMStoreFloat3(&low, centerMin);
+	XMStoreFloat3(&high, centerMax);
+
+	size_t count = end - begin, middle = begin;
+	if (count > 1 && depth < BVH_MAX_SAH_DEPTH)
+	{
+		// Costs in units of half areas, a leaf costs one test per item wherever the node's box is hit
+		float leafCost = count * HalfArea(boxMin, boxMax);
+		float bestCost = FLT_MAX;
+		int bestAxis = -1, bestBin = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float axisMin = (&low.x)[axis], extent = (&high.x)[axis] - axisMin;
+			if (extent <= 0.0f)
+				continue;
+			float scale = BVH_BINS / extent;
+			size_t binCounts[BVH_BINS] = {};
+			XMVECTOR binMin[BVH_BINS], binMax[BVH_BINS];
+			for (int b = 0; b < BVH_BINS; b++)
+				binMin[b] = XMVectorReplicate(FLT_MAX), binMax[b] = XMVectorReplicate(-FLT_MAX);
+			for (size_t slot = begin; slot < end; slot++)
+			{
+				unsigned int item = items[slot];
+				int b = min(BVH_BINS - 1, (int)(((&centroids[item].x)[axis] - axisMin) * scale));
+				binCounts[b]++;
+				binMin[b] = XMVectorMin(binMin[b], XMLoadFloat3(&itemBoxes[item].boxMin));
+				binMax[b] = XMVectorMax(binMax[b], XMLoadFloat3(&itemBoxes[item].boxMax));
+			}
+
+			// Sweep from the right keeping what's right of each split, then from the left pricing each split
+			float rightCost[BVH_BINS];
+			XMVECTOR sweepMin = XMVectorReplicate(FLT_MAX), sweepMax = XMVectorReplicate(-FLT_MAX);
+			size_t sweepCount = 0;
+			for (int b = BVH_BINS - 1; b > 0; b--)
+			{
+				sweepMin = XMVectorMin(sweepMin, binMin[b]);
+				sweepMax = XMVectorMax(sweepMax, binMax[b]);
+				sweepCount += binCounts[b];
+				rightCost[b] = sweepCount ? sweepCount * HalfArea(sweepMin, sweepMax) : 0.0f;
+			}
+			sweepMin = XMVectorReplicate(FLT_MAX), sweepMax = XMVectorReplicate(-FLT_MAX);
+			sweepCount = 0;
+			for (int b = 1; b < BVH_BINS; b++)
+			{
+				sweepMin = XMVectorMin(sweepMin, binMin[b - 1]);
+				sweepMax = XMVectorMax(sweepMax, binMax[b - 1]);
+				sweepCount += binCounts[b - 1];
+				if (sweepCount == 0 || sweepCount == count)
+					continue;
+				float cost = sweepCount * HalfArea(sweepMin, sweepMax) + rightCost[b];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+
+		if (bestAxis >= 0 && (bestCost + BVH_TRAVERSAL_COST * HalfArea(boxMin, boxMax) < leafCost || count > BVH_MAX_LEAF_ITEMS))
+		{
+			float axisMin = (&low.x)[bestAxis], scale = BVH_BINS / ((&high.x)[bestAxis] - axisMin);
+			middle = partition(items.begin() + begin, items.begin() + end, [&](unsigned int item)
+			{
+				return min(BVH_BINS - 1, (int)(((&centroids[item].x)[bestAxis] - axisMin) * scale)) < bestBin;
+			}) - items.begin();
+		}
+	}
+	else if (count > BVH_MAX_LEAF_ITEMS)
+	{
+		// Too deep for more SAH splits, halve along the widest spread of centroids
+		int axis = high.x - low.x >= high.y - low.y && high.x - low.x >= high.z - low.z ? 0 : high.y - low.y >= high.z - low.z ? 1 : 2;
+		middle = begin + count / 2;
+		nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, [&](unsigned int a, unsigned int b)
+		{
+			return (&centroids[a].x)[axis] < (&centroids[b].x)[axis];
+		});
+	}
+
+	// Every centroid in the same place: nothing to split on, but too many items for one leaf
+	if (middle == begin && count > BVH_MAX_LEAF_ITEMS)
+		middle = begin + count / 2;
+
+	if (middle == begin)
+	{
+		nodes[index].index = (unsigned int)begin;
+		nodes[index].count = (unsigned int)count;
+		return index;
+	}
+	BuildNode(centroids, begin, middle, depth + 1);
+	unsigned int second = BuildNode(centroids, middle, end, depth + 1);
+	nodes[index].index = second;
+	nodes[index].count = 0;
+	return index;
+}
+
+/// <summary>
+/// Shrink or grow a node's box to fit its items, or its children which must already fit theirs
+/// </summary>
+void Bvh::RefitNode(unsigned int n)
+{
+	BvhNode& node = nodes[n];
+	XMVECTOR boxMin, boxMax;
+	if (node.count)
+	{
+		boxMin = XMVectorReplicate(FLT_MAX), boxMax = XMVectorReplicate(-FLT_MAX);
+		for (unsigned int slot = node.index; slot < node.index + node.count; slot++)
+		{
+			boxMin = XMVectorMin(boxMin, XMLoadFloat3(&itemBoxes[slot].boxMin));
+			boxMax = XMVectorMax(boxMax, XMLoadFloat3(&itemBoxes[slot].boxMax));
+		}
+	}
+	else
+	{
+		const BvhNode& first = nodes[n + 1];
+		const BvhNode& second = nodes[node.index];
+		boxMin = XMVectorMin(XMLoadFloat3(&first.boxMin), XMLoadFloat3(&second.boxMin));
+		boxMax = XMVectorMax(XMLoadFloat3(&first.boxMax), XMLoadFloat3(&second.boxMax));
+	}
+	XMStoreFloat3(&node.boxMin, boxMin);
+	XMStoreFloat3(&node.boxMax, boxMax);
+}
+
+/// <returns>What the node adds to weightedArea: its area times the cost of visiting it, or of testing its items</returns>
+double Bvh::NodeCost(unsigned int n) const
+{
+	const BvhNode& node = nodes[n];
+	return (node.count ? (double)node.count : (double)BVH_TRAVERSAL_COST) * HalfArea(node.boxMin, node.boxMax);
+}
+
+/// <summary>
+/// Fit every node to new bounds for all items, children come after their parents so going backwards does children first
+/// </summary>
+/// <param name="bounds">- world bounds of each item, as many as the tree was built with</param>
+void Bvh::Refit(const Bounds* bounds)
+{
+	for (size_t slot = 0; slot < items.size(); slot++)
+	{
+		itemBoxes[slot] = { bounds[items[slot]].boxMin, bounds[items[slot]].boxMax };
+		cullBoxes.Set(slot, bounds[items[slot]]);
+	}
+	weightedArea = 0;
+	for (size_t n = nodes.size(); n-- > 0;)
+	{
+		RefitNode((unsigned int)n);
+		weightedArea += NodeCost((unsigned int)n);
+	}
+}
+
+/// <summary>
+/// Fit only the leaves of items that moved and the nodes above them
+/// </summary>
+/// <param name="bounds">- world bounds of each item, only the moved ones are read</param>
+/// <param name="moved">- items whose bounds changed</param>
+/// <param name="movedCount">- number of moved items</param>
+void Bvh::Refit(const Bounds* bounds, const unsigned int* moved, size_t movedCount)
+{
+	for (size_t i = 0; i < movedCount; i++)
+	{
+		unsigned int item = moved[i];
+		itemBoxes[itemSlots[item]] = { bounds[item].boxMin, bounds[item].boxMax };
+		cullBoxes.Set(itemSlots[item], bounds[item]);
+		for (unsigned int n = itemLeaves[item]; !isDirty[n]; n = parents[n])
+		{
+			isDirty[n] = 1;
+			dirty.push_back(n);
+			if (n == 0)
+				break;
+		}
+	}
+
+	// Highest index first is children before parents. Past a share of the tree, walking the flags backwards beats sorting
+	auto refit = [&](unsigned int n)
+	{
+		weightedArea -= NodeCost(n);
+		RefitNode(n);
+		weightedArea += NodeCost(n);
+		isDirty[n] = 0;
+	};
+	if (dirty.size() * BVH_SORTED_REFIT_SHARE < nodes.size())
+	{
+		sort(dirty.begin(), dirty.end(), greater<unsigned int>());
+		for (unsigned int n : dirty)
+			refit(n);
+	}
+	else
+	{
+		for (size_t n = nodes.size(); n-- > 0;)
+			if (isDirty[n])
+				refit((unsigned int)n);
+	}
+	dirty.clear();
+}
+
+/// <summary>
+/// Keep the tree in step with its items once a frame: refit what moved, rebuild if that made the tree too loose or items came or went
+/// </summary>
+/// <param name="bounds">- world bounds of each item</param>
+/// <param name="count">- number of items, a different count from last time rebuilds</param>
+/// <param name="moved">- items whose bounds changed since the last update</param>
+/// <param name="movedCount">- number of moved items</param>
+/// <returns>True if the tree was rebuilt</returns>
+bool Bvh::Update(const Bounds* bounds, size_t count, const unsigned int* moved, size_t movedCount)
+{
+	if (count != items.size())
+	{
+		Build(bounds, count);
+		return true;
+	}
+	Refit(bounds, moved, movedCount);
+	if (!NeedsRebuild())
+		return false;
+	Build(bounds, count);
+	return true;
+}
+
+/// <returns>Expected cost of a query by the surface area heuristic, in box tests per query that reaches the root</returns>
+float Bvh::GetCost() const
+{
+	if (nodes.empty())
+		return 0.0f;
+	float rootArea = HalfArea(nodes[0].boxMin, nodes[0].boxMax);
+	return rootArea > 0.0f ? (float)(weightedArea / rootArea) : 0.0f;
+}
+
+/// <summary>
+/// Both costs are areas divided by the root's area, so the check gives the same answer however large the world is
+/// </summary>
+/// <returns>Whether refitting has made the tree BVH_REBUILD_RATIO costlier than it was when built</returns>
+bool Bvh::NeedsRebuild() const
+{
+	return GetCost() > builtCost * BVH_REBUILD_RATIO;
+}
+
+/// <summary>
+/// The run of slots under a node, subtrees are built from a run of slots so its first and last leaf bracket it
+/// </summary>
+void Bvh::SubtreeSlots(unsigned int n, size_t& begin, size_t& end) const
+{
+	unsigned int first = n, last = n;
+	while (!nodes[first].count)
+		first = first + 1;
+	while (!nodes[last].count)
+		last = nodes[last].index;
+	begin = nodes[first].index;
+	end = nodes[last].index + nodes[last].count;
+}
+
+void Bvh::AppendFrustum(const Frustum& frustum, vector<unsigned int>& results) const
+{
+	if (nodes.empty())
+		return;
+	struct Entry { unsigned int node; unsigned int planes; };
+	Entry stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = { 0, 0x3f };
+	while (top > 0)
+	{
+		Entry entry = stack[--top];
+		const BvhNode& node = nodes[entry.node];
+		unsigned int planes = entry.planes;
+		if (!ClipBox(frustum, node.boxMin, node.boxMax, planes))
+			continue;
+		if (planes == 0)
+		{
+			// Entirely inside, everything under it is visible without another test
+			size_t begin, end;
+			SubtreeSlots(entry.node, begin, end);
+			results.insert(results.end(), items.begin() + begin, items.begin() + end);
+		}
+		else if (node.count)
+		{
+			// A leaf's items are a run of slots, so the culler tests them in lanes. Planes the leaf is entirely in front of
+			// pass every item anyway, so testing all six keeps the same items ClipBox() would
+			unsigned int visible[BVH_MAX_LEAF_ITEMS];
+			size_t visibleCount = FrustumCuller::Cull(frustum, cullBoxes, node.index, node.count, visible);
+			for (size_t i = 0; i < visibleCount; i++)
+				results.push_back(items[visible[i]]);
+		}
+		else
+		{
+			stack[top++] = { node.index, planes };
+			stack[top++] = { entry.node + 1, planes };
+		}
+	}
+}
+
+/// <summary>
+/// Walk down every node test() lets through and call found(slot) for each item box it lets through too
+/// </summary>
+template<typename Test, typename Found>
+void Bvh::Walk(Test test, Found found) const
+{
+	if (nodes.empty())
+		return;
+	unsigned int stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		unsigned int n = stack[--top];
+		const BvhNode& node = nodes[n];
+		if (!test(node.boxMin, node.boxMax))
+			continue;
+		if (node.count)
+		{
+			for (unsigned int slot = node.index; slot < node.index + node.count; slot++)
+				if (test(itemBoxes[slot].boxMin, itemBoxes[slot].boxMax))
+					found(slot);
+		}
+		else
+		{
+			stack[top++] = node.index;
+			stack[top++] = n + 1;
+		}
+	}
+}
+
+void Bvh::AppendSphere(XMFLOAT3 center, float radius, vector<unsigned int>& results) const
+{
+	float radiusSq = radius * radius;
+	Walk([&](const XMFLOAT3& boxMin, const XMFLOAT3& boxMax) { return SphereTouchesBox(center, radiusSq, boxMin, boxMax); },
+		[&](unsigned int slot) { results.push_back(items[slot]); });
+}
+
+void Bvh::AppendBox(XMFLOAT3 boxMin, XMFLOAT3 boxMax, vector<unsigned int>& results) const
+{
+	Walk([&](const XMFLOAT3& otherMin, const XMFLOAT3& otherMax) { return BoxesOverlap(boxMin, boxMax, otherMin, otherMax); },
+		[&](unsigned int slot) { results.push_back(items[slot]); });
+}
+
+void Bvh::AppendRay(const BvhRay& ray, vector<unsigned int>& results) const
+{
+	XMFLOAT3 inverse = Inverse(ray.direction);
+	float enter;
+	Walk([&](const XMFLOAT3& boxMin, const XMFLOAT3& boxMax) { return RayHitsBox(ray.origin, inverse, ray.maxDistance, boxMin, boxMax, enter); },
+		[&](unsigned int slot) { results.push_back(items[slot]); });
+}
+
+/// <summary>
+/// Items whose boxes are at least partly inside a frustum, the same ones FrustumCuller::Cull() keeps though not in the same order
+/// </summary>
+/// <param name="frustum">- planes in the same space as the items' bounds</param>
+/// <param name="results">- overwritten with the items found</param>
+void Bvh::QueryFrustum(const Frustum& frustum, vector<unsigned int>& results) const
+{
+	results.clear();
+	AppendFrustum(frustum, results);
+}
+
+/// <summary>
+/// Items whose boxes touch a sphere
+/// </summary>
+/// <param name="results">- overwritten with the items found</param>
+void Bvh::QuerySphere(XMFLOAT3 center, float radius, vector<unsigned int>& results) const
+{
+	results.clear();
+	AppendSphere(center, radius, results);
+}
+
+/// <summary>
+/// Items whose boxes overlap a box, touching counts
+/// </summary>
+/// <param name="results">- overwritten with the items found</param>
+void Bvh::QueryBox(XMFLOAT3 boxMin, XMFLOAT3 boxMax, vector<unsigned int>& results) const
+{
+	results.clear();
+	AppendBox(boxMin, boxMax, results);
+}
+
+/// <summary>
+/// Every item whose box a ray passes through before its max distance, in no particular order
+/// </summary>
+/// <param name="results">- overwritten with the items found</param>
+void Bvh::QueryRay(const BvhRay& ray, vector<unsigned int>& results) const
+{
+	results.clear();
+	AppendRay(ray, results);
+}
+
+/// <summary>
+/// The item whose box a ray enters first, nearer children are walked first and anything beyond the best hit so far is skipped
+/// </summary>
+BvhHit Bvh::Raycast(const BvhRay& ray) const
+{
+	BvhHit hit = { BVH_NO_ITEM, ray.maxDistance };
+	float enter;
+	if (nodes.empty() || !RayHitsBox(ray.origin, Inverse(ray.direction), ray.maxDistance, nodes[0].boxMin, nodes[0].boxMax, enter))
+		return hit;
+	XMFLOAT3 inverse = Inverse(ray.direction);
+	struct Entry { unsigned int node; float enter; };
+	Entry stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = { 0, enter };
+	while (top > 0)
+	{
+		Entry entry = stack[--top];
+		if (entry.enter > hit.distance)
+			continue;
+		const BvhNode& node = nodes[entry.node];
+		if (node.count)
+		{
+			for (unsigned int slot = node.index; slot < node.index + node.count; slot++)
+			{
+				if (RayHitsBox(ray.origin, inverse, hit.distance, itemBoxes[slot].boxMin, itemBoxes[slot].boxMax, enter) &&
+					(enter < hit.distance || hit.item == BVH_NO_ITEM))
+				{
+					hit.item = items[slot];
+					hit.distance = enter;
+				}
+			}
+			continue;
+		}
+
+		float firstEnter, secondEnter;
+		bool first = RayHitsBox(ray.origin, inverse, hit.distance, nodes[entry.node + 1].boxMin, nodes[entry.node + 1].boxMax, firstEnter);
+		bool second = RayHitsBox(ray.origin, inverse, hit.distance, nodes[node.index].boxMin, nodes[node.index].boxMax, secondEnter);
+		if (first && second)
+		{
+			// Nearer child on top so it's walked first
+			if (firstEnter <= secondEnter)
+			{
+				stack[top++] = { node.index, secondEnter };
+				stack[top++] = { entry.node + 1, firstEnter };
+			}
+			else
+			{
+				stack[top++] = { entry.node + 1, firstEnter };
+				stack[top++] = { node.index, secondEnter };
+			}
+		}
+		else if (first)
+			stack[top++] = { entry.node + 1, firstEnter };
+		else if (second)
+			stack[top++] = { node.index, secondEnter };
+	}
+	return hit;
+}
+
+template<typename Query>
+void Bvh::QueryBatch(size_t count, vector<unsigned int>& results, vector<unsigned int>& offsets, JobSystem* jobs, Query query) const
+{
+	results.clear();
+	offsets.assign(count + 1, 0);
+	size_t blocks = (count + BVH_QUERIES_PER_JOB - 1) / BVH_QUERIES_PER_JOB;
+	vector<vector<unsigned int>> blockResults(blocks);
+	auto runBlocks = [&](size_t begin, size_t end)
+	{
+		for (size_t block = begin; block < end; block++)
+		{
+			// Offsets are within the block's own results until they're strung together
+			vector<unsigned int>& found = blockResults[block];
+			for (size_t q = block * BVH_QUERIES_PER_JOB; q < count && q < (block + 1) * BVH_QUERIES_PER_JOB; q++)
+			{
+				query(q, found);
+				offsets[q + 1] = (unsigned int)found.size();
+			}
+		}
+	};
+	if (jobs)
+		jobs->ParallelFor(blocks, 1, runBlocks);
+	else
+		runBlocks(0, blocks);
+
+	for (size_t block = 0; block < blocks; block++)
+	{
+		unsigned int base = (unsigned int)results.size();
+		for (size_t q = block * BVH_QUERIES_PER_JOB; q < count && q < (block + 1) * BVH_QUERIES_PER_JOB; q++)
+			offsets[q + 1] += base;
+		results.insert(results.end(), blockResults[block].begin(), blockResults[block].end());
+	}
+}
+
+/// <summary>
+/// Many frustum queries at once, such as a camera's and a shadow map's, spread over the job system
+/// </summary>
+/// <param name="frusta">- planes in the same space as the items' bounds</param>
+/// <param name="count">- number of frusta</param>
+/// <param name="results">- overwritten with every frustum's items, one after the other</param>
+/// <param name="offsets">- overwritten, frustum i's items are results[offsets[i]] up to results[offsets[i + 1]]</param>
+/// <param name="jobs">- optional, 0 runs every query on the calling thread</param>
+void Bvh::QueryFrustums(const Frustum* frusta, size_t count, vector<unsigned int>& results, vector<unsigned int>& offsets, JobSystem* jobs) const
+{
+	QueryBatch(count, results, offsets, jobs, [&](size_t q, vector<unsigned int>& found)
+	{
+		AppendFrustum(frusta[q], found);
+	});
+}
+
+/// <summary>
+/// Many sphere queries at once, spread over the job system
+/// </summary>
+/// <param name="spheres">- center in x, y and z, radius in w</param>
+/// <param name="count">- number of spheres</param>
+/// <param name="results">- overwritten with every sphere's items, one after the other</param>
+/// <param name="offsets">- overwritten, sphere i's items are results[offsets[i]] up to results[offsets[i + 1]]</param>
+/// <param name="jobs">- optional, 0 runs every query on the calling thread</param>
+void Bvh::QuerySpheres(const XMFLOAT4* spheres, size_t count, vector<unsigned int>& results, vector<unsigned int>& offsets, JobSystem* jobs) const
+{
+	QueryBatch(count, results, offsets, jobs, [&](size_t q, vector<unsigned int>& found)
+	{
+		AppendSphere(XMFLOAT3(spheres[q].x, spheres[q].y, spheres[q].z), spheres[q].w, found);
+	});
+}
+
+/// <summary>
+/// Many box queries at once, spread over the job system
+/// </summary>
+/// <param name="boxes">- the boxes to look in, only boxMin and boxMax are used</param>
+/// <param name="count">- number of boxes</param>
+/// <param name="results">- overwritten with every box's items, one after the other</param>
+/// <param name="offsets">- overwritten, box i's items are results[offsets[i]] up to results[offsets[i + 1]]</param>
+/// <param name="jobs">- optional, 0 runs every query on the calling thread</param>
+void Bvh::QueryBoxes(const Bounds* boxes, size_t count, vector<unsigned int>& results, vector<unsigned int>& offsets, JobSystem* jobs) const
+{
+	QueryBatch(count, results, offsets, jobs, [&](size_t q, vector<unsigned int>& found)
+	{
+		AppendBox(boxes[q].boxMin, boxes[q].boxMax, found);
+	});
+}
+
+/// <summary>
+/// Many Raycast()s at once, spread over the job system
+/// </summary>
+/// <param name="hits">- output, one per ray</param>
+/// <param name="jobs">- optional, 0 runs every ray on the calling thread</param>
+void Bvh::Raycast(const BvhRay* rays, size_t count, BvhHit* hits, JobSystem* jobs) const
+{
+	auto castRays = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			hits[i] = Raycast(rays[i]);
+	};
+	if (jobs)
+		jobs->ParallelFor(count, BVH_QUERIES_PER_JOB, castRays);
+	else
+		castRays(0, count);
+}
+
+size_t Bvh::GetNodeCount() const
+{
+	return nodes.size();
+}
+
+size_t Bvh::GetItemCount() const
+{
+	return items.size();
+}
+
+/// <returns>Nodes on the longest path from the root to a leaf, 0 for an empty tree</returns>
+unsigned int Bvh::GetDepth() const
+{
+	if (nodes.empty())
+		return 0;
+	struct Entry { unsigned int node; unsigned int depth; };
+	Entry stack[BVH_STACK_SIZE];
+	int top = 0;
+	unsigned int deepest = 0;
+	stack[top++] = { 0, 1 };
+	while (top > 0)
+	{
+		Entry entry = stack[--top];
+		deepest = max(deepest, entry.depth);
+		if (!nodes[entry.node].count)
+		{
+			stack[top++] = { nodes[entry.node].index, entry.depth + 1 };
+			stack[top++] = { entry.node + 1, entry.depth + 1 };
+		}
+	}
+	return deepest;
+}
+
+/// <returns>The flattened tree, for walking it some other way than the queries here do</returns>
+const vector<BvhNode>& Bvh::GetNodes() const
+{
+	return nodes;
+}
+
+/// <returns>Item of each slot, a leaf's items are the run of slots from its index</returns>
+const vector<unsigned int>& Bvh::GetItems() const
+{
+	return items;
+}
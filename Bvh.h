@@ -0,0 +1,120 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "Bounds.h"
+#include "FrustumCuller.h"
+
+class JobSystem;
+
+// Buckets centroids are sorted into along each axis when looking for the cheapest split
+#define BVH_BINS 16
+// Leaves hold at most this many items, fewer when splitting them is cheaper
+#define BVH_MAX_LEAF_ITEMS 8
+// SAH cost of visiting a node, relative to testing one item's box
+#define BVH_TRAVERSAL_COST 1.0f
+// Below this depth nodes split at the median instead, keeping the tree shallow enough for the traversal stack
+#define BVH_MAX_SAH_DEPTH 48
+// Nodes a traversal can have waiting, the deepest tree the build makes needs fewer
+#define BVH_STACK_SIZE 96
+// Refit() sorts the nodes it has to fit while they're under one in this many of the tree, and walks the whole tree past that
+#define BVH_SORTED_REFIT_SHARE 16
+// Update() rebuilds once refitting has made the tree this much costlier than when it was built
+#define BVH_REBUILD_RATIO 1.5f
+// Queries each job of a batch runs
+#define BVH_QUERIES_PER_JOB 64
+// Item of a ray that hit nothing
+#define BVH_NO_ITEM 0xffffffffu
+
+/// <summary>
+/// One node of the flattened tree, two to a cache line. Nodes are in depth-first order: a node's first child
+/// is right after it, so a walk down the tree mostly reads forward
+/// </summary>
+struct BvhNode
+{
+	DirectX::XMFLOAT3 boxMin;
+	unsigned int index; // leaf: its first item's slot, interior: its second child
+	DirectX::XMFLOAT3 boxMax;
+	unsigned int count; // items in a leaf, 0 for interior nodes
+};
+
+struct BvhRay
+{
+	DirectX::XMFLOAT3 origin;
+	float maxDistance;
+	DirectX::XMFLOAT3 direction; // needn't be normalized, distances are in multiples of it
+};
+
+struct BvhHit
+{
+	unsigned int item; // BVH_NO_ITEM if the ray hit nothing
+	float distance; // along the ray to where it enters the item's box, 0 if it starts inside
+};
+
+/// <summary>
+/// <para>Bounding volume hierarchy over items' world space boxes, for finding what's in a region without looking at everything</para>
+/// Built top down with the surface area heuristic. Items that move are refitted in place, which keeps queries
+/// right but lets the tree get looser, so Update() rebuilds once it's BVH_REBUILD_RATIO costlier than when built.
+/// Items are the indices of the bounds passed to Build(), every query hands back those indices
+/// </summary>
+class Bvh
+{
+private:
+	struct Box
+	{
+		DirectX::XMFLOAT3 boxMin;
+		DirectX::XMFLOAT3 boxMax;
+	};
+	std::vector<BvhNode> nodes;
+	std::vector<unsigned int> items; // item of each slot, each leaf's items are a run of slots
+	std::vector<Box> itemBoxes; // box of each slot, so leaves read their boxes in order
+	CullBoxes cullBoxes; // the same boxes split into lanes, for testing a leaf's items against a frustum all at once
+	std::vector<unsigned int> itemSlots; // slot of each item
+	std::vector<unsigned int> itemLeaves; // leaf of each item
+	std::vector<unsigned int> parents; // of each node, the root's is itself
+	std::vector<unsigned int> dirty; // nodes waiting for a refit
+	std::vector<char> isDirty;
+	double weightedArea = 0; // every node's surface area times what visiting it costs, the SAH cost without dividing by the root's area
+	float builtCost = 0;
+
+	unsigned int BuildNode(std::vector<DirectX::XMFLOAT3>& centroids, size_t begin, size_t end, unsigned int depth);
+	void RefitNode(unsigned int node);
+	double NodeCost(unsigned int node) const;
+	void SubtreeSlots(unsigned int node, size_t& begin, size_t& end) const;
+	void AppendFrustum(const Frustum& frustum, std::vector<unsigned int>& results) const;
+	void AppendSphere(DirectX::XMFLOAT3 center, float radius, std::vector<unsigned int>& results) const;
+	void AppendBox(DirectX::XMFLOAT3 boxMin, DirectX::XMFLOAT3 boxMax, std::vector<unsigned int>& results) const;
+	void AppendRay(const BvhRay& ray, std::vector<unsigned int>& results) const;
+
+	template<typename Test, typename Found>
+	void Walk(Test test, Found found) const;
+
+	/// <summary>
+	/// Run count queries across the job system, each appending what it finds, and string the answers together in order
+	/// </summary>
+	template<typename Query>
+	void QueryBatch(size_t count, std::vector<unsigned int>& results, std::vector<unsigned int>& offsets, JobSystem* jobs, Query query) const;
+public:
+	void Build(const Bounds* bounds, size_t count);
+	void Refit(const Bounds* bounds);
+	void Refit(const Bounds* bounds, const unsigned int* moved, size_t movedCount);
+	bool Update(const Bounds* bounds, size_t count, const unsigned int* moved, size_t movedCount);
+	float GetCost() const;
+	bool NeedsRebuild() const;
+
+	void QueryFrustum(const Frustum& frustum, std::vector<unsigned int>& results) const;
+	void QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<unsigned int>& results) const;
+	void QueryBox(DirectX::XMFLOAT3 boxMin, DirectX::XMFLOAT3 boxMax, std::vector<unsigned int>& results) const;
+	void QueryRay(const BvhRay& ray, std::vector<unsigned int>& results) const;
+	BvhHit Raycast(const BvhRay& ray) const;
+
+	void QueryFrustums(const Frustum* frusta, size_t count, std::vector<unsigned int>& results, std::vector<unsigned int>& offsets, JobSystem* jobs = 0) const;
+	void QuerySpheres(const DirectX::XMFLOAT4* spheres, size_t count, std::vector<unsigned int>& results, std::vector<unsigned int>& offsets, JobSystem* jobs = 0) const;
+	void QueryBoxes(const Bounds* boxes, size_t count, std::vector<unsigned int>& results, std::vector<unsigned int>& offsets, JobSystem* jobs = 0) const;
+	void Raycast(const BvhRay* rays, size_t count, BvhHit* hits, JobSystem* jobs = 0) const;
+
+	size_t GetNodeCount() const;
+	size_t GetItemCount() const;
+	unsigned int GetDepth() const;
+	const std::vector<BvhNode>& GetNodes() const;
+	const std::vector<unsigned int>& GetItems() const;
+};
@@ -61,6 +61,12 @@ float Cam::GetAspRat()
 	return aspRat;
 }
 
+/// <returns>How far this cam sees</returns>
+float Cam::GetFarClip()
+{
+	return farClip;
+}
+
 /// <summary>
 /// Update the aspect ratio of this cam's projection matrix
 /// </summary>
@@ -25,6 +25,7 @@ public:
 	DirectX::XMFLOAT3 GetPos();
 	float GetFOV();
 	float GetAspRat();
+	float GetFarClip();
 	void UpdateProj(float);
 	void Move(float);
 };
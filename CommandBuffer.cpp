@@ -0,0 +1,360 @@
+#include "CommandBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+/// <summary>
+/// Append a command, counting it as if it had run
+/// </summary>
+/// <param name="type">- which call</param>
+/// <param name="object">- the call's one object, if it has one</param>
+/// <returns>The command, to fill in the rest of</returns>
+CommandBuffer::Command& CommandBuffer::Add(RenderCallType type, void* object)
+{
+	Count(type);
+	commands.push_back({ type, 0, {}, object });
+	return commands.back();
+}
+
+/// <summary>
+/// Make room for size bytes at the end of the payload, growing it if it's full
+/// </summary>
+/// <returns>Offset of the room</returns>
+UINT CommandBuffer::Allocate(size_t size)
+{
+	size_t offset = (payloadUsed + COMMAND_BUFFER_PAYLOAD_ALIGN - 1) & ~(size_t)(COMMAND_BUFFER_PAYLOAD_ALIGN - 1);
+	if (payload.empty() || offset + size > payload.size())
+		payload.resize(max(max(payload.size() * 2, offset + size), (size_t)COMMAND_BUFFER_PAYLOAD_START));
+	payloadUsed = offset + size;
+	return (UINT)offset;
+}
+
+/// <returns>Offset of a copy of data in the payload</returns>
+UINT CommandBuffer::Copy(const void* data, size_t size)
+{
+	UINT offset = Allocate(size);
+	memcpy(payload.data() + offset, data, size);
+	return offset;
+}
+
+/// <summary>
+/// Forget every recorded command and the stats, keeping the memory for the next recording
+/// </summary>
+void CommandBuffer::Reset()
+{
+	commands.clear();
+	payloadUsed = 0;
+	ResetStats();
+}
+
+/// <summary>
+/// Make every recorded call on another device, in the order they were recorded
+/// </summary>
+/// <param name="target">- usually the device wrapping the immediate context, or one wrapping a deferred context</param>
+void CommandBuffer::Replay(RenderDevice& target) const
+{
+	const unsigned char* data = payload.data();
+	for (const Command& command : commands)
+	{
+		const UINT* args = command.args;
+		const unsigned char* arrays = data + command.payload;
+		switch (command.type)
+		{
+		case RENDER_CALL_IA_SET_PRIMITIVE_TOPOLOGY:
+			target.IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)args[0]);
+			break;
+		case RENDER_CALL_IA_SET_INPUT_LAYOUT:
+			target.IASetInputLayout((ID3D11InputLayout*)command.object);
+			break;
+		case RENDER_CALL_IA_SET_VERTEX_BUFFERS:
+		{
+			// Buffers, then strides, then offsets
+			ID3D11Buffer* const* buffers = (ID3D11Buffer* const*)arrays;
+			const UINT* strides = (const UINT*)(arrays + sizeof(ID3D11Buffer*) * args[1]);
+			target.IASetVertexBuffers(args[0], args[1], buffers, strides, strides + args[1]);
+			break;
+		}
+		case RENDER_CALL_IA_SET_INDEX_BUFFER:
+			target.IASetIndexBuffer((ID3D11Buffer*)command.object, (DXGI_FORMAT)args[0], args[1]);
+			break;
+		case RENDER_CALL_VS_SET_SHADER:
+			target.VSSetShader((ID3D11VertexShader*)command.object);
+			break;
+		case RENDER_CALL_PS_SET_SHADER:
+			target.PSSetShader((ID3D11PixelShader*)command.object);
+			break;
+		case RENDER_CALL_VS_SET_CONSTANT_BUFFERS:
+			target.VSSetConstantBuffers(args[0], args[1], (ID3D11Buffer* const*)arrays);
+			break;
+		case RENDER_CALL_PS_SET_CONSTANT_BUFFERS:
+			target.PSSetConstantBuffers(args[0], args[1], (ID3D11Buffer* const*)arrays);
+			break;
+		case RENDER_CALL_VS_SET_SHADER_RESOURCES:
+			target.VSSetShaderResources(args[0], args[1], (ID3D11ShaderResourceView* const*)arrays);
+			break;
+		case RENDER_CALL_PS_SET_SHADER_RESOURCES:
+			target.PSSetShaderResources(args[0], args[1], (ID3D11ShaderResourceView* const*)arrays);
+			break;
+		case RENDER_CALL_VS_SET_SAMPLERS:
+			target.VSSetSamplers(args[0], args[1], (ID3D11SamplerState* const*)arrays);
+			break;
+		case RENDER_CALL_PS_SET_SAMPLERS:
+			target.PSSetSamplers(args[0], args[1], (ID3D11SamplerState* const*)arrays);
+			break;
+		case RENDER_CALL_UPDATE_CONSTANT_BUFFER:
+			target.UpdateConstantBuffer((ID3D11Buffer*)command.object, arrays, args[0]);
+			break;
+		case RENDER_CALL_UPDATE_BUFFER:
+			target.UpdateBuffer((ID3D11Buffer*)command.object, arrays, args[0]);
+			break;
+		case RENDER_CALL_RS_SET_STATE:
+			target.RSSetState((ID3D11RasterizerState*)command.object);
+			break;
+		case RENDER_CALL_RS_SET_VIEWPORTS:
+			target.RSSetViewports(args[0], (const D3D11_VIEWPORT*)arrays);
+			break;
+		case RENDER_CALL_OM_SET_RENDER_TARGETS:
+			target.OMSetRenderTargets(args[0], (ID3D11RenderTargetView* const*)arrays, (ID3D11DepthStencilView*)command.object);
+			break;
+		case RENDER_CALL_OM_SET_DEPTH_STENCIL_STATE:
+			target.OMSetDepthStencilState((ID3D11DepthStencilState*)command.object, args[0]);
+			break;
+		case RENDER_CALL_CLEAR_RENDER_TARGET_VIEW:
+			target.ClearRenderTargetView((ID3D11RenderTargetView*)command.object, (const float*)arrays);
+			break;
+		case RENDER_CALL_CLEAR_DEPTH_STENCIL_VIEW:
+		{
+			float depth;
+			memcpy(&depth, &args[1], sizeof(float));
+			target.ClearDepthStencilView((ID3D11DepthStencilView*)command.object, args[0], depth, (UINT8)args[2]);
+			break;
+		}
+		case RENDER_CALL_DRAW:
+			target.Draw(args[0], args[1]);
+			break;
+		case RENDER_CALL_DRAW_INDEXED:
+			target.DrawIndexed(args[0], args[1], (INT)args[2]);
+			break;
+		case RENDER_CALL_DRAW_INDEXED_INSTANCED:
+			target.DrawIndexedInstanced(args[0], args[1], args[2], (INT)args[3], args[4]);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/// <summary>
+/// Record a constant buffer update whose data is written in place, saving the copy UpdateConstantBuffer() makes
+/// </summary>
+/// <param name="buffer">- constant buffer to overwrite when replayed</param>
+/// <param name="size">- bytes of data</param>
+/// <returns>Where to write the data, only until the next call is recorded</returns>
+void* CommandBuffer::RecordConstantBuffer(ID3D11Buffer* buffer, UINT size)
+{
+	UINT offset = Allocate(size);
+	Command& command = Add(RENDER_CALL_UPDATE_CONSTANT_BUFFER, buffer);
+	command.payload = offset;
+	command.args[0] = size;
+	stats.bytesUploaded += size;
+	return payload.data() + offset;
+}
+
+/// <returns>Calls recorded since Reset()</returns>
+size_t CommandBuffer::GetCommandCount() const
+{
+	return commands.size();
+}
+
+/// <returns>Bytes the recorded commands and their payload take</returns>
+size_t CommandBuffer::GetByteCount() const
+{
+	return commands.size() * sizeof(Command) + payloadUsed;
+}
+
+ID3D11DeviceContext* CommandBuffer::GetContext()
+{
+	return nullptr;
+}
+
+void CommandBuffer::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	Add(RENDER_CALL_IA_SET_PRIMITIVE_TOPOLOGY).args[0] = (UINT)topology;
+}
+
+void CommandBuffer::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	Add(RENDER_CALL_IA_SET_INPUT_LAYOUT, inputLayout);
+}
+
+void CommandBuffer::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	UINT offset = Allocate((sizeof(ID3D11Buffer*) + 2 * sizeof(UINT)) * numBuffers);
+	memcpy(payload.data() + offset, buffers, sizeof(ID3D11Buffer*) * numBuffers);
+	memcpy(payload.data() + offset + sizeof(ID3D11Buffer*) * numBuffers, strides, sizeof(UINT) * numBuffers);
+	memcpy(payload.data() + offset + (sizeof(ID3D11Buffer*) + sizeof(UINT)) * numBuffers, offsets, sizeof(UINT) * numBuffers);
+	Command& command = Add(RENDER_CALL_IA_SET_VERTEX_BUFFERS);
+	command.payload = offset;
+	command.args[0] = startSlot;
+	command.args[1] = numBuffers;
+}
+
+void CommandBuffer::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	Command& command = Add(RENDER_CALL_IA_SET_INDEX_BUFFER, buffer);
+	command.args[0] = (UINT)format;
+	command.args[1] = offset;
+}
+
+void CommandBuffer::VSSetShader(ID3D11VertexShader* shader)
+{
+	Add(RENDER_CALL_VS_SET_SHADER, shader);
+}
+
+void CommandBuffer::PSSetShader(ID3D11PixelShader* shader)
+{
+	Add(RENDER_CALL_PS_SET_SHADER, shader);
+}
+
+void CommandBuffer::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	UINT offset = Copy(buffers, sizeof(ID3D11Buffer*) * numBuffers);
+	Command& command = Add(RENDER_CALL_VS_SET_CONSTANT_BUFFERS);
+	command.payload = offset;
+	command.args[0] = startSlot;
+	command.args[1] = numBuffers;
+}
+
+void CommandBuffer::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	UINT offset = Copy(buffers, sizeof(ID3D11Buffer*) * numBuffers);
+	Command& command = Add(RENDER_CALL_PS_SET_CONSTANT_BUFFERS);
+	command.payload = offset;
+	command.args[0] = startSlot;
+	command.args[1] = numBuffers;
+}
+
+void CommandBuffer::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+	UINT offset = Copy(views, sizeof(ID3D11ShaderResourceView*) * numViews);
+	Command& command = Add(RENDER_CALL_VS_SET_SHADER_RESOURCES);
+	command.payload = offset;
+	command.args[0] = startSlot;
+	command.args[1] = numViews;
+}
+
+void CommandBuffer::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+	UINT offset = Copy(views, sizeof(ID3D11ShaderResourceView*) * numViews);
+	Command& command = Add(RENDER_CALL_PS_SET_SHADER_RESOURCES);
+	command.payload = offset;
+	command.args[0] = startSlot;
+	command.args[1] = numViews;
+}
+
+void CommandBuffer::VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	UINT offset = Copy(samplers, sizeof(ID3D11SamplerState*) * numSamplers);
+	Command& command = Add(RENDER_CALL_VS_SET_SAMPLERS);
+	command.payload = offset;
+	command.args[0] = startSlot;
+	command.args[1] = numSamplers;
+}
+
+void CommandBuffer::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	UINT offset = Copy(samplers, sizeof(ID3D11SamplerState*) * numSamplers);
+	Command& command = Add(RENDER_CALL_PS_SET_SAMPLERS);
+	command.payload = offset;
+	command.args[0] = startSlot;
+	command.args[1] = numSamplers;
+}
+
+/// <summary>
+/// Record a constant buffer update, data is copied into the payload right away
+/// </summary>
+/// <param name="buffer">- constant buffer to overwrite when replayed</param>
+/// <param name="data">- new contents</param>
+/// <param name="size">- how many bytes data holds</param>
+void CommandBuffer::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	memcpy(RecordConstantBuffer(buffer, size), data, size);
+}
+
+void CommandBuffer::UpdateBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	UINT offset = Copy(data, size);
+	Command& command = Add(RENDER_CALL_UPDATE_BUFFER, buffer);
+	command.payload = offset;
+	command.args[0] = size;
+	stats.bytesUploaded += size;
+}
+
+void CommandBuffer::RSSetState(ID3D11RasterizerState* state)
+{
+	Add(RENDER_CALL_RS_SET_STATE, state);
+}
+
+void CommandBuffer::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports)
+{
+	UINT offset = Copy(viewports, sizeof(D3D11_VIEWPORT) * numViewports);
+	Command& command = Add(RENDER_CALL_RS_SET_VIEWPORTS);
+	command.payload = offset;
+	command.args[0] = numViewports;
+}
+
+void CommandBuffer::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	UINT offset = Copy(rtvs, sizeof(ID3D11RenderTargetView*) * numViews);
+	Command& command = Add(RENDER_CALL_OM_SET_RENDER_TARGETS, dsv);
+	command.payload = offset;
+	command.args[0] = numViews;
+}
+
+void CommandBuffer::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	Add(RENDER_CALL_OM_SET_DEPTH_STENCIL_STATE, state).args[0] = stencilRef;
+}
+
+void CommandBuffer::ClearRenderTargetView(ID3D11RenderTargetView* rtv, const float color[4])
+{
+	UINT offset = Copy(color, sizeof(float) * 4);
+	Add(RENDER_CALL_CLEAR_RENDER_TARGET_VIEW, rtv).payload = offset;
+}
+
+void CommandBuffer::ClearDepthStencilView(ID3D11DepthStencilView* dsv, UINT clearFlags, float depth, UINT8 stencil)
+{
+	Command& command = Add(RENDER_CALL_CLEAR_DEPTH_STENCIL_VIEW, dsv);
+	command.args[0] = clearFlags;
+	memcpy(&command.args[1], &depth, sizeof(float));
+	command.args[2] = stencil;
+}
+
+void CommandBuffer::Draw(UINT vertexCount, UINT startVertex)
+{
+	Command& command = Add(RENDER_CALL_DRAW);
+	command.args[0] = vertexCount;
+	command.args[1] = startVertex;
+	stats.indices += vertexCount;
+}
+
+void CommandBuffer::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	Command& command = Add(RENDER_CALL_DRAW_INDEXED);
+	command.args[0] = indexCount;
+	command.args[1] = startIndex;
+	command.args[2] = (UINT)baseVertex;
+	stats.indices += indexCount;
+}
+
+void CommandBuffer::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+{
+	Command& command = Add(RENDER_CALL_DRAW_INDEXED_INSTANCED);
+	command.args[0] = indexCount;
+	command.args[1] = instanceCount;
+	command.args[2] = startIndex;
+	command.args[3] = (UINT)baseVertex;
+	command.args[4] = startInstance;
+	stats.indices += indexCount * instanceCount;
+}
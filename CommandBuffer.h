@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include "RenderDevice.h"
+
+// Bytes of payload a command buffer starts with room for, it doubles whenever recording runs out
+#define COMMAND_BUFFER_PAYLOAD_START (64 * 1024)
+// Alignment of everything in the payload, enough for matrices
+#define COMMAND_BUFFER_PAYLOAD_ALIGN 16
+
+/// <summary>
+/// <para>Render device that records every call into flat arrays instead of running it, to be replayed later onto a real one</para>
+/// Each call is one fixed size command, what it points at (buffer lists, viewports, constant data) is copied into a
+/// payload arena and the command keeps its offset. Resetting keeps the memory, so a buffer recorded into every frame stops
+/// allocating once it has seen the biggest frame. A buffer belongs to one thread while recording, and any number of
+/// them can be recorded at once. Replaying only reads it.
+/// Nothing keeps the recorded objects alive, they have to outlive the replay
+/// </summary>
+class CommandBuffer : public RenderDevice
+{
+private:
+	struct Command
+	{
+		RenderCallType type;
+		UINT payload; // offset of what the command points at
+		UINT args[6]; // the call's numbers, in the order it takes them
+		void* object; // the call's one object, a buffer, shader or state
+	};
+	std::vector<Command> commands;
+	std::vector<unsigned char> payload;
+	size_t payloadUsed = 0;
+
+	Command& Add(RenderCallType type, void* object = 0);
+	UINT Allocate(size_t size);
+	UINT Copy(const void* data, size_t size);
+
+public:
+	void Reset();
+	void Replay(RenderDevice& target) const;
+	void* RecordConstantBuffer(ID3D11Buffer* buffer, UINT size);
+	size_t GetCommandCount() const;
+	size_t GetByteCount() const;
+
+	ID3D11DeviceContext* GetContext();
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY);
+	void IASetInputLayout(ID3D11InputLayout*);
+	void IASetVertexBuffers(UINT, UINT, ID3D11Buffer* const*, const UINT*, const UINT*);
+	void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT);
+	void VSSetShader(ID3D11VertexShader*);
+	void PSSetShader(ID3D11PixelShader*);
+	void VSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*);
+	void PSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*);
+	void VSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*);
+	void PSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*);
+	void VSSetSamplers(UINT, UINT, ID3D11SamplerState* const*);
+	void PSSetSamplers(UINT, UINT, ID3D11SamplerState* const*);
+	void UpdateConstantBuffer(ID3D11Buffer*, const void*, UINT);
+	void UpdateBuffer(ID3D11Buffer*, const void*, UINT);
+	void RSSetState(ID3D11RasterizerState*);
+	void RSSetViewports(UINT, const D3D11_VIEWPORT*);
+	void OMSetRenderTargets(UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*);
+	void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT);
+	void ClearRenderTargetView(ID3D11RenderTargetView*, const float[4]);
+	void ClearDepthStencilView(ID3D11DepthStencilView*, UINT, float, UINT8);
+	void Draw(UINT, UINT);
+	void DrawIndexed(UINT, UINT, INT);
+	void DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT);
+};
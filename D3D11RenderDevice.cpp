@@ -0,0 +1,233 @@
+#include "D3D11RenderDevice.h"
+#include "CommandBuffer.h"
+#include "JobSystem.h"
+#include <cstring>
+
+D3D11RenderDevice::D3D11RenderDevice(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->context = context;
+}
+
+ID3D11DeviceContext* D3D11RenderDevice::GetContext()
+{
+	return context.Get();
+}
+
+/// <summary>
+/// Choose how ExecuteCommandBuffers() replays: onto this context on the calling thread, or through deferred contexts on the job system
+/// </summary>
+void D3D11RenderDevice::SetDeferredContexts(bool deferredContexts)
+{
+	this->deferredContexts = deferredContexts;
+}
+
+/// <summary>
+/// <para>Replay recorded command buffers, in order, onto this context</para>
+/// Through deferred contexts, each buffer starts from the default pipeline state, so it has to set everything it
+/// draws with. This context's state is kept across the command lists. If a deferred context can't be made, the
+/// buffers are replayed directly instead
+/// </summary>
+/// <param name="buffers">- executed in this order</param>
+/// <param name="jobs">- optional, replays the buffers onto their deferred contexts on its threads</param>
+void D3D11RenderDevice::ExecuteCommandBuffers(const CommandBuffer* const* buffers, size_t count, JobSystem* jobs)
+{
+	if (!deferredContexts)
+	{
+		RenderDevice::ExecuteCommandBuffers(buffers, count, jobs);
+		return;
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	context->GetDevice(device.GetAddressOf());
+	while (deferredDevices.size() < count)
+	{
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> deferred;
+		if (FAILED(device->CreateDeferredContext(0, deferred.GetAddressOf())))
+		{
+			RenderDevice::ExecuteCommandBuffers(buffers, count, jobs);
+			return;
+		}
+		deferredDevices.push_back(std::make_shared<D3D11RenderDevice>(deferred));
+	}
+	commandLists.resize(count);
+
+	auto build = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			deferredDevices[i]->ResetStats();
+			buffers[i]->Replay(*deferredDevices[i]);
+			deferredDevices[i]->GetContext()->FinishCommandList(FALSE, commandLists[i].ReleaseAndGetAddressOf());
+		}
+	};
+	if (jobs)
+		jobs->ParallelFor(count, 1, build);
+	else
+		build(0, count);
+
+	// The calls counted on the deferred contexts are this device's
+	for (size_t i = 0; i < count; i++)
+	{
+		context->ExecuteCommandList(commandLists[i].Get(), TRUE);
+		commandLists[i].Reset();
+		RenderStats deferredStats = deferredDevices[i]->GetStats();
+		stats.drawCalls += deferredStats.drawCalls;
+		stats.indices += deferredStats.indices;
+		stats.bytesUploaded += deferredStats.bytesUploaded;
+		for (int call = 0; call < RENDER_CALL_COUNT; call++)
+			stats.calls[call] += deferredStats.calls[call];
+	}
+}
+
+void D3D11RenderDevice::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	Count(RENDER_CALL_IA_SET_PRIMITIVE_TOPOLOGY);
+	context->IASetPrimitiveTopology(topology);
+}
+
+void D3D11RenderDevice::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	Count(RENDER_CALL_IA_SET_INPUT_LAYOUT);
+	context->IASetInputLayout(inputLayout);
+}
+
+void D3D11RenderDevice::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	Count(RENDER_CALL_IA_SET_VERTEX_BUFFERS);
+	context->IASetVertexBuffers(startSlot, numBuffers, buffers, strides, offsets);
+}
+
+void D3D11RenderDevice::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	Count(RENDER_CALL_IA_SET_INDEX_BUFFER);
+	context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void D3D11RenderDevice::VSSetShader(ID3D11VertexShader* shader)
+{
+	Count(RENDER_CALL_VS_SET_SHADER);
+	context->VSSetShader(shader, 0, 0);
+}
+
+void D3D11RenderDevice::PSSetShader(ID3D11PixelShader* shader)
+{
+	Count(RENDER_CALL_PS_SET_SHADER);
+	context->PSSetShader(shader, 0, 0);
+}
+
+void D3D11RenderDevice::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	Count(RENDER_CALL_VS_SET_CONSTANT_BUFFERS);
+	context->VSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void D3D11RenderDevice::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	Count(RENDER_CALL_PS_SET_CONSTANT_BUFFERS);
+	context->PSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void D3D11RenderDevice::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+	Count(RENDER_CALL_VS_SET_SHADER_RESOURCES);
+	context->VSSetShaderResources(startSlot, numViews, views);
+}
+
+void D3D11RenderDevice::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+	Count(RENDER_CALL_PS_SET_SHADER_RESOURCES);
+	context->PSSetShaderResources(startSlot, numViews, views);
+}
+
+void D3D11RenderDevice::VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	Count(RENDER_CALL_VS_SET_SAMPLERS);
+	context->VSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+void D3D11RenderDevice::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	Count(RENDER_CALL_PS_SET_SAMPLERS);
+	context->PSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+/// <summary>
+/// Copy a whole constant buffer's worth of data to the GPU
+/// </summary>
+/// <param name="buffer">- constant buffer to overwrite</param>
+/// <param name="data">- new contents</param>
+/// <param name="size">- how many bytes data holds (only used for stats, D3D copies the whole buffer)</param>
+void D3D11RenderDevice::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	Count(RENDER_CALL_UPDATE_CONSTANT_BUFFER);
+	stats.bytesUploaded += size;
+	context->UpdateSubresource(buffer, 0, 0, data, 0, 0);
+}
+
+void D3D11RenderDevice::UpdateBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	Count(RENDER_CALL_UPDATE_BUFFER);
+	stats.bytesUploaded += size;
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, data, size);
+	context->Unmap(buffer, 0);
+}
+
+void D3D11RenderDevice::RSSetState(ID3D11RasterizerState* state)
+{
+	Count(RENDER_CALL_RS_SET_STATE);
+	context->RSSetState(state);
+}
+
+void D3D11RenderDevice::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports)
+{
+	Count(RENDER_CALL_RS_SET_VIEWPORTS);
+	context->RSSetViewports(numViewports, viewports);
+}
+
+void D3D11RenderDevice::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	Count(RENDER_CALL_OM_SET_RENDER_TARGETS);
+	context->OMSetRenderTargets(numViews, rtvs, dsv);
+}
+
+void D3D11RenderDevice::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	Count(RENDER_CALL_OM_SET_DEPTH_STENCIL_STATE);
+	context->OMSetDepthStencilState(state, stencilRef);
+}
+
+void D3D11RenderDevice::ClearRenderTargetView(ID3D11RenderTargetView* rtv, const float color[4])
+{
+	Count(RENDER_CALL_CLEAR_RENDER_TARGET_VIEW);
+	context->ClearRenderTargetView(rtv, color);
+}
+
+void D3D11RenderDevice::ClearDepthStencilView(ID3D11DepthStencilView* dsv, UINT clearFlags, float depth, UINT8 stencil)
+{
+	Count(RENDER_CALL_CLEAR_DEPTH_STENCIL_VIEW);
+	context->ClearDepthStencilView(dsv, clearFlags, depth, stencil);
+}
+
+void D3D11RenderDevice::Draw(UINT vertexCount, UINT startVertex)
+{
+	Count(RENDER_CALL_DRAW);
+	stats.indices += vertexCount;
+	context->Draw(vertexCount, startVertex);
+}
+
+void D3D11RenderDevice::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	Count(RENDER_CALL_DRAW_INDEXED);
+	stats.indices += indexCount;
+	context->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void D3D11RenderDevice::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+{
+	Count(RENDER_CALL_DRAW_INDEXED_INSTANCED);
+	stats.indices += indexCount * instanceCount;
+	context->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include "RenderDevice.h"
+
+/// <summary>
+/// <para>Render device that forwards every call straight to a D3D11 device context</para>
+/// With deferred contexts on, command buffers are each replayed onto a deferred context of their own, on the job
+/// system's threads, and the command lists that come out are executed in order on this one
+/// </summary>
+class D3D11RenderDevice : public RenderDevice
+{
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	bool deferredContexts = false;
+	std::vector<std::shared_ptr<D3D11RenderDevice>> deferredDevices; // one per command buffer, kept between frames
+	std::vector<Microsoft::WRL::ComPtr<ID3D11CommandList>> commandLists;
+public:
+	D3D11RenderDevice(Microsoft::WRL::ComPtr<ID3D11DeviceContext>);
+	ID3D11DeviceContext* GetContext();
+	void SetDeferredContexts(bool);
+	void ExecuteCommandBuffers(const CommandBuffer* const* buffers, size_t count, JobSystem* jobs = 0);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY);
+	void IASetInputLayout(ID3D11InputLayout*);
+	void IASetVertexBuffers(UINT, UINT, ID3D11Buffer* const*, const UINT*, const UINT*);
+	void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT);
+	void VSSetShader(ID3D11VertexShader*);
+	void PSSetShader(ID3D11PixelShader*);
+	void VSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*);
+	void PSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*);
+	void VSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*);
+	void PSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*);
+	void VSSetSamplers(UINT, UINT, ID3D11SamplerState* const*);
+	void PSSetSamplers(UINT, UINT, ID3D11SamplerState* const*);
+	void UpdateConstantBuffer(ID3D11Buffer*, const void*, UINT);
+	void UpdateBuffer(ID3D11Buffer*, const void*, UINT);
+	void RSSetState(ID3D11RasterizerState*);
+	void RSSetViewports(UINT, const D3D11_VIEWPORT*);
+	void OMSetRenderTargets(UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*);
+	void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT);
+	void ClearRenderTargetView(ID3D11RenderTargetView*, const float[4]);
+	void ClearDepthStencilView(ID3D11DepthStencilView*, UINT, float, UINT8);
+	void Draw(UINT, UINT);
+	void DrawIndexed(UINT, UINT, INT);
+	void DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT);
+};
@@ -1,5 +1,7 @@
 #include "DXCore.h"
 #include "Input.h"
+#include "D3D11RenderDevice.h"
+#include "NullRenderDevice.h"
 
 #include <dxgi1_5.h>
 #include <WindowsX.h>
@@ -58,7 +60,9 @@ DXCore::DXCore(
 	deltaTime(0),
 	startTime(0),
 	totalTime(0),
-	hWnd(0)
+	hWnd(0),
+	headless(false),
+	frameStats()
 {
 	// Save a static reference to this object.
 	//  - Since the OS-level message function must be a non-member (global) function, 
@@ -239,6 +243,10 @@ HRESULT DXCore::InitDirect3D()
 		context.GetAddressOf());	// Pointer to our Device Context pointer
 	if (FAILED(hr)) return hr;
 
+	// All per-frame drawing goes to the real context, past a cache that drops redundant state changes
+	stateCache = std::make_shared<StateCacheRenderDevice>(std::make_shared<D3D11RenderDevice>(context));
+	renderDevice = stateCache;
+
 	// Create the Render Target View for the back buffer render target
 	{
 		// The above function created the back buffer texture for us
@@ -307,6 +315,49 @@ HRESULT DXCore::InitDirect3D()
 	return S_OK;
 }
 
+// --------------------------------------------------------
+// Initializes everything needed to run the game loop
+// without a window or a GPU.
+//
+// - Resources (buffers, shaders, textures) are still created
+//   on a D3D device, but it's the WARP software device so no
+//   graphics hardware is needed
+// - Per-frame work goes to a NullRenderDevice, which only
+//   counts what it was asked to do
+// - This is still Windows only: WARP, the shader compiler,
+//   reflection and WIC texture loading all come with the
+//   Windows D3D runtime, and Game::Init needs every one of
+//   them. Only the per-frame calls are backend neutral
+// --------------------------------------------------------
+HRESULT DXCore::InitHeadless()
+{
+	headless = true;
+
+	// Results get printed, so make sure there's somewhere to print them
+	if (!GetConsoleWindow())
+		CreateConsoleWindow(500, 120, 32, 120);
+
+	// Input still gets polled by the game, so its key arrays must exist
+	Input::GetInstance().Initialize(0);
+
+	HRESULT hr = D3D11CreateDevice(
+		0,							// Default adapter
+		D3D_DRIVER_TYPE_WARP,		// Software device, only used to create resources
+		0,							// No software rasterizer module
+		0,							// No special options
+		0,							// No fallback feature levels
+		0,
+		D3D11_SDK_VERSION,
+		device.GetAddressOf(),
+		&dxFeatureLevel,
+		context.GetAddressOf());
+	if (FAILED(hr)) return hr;
+
+	stateCache = std::make_shared<StateCacheRenderDevice>(std::make_shared<NullRenderDevice>());
+	renderDevice = stateCache;
+	return S_OK;
+}
+
 // --------------------------------------------------------
 // When the window is resized, the underlying 
 // buffers (textures) must also be resized to match.
@@ -391,6 +442,9 @@ void DXCore::OnResize()
 	viewport.MaxDepth	= 1.0f;
 	context->RSSetViewports(1, &viewport);
 
+	// Those went straight to the context
+	if (stateCache) stateCache->Invalidate();
+
 	// Are we in a fullscreen state?
  	swapChain->GetFullscreenState(&isFullscreen, 0);
 }
@@ -437,8 +491,10 @@ HRESULT DXCore::Run()
 			Input::GetInstance().Update();
 
 			// The game loop
+			renderDevice->ResetStats();
 			Update(deltaTime, totalTime);
 			Draw(deltaTime, totalTime);
+			frameStats = renderDevice->GetStats();
 
 			// Frame is over, notify the input manager
 			Input::GetInstance().EndOfFrame();
@@ -450,6 +506,59 @@ HRESULT DXCore::Run()
 	return (HRESULT)msg.wParam;
 }
 
+// --------------------------------------------------------
+// Runs a fixed number of frames without a window, using a
+// fixed time step so every run does the same work, then
+// prints the average CPU cost and render device stats
+//
+// frameCount - How many frames to update and draw
+// --------------------------------------------------------
+HRESULT DXCore::RunHeadless(int frameCount)
+{
+	Init();
+
+	const float fixedDeltaTime = 1.0f / 60.0f;
+	__int64 cpuTicks = 0;
+	unsigned long long drawCalls = 0;
+	unsigned long long indices = 0;
+	unsigned long long bytesUploaded = 0;
+	unsigned long long deviceCalls = 0;
+
+	for (int i = 0; i < frameCount; i++)
+	{
+		deltaTime = fixedDeltaTime;
+		totalTime = fixedDeltaTime * (i + 1);
+
+		__int64 frameStart = 0;
+		__int64 frameEnd = 0;
+		renderDevice->ResetStats();
+		QueryPerformanceCounter((LARGE_INTEGER*)&frameStart);
+		Update(deltaTime, totalTime);
+		Draw(deltaTime, totalTime);
+		QueryPerformanceCounter((LARGE_INTEGER*)&frameEnd);
+		Input::GetInstance().EndOfFrame();
+
+		cpuTicks += frameEnd - frameStart;
+		frameStats = renderDevice->GetStats();
+		drawCalls += frameStats.drawCalls;
+		indices += frameStats.indices;
+		bytesUploaded += frameStats.bytesUploaded;
+		for (int c = 0; c < RENDER_CALL_COUNT; c++) deviceCalls += frameStats.calls[c];
+	}
+
+	if (frameCount > 0)
+	{
+		double frames = (double)frameCount;
+		printf("Headless run: %d frames\n", frameCount);
+		printf("  CPU ms/frame:         %.4f\n", cpuTicks * perfCounterSeconds * 1000.0 / frames);
+		printf("  Draw calls/frame:     %.1f\n", drawCalls / frames);
+		printf("  Indices/frame:        %.1f\n", indices / frames);
+		printf("  Bytes uploaded/frame: %.1f\n", bytesUploaded / frames);
+		printf("  Device calls/frame:   %.1f\n", deviceCalls / frames);
+	}
+	return S_OK;
+}
+
 
 // --------------------------------------------------------
 // Sends an OS-level window close message to our process, which
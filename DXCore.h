@@ -3,7 +3,10 @@
 #include <Windows.h>
 #include <d3d11.h>
 #include <string>
+#include <memory>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include "RenderDevice.h"
+#include "StateCacheRenderDevice.h"
 
 // We can include the correct library files here
 // instead of in Visual Studio settings if we want
@@ -37,7 +40,9 @@ public:
 	// Initialization and game-loop related methods
 	HRESULT InitWindow();
 	HRESULT InitDirect3D();
+	HRESULT InitHeadless();
 	HRESULT Run();
+	HRESULT RunHeadless(int frameCount);
 	void Quit();
 	virtual void OnResize();
 
@@ -46,6 +51,9 @@ public:
 	virtual void Update(float deltaTime, float totalTime) = 0;
 	virtual void Draw(float deltaTime, float totalTime) = 0;
 
+	// Helper function for allocating a console window
+	static void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
+
 protected:
 	HINSTANCE		hInstance;		// The handle to the application
 	HWND			hWnd;			// The handle to the window itself
@@ -75,8 +83,12 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV;
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV;
 
-	// Helper function for allocating a console window
-	void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
+	// Everything drawn per frame goes through this instead of the context,
+	// which lets us swap in a null device and run without a GPU or window
+	std::shared_ptr<RenderDevice> renderDevice;
+	std::shared_ptr<StateCacheRenderDevice> stateCache; // renderDevice, dropping calls that bind what's already bound
+	bool headless;
+	RenderStats frameStats; // What the last complete frame asked the render device to do
 
 private:
 	// Timing related data
@@ -0,0 +1,31 @@
+#include "FrameConstants.h"
+
+/// <param name="device">- creates the buffer</param>
+/// <param name="renderDevice">- uploads to and binds it every frame</param>
+FrameConstants::FrameConstants(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice)
+{
+	this->renderDevice = renderDevice;
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.ByteWidth = sizeof(FrameData);
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+}
+
+/// <summary>
+/// Upload this frame's data and bind it, once before anything is drawn
+/// </summary>
+void FrameConstants::Update(const FrameData& data)
+{
+	renderDevice->UpdateConstantBuffer(buffer.Get(), &data, sizeof(FrameData));
+	Bind(*renderDevice);
+}
+
+/// <summary>
+/// Bind the buffer to both stages of another device, like a command buffer that may start from nothing bound
+/// </summary>
+void FrameConstants::Bind(RenderDevice& target)
+{
+	target.VSSetConstantBuffers(FRAME_CONSTANTS_REGISTER, 1, buffer.GetAddressOf());
+	target.PSSetConstantBuffers(FRAME_CONSTANTS_REGISTER, 1, buffer.GetAddressOf());
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <memory>
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include "RenderDevice.h"
+#include "Lights.h"
+
+// Register the per-frame constant buffer is bound to in every stage, PerFrame in PerFrame.hlsli
+#define FRAME_CONSTANTS_REGISTER 13
+
+/// <summary>
+/// What every shader reads from PerFrame.hlsli, laid out the way HLSL packs it: the light starts a new 16 byte row
+/// </summary>
+struct FrameData
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 proj;
+	DirectX::XMFLOAT4X4 lightView;
+	DirectX::XMFLOAT4X4 lightProjection;
+	DirectX::XMFLOAT3 camPos;
+	float padding;
+	Light dir;
+};
+static_assert(sizeof(FrameData) % 16 == 0, "Constant buffers are whole 16 byte rows");
+
+/// <summary>
+/// <para>The one constant buffer every shader shares for the camera, shadow map and lights</para>
+/// It's uploaded once a frame and bound to FRAME_CONSTANTS_REGISTER of the vertex and pixel stages. Shaders made with it
+/// as their shared buffer register leave that register alone, so their own buffers only carry
+/// what changes per material or per draw
+/// </summary>
+class FrameConstants
+{
+private:
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	std::shared_ptr<RenderDevice> renderDevice;
+
+public:
+	FrameConstants(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice);
+	void Update(const FrameData& data);
+	void Bind(RenderDevice& target);
+};
@@ -0,0 +1,394 @@
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#ifdef _XM_AVX_INTRINSICS_
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	/// <summary>
+	/// Four boxes at a time in XMVECTORs, works wherever DirectXMath does
+	/// </summary>
+	struct Lanes4
+	{
+		typedef XMVECTOR V;
+		static const size_t Width = 4;
+		static V Load(const float* p) { return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(p)); }
+		static V Gather(const float* p, const unsigned int* i) { return XMVectorSet(p[i[0]], p[i[1]], p[i[2]], p[i[3]]); }
+		static V Splat(float f) { return XMVectorReplicate(f); }
+		static V Add(V a, V b) { return XMVectorAdd(a, b); }
+		static V Mul(V a, V b) { return XMVectorMultiply(a, b); }
+		static V Less(V a, V b) { return XMVectorLess(a, b); }
+		static V Or(V a, V b) { return XMVectorOrInt(a, b); }
+
+		/// <returns>One bit per lane whose comparison came out true, lane 0 in bit 0</returns>
+		static unsigned int Mask(V v)
+		{
+#ifdef _XM_SSE_INTRINSICS_
+			return (unsigned int)_mm_movemask_ps(v);
+#else
+			uint32_t lanes[4];
+			XMStoreInt4(lanes, v);
+			return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+#endif
+		}
+	};
+
+#ifdef _XM_AVX_INTRINSICS_
+	/// <summary>
+	/// Eight boxes at a time in AVX registers, only built when the compiler targets AVX
+	/// </summary>
+	struct Lanes8
+	{
+		typedef __m256 V;
+		static const size_t Width = 8;
+		static V Load(const float* p) { return _mm256_loadu_ps(p); }
+		static V Gather(const float* p, const unsigned int* i)
+		{
+			return _mm256_setr_ps(p[i[0]], p[i[1]], p[i[2]], p[i[3]], p[i[4]], p[i[5]], p[i[6]], p[i[7]]);
+		}
+		static V Splat(float f) { return _mm256_set1_ps(f); }
+		static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V Less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static V Or(V a, V b) { return _mm256_or_ps(a, b); }
+		static unsigned int Mask(V v) { return (unsigned int)_mm256_movemask_ps(v); }
+	};
+	typedef Lanes8 Lanes;
+#else
+	typedef Lanes4 Lanes;
+#endif
+
+	/// <summary>
+	/// <para>Whether a box is entirely behind one of the planes</para>
+	/// The box reaches toward a plane by its half size along each axis times how much the normal points down that axis.
+	/// The lanes do the same sums in the same order, so both ways always agree
+	/// </summary>
+	inline bool IsOutside(const Frustum& frustum, float cx, float cy, float cz, float ex, float ey, float ez)
+	{
+		for (const XMFLOAT4& plane : frustum.planes)
+		{
+			float distance = cx * plane.x + cy * plane.y + cz * plane.z + plane.w;
+			float reach = ex * fabsf(plane.x) + ey * fabsf(plane.y) + ez * fabsf(plane.z);
+			if (distance + reach < 0.0f)
+				return true;
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Clip a box in the light's clip space to the shadow map and turn it into planes around the casters that can shade it
+	/// </summary>
+	/// <param name="toClip">- light view * light projection</param>
+	/// <param name="low">- lowest corner of what receives shadows, in light clip space</param>
+	/// <param name="high">- highest corner</param>
+	/// <returns>False if the box misses the shadow map</returns>
+	bool CasterFrustum(FXMMATRIX toClip, FXMVECTOR low, FXMVECTOR high, Frustum& casters)
+	{
+		// Receivers only pick up shadows from inside the map, x and y run -1 to 1 and depth 0 to 1
+		XMFLOAT3 receiverMin, receiverMax;
+		XMStoreFloat3(&receiverMin, XMVectorMax(low, XMVectorSet(-1.0f, -1.0f, 0.0f, 0.0f)));
+		XMStoreFloat3(&receiverMax, XMVectorMin(high, XMVectorSet(1.0f, 1.0f, 1.0f, 0.0f)));
+		if (receiverMin.x > receiverMax.x || receiverMin.y > receiverMax.y || receiverMin.z > receiverMax.z)
+			return false;
+		receiverMax.x = fmaxf(receiverMax.x, receiverMin.x + FRUSTUM_CASTER_MIN_SIZE);
+		receiverMax.y = fmaxf(receiverMax.y, receiverMin.y + FRUSTUM_CASTER_MIN_SIZE);
+		receiverMax.z = fmaxf(receiverMax.z, FRUSTUM_CASTER_MIN_SIZE);
+
+		// Squeeze the caster box to the whole clip volume and its planes come out of the combined matrix like a camera's
+		XMMATRIX toCasterBox = XMMatrixOrthographicOffCenterLH(receiverMin.x, receiverMax.x, receiverMin.y, receiverMax.y, 0.0f, receiverMax.z);
+		casters = FrustumCuller::ExtractPlanes(toClip * toCasterBox);
+		return true;
+	}
+
+	/// <summary>
+	/// Test boxes Width at a time, appending the ones that pass to visible without branching on each lane
+	/// </summary>
+	/// <param name="i">- first box, left at the first box of the tail too short for a whole set of lanes</param>
+	/// <param name="candidates">- optional, box indices to test, i and end then count through this list instead of the boxes</param>
+	/// <returns>Indices written</returns>
+	template<typename L>
+	size_t CullLanes(const Frustum& frustum, const CullBoxes& boxes, size_t& i, size_t end, const unsigned int* candidates, unsigned int* visible)
+	{
+		typedef typename L::V V;
+		V nx[6], ny[6], nz[6], d[6], ax[6], ay[6], az[6];
+		for (int p = 0; p < 6; p++)
+		{
+			const XMFLOAT4& plane = frustum.planes[p];
+			nx[p] = L::Splat(plane.x), ny[p] = L::Splat(plane.y), nz[p] = L::Splat(plane.z), d[p] = L::Splat(plane.w);
+			ax[p] = L::Splat(fabsf(plane.x)), ay[p] = L::Splat(fabsf(plane.y)), az[p] = L::Splat(fabsf(plane.z));
+		}
+		V zero = L::Splat(0.0f);
+
+		size_t written = 0;
+		for (; i + L::Width <= end; i += L::Width)
+		{
+			V cx, cy, cz, ex, ey, ez;
+			if (candidates)
+			{
+				const unsigned int* lanes = candidates + i;
+				cx = L::Gather(boxes.centerX.data(), lanes), cy = L::Gather(boxes.centerY.data(), lanes), cz = L::Gather(boxes.centerZ.data(), lanes);
+				ex = L::Gather(boxes.extentX.data(), lanes), ey = L::Gather(boxes.extentY.data(), lanes), ez = L::Gather(boxes.extentZ.data(), lanes);
+			}
+			else
+			{
+				cx = L::Load(&boxes.centerX[i]), cy = L::Load(&boxes.centerY[i]), cz = L::Load(&boxes.centerZ[i]);
+				ex = L::Load(&boxes.extentX[i]), ey = L::Load(&boxes.extentY[i]), ez = L::Load(&boxes.extentZ[i]);
+			}
+			V outside = zero;
+			for (int p = 0; p < 6; p++)
+			{
+				V distance = L::Add(L::Add(L::Add(L::Mul(cx, nx[p]), L::Mul(cy, ny[p])), L::Mul(cz, nz[p])), d[p]);
+				V reach = L::Add(L::Add(L::Mul(ex, ax[p]), L::Mul(ey, ay[p])), L::Mul(ez, az[p]));
+				outside = L::Or(outside, L::Less(L::Add(distance, reach), zero));
+			}
+
+			// Every lane's index is written, only the visible ones move the end of the list on
+			unsigned int inside = ~L::Mask(outside);
+			for (size_t lane = 0; lane < L::Width; lane++)
+			{
+				visible[written] = candidates ? candidates[i + lane] : (unsigned int)(i + lane);
+				written += (inside >> lane) & 1;
+			}
+		}
+		return written;
+	}
+}
+
+void CullBoxes::Clear()
+{
+	centerX.clear(); centerY.clear(); centerZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+/// <summary>
+/// Add a box at the end, its index is the number of boxes before it
+/// </summary>
+void CullBoxes::Add(const Bounds& bounds)
+{
+	centerX.push_back((bounds.boxMin.x + bounds.boxMax.x) * 0.5f);
+	centerY.push_back((bounds.boxMin.y + bounds.boxMax.y) * 0.5f);
+	centerZ.push_back((bounds.boxMin.z + bounds.boxMax.z) * 0.5f);
+	extentX.push_back((bounds.boxMax.x - bounds.boxMin.x) * 0.5f);
+	extentY.push_back((bounds.boxMax.y - bounds.boxMin.y) * 0.5f);
+	extentZ.push_back((bounds.boxMax.z - bounds.boxMin.z) * 0.5f);
+}
+
+/// <summary>
+/// Replace the box at an index, for boxes kept from frame to frame and only changed where things moved
+/// </summary>
+void CullBoxes::Set(size_t index, const Bounds& bounds)
+{
+	centerX[index] = (bounds.boxMin.x + bounds.boxMax.x) * 0.5f;
+	centerY[index] = (bounds.boxMin.y + bounds.boxMax.y) * 0.5f;
+	centerZ[index] = (bounds.boxMin.z + bounds.boxMax.z) * 0.5f;
+	extentX[index] = (bounds.boxMax.x - bounds.boxMin.x) * 0.5f;
+	extentY[index] = (bounds.boxMax.y - bounds.boxMin.y) * 0.5f;
+	extentZ[index] = (bounds.boxMax.z - bounds.boxMin.z) * 0.5f;
+}
+
+size_t CullBoxes::GetCount() const
+{
+	return centerX.size();
+}
+
+/// <summary>
+/// Planes straight out of a matrix that goes to D3D clip space (Gribb/Hartmann), its columns are the rows of the transpose
+/// </summary>
+/// <param name="toClip">- world * view * proj, planes come out in the space world starts from</param>
+Frustum FrustumCuller::ExtractPlanes(FXMMATRIX toClip)
+{
+	XMMATRIX columns = XMMatrixTranspose(toClip);
+	XMVECTOR planes[6] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]), // left
+		XMVectorSubtract(columns.r[3], columns.r[0]), // right
+		XMVectorAdd(columns.r[3], columns.r[1]), // bottom
+		XMVectorSubtract(columns.r[3], columns.r[1]), // top
+		columns.r[2], // near, D3D clip z starts at 0
+		XMVectorSubtract(columns.r[3], columns.r[2]), // far
+	};
+
+	// Normalized so plane distances are in the same units as box sizes
+	Frustum result;
+	for (int i = 0; i < 6; i++)
+		XMStoreFloat4(&result.planes[i], XMVectorDivide(planes[i], XMVector3Length(planes[i])));
+	return result;
+}
+
+/// <summary>
+/// World space frustum of a camera
+/// </summary>
+/// <param name="view">- the camera's view matrix, Cam::GetView()</param>
+/// <param name="proj">- the camera's projection matrix, Cam::GetProj()</param>
+Frustum FrustumCuller::MakeFrustum(const XMFLOAT4X4& view, const XMFLOAT4X4& proj)
+{
+	return ExtractPlanes(XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+}
+
+/// <summary>
+/// <para>Where the objects that can shadow what's on screen are, for a directional light's orthographic shadow map</para>
+/// The receivers are boxed in the light's clip space and clipped to the shadow map. A caster has to overlap that box
+/// across the light's rays, and can be anywhere between the receivers and the light, so the box is stretched back to
+/// the shadow map's near plane. Anything in front of that is clipped when the shadow map is drawn anyway
+/// </summary>
+/// <param name="lightView">- the shadow map's view matrix</param>
+/// <param name="lightProj">- the shadow map's projection, must be orthographic</param>
+/// <param name="boxes">- world bounds of every object</param>
+/// <param name="receivers">- indices into boxes of the objects on screen, from Cull() with the camera's frustum</param>
+/// <param name="casters">- output, world space planes around every object that can cast onto a receiver</param>
+/// <returns>False if no receiver is inside the shadow map, nothing needs drawing into it then</returns>
+bool FrustumCuller::MakeCasterFrustum(const XMFLOAT4X4& lightView, const XMFLOAT4X4& lightProj,
+	const CullBoxes& boxes, const vector<unsigned int>& receivers, Frustum& casters)
+{
+	// An orthographic projection keeps w at 1, so boxes move into clip space like they would by any affine matrix
+	XMMATRIX toClip = XMLoadFloat4x4(&lightView) * XMLoadFloat4x4(&lightProj);
+	XMVECTOR reachX = XMVectorAbs(toClip.r[0]), reachY = XMVectorAbs(toClip.r[1]), reachZ = XMVectorAbs(toClip.r[2]);
+	XMVECTOR low = XMVectorReplicate(FLT_MAX), high = XMVectorReplicate(-FLT_MAX);
+	for (unsigned int i : receivers)
+	{
+		XMVECTOR center = XMVector3Transform(XMVectorSet(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i], 1.0f), toClip);
+		XMVECTOR extent = XMVectorMultiply(XMVectorReplicate(boxes.extentX[i]), reachX);
+		extent = XMVectorMultiplyAdd(XMVectorReplicate(boxes.extentY[i]), reachY, extent);
+		extent = XMVectorMultiplyAdd(XMVectorReplicate(boxes.extentZ[i]), reachZ, extent);
+		low = XMVectorMin(low, XMVectorSubtract(center, extent));
+		high = XMVectorMax(high, XMVectorAdd(center, extent));
+	}
+	return CasterFrustum(toClip, low, high, casters);
+}
+
+/// <summary>
+/// <para>MakeCasterFrustum() for everything the camera can see rather than the objects it does</para>
+/// Looser than boxing the receivers, but it only needs the camera, so it can be queried before the receivers are known
+/// and the receivers' caster frustum used to trim what it found
+/// </summary>
+/// <param name="lightView">- the shadow map's view matrix</param>
+/// <param name="lightProj">- the shadow map's projection, must be orthographic</param>
+/// <param name="view">- the camera's view matrix</param>
+/// <param name="proj">- the camera's projection matrix</param>
+/// <param name="casters">- output, world space planes around every object that can cast onto what the camera sees</param>
+/// <returns>False if the camera sees none of the shadow map</returns>
+bool FrustumCuller::MakeCasterFrustum(const XMFLOAT4X4& lightView, const XMFLOAT4X4& lightProj,
+	const XMFLOAT4X4& view, const XMFLOAT4X4& proj, Frustum& casters)
+{
+	// The camera's clip volume corners go back to the world, then on into the light's clip space
+	XMMATRIX toClip = XMLoadFloat4x4(&lightView) * XMLoadFloat4x4(&lightProj);
+	XMMATRIX fromCameraClip = XMMatrixInverse(0, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+	XMVECTOR low = XMVectorReplicate(FLT_MAX), high = XMVectorReplicate(-FLT_MAX);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		XMVECTOR clip = XMVectorSet(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : 0.0f, 1.0f);
+		XMVECTOR world = XMVector3TransformCoord(clip, fromCameraClip);
+		XMVECTOR light = XMVector3Transform(world, toClip);
+		low = XMVectorMin(low, light);
+		high = XMVectorMax(high, light);
+	}
+	return CasterFrustum(toClip, low, high, casters);
+}
+
+/// <summary>
+/// One box at a time, for the odd object not worth gathering into CullBoxes
+/// </summary>
+/// <returns>False if the box is entirely behind one of the planes</returns>
+bool FrustumCuller::IsVisible(const Frustum& frustum, const Bounds& bounds)
+{
+	return !IsOutside(frustum,
+		(bounds.boxMin.x + bounds.boxMax.x) * 0.5f, (bounds.boxMin.y + bounds.boxMax.y) * 0.5f, (bounds.boxMin.z + bounds.boxMax.z) * 0.5f,
+		(bounds.boxMax.x - bounds.boxMin.x) * 0.5f, (bounds.boxMax.y - bounds.boxMin.y) * 0.5f, (bounds.boxMax.z - bounds.boxMin.z) * 0.5f);
+}
+
+/// <summary>
+/// Cull a run of boxes on the calling thread, as many at a time as the compiler's target allows
+/// </summary>
+/// <param name="first">- index of the first box</param>
+/// <param name="count">- boxes to test</param>
+/// <param name="visible">- output, room for count indices, the visible boxes' indices are written in order</param>
+/// <returns>Boxes that passed</returns>
+size_t FrustumCuller::Cull(const Frustum& frustum, const CullBoxes& boxes, size_t first, size_t count, unsigned int* visible)
+{
+	size_t i = first, end = first + count;
+	size_t written = CullLanes<Lanes>(frustum, boxes, i, end, 0, visible);
+	for (; i < end; i++)
+	{
+		if (!IsOutside(frustum, boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i], boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]))
+			visible[written++] = (unsigned int)i;
+	}
+	return written;
+}
+
+/// <summary>
+/// Cull a list of boxes on the calling thread, such as what a coarser test let through, gathering them into lanes
+/// </summary>
+/// <param name="candidates">- indices of the boxes to test</param>
+/// <param name="count">- number of candidates</param>
+/// <param name="visible">- output, room for count indices, the candidates that passed are written in order. May be candidates itself</param>
+/// <returns>Boxes that passed</returns>
+size_t FrustumCuller::CullList(const Frustum& frustum, const CullBoxes& boxes, const unsigned int* candidates, size_t count, unsigned int* visible)
+{
+	size_t i = 0;
+	size_t written = CullLanes<Lanes>(frustum, boxes, i, count, candidates, visible);
+	for (; i < count; i++)
+	{
+		unsigned int box = candidates[i];
+		if (!IsOutside(frustum, boxes.centerX[box], boxes.centerY[box], boxes.centerZ[box], boxes.extentX[box], boxes.extentY[box], boxes.extentZ[box]))
+			visible[written++] = box;
+	}
+	return written;
+}
+
+/// <summary>
+/// Find every box that might be visible, in blocks spread over the job system's workers
+/// </summary>
+/// <param name="frustum">- planes in the same space as the boxes</param>
+/// <param name="boxes">- boxes to test</param>
+/// <param name="visible">- overwritten with the indices of the boxes that passed, ascending</param>
+/// <param name="jobs">- optional, 0 culls everything on the calling thread</param>
+/// <param name="stats">- optional, counts are added to</param>
+void FrustumCuller::Cull(const Frustum& frustum, const CullBoxes& boxes, vector<unsigned int>& visible, JobSystem* jobs, FrustumCullStats* stats)
+{
+	size_t count = boxes.GetCount();
+	visible.resize(count);
+	size_t visibleCount;
+	if (!jobs || count <= FRUSTUM_CULL_BLOCK)
+		visibleCount = Cull(frustum, boxes, 0, count, visible.data());
+	else
+	{
+		// Each block fills the start of its own stretch, then the stretches are slid down next to each other
+		size_t blocks = (count + FRUSTUM_CULL_BLOCK - 1) / FRUSTUM_CULL_BLOCK;
+		vector<size_t> blockCounts(blocks);
+		jobs->ParallelFor(blocks, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t block = begin; block < end; block++)
+			{
+				size_t first = block * FRUSTUM_CULL_BLOCK;
+				size_t length = count - first < FRUSTUM_CULL_BLOCK ? count - first : FRUSTUM_CULL_BLOCK;
+				blockCounts[block] = Cull(frustum, boxes, first, length, visible.data() + first);
+			}
+		});
+		visibleCount = blockCounts[0];
+		for (size_t block = 1; block < blocks; block++)
+		{
+			memmove(visible.data() + visibleCount, visible.data() + block * FRUSTUM_CULL_BLOCK, blockCounts[block] * sizeof(unsigned int));
+			visibleCount += blockCounts[block];
+		}
+	}
+	visible.resize(visibleCount);
+
+	if (stats)
+	{
+		stats->tested += (unsigned int)count;
+		stats->visible += (unsigned int)visibleCount;
+	}
+}
+
+/// <returns>Boxes tested per instruction, 8 when built for AVX and 4 otherwise</returns>
+unsigned int FrustumCuller::GetLaneCount()
+{
+	return (unsigned int)Lanes::Width;
+}
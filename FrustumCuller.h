@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "Bounds.h"
+
+class JobSystem;
+
+// Boxes one job culls, each block writes its visible indices to its own stretch of the output before they're packed together
+#define FRUSTUM_CULL_BLOCK 4096
+// Smallest size of the shadow caster volume in light clip space, so a single flat receiver still gives it some thickness
+#define FRUSTUM_CASTER_MIN_SIZE 1e-4f
+
+/// <summary>
+/// Six planes, normalized and facing inwards, in whatever space the matrix they came from started in
+/// </summary>
+struct Frustum
+{
+	DirectX::XMFLOAT4 planes[6]; // left, right, bottom, top, near, far
+};
+
+/// <summary>
+/// How many boxes the culler looked at and let through, counts are added to so one set can cover a whole frame
+/// </summary>
+struct FrustumCullStats
+{
+	unsigned int tested;
+	unsigned int visible;
+};
+
+/// <summary>
+/// <para>World space boxes kept as one array per coordinate of their centers and half sizes</para>
+/// That's the layout the culler loads 4 or 8 boxes at a time from, one plane test covering every lane
+/// </summary>
+struct CullBoxes
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ; // half sizes
+
+	void Clear();
+	void Add(const Bounds& bounds);
+	void Set(size_t index, const Bounds& bounds);
+	size_t GetCount() const;
+};
+
+/// <summary>
+/// <para>Finds which boxes might be inside a view frustum</para>
+/// A box is only rejected when it's entirely behind one plane, so the test is conservative: boxes near a
+/// corner of the frustum can pass without being on screen, but nothing on screen is ever rejected
+/// </summary>
+class FrustumCuller
+{
+public:
+	static Frustum ExtractPlanes(DirectX::FXMMATRIX toClip);
+	static Frustum MakeFrustum(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& proj);
+	static bool MakeCasterFrustum(const DirectX::XMFLOAT4X4& lightView, const DirectX::XMFLOAT4X4& lightProj,
+		const CullBoxes& boxes, const std::vector<unsigned int>& receivers, Frustum& casters);
+	static bool MakeCasterFrustum(const DirectX::XMFLOAT4X4& lightView, const DirectX::XMFLOAT4X4& lightProj,
+		const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& proj, Frustum& casters);
+	static bool IsVisible(const Frustum& frustum, const Bounds& bounds);
+	static size_t Cull(const Frustum& frustum, const CullBoxes& boxes, size_t first, size_t count, unsigned int* visible);
+	static size_t CullList(const Frustum& frustum, const CullBoxes& boxes, const unsigned int* candidates, size_t count, unsigned int* visible);
+	static void Cull(const Frustum& frustum, const CullBoxes& boxes, std::vector<unsigned int>& visible, JobSystem* jobs = 0, FrustumCullStats* stats = 0);
+	static unsigned int GetLaneCount();
+};
@@ -1,12 +1,18 @@
 #include "Game.h"
 #include "Vertex.h"
+#include "VertexPacking.h"
 #include "Input.h"
 #include "Helpers.h"
 #include "ImGui/imgui.h"
 #include "ImGui/imgui_impl_dx11.h"
 #include "ImGui/imgui_impl_win32.h"
+#include "JobSystem.h"
+#include "D3D11RenderDevice.h"
 #include <memory>
 #include <iostream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
 
 // Needed for a helper function to load pre-compiled shader files
 #pragma comment(lib, "d3dcompiler.lib")
@@ -24,9 +30,11 @@ using namespace Microsoft::WRL;
 // DXCore (base class) constructor will set up underlying fields.
 // Direct3D itself, and our window, are not ready at this point!
 //
-// hInstance - the application's OS-level handle (unique ID)
+// hInstance      - the application's OS-level handle (unique ID)
+// packedVertices - load models as PackedVertex and draw them with the *Packed shaders
+// meshletCulling - cull meshlets on the CPU before drawing
 // --------------------------------------------------------
-Game::Game(HINSTANCE hInstance)
+Game::Game(HINSTANCE hInstance, bool packedVertices, bool meshletCulling)
 	: DXCore(
 		hInstance,			// The application's handle
 		L"DirectX Game",	// Text for the window's title bar (as a wide-character string)
@@ -49,6 +57,21 @@ Game::Game(HINSTANCE hInstance)
 	ent4Dir = 1;
 	shadowMapResolution = 2048;
 	blurRadius = 5;
+	this->packedVertices = packedVertices;
+	this->meshletCulling = meshletCulling;
+	meshletStats = {};
+	frustumCulling = true;
+	frustumStats = {};
+	occlusionCulling = true;
+	occlusionStats = {};
+	occlusionTime = 0;
+	shadowCulling = true;
+	shadowStats = {};
+	instancing = true;
+	commandRecording = false;
+	deferredContexts = false;
+	pickedTriangle = 0;
+	pickedDistance = 0;
 }						 
 
 // -----------------------Entity(triangle1);---------------------------------
@@ -67,9 +90,12 @@ Game::~Game()
 	// - Note: this is unnecessary for D3D objects stored in ComPtrs
 
 	// Game class destructor needs to clean up the ImGui library and free its memory
-	ImGui_ImplDX11_Shutdown();
-	ImGui_ImplWin32_Shutdown();
-	ImGui::DestroyContext();
+	if (!headless)
+	{
+		ImGui_ImplDX11_Shutdown();
+		ImGui_ImplWin32_Shutdown();
+		ImGui::DestroyContext();
+	}
 }
 
 /// <summary>
@@ -147,17 +173,23 @@ void Game::Init()
 		// Tell the input assembler (IA) stage of the pipeline what kind of
 		// geometric primitives (points, lines or triangles) we want to draw.  
 		// Essentially: "What kind of shape should the GPU draw with our vertices?"
-		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		renderDevice->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	}
 
 	// Initialize ImGui itself & platform/renderer backends
-	IMGUI_CHECKVERSION();
-	ImGui::CreateContext();
-	ImGui_ImplWin32_Init(hWnd);
-	ImGui_ImplDX11_Init(device.Get(), context.Get());
-	ImGui::StyleColorsDark();
+	// There's no window to draw it in when running headless
+	if (!headless)
+	{
+		IMGUI_CHECKVERSION();
+		ImGui::CreateContext();
+		ImGui_ImplWin32_Init(hWnd);
+		ImGui_ImplDX11_Init(device.Get(), context.Get());
+		ImGui::StyleColorsDark();
+	}
 
 
+	frameConstants = make_shared<FrameConstants>(device, renderDevice);
+
 	// Initialize lights before loading shaders
 	XMFLOAT3 dirOri = XMFLOAT3(0, -1, -0.5f);
 	XMVECTOR dirOriMath = XMLoadFloat3(&dirOri);
@@ -165,22 +197,52 @@ void Game::Init()
 	XMStoreFloat3(&dirOri, dirOriMath);
 	dir = MakeDir(dirOri, XMFLOAT3(1,1,1), 1);
 	
-	vs = make_shared<SimpleVertexShader>(device, context, FixPath(L"VertexShader.cso").c_str());
-	ps = make_shared<SimplePixelShader>(device, context, FixPath(L"PixelShader.cso").c_str());
-	unsigned int lightSize = sizeof(Light);
-	ps->SetData("dir", &dir, lightSize);
-	ps->SetData("pt", &pt, lightSize);
-	ps->SetData("spot", &spot, lightSize);
-	skyVS = make_shared<SimpleVertexShader>(device, context, FixPath(L"SkyVS.cso").c_str());
-	skyPS = make_shared<SimplePixelShader>(device, context, FixPath(L"SkyPS.cso").c_str());
-	shadowVS = make_shared<SimpleVertexShader>(device, context, FixPath(L"Shadow.cso").c_str());
-
-	ppVS = make_shared<SimpleVertexShader>(device, context, FixPath(L"ppVS.cso").c_str());
-	ppPS = make_shared<SimplePixelShader>(device, context, FixPath(L"ppPS.cso").c_str());
-
-	meshes.insert({ "sphere", make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.obj").c_str(), device, context) });
-	meshes.insert({ "cube", make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.obj").c_str(), device, context) });
-	meshes.insert({ "helix", make_shared<Mesh>(FixPath(L"../../Assets/Models/helix.obj").c_str(), device, context) });
+	// Every shader's PerFrame buffer is the one frameConstants binds, shaders only get buffers for the rest.
+	// Packed vertices need a hand made input layout, reflection only knows 32 bit formats
+	if (packedVertices)
+	{
+		ComPtr<ID3D11InputLayout> packedLayout;
+		VertexPacking::CreateInputLayout(device, FixPath(L"VertexShaderPacked.cso").c_str(), packedLayout);
+		vs = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"VertexShaderPacked.cso").c_str(), packedLayout, false, FRAME_CONSTANTS_REGISTER);
+	}
+	else vs = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"VertexShader.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+	ps = make_shared<SimplePixelShader>(device, renderDevice, FixPath(L"PixelShader.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+	skyVS = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"SkyVS.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+	skyPS = make_shared<SimplePixelShader>(device, renderDevice, FixPath(L"SkyPS.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+	if (packedVertices)
+	{
+		ComPtr<ID3D11InputLayout> packedShadowLayout;
+		VertexPacking::CreateInputLayout(device, FixPath(L"ShadowPacked.cso").c_str(), packedShadowLayout);
+		shadowVS = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"ShadowPacked.cso").c_str(), packedShadowLayout, false, FRAME_CONSTANTS_REGISTER);
+	}
+	else shadowVS = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"Shadow.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+
+	// The same shaders reading world matrices per instance, reflection finds the _PER_INSTANCE inputs on its own
+	if (packedVertices)
+	{
+		ComPtr<ID3D11InputLayout> instancedLayout;
+		VertexPacking::CreateInputLayout(device, FixPath(L"VertexShaderPackedInstanced.cso").c_str(), instancedLayout, true);
+		instancedVS = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"VertexShaderPackedInstanced.cso").c_str(), instancedLayout, true, FRAME_CONSTANTS_REGISTER);
+		ComPtr<ID3D11InputLayout> instancedShadowLayout;
+		VertexPacking::CreateInputLayout(device, FixPath(L"ShadowPackedInstanced.cso").c_str(), instancedShadowLayout, true);
+		instancedShadowVS = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"ShadowPackedInstanced.cso").c_str(), instancedShadowLayout, true, FRAME_CONSTANTS_REGISTER);
+	}
+	else
+	{
+		instancedVS = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"VertexShaderInstanced.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+		instancedShadowVS = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"ShadowInstanced.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+	}
+	instanceBatcher = make_shared<InstanceBatcher>(device, renderDevice);
+
+	ppVS = make_shared<SimpleVertexShader>(device, renderDevice, FixPath(L"ppVS.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+	ppPS = make_shared<SimplePixelShader>(device, renderDevice, FixPath(L"ppPS.cso").c_str(), FRAME_CONSTANTS_REGISTER);
+
+	meshes.insert({ "sphere", make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.obj").c_str(), device, renderDevice, packedVertices) });
+	meshes.insert({ "cube", make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.obj").c_str(), device, renderDevice, packedVertices) });
+	meshes.insert({ "helix", make_shared<Mesh>(FixPath(L"../../Assets/Models/helix.obj").c_str(), device, renderDevice, packedVertices) });
+
+	// The sky shaders only read full Vertex, so it gets its own cube when the others are packed
+	skyMesh = packedVertices ? make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.obj").c_str(), device, renderDevice) : meshes["cube"];
 
 	// Sampler state for post processing
 	D3D11_SAMPLER_DESC ppSampDesc = {};
@@ -268,22 +330,22 @@ void Game::Init()
 		mats.push_back(make_shared<Material>(XMFLOAT4(1, 1, 1, 1), vs, ps));
 		mats[i]->AddSampler("Sampler", ss);
 		mats[i]->AddSampler("ShadowSampler", shadowSampler);
-		if (i % 3 == 0) ents.push_back(Ent(meshes["sphere"], mats[i]));
-		else if (i % 2 == 0) ents.push_back(Ent(meshes["cube"], mats[i]));
-		else ents.push_back(Ent(meshes["helix"], mats[i]));
-		ents[i].GetTf()->SetPosition((float)i, 1, 0);
-		ents[i].GetTf()->SetScale(0.25f,0.25f,0.25f);
+		shared_ptr<Mesh> mesh = i % 3 == 0 ? meshes["sphere"] : i % 2 == 0 ? meshes["cube"] : meshes["helix"];
+		ents.push_back(scene.Create(Transform(), Renderable(mesh, mats[i])));
+		scene.Get<Transform>(ents[i])->SetPosition((float)i, 1, 0);
+		scene.Get<Transform>(ents[i])->SetScale(0.25f,0.25f,0.25f);
 	}
 
-	int rows = sizeof(floor) / sizeof(floor[0]);
-	int cols = sizeof(floor[0]) / sizeof(Ent);
-	for (int i = 0; i < rows; i++)
+	// 15 x 15 floor tiles, only the registry keeps track of them. They're boxes, so they occlude with their own bounds
+	const Bounds& cubeBounds = meshes["cube"]->GetBounds();
+	shared_ptr<OccluderMesh> tileOccluder = make_shared<OccluderMesh>(OcclusionCuller::MakeBox(cubeBounds.boxMin, cubeBounds.boxMax));
+	for (int i = 0; i < 15; i++)
 	{
-		for (int j = 0; j < cols; j++)
+		for (int j = 0; j < 15; j++)
 		{
-			floor[i][j] = Ent(meshes["cube"], mats[6]);
-			floor[i][j].GetTf()->SetPosition((i * 2.0f) - 10, -2.0f, (j * 2.0f) - 10);
-			floor[i][j].GetTf()->UpdateMatrices();
+			Transform* tf = scene.Get<Transform>(scene.Create(Transform(), Renderable(meshes["cube"], mats[6]), Occluder{ tileOccluder }));
+			tf->SetPosition((i * 2.0f) - 10, -2.0f, (j * 2.0f) - 10);
+			tf->UpdateMatrices();
 		}
 	}
 
@@ -340,7 +402,7 @@ void Game::Init()
 	device->CreateDepthStencilState(&skyDSSDesc, skyDSS.GetAddressOf());
 
 	// Can just reuse the sampler state for the textures (unless you want different settings)
-	sky = Sky(ss, skySRV, skyDSS, skyRS, meshes["cube"], skyVS, skyPS, device);
+	sky = Sky(ss, skySRV, skyDSS, skyRS, skyMesh, skyVS, skyPS, device);
 	sky.CreateCubemap(FixPath(L"../../Assets/Textures/Sky/right.png").c_str(),
 		FixPath(L"../../Assets/Textures/Sky/left.png").c_str(),
 		FixPath(L"../../Assets/Textures/Sky/up.png").c_str(),
@@ -404,19 +466,22 @@ void Game::OnResize()
 /// Helper function for creating dropdown tree nodes
 /// </summary>
 /// <param name="label">tree node name</param>
-/// <param name="object">object to showcase in tree node</param>
-void Game::Node(const char* label, Ent* object)
+/// <param name="object">entity to showcase in tree node</param>
+void Game::Node(const char* label, Entity object)
 {
-	if (TreeNode(label))
+	Transform* tf = scene.Get<Transform>(object);
+	Renderable* renderable = scene.Get<Renderable>(object);
+	if (tf && renderable && TreeNode(label))
 	{
-		float position[3] = { object->GetTf()->GetPosition().x, object->GetTf()->GetPosition().y, object->GetTf()->GetPosition().z };
-		float scale[3] = { object->GetTf()->GetScale().x, object->GetTf()->GetScale().y, object->GetTf()->GetScale().z };
+		float position[3] = { tf->GetPosition().x, tf->GetPosition().y, tf->GetPosition().z };
+		float scale[3] = { tf->GetScale().x, tf->GetScale().y, tf->GetScale().z };
 		if (DragFloat3("Position", position, 0.01f)) {
-			object->GetTf()->SetPosition(position[0], position[1], position[2]);
+			tf->SetPosition(position[0], position[1], position[2]);
 		}
 		if (DragFloat3("Scale", scale, 0.01f)) {
-			object->GetTf()->SetScale(scale[0], scale[1], scale[2]);
+			tf->SetScale(scale[0], scale[1], scale[2]);
 		}
+		Text("LOD: %d of %d", renderable->GetLod(), renderable->GetMesh()->GetLodCount());
 		TreePop();
 	}
 }
@@ -447,11 +512,12 @@ void Game::LightNode(const char* label, Light* light) {
 	}
 }
 
-// --------------------------------------------------------
-// Update your game here - user input, move objects, AI, etc.
-// --------------------------------------------------------
-void Game::Update(float deltaTime, float totalTime)
-{ 
+/// <summary>
+/// Builds this frame's ImGui windows, skipped entirely when running headless
+/// </summary>
+/// <param name="deltaTime">- time since last frame</param>
+void Game::BuildUI(float deltaTime)
+{
 	// The imgui stuff needs to be done first
 	// Feed fresh input data to ImGui
 	ImGuiIO& io = ImGui::GetIO();
@@ -480,6 +546,51 @@ void Game::Update(float deltaTime, float totalTime)
 	ImGui::Text("Cam FOV: %f", cams[activeCam]->GetFOV());
 	ImGui::Text("Cam Aspect Ratio: %f", cams[activeCam]->GetAspRat());
 	ImGui::SliderInt("Blur Radius: %f", &blurRadius, 0, 10);
+	ImGui::Text("Draw Calls: %u", frameStats.drawCalls);
+	ImGui::Text("Triangles: %u", frameStats.indices / 3);
+	ImGui::Text("Bytes Uploaded: %u", frameStats.bytesUploaded);
+	bool stateCaching = stateCache->IsEnabled();
+	if (ImGui::Checkbox("Filter Redundant State", &stateCaching))
+		stateCache->SetEnabled(stateCaching);
+	unsigned int filteredCalls = 0;
+	for (int call = 0; call < RENDER_CALL_COUNT; call++)
+		filteredCalls += frameStats.filtered[call];
+	unsigned int filteredUploads = frameStats.filtered[RENDER_CALL_UPDATE_CONSTANT_BUFFER];
+	ImGui::Text("Calls Filtered: %u (%u binds, %u constant uploads)", filteredCalls, filteredCalls - filteredUploads, filteredUploads);
+	ImGui::Checkbox("Frustum Culling", &frustumCulling);
+	ImGui::Text("Entities Drawn: %u of %u", frustumStats.visible, frustumStats.tested);
+	ImGui::Checkbox("Occlusion Culling", &occlusionCulling);
+	ImGui::Text("Entities Occluded: %u of %u, %u triangles, %.3f ms", occlusionStats.tested - occlusionStats.visible, occlusionStats.tested,
+		occlusionStats.triangles, occlusionTime);
+	ImGui::Checkbox("Instancing", &instancing);
+	ImGui::Text("Instanced Draws: %zu shadow, %zu main for %zu instances", shadowGroups.size(), mainGroups.size(), instanceBatcher->GetInstances().size());
+	RenderQueueStats queueStats = renderQueue.GetStats();
+	ImGui::Text("Render Queue: %u draws sorted in %.3f ms", queueStats.draws, queueStats.sortTime);
+	ImGui::Text("State Changes: %u shader, %u material, %u mesh", queueStats.shaderChanges, queueStats.materialChanges, queueStats.meshChanges);
+	ImGui::Checkbox("Record Commands On Every Thread", &commandRecording);
+	ImGui::Checkbox("Replay Through Deferred Contexts", &deferredContexts);
+	if (commandRecording)
+	{
+		size_t commands = 0, bytes = 0;
+		for (const shared_ptr<CommandBuffer>& buffer : commandBuffers)
+		{
+			commands += buffer->GetCommandCount();
+			bytes += buffer->GetByteCount();
+		}
+		ImGui::Text("Recorded: %zu commands in %zu buffers, %zu bytes", commands, commandBuffers.size(), bytes);
+	}
+	ImGui::Checkbox("Shadow Caster Culling", &shadowCulling);
+	ImGui::Text("Shadow Casters Drawn: %u of %u", shadowStats.visible, shadowStats.tested);
+	if (pickedEntity != Entity())
+		ImGui::Text("Picked: entity %u, triangle %u, %.2f units away", pickedEntity.index, pickedTriangle, pickedDistance);
+	else
+		ImGui::Text("Picked: nothing (right click to pick)");
+	ImGui::Checkbox("Meshlet Culling", &meshletCulling);
+	if (meshletCulling)
+	{
+		ImGui::Text("Meshlets Culled: %u frustum, %u backface of %u", meshletStats.frustumMeshlets, meshletStats.backfaceMeshlets, meshletStats.meshlets);
+		ImGui::Text("Triangles Culled: %u frustum, %u backface of %u", meshletStats.frustumTriangles, meshletStats.backfaceTriangles, meshletStats.triangles);
+	}
 	ImGui::Image(shadowSRV.Get(), ImVec2(512, 512));
 
 	if (CollapsingHeader("Inspector"))
@@ -492,81 +603,393 @@ void Game::Update(float deltaTime, float totalTime)
 	}
 
 	ImGui::End();
+}
 
+// --------------------------------------------------------
+// Update your game here - user input, move objects, AI, etc.
+// --------------------------------------------------------
+void Game::Update(float deltaTime, float totalTime)
+{ 
+	if (!headless) BuildUI(deltaTime);
 
-	if (ents[6].GetTf()->GetPosition().z > 2) ent6Dir = -1;
-	else if (ents[6].GetTf()->GetPosition().z < -2) ent6Dir = 1;
-	ents[6].GetTf()->MoveAbsolute(0, 0, ent6Dir * deltaTime);
+	Transform* ent6 = scene.Get<Transform>(ents[6]);
+	if (ent6->GetPosition().z > 2) ent6Dir = -1;
+	else if (ent6->GetPosition().z < -2) ent6Dir = 1;
+	ent6->MoveAbsolute(0, 0, ent6Dir * deltaTime);
 
-	ents[5].GetTf()->Rotate(0, deltaTime, 0);
+	scene.Get<Transform>(ents[5])->Rotate(0, deltaTime, 0);
 
-	if (ents[4].GetTf()->GetPosition().y > 2) ent4Dir = -1;
-	else if (ents[4].GetTf()->GetPosition().y < 0) ent4Dir = 1;
-	ents[4].GetTf()->MoveAbsolute(0, ent4Dir * deltaTime, 0);
+	Transform* ent4 = scene.Get<Transform>(ents[4]);
+	if (ent4->GetPosition().y > 2) ent4Dir = -1;
+	else if (ent4->GetPosition().y < 0) ent4Dir = 1;
+	ent4->MoveAbsolute(0, ent4Dir * deltaTime, 0);
 	
 
 
-	unsigned int lightSize = sizeof(Light);
-	ps->SetData("dir", &dir, lightSize);
-	ps->SetData("pt", &pt, lightSize);
-	ps->SetData("spot", &spot, lightSize);
-
-	for (int i = 0; i < ents.size(); i++) ents[i].GetTf()->UpdateMatrices();
+	// Every entity and camera transform that changed this frame, several per SIMD instruction
+	TransformStore::Shared().UpdateMatrices();
 
 	cams[activeCam]->Move(deltaTime);
+
+	// Right click picks against the entity tree last frame's Draw() left behind
+	if (Input::GetInstance().MouseRightPress())
+		Pick(Input::GetInstance().GetMouseX(), Input::GetInstance().GetMouseY());
+
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::GetInstance().KeyDown(VK_ESCAPE))
 		Quit();
 }
 
+/// <summary>
+/// Find the triangle under a point on screen: entity bounds through sceneBvh first, then the meshes' own triangle trees
+/// </summary>
+/// <param name="mouseX">- pixels from the left of the window</param>
+/// <param name="mouseY">- pixels from the top of the window</param>
+void Game::Pick(int mouseX, int mouseY)
+{
+	// The cursor at the near and far planes, back through the camera, gives the ray
+	XMFLOAT4X4 view = cams[activeCam]->GetView();
+	XMFLOAT4X4 proj = cams[activeCam]->GetProj();
+	XMMATRIX inverseViewProj = XMMatrixInverse(0, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj)));
+	float x = mouseX * 2.0f / windowWidth - 1.0f;
+	float y = 1.0f - mouseY * 2.0f / windowHeight;
+	XMVECTOR start = XMVector3TransformCoord(XMVectorSet(x, y, 0, 1), inverseViewProj);
+	XMVECTOR end = XMVector3TransformCoord(XMVectorSet(x, y, 1, 1), inverseViewProj);
+	BvhRay ray;
+	XMStoreFloat3(&ray.origin, start);
+	XMStoreFloat3(&ray.direction, end - start);
+	ray.maxDistance = 1.0f;
+
+	pickTargets.resize(cullTransforms.size());
+	for (size_t i = 0; i < pickTargets.size(); i++)
+	{
+		XMFLOAT4X4 world = cullTransforms[i]->GetWorldMatrix();
+		XMStoreFloat4x4(&pickTargets[i].worldToObject, XMMatrixInverse(0, XMLoadFloat4x4(&world)));
+		pickTargets[i].triangles = &cullRenderables[i]->GetMesh()->GetTriangleBvh();
+	}
+	RayHit hit = TriangleBvh::RaycastScene(sceneBvh, pickTargets.data(), ray);
+	pickedEntity = hit.target == BVH_NO_ITEM ? Entity() : cullEntities[hit.target];
+	pickedTriangle = hit.triangle;
+	pickedDistance = hit.distance * XMVectorGetX(XMVector3Length(end - start));
+}
+
+/// <summary>
+/// <para>Record a piece of the main pass's sorted draws, the way the direct path draws them, safe to call from any thread</para>
+/// Shaders' local data is only read: each draw's constants are copied from it into the buffer with the world matrices,
+/// mesh bounds and tint written over their spots. The piece sets everything it draws with, FrameConstants' buffer
+/// included, so it can be replayed onto a deferred context that starts from nothing
+/// </summary>
+/// <param name="buffer">- recorded into, Reset() first</param>
+/// <param name="begin">- the piece's first draw in the render queue</param>
+/// <param name="end">- one past its last</param>
+/// <param name="viewport">- the main pass's</param>
+/// <returns>The piece's draws and state changes, for the render queue's stats</returns>
+RenderQueueStats Game::RecordOpaque(CommandBuffer& buffer, size_t begin, size_t end, const D3D11_VIEWPORT& viewport)
+{
+	buffer.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	buffer.RSSetState(0);
+	buffer.RSSetViewports(1, &viewport);
+	buffer.OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
+	buffer.OMSetDepthStencilState(0, 0);
+	frameConstants->Bind(buffer);
+
+	// Where each patched variable sits in its shader's constants, looked up when the shader changes
+	struct Patch
+	{
+		const SimpleShaderVariable* var;
+		const void* data;
+	};
+	SimpleVertexShader* entityVS = 0;
+	SimplePixelShader* entityPS = 0;
+	const SimpleShaderVariable* vsVars[4] = {};
+	const SimpleShaderVariable* tintVar = 0;
+	const char* vsNames[4] = { "world", "worldIT", "positionMin", "positionExtent" };
+	Mesh* mesh = 0;
+	XMFLOAT4 tint = {};
+	XMFLOAT3 positionMin = {}, positionExtent = {};
+
+	// Every constant buffer of a shader goes in with each draw, its patches written over the copy
+	auto record = [&buffer](ISimpleShader* shader, const Patch* patches, int patchCount)
+	{
+		for (unsigned int b = 0; b < shader->GetBufferCount(); b++)
+		{
+			const SimpleConstantBuffer* cb = shader->GetBufferInfo(b);
+			if (!cb->ConstantBuffer)
+				continue;
+			unsigned char* data = (unsigned char*)buffer.RecordConstantBuffer(cb->ConstantBuffer.Get(), cb->Size);
+			memcpy(data, cb->LocalDataBuffer, cb->Size);
+			for (int p = 0; p < patchCount; p++)
+			{
+				if (patches[p].var && patches[p].var->ConstantBufferIndex == b)
+					memcpy(data + patches[p].var->ByteOffset, patches[p].data, patches[p].var->Size);
+			}
+		}
+	};
+
+	return renderQueue.SubmitRange(begin, end, [&](unsigned int i, unsigned int changes)
+	{
+		Renderable& renderable = *cullRenderables[i];
+		Transform& tf = *cullTransforms[i];
+		if (changes & RENDER_CHANGE_SHADER)
+		{
+			entityVS = renderable.GetMat()->GetVertexShader().get();
+			entityPS = renderable.GetMat()->GetPixelShader().get();
+			entityVS->SetShader(buffer);
+			entityPS->SetShader(buffer);
+			for (int v = 0; v < 4; v++)
+				vsVars[v] = entityVS->GetVariableInfo(vsNames[v]);
+			tintVar = entityPS->GetVariableInfo("tint");
+		}
+		if (changes & RENDER_CHANGE_MATERIAL)
+		{
+			shared_ptr<Material> mat = renderable.GetMat();
+			tint = mat->GetColorTint();
+			Patch psPatch = { tintVar, &tint };
+			record(entityPS, &psPatch, 1);
+			mat->PrepareMaterial(buffer);
+		}
+		if (changes & RENDER_CHANGE_MESH)
+		{
+			mesh = renderable.GetMesh().get();
+			positionMin = mesh->GetPositionMin();
+			positionExtent = mesh->GetPositionExtent();
+		}
+		XMFLOAT4X4 world = tf.GetWorldMatrix();
+		XMFLOAT4X4 worldIT = tf.GetWorldInverseTransposeMatrix();
+		Patch vsPatches[4] = { { vsVars[0], &world }, { vsVars[1], &worldIT }, { 0, 0 }, { 0, 0 } };
+		if (mesh->IsPacked())
+		{
+			vsPatches[2] = { vsVars[2], &positionMin };
+			vsPatches[3] = { vsVars[3], &positionExtent };
+		}
+		record(entityVS, vsPatches, 4);
+		mesh->Draw(renderable.GetLod(), (changes & RENDER_CHANGE_MESH) != 0, &buffer);
+	});
+}
+
 // --------------------------------------------------------
 // Clear the screen, redraw everything, present to the user
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
+	meshletStats = {};
+	frustumStats = {};
+
+	// Gather every entity's mesh bounds and world matrix, then move them all into the world in one batch.
+	// Nothing is created or destroyed during Draw, so the pointers hold
+	cullTransforms.clear();
+	cullRenderables.clear();
+	cullEntities.clear();
+	cullLocalBounds.clear();
+	cullWorlds.clear();
+	scene.Each<Transform, Renderable>([&](Entity entity, Transform& tf, Renderable& renderable)
+	{
+		cullLocalBounds.push_back(renderable.GetMesh()->GetBounds());
+		cullWorlds.push_back(tf.GetWorldMatrix());
+		cullTransforms.push_back(&tf);
+		cullRenderables.push_back(&renderable);
+		cullEntities.push_back(entity);
+	});
+	gatheredBounds.resize(cullTransforms.size());
+	BoundingVolumes::ToWorld(cullLocalBounds.data(), cullWorlds.data(), cullWorlds.size(), gatheredBounds.data());
+
+	// Pick every entity's LOD once so the shadow and main passes draw the same triangles,
+	// and compare with last frame's bounds to tell the tree which entities moved
+	cullBoxes.Clear();
+	movedEntities.clear();
+	for (unsigned int i = 0; i < gatheredBounds.size(); i++)
+	{
+		const Bounds& bounds = gatheredBounds[i];
+		cullRenderables[i]->UpdateLod(*cullTransforms[i], bounds, cams[activeCam], (float)windowHeight);
+		if (i < entityBounds.size() && memcmp(&entityBounds[i], &bounds, sizeof(Bounds)) != 0)
+			movedEntities.push_back(i);
+		cullBoxes.Add(bounds);
+	}
+	entityBounds.swap(gatheredBounds);
+	sceneBvh.Update(entityBounds.data(), entityBounds.size(), movedEntities.data(), movedEntities.size());
+
+	// The camera's frustum and the volume that can shadow anything it sees go to the tree together.
+	// Receivers aren't known until after occlusion, so their tighter caster volume trims the casters found here later
+	XMFLOAT4X4 view = cams[activeCam]->GetView(), proj = cams[activeCam]->GetProj();
+	Frustum queryFrusta[2];
+	size_t queryCount = 0;
+	if (frustumCulling)
+		queryFrusta[queryCount++] = FrustumCuller::MakeFrustum(view, proj);
+	bool casterQuery = shadowCulling && FrustumCuller::MakeCasterFrustum(shadowViewMatrix, shadowProjectionMatrix, view, proj, queryFrusta[queryCount]);
+	if (casterQuery)
+		queryCount++;
+	sceneBvh.QueryFrustums(queryFrusta, queryCount, frustumResults, frustumOffsets);
+	if (frustumCulling)
+	{
+		visibleEntities.assign(frustumResults.begin() + frustumOffsets[0], frustumResults.begin() + frustumOffsets[1]);
+		frustumStats.tested = (unsigned int)entityBounds.size();
+		frustumStats.visible = (unsigned int)visibleEntities.size();
+	}
+	else
+	{
+		visibleEntities.resize(cullBoxes.GetCount());
+		for (size_t i = 0; i < visibleEntities.size(); i++)
+			visibleEntities[i] = (unsigned int)i;
+		frustumStats.tested = frustumStats.visible = (unsigned int)visibleEntities.size();
+	}
+
+	// Draw the occluders into a small depth buffer on the CPU and drop what's behind them
+	occlusionStats = {};
+	if (occlusionCulling)
+	{
+		auto start = chrono::steady_clock::now();
+		occlusionCuller.Begin(view, proj);
+		scene.Each<Transform, Occluder>([&](Entity, Transform& tf, Occluder& occluder)
+		{
+			occlusionCuller.AddOccluder(*occluder.mesh, tf.GetWorldMatrix());
+		});
+		occlusionCuller.Rasterize(&JobSystem::Shared());
+		occlusionCuller.Cull(cullBoxes, visibleEntities, &JobSystem::Shared(), &occlusionStats);
+		occlusionTime = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// Casters only matter if their shadow can land on something on screen
+	shadowStats = {};
+	Frustum casterFrustum;
+	if (!shadowCulling)
+	{
+		shadowCasters.resize(cullBoxes.GetCount());
+		for (size_t i = 0; i < shadowCasters.size(); i++)
+			shadowCasters[i] = (unsigned int)i;
+		shadowStats.tested = shadowStats.visible = (unsigned int)shadowCasters.size();
+	}
+	else if (casterQuery && FrustumCuller::MakeCasterFrustum(shadowViewMatrix, shadowProjectionMatrix, cullBoxes, visibleEntities, casterFrustum))
+	{
+		shadowCasters.assign(frustumResults.begin() + frustumOffsets[queryCount - 1], frustumResults.begin() + frustumOffsets[queryCount]);
+		shadowCasters.resize(FrustumCuller::CullList(casterFrustum, cullBoxes, shadowCasters.data(), shadowCasters.size(), shadowCasters.data()));
+		shadowStats.tested = (unsigned int)entityBounds.size();
+		shadowStats.visible = (unsigned int)shadowCasters.size();
+	}
+	else
+	{
+		shadowCasters.clear();
+		shadowStats.tested = (unsigned int)cullBoxes.GetCount();
+	}
+
+	// Both passes' instances go up in one upload. Meshlet culling needs every entity's own view, so it keeps the main pass one draw each
+	shadowGroups.clear();
+	mainGroups.clear();
+	instanceBatcher->Clear();
+	// instancedVS is vs reading its matrices per instance, so a material with another vertex shader keeps its own draws
+	instancedEntities.clear();
+	queuedEntities.clear();
+	for (unsigned int i : visibleEntities)
+	{
+		if (instancing && !meshletCulling && cullRenderables[i]->GetMat()->GetVertexShader() == vs)
+			instancedEntities.push_back(i);
+		else
+			queuedEntities.push_back(i);
+	}
+	if (instancing)
+	{
+		instanceBatcher->Gather(shadowCasters, cullRenderables.data(), cullTransforms.data(), false, shadowGroups);
+		instanceBatcher->Gather(instancedEntities, cullRenderables.data(), cullTransforms.data(), true, mainGroups);
+		instanceBatcher->Upload();
+	}
+
+	// Whatever isn't drawn instanced goes through the render queue, sorted so each draw only binds what the one before it didn't
+	renderQueue.Clear();
+	if (!instancing)
+	{
+		for (unsigned int i : shadowCasters)
+		{
+			Renderable& renderable = *cullRenderables[i];
+			renderQueue.Add(RenderQueue::MakeKey(RENDER_PASS_SHADOW, 0, 0, renderable.GetMesh()->GetSortId(), renderable.GetLod(), 0), i);
+		}
+	}
+
+	// Shader ids are handed out as pairs turn up, there are only ever a few
+	XMFLOAT4X4 camView = cams[activeCam]->GetView();
+	float farClip = cams[activeCam]->GetFarClip();
+	queueShaders.clear();
+	for (unsigned int i : queuedEntities)
+	{
+		Renderable& renderable = *cullRenderables[i];
+		shared_ptr<Material> mat = renderable.GetMat();
+		pair<SimpleVertexShader*, SimplePixelShader*> shaders(mat->GetVertexShader().get(), mat->GetPixelShader().get());
+		unsigned int shader = (unsigned int)(find(queueShaders.begin(), queueShaders.end(), shaders) - queueShaders.begin());
+		if (shader == queueShaders.size())
+			queueShaders.push_back(shaders);
+		assert(shader < (1u << RENDER_QUEUE_SHADER_BITS));
+		XMFLOAT3 center = entityBounds[i].center;
+		float depth = center.x * camView._13 + center.y * camView._23 + center.z * camView._33 + camView._43;
+		renderQueue.Add(RenderQueue::MakeKey(RENDER_PASS_OPAQUE, shader, mat->GetSortId(), renderable.GetMesh()->GetSortId(), renderable.GetLod(),
+			depth / farClip), i);
+	}
+	renderQueue.Sort();
+
+	// What every shader shares goes up once for the whole frame
+	FrameData frameData = {};
+	frameData.view = cams[activeCam]->GetView();
+	frameData.proj = cams[activeCam]->GetProj();
+	frameData.lightView = shadowViewMatrix;
+	frameData.lightProjection = shadowProjectionMatrix;
+	frameData.camPos = cams[activeCam]->GetPos();
+	frameData.dir = dir;
+	frameConstants->Update(frameData);
 
 	// CODE: Render fresh info to the shadow map
-	context->RSSetState(shadowRasterizer.Get());
+	renderDevice->RSSetState(shadowRasterizer.Get());
 
-	context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+	renderDevice->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
 	ID3D11RenderTargetView* nullRTV{};
-	context->OMSetRenderTargets(1, &nullRTV, shadowDSV.Get());
-	context->PSSetShader(0, 0, 0);
+	renderDevice->OMSetRenderTargets(1, &nullRTV, shadowDSV.Get());
+	renderDevice->PSSetShader(0);
 	D3D11_VIEWPORT viewport = {};
 	viewport.Width = (float)shadowMapResolution;
 	viewport.Height = (float)shadowMapResolution;
 	viewport.MaxDepth = 1.0f;
-	context->RSSetViewports(1, &viewport);
-
-	shadowVS->SetShader();
-	shadowVS->SetMatrix4x4("view", shadowViewMatrix);
-	shadowVS->SetMatrix4x4("projection", shadowProjectionMatrix);
-	
+	renderDevice->RSSetViewports(1, &viewport);
 
-	for (auto& e : ents)
+	if (instancing)
 	{
-		shadowVS->SetMatrix4x4("world", e.GetTf()->GetWorldMatrix());
-		shadowVS->CopyAllBufferData();
-		// Draw the mesh directly to avoid the entity's material
-		e.GetMesh()->Draw();
+		// One draw per mesh and LOD, only packed meshes have anything of their own to upload
+		instancedShadowVS->SetShader();
+		for (const InstanceGroup& group : shadowGroups)
+		{
+			if (group.mesh->IsPacked())
+			{
+				instancedShadowVS->SetFloat3("positionMin", group.mesh->GetPositionMin());
+				instancedShadowVS->SetFloat3("positionExtent", group.mesh->GetPositionExtent());
+				instancedShadowVS->CopyAllBufferData();
+			}
+			group.mesh->DrawInstanced(group.lod, instanceBatcher->GetBuffer(), group.firstInstance, group.instanceCount);
+		}
 	}
-
-	for (int i = 0; i < sizeof(floor) / sizeof(floor[0]); i++)
+	else
 	{
-		for (int j = 0; j < sizeof(floor[0]) / sizeof(Ent); j++)
+		shadowVS->SetShader();
+
+		// Draw the mesh directly to avoid the entity's material, its buffers and bounds only when it changes
+		Mesh* mesh = 0;
+		renderQueue.Submit(RENDER_PASS_SHADOW, [&](unsigned int i, unsigned int changes)
 		{
-			shadowVS->SetMatrix4x4("world", floor[i][j].GetTf()->GetWorldMatrix());
+			if (changes & RENDER_CHANGE_MESH)
+			{
+				mesh = cullRenderables[i]->GetMesh().get();
+				if (mesh->IsPacked())
+				{
+					shadowVS->SetFloat3("positionMin", mesh->GetPositionMin());
+					shadowVS->SetFloat3("positionExtent", mesh->GetPositionExtent());
+				}
+			}
+			shadowVS->SetMatrix4x4("world", cullTransforms[i]->GetWorldMatrix());
 			shadowVS->CopyAllBufferData();
-			floor[i][j].GetMesh()->Draw();
-		}
+			mesh->Draw(cullRenderables[i]->GetLod(), (changes & RENDER_CHANGE_MESH) != 0);
+		});
 	}
 
 	// change rendering pipeline settings back to normal
-	context->RSSetState(0);
+	renderDevice->RSSetState(0);
 	viewport.Width = (float)this->windowWidth;
 	viewport.Height = (float)this->windowHeight;
-	context->RSSetViewports(1, &viewport);
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+	renderDevice->RSSetViewports(1, &viewport);
+	renderDevice->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
 	// CODE END
 
 	// Frame START
@@ -575,46 +998,127 @@ void Game::Draw(float deltaTime, float totalTime)
 	{
 		// Clear the back buffer (erases what's on the screen)
 		const float bgColor[4] = { 0.4f, 0.6f, 0.75f, 1.0f }; // Cornflower Blue
-		context->ClearRenderTargetView(backBufferRTV.Get(), bgColor);
+		renderDevice->ClearRenderTargetView(backBufferRTV.Get(), bgColor);
 
 		// clear extra render targets
-		context->ClearRenderTargetView(ppRTV.Get(), bgColor);
+		renderDevice->ClearRenderTargetView(ppRTV.Get(), bgColor);
 
 		// Clear the depth buffer (resets per-pixel occlusion information)
-		context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+		renderDevice->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
 	}
 
-	context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
+	renderDevice->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
 
 	// DRAW geometry
 	// - These steps are generally repeated for EACH object you draw
 	// - Other Direct3D calls will also be necessary to do more complex things
 	{
-		for (int i = 0; i < ents.size(); i++) {
-			
-			vs->SetMatrix4x4("lightView", shadowViewMatrix);
-			vs->SetMatrix4x4("lightProjection", shadowProjectionMatrix);
-			// set shader before drawing entity since most likely each entity will want to be drawn via a different shader instead of the same global one
-			ents[i].GetMat()->GetVertexShader()->SetShader();
-			ents[i].GetMat()->GetPixelShader()->SetShader();
-			ents[i].Draw(cams[activeCam]);
+		if (!mainGroups.empty())
+		{
+			// Only materials drawn with vs were gathered, so instancedVS stands in for all of them.
+			// Groups are sorted by material, the pixel shader's data only changes when the material does
+			instancedVS->SetShader();
+			Material* mat = 0;
+			for (const InstanceGroup& group : mainGroups)
+			{
+				if (group.mesh->IsPacked())
+				{
+					instancedVS->SetFloat3("positionMin", group.mesh->GetPositionMin());
+					instancedVS->SetFloat3("positionExtent", group.mesh->GetPositionExtent());
+					instancedVS->CopyAllBufferData();
+				}
+				if (group.mat != mat)
+				{
+					mat = group.mat;
+					shared_ptr<SimplePixelShader> groupPS = mat->GetPixelShader();
+					groupPS->SetShader();
+					groupPS->SetFloat4("tint", mat->GetColorTint());
+					groupPS->CopyAllBufferData();
+					mat->PrepareMaterial();
+				}
+				group.mesh->DrawInstanced(group.lod, instanceBatcher->GetBuffer(), group.firstInstance, group.instanceCount);
+			}
 		}
 
-		for (int i = 0; i < sizeof(floor) / sizeof(floor[0]); i++)
+		// Then whatever wasn't instanced, out of the render queue
+		size_t begin, end;
+		renderQueue.GetPass(RENDER_PASS_OPAQUE, begin, end);
+		if (commandRecording && !meshletCulling && begin != end)
 		{
-			for (int j = 0; j < sizeof(floor[0]) / sizeof(Ent); j++)
+			// One piece of the sorted draws per thread, each recorded into its own buffer, replayed in order
+			JobSystem& jobs = JobSystem::Shared();
+			size_t pieces = min((size_t)jobs.GetThreadCount(), end - begin);
+			while (commandBuffers.size() < pieces)
+				commandBuffers.push_back(make_shared<CommandBuffer>());
+			commandBufferList.resize(pieces);
+			commandStats.resize(pieces);
+			jobs.ParallelFor(pieces, 1, [&](size_t first, size_t last)
 			{
-				floor[i][j].GetMat()->GetVertexShader()->SetShader();
-				floor[i][j].GetMat()->GetPixelShader()->SetShader();
-				floor[i][j].Draw(cams[activeCam]);
-			}
+				for (size_t p = first; p < last; p++)
+				{
+					commandBuffers[p]->Reset();
+					commandStats[p] = RecordOpaque(*commandBuffers[p], begin + (end - begin) * p / pieces, begin + (end - begin) * (p + 1) / pieces, viewport);
+					commandBufferList[p] = commandBuffers[p].get();
+				}
+			});
+			for (const RenderQueueStats& pieceStats : commandStats)
+				renderQueue.AddStats(pieceStats);
+
+			D3D11RenderDevice* d3d11Device = dynamic_cast<D3D11RenderDevice*>(stateCache->GetTarget());
+			if (d3d11Device)
+				d3d11Device->SetDeferredContexts(deferredContexts);
+			renderDevice->ExecuteCommandBuffers(commandBufferList.data(), pieces, &jobs);
+		}
+		else
+		{
+			// Each entity's draw split up by what changes: the camera and light are already in FrameConstants,
+			// a material's data goes up once per run of its draws, and a mesh's buffers once per run of the mesh
+			shared_ptr<SimpleVertexShader> entityVS;
+			Mesh* mesh = 0;
+			renderQueue.Submit(RENDER_PASS_OPAQUE, [&](unsigned int i, unsigned int changes)
+			{
+				Renderable& renderable = *cullRenderables[i];
+				Transform& tf = *cullTransforms[i];
+				if (changes & RENDER_CHANGE_SHADER)
+				{
+					entityVS = renderable.GetMat()->GetVertexShader();
+					entityVS->SetShader();
+					renderable.GetMat()->GetPixelShader()->SetShader();
+				}
+				if (changes & RENDER_CHANGE_MATERIAL)
+				{
+					shared_ptr<Material> mat = renderable.GetMat();
+					shared_ptr<SimplePixelShader> entityPS = mat->GetPixelShader();
+					entityPS->SetFloat4("tint", mat->GetColorTint());
+					entityPS->CopyAllBufferData();
+					mat->PrepareMaterial();
+				}
+				if (changes & RENDER_CHANGE_MESH)
+				{
+					mesh = renderable.GetMesh().get();
+					if (mesh->IsPacked())
+					{
+						entityVS->SetFloat3("positionMin", mesh->GetPositionMin());
+						entityVS->SetFloat3("positionExtent", mesh->GetPositionExtent());
+					}
+				}
+				entityVS->SetMatrix4x4("world", tf.GetWorldMatrix());
+				entityVS->SetMatrix4x4("worldIT", tf.GetWorldInverseTransposeMatrix());
+				entityVS->CopyAllBufferData();
+				bool bind = (changes & RENDER_CHANGE_MESH) != 0;
+				if (meshletCulling)
+					mesh->DrawCulled(renderable.GetLod(), MeshletCuller::MakeView(tf.GetWorldMatrix(), cams[activeCam]->GetView(), cams[activeCam]->GetProj(),
+						cams[activeCam]->GetPos()), &meshletStats, bind);
+				else
+					mesh->Draw(renderable.GetLod(), bind);
+			});
 		}
 	}
 
 	// Draw sky last so pixelshader doesn't have to draw the part of the sky we can't see
-	sky.Draw(context, cams, activeCam);
+	sky.Draw(renderDevice);
 
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+	renderDevice->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
 
 	// Activate shaders and bind resources
 	// Also set any required cbuffer data (not shown)
@@ -626,7 +1130,7 @@ void Game::Draw(float deltaTime, float totalTime)
 	ppPS->SetFloat("pixelWidth", 1.0f / windowWidth);
 	ppPS->SetFloat("pixelHeight", 1.0f / windowHeight);
 	ppPS->CopyAllBufferData();
-	context->Draw(3, 0); // Draw exactly 3 vertices (one triangle)
+	renderDevice->Draw(3, 0); // Draw exactly 3 vertices (one triangle)
 
 	// Frame END
 	// - These should happen exactly ONCE PER FRAME
@@ -635,21 +1139,27 @@ void Game::Draw(float deltaTime, float totalTime)
 		// Present the back buffer to the user
 		//  - Puts the results of what we've drawn onto the window
 		//  - Without this, the user never sees anything
-		bool vsyncNecessary = vsync || !deviceSupportsTearing || isFullscreen;
+		// Nothing to present to when running headless
+		if (!headless)
+		{
+			bool vsyncNecessary = vsync || !deviceSupportsTearing || isFullscreen;
 
-		// the imgui stuff should be drawn last here, right before the swap chain presents
-		ImGui::Render();
-		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+			// the imgui stuff should be drawn last here, right before the swap chain presents
+			ImGui::Render();
+			ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
 
-		swapChain->Present(
-			vsyncNecessary ? 1 : 0,
-			vsyncNecessary ? 0 : DXGI_PRESENT_ALLOW_TEARING);
+			swapChain->Present(
+				vsyncNecessary ? 1 : 0,
+				vsyncNecessary ? 0 : DXGI_PRESENT_ALLOW_TEARING);
+		}
 
-		// Must re-bind buffers after presenting, as they become unbound
-		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+		// Must re-bind buffers after presenting, as they become unbound.
+		// ImGui and presenting changed the context behind the state cache's back
+		stateCache->Invalidate();
+		renderDevice->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
 
 		ID3D11ShaderResourceView* nullSRVs[128] = {};
-		context->PSSetShaderResources(0, 128, nullSRVs);
+		renderDevice->PSSetShaderResources(0, 128, nullSRVs);
 	}
 
 }
\ No newline at end of file
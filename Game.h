@@ -6,7 +6,16 @@
 #include <array>
 #include "WICTextureLoader.h"
 #include "DXCore.h"
-#include "Ent.h"
+#include "Registry.h"
+#include "FrustumCuller.h"
+#include "Bvh.h"
+#include "OcclusionCuller.h"
+#include "TriangleBvh.h"
+#include "InstanceBatcher.h"
+#include "RenderQueue.h"
+#include "CommandBuffer.h"
+#include "FrameConstants.h"
+#include "Renderable.h"
 #include "Mesh.h"
 #include "Transform.h"
 #include "Cam.h"
@@ -16,7 +25,7 @@
 #include "Sky.h"
 class Game: public DXCore {
 	public:
-		Game(HINSTANCE hInstance);
+		Game(HINSTANCE hInstance, bool packedVertices = false, bool meshletCulling = false);
 		~Game();
 		void Init();
 		void OnResize();
@@ -25,9 +34,12 @@ class Game: public DXCore {
 
 	private:
 		void ResetRenderTarget();
+		void BuildUI(float);
 		void AddTextures(std::shared_ptr<Material>, const wchar_t*, const wchar_t*, const wchar_t*, const wchar_t*);
-		void Node(const char*, Ent*);
+		void Node(const char*, Entity);
+		void Pick(int, int);
 		void LightNode(const char*, Light*);
+		RenderQueueStats RecordOpaque(CommandBuffer&, size_t, size_t, const D3D11_VIEWPORT&);
 		Light MakeDir(DirectX::XMFLOAT3, DirectX::XMFLOAT3, float);
 		Light MakePoint(float, DirectX::XMFLOAT3, float, DirectX::XMFLOAT3);
 		Light MakeSpot(DirectX::XMFLOAT3, float, DirectX::XMFLOAT3, float, DirectX::XMFLOAT3, float);
@@ -46,8 +58,8 @@ class Game: public DXCore {
 		std::unordered_map<std::string, std::shared_ptr<Mesh>> meshes;
 		std::vector<std::shared_ptr<Material>> mats;
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> ss;
-		std::vector<Ent> ents;
-		Ent floor[15][15];
+		Registry scene; // every entity, its Transform and what it's drawn with
+		std::vector<Entity> ents; // the showcase objects Update() moves around
 		std::vector<std::shared_ptr<Cam>> cams;
 		int activeCam;
 		int ent6Dir;
@@ -71,4 +83,50 @@ class Game: public DXCore {
 		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ppRTV; // For rendering
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ppSRV; // For sampling
 		int blurRadius;
+
+		bool packedVertices; // Models use PackedVertex instead of Vertex
+		bool meshletCulling; // Skip meshlets that are off screen or facing away in the main pass
+		MeshletCullStats meshletStats; // What meshlet culling rejected last frame
+		bool frustumCulling; // Only draw entities whose bounds are in the active camera's frustum in the main pass
+		FrustumCullStats frustumStats; // Entities tested and drawn last frame
+		CullBoxes cullBoxes; // World bounds of every drawn entity, gathered each frame
+		std::vector<Bounds> entityBounds; // The same bounds as last frame's, to tell which entities moved
+		std::vector<Bounds> cullLocalBounds; // Each entity's mesh bounds and world matrix, moved into gatheredBounds in one batch
+		std::vector<DirectX::XMFLOAT4X4> cullWorlds;
+		std::vector<Bounds> gatheredBounds;
+		std::vector<unsigned int> movedEntities;
+		Bvh sceneBvh; // Over entityBounds, refitted as entities move, answers the frustum queries
+		std::vector<unsigned int> frustumResults; // The camera's and shadow casters' frustum queries, asked in one batch
+		std::vector<unsigned int> frustumOffsets;
+		std::vector<Transform*> cullTransforms; // Which entity each box is
+		std::vector<Renderable*> cullRenderables;
+		std::vector<Entity> cullEntities;
+		std::vector<unsigned int> visibleEntities; // Indices into the above the main pass draws
+		bool occlusionCulling; // Also leave out entities hidden behind occluders in the main pass
+		OcclusionStats occlusionStats; // Entities tested against the occluders and drawn last frame
+		float occlusionTime; // Milliseconds drawing the occluders and testing entities last frame
+		OcclusionCuller occlusionCuller;
+		bool shadowCulling; // Only draw entities that can shadow something on screen into the shadow map
+		FrustumCullStats shadowStats; // Entities tested and drawn into the shadow map last frame
+		std::vector<unsigned int> shadowCasters; // Indices into the above the shadow pass draws
+		bool instancing; // Draw entities sharing a mesh, LOD and material with one DrawIndexedInstanced
+		std::shared_ptr<InstanceBatcher> instanceBatcher;
+		std::vector<unsigned int> instancedEntities; // visibleEntities whose material uses vs, the only ones instancedVS can draw
+		std::vector<unsigned int> queuedEntities; // visibleEntities the main pass draws through the render queue
+		std::shared_ptr<FrameConstants> frameConstants; // The camera, shadow map and light every shader reads, uploaded once a frame
+		std::shared_ptr<SimpleVertexShader> instancedVS; // vs, reading the world matrices per instance
+		std::shared_ptr<SimpleVertexShader> instancedShadowVS;
+		std::vector<InstanceGroup> shadowGroups; // This frame's instances, both passes share one buffer
+		std::vector<InstanceGroup> mainGroups;
+		RenderQueue renderQueue; // The draws that aren't instanced, of both passes
+		std::vector<std::pair<SimpleVertexShader*, SimplePixelShader*>> queueShaders; // Each render queue shader id's shaders, this frame
+		bool commandRecording; // Record the main pass's queued draws on every thread and replay them after, instead of drawing directly
+		bool deferredContexts; // Replay them through D3D11 deferred contexts, when the device has them
+		std::vector<std::shared_ptr<CommandBuffer>> commandBuffers; // One per piece of the main pass, kept so recording stops allocating
+		std::vector<const CommandBuffer*> commandBufferList; // The same, as ExecuteCommandBuffers() takes them
+		std::vector<RenderQueueStats> commandStats; // Each piece's draws and state changes
+		std::vector<RayTarget> pickTargets; // Each entity's mesh and where it is, for picking against sceneBvh
+		Entity pickedEntity; // Under the cursor at the last right click, null if nothing was
+		unsigned int pickedTriangle;
+		float pickedDistance; // From the camera, in world units
 };
\ No newline at end of file
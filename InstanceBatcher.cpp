@@ -0,0 +1,103 @@
+#include "InstanceBatcher.h"
+#include "Renderable.h"
+#include <algorithm>
+
+using namespace DirectX;
+using namespace std;
+
+const D3D11_INPUT_ELEMENT_DESC InstanceBatcher::InputLayout[INSTANCE_ELEMENT_COUNT] =
+{
+	{ "WORLD_PER_INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD_PER_INSTANCE", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD_PER_INSTANCE", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD_PER_INSTANCE", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLDIT_PER_INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLDIT_PER_INSTANCE", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLDIT_PER_INSTANCE", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLDIT_PER_INSTANCE", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+};
+
+InstanceBatcher::InstanceBatcher(Microsoft::WRL::ComPtr<ID3D11Device> device, shared_ptr<RenderDevice> renderDevice)
+{
+	this->device = device;
+	this->renderDevice = renderDevice;
+}
+
+/// <summary>
+/// Start a new frame, forgetting every instance gathered for the last one
+/// </summary>
+void InstanceBatcher::Clear()
+{
+	instances.clear();
+}
+
+/// <summary>
+/// Sort a pass's entities into groups and append their matrices, each group's instances in a row
+/// </summary>
+/// <param name="entities">- indices into renderables and transforms of what the pass draws</param>
+/// <param name="byMaterial">- false if the pass doesn't use materials, so entities only need the same mesh and LOD to share a draw</param>
+/// <param name="groups">- output, replaced with this pass's groups, in material then mesh order so switching materials happens as little as possible</param>
+void InstanceBatcher::Gather(const vector<unsigned int>& entities, Renderable* const* renderables, Transform* const* transforms, bool byMaterial,
+	vector<InstanceGroup>& groups)
+{
+	// Render queue keys without the depth put the entities in order, the sort is stable so each group keeps them in the
+	// order they came. Groups are split by the mesh, material and LOD themselves, not the key
+	sorted.resize(entities.size());
+	for (size_t i = 0; i < entities.size(); i++)
+	{
+		Renderable& renderable = *renderables[entities[i]];
+		unsigned int material = byMaterial ? renderable.GetMat()->GetSortId() : 0;
+		sorted[i] = { RenderQueue::MakeKey(0, 0, material, renderable.GetMesh()->GetSortId(), renderable.GetLod(), 0), entities[i] };
+	}
+	RenderQueue::RadixSort(sorted, scratch);
+
+	groups.clear();
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		unsigned int entity = sorted[i].item;
+		Renderable& renderable = *renderables[entity];
+		Mesh* mesh = renderable.GetMesh().get();
+		Material* mat = byMaterial ? renderable.GetMat().get() : 0;
+		int lod = renderable.GetLod();
+		if (groups.empty() || groups.back().mesh != mesh || groups.back().mat != mat || groups.back().lod != lod)
+			groups.push_back({ mesh, mat, lod, (unsigned int)instances.size(), 0 });
+		Transform& tf = *transforms[entity];
+		instances.push_back({ tf.GetWorldMatrix(), tf.GetWorldInverseTransposeMatrix() });
+		groups.back().instanceCount++;
+	}
+}
+
+/// <summary>
+/// Send everything gathered this frame to the instance buffer in one go, growing it first if it's too small
+/// </summary>
+void InstanceBatcher::Upload()
+{
+	if (instances.empty())
+		return;
+	if (instances.size() > capacity)
+	{
+		capacity = max(capacity * 2, (size_t)INSTANCE_BUFFER_START);
+		while (capacity < instances.size())
+			capacity *= 2;
+		D3D11_BUFFER_DESC desc = {};
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = (UINT)(sizeof(InstanceData) * capacity);
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		buffer.Reset();
+		device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+	}
+	renderDevice->UpdateBuffer(buffer.Get(), instances.data(), (UINT)(sizeof(InstanceData) * instances.size()));
+}
+
+/// <returns>The instance buffer, for Mesh::DrawInstanced()</returns>
+ID3D11Buffer* InstanceBatcher::GetBuffer()
+{
+	return buffer.Get();
+}
+
+/// <returns>Every instance gathered since Clear(), in the order the groups index them</returns>
+const vector<InstanceData>& InstanceBatcher::GetInstances() const
+{
+	return instances;
+}
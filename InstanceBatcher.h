@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include "RenderDevice.h"
+#include "RenderQueue.h"
+
+class Mesh;
+class Material;
+class Renderable;
+class Transform;
+
+// Elements of InstanceData in the instanced input layouts, four rows per matrix
+#define INSTANCE_ELEMENT_COUNT 8
+// Instances the buffer has room for at first, it doubles whenever a frame needs more
+#define INSTANCE_BUFFER_START 1024
+
+/// <summary>
+/// What the instanced shaders read per instance from vertex buffer slot 1, both matrices as Transform stores them
+/// </summary>
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInverseTranspose;
+};
+
+/// <summary>
+/// A run of instances drawn with one DrawIndexedInstanced: the same mesh and LOD, and the same material when gathered by material
+/// </summary>
+struct InstanceGroup
+{
+	Mesh* mesh;
+	Material* mat; // 0 when gathered without materials, like for the shadow map
+	int lod;
+	unsigned int firstInstance;
+	unsigned int instanceCount;
+};
+
+/// <summary>
+/// <para>Sorts the entities a pass draws into groups that can share a draw, and packs their matrices into one instance buffer</para>
+/// Every pass of a frame is gathered first and the buffer is uploaded once, each group then draws its own range of it.
+/// The instanced shaders read the matrices through semantics ending in _PER_INSTANCE, which is how SimpleVertexShader's
+/// reflection knows to step them per instance
+/// </summary>
+class InstanceBatcher
+{
+private:
+	std::vector<RenderQueueEntry> sorted;
+	std::vector<RenderQueueEntry> scratch;
+	std::vector<InstanceData> instances;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	size_t capacity = 0;
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	std::shared_ptr<RenderDevice> renderDevice;
+
+public:
+	static const D3D11_INPUT_ELEMENT_DESC InputLayout[INSTANCE_ELEMENT_COUNT];
+
+	InstanceBatcher(Microsoft::WRL::ComPtr<ID3D11Device>, std::shared_ptr<RenderDevice>);
+	void Clear();
+	void Gather(const std::vector<unsigned int>& entities, Renderable* const* renderables, Transform* const* transforms, bool byMaterial,
+		std::vector<InstanceGroup>& groups);
+	void Upload();
+	ID3D11Buffer* GetBuffer();
+	const std::vector<InstanceData>& GetInstances() const;
+};
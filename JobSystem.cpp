@@ -0,0 +1,325 @@
+#include "JobSystem.h"
+
+using namespace std;
+
+namespace
+{
+	// Which worker of which system the current thread is, if any
+	thread_local JobSystem* currentSystem = 0;
+	thread_local int currentWorker = -1;
+
+	// Every thread hands out jobs from its own pool, so making one needs no locking
+	thread_local vector<unique_ptr<Job[]>> jobBlocks;
+	thread_local size_t nextJob = 0;
+}
+
+JobDeque::JobDeque() : top(0), bottom(0), jobs(new atomic<Job*>[JOB_DEQUE_SIZE]) {
+}
+
+/// <summary>
+/// Add a job at the bottom, only the owning worker may call this
+/// </summary>
+/// <returns>False if the deque is full</returns>
+bool JobDeque::Push(Job* job)
+{
+	int64_t b = bottom.load(memory_order_relaxed);
+	int64_t t = top.load(memory_order_acquire);
+	if (b - t >= JOB_DEQUE_SIZE)
+		return false;
+	jobs[b & (JOB_DEQUE_SIZE - 1)].store(job, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	bottom.store(b + 1, memory_order_relaxed);
+	return true;
+}
+
+/// <summary>
+/// Take the newest job back from the bottom, only the owning worker may call this
+/// </summary>
+/// <returns>The job, or 0 if the deque is empty or a thief got the last one first</returns>
+Job* JobDeque::Pop()
+{
+	int64_t b = bottom.load(memory_order_relaxed) - 1;
+	bottom.store(b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t t = top.load(memory_order_relaxed);
+	if (t > b)
+	{
+		bottom.store(b + 1, memory_order_relaxed);
+		return 0;
+	}
+	Job* job = jobs[b & (JOB_DEQUE_SIZE - 1)].load(memory_order_relaxed);
+	if (t == b)
+	{
+		// The last job, race the thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+			job = 0;
+		bottom.store(b + 1, memory_order_relaxed);
+	}
+	return job;
+}
+
+/// <summary>
+/// Take the oldest job from the top, any thread may call this
+/// </summary>
+/// <returns>The job, or 0 if the deque is empty or another thread took it first</returns>
+Job* JobDeque::Steal()
+{
+	int64_t t = top.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t b = bottom.load(memory_order_acquire);
+	if (t >= b)
+		return 0;
+	Job* job = jobs[t & (JOB_DEQUE_SIZE - 1)].load(memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+		return 0;
+	return job;
+}
+
+/// <summary>
+/// The job system everything shares, one worker per core, made by the first thread to use it
+/// </summary>
+JobSystem& JobSystem::Shared()
+{
+	static JobSystem shared;
+	return shared;
+}
+
+/// <summary>
+/// Start the workers, the calling thread becomes worker 0
+/// </summary>
+/// <param name="threadCount">- workers including the calling thread, 0 for one per core</param>
+JobSystem::JobSystem(unsigned int threadCount) : queued(0), sleeping(0), running(true)
+{
+	if (threadCount == 0) threadCount = thread::hardware_concurrency();
+	if (threadCount == 0) threadCount = 1;
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(unique_ptr<Worker>(new Worker()));
+		workers.back()->random = i * 2654435761u + 1;
+	}
+
+	previousSystem = currentSystem;
+	previousWorker = currentWorker;
+	currentSystem = this;
+	currentWorker = 0;
+	for (unsigned int i = 1; i < threadCount; i++)
+		threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+/// <summary>
+/// Stop the workers once they're done with what they're running, jobs still queued are dropped
+/// </summary>
+JobSystem::~JobSystem()
+{
+	running = false;
+	{
+		lock_guard<mutex> lock(sleepLock);
+		wake.notify_all();
+	}
+	for (thread& t : threads)
+		t.join();
+	if (currentSystem == this)
+	{
+		currentSystem = previousSystem;
+		currentWorker = previousWorker;
+	}
+}
+
+/// <summary>
+/// Take the next finished job of the calling thread's pool, going round it in order, and grow the pool when every job is still busy
+/// </summary>
+Job* JobSystem::Allocate()
+{
+	size_t total = jobBlocks.size() * JOB_POOL_SIZE;
+	for (size_t tries = 0; tries < total; tries++)
+	{
+		size_t index = nextJob++ % total;
+		Job* job = &jobBlocks[index / JOB_POOL_SIZE][index % JOB_POOL_SIZE];
+		if (job->unfinished.load(memory_order_acquire) == 0)
+			return job;
+	}
+	jobBlocks.push_back(unique_ptr<Job[]>(new Job[JOB_POOL_SIZE]));
+	nextJob = total + 1;
+	return &jobBlocks.back()[0];
+}
+
+/// <returns>The calling thread's worker index in this system, -1 if it isn't one of them</returns>
+int JobSystem::CurrentWorker()
+{
+	return currentSystem == this ? currentWorker : -1;
+}
+
+/// <summary>
+/// Queue a job that's ready to go and wake a worker for it if any are asleep
+/// </summary>
+void JobSystem::Push(Job* job)
+{
+	int worker = CurrentWorker();
+	if (worker >= 0)
+	{
+		if (!workers[worker]->deque.Push(job))
+		{
+			Execute(job);
+			return;
+		}
+	}
+	else
+	{
+		lock_guard<mutex> lock(injectedLock);
+		injected.push_back(job);
+	}
+	queued.fetch_add(1);
+	if (sleeping.load() > 0)
+	{
+		lock_guard<mutex> lock(sleepLock);
+		wake.notify_one();
+	}
+}
+
+/// <summary>
+/// Find something to run: the worker's own newest job, else the oldest job of another worker, else the shared queue
+/// </summary>
+/// <param name="worker">- the calling thread's worker index, -1 if it isn't one</param>
+/// <returns>The job, or 0 if there's nothing</returns>
+Job* JobSystem::Find(int worker)
+{
+	Job* job = worker >= 0 ? workers[worker]->deque.Pop() : 0;
+	if (!job && queued.load(memory_order_relaxed) > 0)
+	{
+		// Xorshift so idle workers don't all go after the same victim
+		unsigned int start = 0;
+		if (worker >= 0)
+		{
+			unsigned int& random = workers[worker]->random;
+			random ^= random << 13;
+			random ^= random >> 17;
+			random ^= random << 5;
+			start = random;
+		}
+		for (size_t i = 0; i < workers.size() && !job; i++)
+		{
+			size_t victim = (start + i) % workers.size();
+			if ((int)victim != worker)
+				job = workers[victim]->deque.Steal();
+		}
+		if (!job)
+		{
+			lock_guard<mutex> lock(injectedLock);
+			if (!injected.empty())
+			{
+				job = injected.front();
+				injected.pop_front();
+			}
+		}
+	}
+	if (job)
+		queued.fetch_sub(1, memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	job->function(job);
+	Finish(job);
+}
+
+/// <summary>
+/// Count a job or one of its children as done, once the job is done run its dependents and tell its parent
+/// </summary>
+void JobSystem::Finish(Job* job)
+{
+	// Read before the count drops, after that the job can be handed out again
+	Job* parent = job->parent;
+	unsigned int dependentCount = job->dependentCount;
+	Job* dependents[JOB_MAX_DEPENDENTS];
+	for (unsigned int i = 0; i < dependentCount; i++)
+		dependents[i] = job->dependents[i];
+	if (job->unfinished.fetch_sub(1, memory_order_acq_rel) != 1)
+		return;
+	for (unsigned int i = 0; i < dependentCount; i++)
+		Run(dependents[i]);
+	if (parent)
+		Finish(parent);
+}
+
+/// <summary>
+/// Workers other than 0 run jobs until the system goes, sleeping while there are none
+/// </summary>
+void JobSystem::WorkerLoop(unsigned int index)
+{
+	currentSystem = this;
+	currentWorker = (int)index;
+	unsigned int spins = 0;
+	while (running.load(memory_order_relaxed))
+	{
+		Job* job = Find((int)index);
+		if (job)
+		{
+			Execute(job);
+			spins = 0;
+			continue;
+		}
+		if (++spins < JOB_IDLE_SPINS)
+		{
+			this_thread::yield();
+			continue;
+		}
+		unique_lock<mutex> lock(sleepLock);
+		sleeping.fetch_add(1);
+		wake.wait(lock, [&]() { return queued.load() > 0 || !running.load(); });
+		sleeping.fetch_sub(1);
+		spins = 0;
+	}
+}
+
+/// <summary>
+/// Hold a job back until another has finished, both must not have been run yet
+/// </summary>
+/// <param name="before">- runs first</param>
+/// <param name="after">- runs once before has finished, with its children</param>
+/// <returns>False if before already has JOB_MAX_DEPENDENTS dependents</returns>
+bool JobSystem::AddDependency(Job* before, Job* after)
+{
+	if (before->dependentCount == JOB_MAX_DEPENDENTS)
+		return false;
+	before->dependents[before->dependentCount++] = after;
+	after->waiting.fetch_add(1, memory_order_relaxed);
+	return true;
+}
+
+/// <summary>
+/// Let a job go, it's queued once the jobs it depends on have finished
+/// </summary>
+void JobSystem::Run(Job* job)
+{
+	if (job->waiting.fetch_sub(1, memory_order_acq_rel) == 1)
+		Push(job);
+}
+
+/// <summary>
+/// Run other jobs until this one has finished, so waiting never leaves a core idle
+/// </summary>
+void JobSystem::Wait(Job* job)
+{
+	int worker = CurrentWorker();
+	while (job->unfinished.load(memory_order_acquire) > 0)
+	{
+		Job* other = Find(worker);
+		if (other)
+			Execute(other);
+		else
+			this_thread::yield();
+	}
+}
+
+/// <returns>Whether the job and its children have all finished</returns>
+bool JobSystem::IsFinished(Job* job)
+{
+	return job->unfinished.load(memory_order_acquire) == 0;
+}
+
+/// <returns>Workers, including the thread that made the system</returns>
+unsigned int JobSystem::GetThreadCount()
+{
+	return (unsigned int)workers.size();
+}
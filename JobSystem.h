@@ -0,0 +1,197 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <malloc.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Jobs each thread's pool grows by, a finished job is reused once the pool comes back around to it
+#define JOB_POOL_SIZE 4096
+// Jobs a worker's deque holds, a job run while it's full is executed right away instead
+#define JOB_DEQUE_SIZE 4096
+// Jobs that can wait on a single job with JobSystem::AddDependency()
+#define JOB_MAX_DEPENDENTS 4
+// Bytes a job's callable can take, lambdas capturing a few references and indices fit
+#define JOB_DATA_BYTES 64
+// ParallelFor() cuts its range into about this many pieces per thread, so threads that run out have something to steal
+#define JOB_PIECES_PER_THREAD 8
+// Times an idle worker looks for work again before it goes to sleep
+#define JOB_IDLE_SPINS 64
+
+/// <summary>
+/// <para>Heap allocation at Alignment for types that need more than plain new gives them</para>
+/// Before C++17 new only aligns to 8 bytes on Win32 and 16 on x64, so the cache line aligned jobs and workers go
+/// through _aligned_malloc instead
+/// </summary>
+template<size_t Alignment>
+struct AlignedAllocation
+{
+	static void* operator new(size_t size)
+	{
+		void* memory = _aligned_malloc(size, Alignment);
+		if (!memory)
+			throw std::bad_alloc();
+		return memory;
+	}
+	static void* operator new[](size_t size) { return operator new(size); }
+	static void operator delete(void* memory) { _aligned_free(memory); }
+	static void operator delete[](void* memory) { _aligned_free(memory); }
+};
+
+/// <summary>
+/// <para>A function to run on some thread, with counters for what it waits on and what waits on it</para>
+/// Jobs come from a pool per thread and are reused after they finish, so wait on a job soon after running it
+/// </summary>
+struct alignas(64) Job : AlignedAllocation<64>
+{
+	void (*function)(Job*);
+	Job* parent; // isn't finished until this job is
+	std::atomic<int> unfinished{ 0 }; // itself and its unfinished children
+	std::atomic<int> waiting{ 0 }; // unfinished dependencies, plus one until Run() is called
+	Job* dependents[JOB_MAX_DEPENDENTS]; // run once this job is finished
+	unsigned int dependentCount;
+	alignas(16) unsigned char data[JOB_DATA_BYTES]; // the callable
+};
+
+/// <summary>
+/// <para>Chase-Lev work-stealing deque of jobs, fixed size</para>
+/// The owning worker pushes and pops at the bottom without locking, other workers steal the oldest job from the top
+/// </summary>
+class JobDeque
+{
+private:
+	std::atomic<int64_t> top;
+	std::atomic<int64_t> bottom;
+	std::unique_ptr<std::atomic<Job*>[]> jobs;
+public:
+	JobDeque();
+	bool Push(Job* job);
+	Job* Pop();
+	Job* Steal();
+};
+
+/// <summary>
+/// <para>Fixed pool of worker threads running jobs, each worker with its own deque and stealing from the others when it runs dry</para>
+/// The thread that makes the system is worker 0, it runs jobs whenever it waits on one. Other threads can
+/// create and run jobs too, theirs go to a shared queue. A job finishes once it and all of its children have,
+/// then the jobs depending on it are run
+/// </summary>
+class JobSystem
+{
+private:
+	struct alignas(64) Worker : AlignedAllocation<64>
+	{
+		JobDeque deque;
+		unsigned int random; // picks who to steal from first
+	};
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+	std::mutex injectedLock;
+	std::deque<Job*> injected; // run by threads that aren't workers
+	std::atomic<int> queued; // jobs waiting in any deque or the shared queue
+	std::atomic<int> sleeping;
+	std::atomic<bool> running;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	JobSystem* previousSystem; // the constructing thread's system before this one, restored when this one goes
+	int previousWorker;
+
+	static Job* Allocate();
+	int CurrentWorker();
+	void Push(Job* job);
+	Job* Find(int worker);
+	void Execute(Job* job);
+	void Finish(Job* job);
+	void WorkerLoop(unsigned int index);
+
+	template<typename Func>
+	static void Call(Job* job)
+	{
+		Func* func = reinterpret_cast<Func*>(job->data);
+		(*func)();
+		func->~Func();
+	}
+
+	/// <summary>
+	/// Keep halving the range, handing the far halves out as jobs, until what's left is at most grain long
+	/// </summary>
+	template<typename Func>
+	void SplitRange(Job* root, size_t begin, size_t end, size_t grain, Func& func)
+	{
+		while (end - begin > grain)
+		{
+			size_t middle = begin + (end - begin) / 2;
+			Run(Create([this, root, middle, end, grain, &func]() { SplitRange(root, middle, end, grain, func); }, root));
+			end = middle;
+		}
+		func(begin, end);
+	}
+public:
+	static JobSystem& Shared();
+	JobSystem(unsigned int threadCount = 0);
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+	~JobSystem();
+
+	/// <summary>
+	/// Make a job that calls func(), it doesn't start until Run()
+	/// </summary>
+	/// <param name="func">- any callable of up to JOB_DATA_BYTES</param>
+	/// <param name="parent">- optional, won't finish before this job has</param>
+	template<typename Func>
+	Job* Create(Func func, Job* parent = 0)
+	{
+		static_assert(sizeof(Func) <= JOB_DATA_BYTES, "Capture less, or capture a pointer to the rest");
+		static_assert(alignof(Func) <= 16, "Job data is only 16 byte aligned");
+		Job* job = Allocate();
+		job->function = Call<Func>;
+		job->parent = parent;
+		job->unfinished.store(1, std::memory_order_relaxed);
+		job->waiting.store(1, std::memory_order_relaxed);
+		job->dependentCount = 0;
+		new (job->data) Func(std::move(func));
+		if (parent)
+			parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+		return job;
+	}
+
+	bool AddDependency(Job* before, Job* after);
+	void Run(Job* job);
+	void Wait(Job* job);
+	bool IsFinished(Job* job);
+
+	/// <summary>
+	/// <para>Call func(begin, end) over [0, count) in pieces spread across the workers, and wait for all of them</para>
+	/// Pieces are sized so every thread gets several, never shorter than minGrain so tiny ones don't cost more
+	/// to hand out than to run. With one thread, or too little work to split, it all runs right here
+	/// </summary>
+	/// <param name="count">- length of the range</param>
+	/// <param name="minGrain">- shortest piece worth a job</param>
+	/// <param name="func">- called with each piece</param>
+	template<typename Func>
+	void ParallelFor(size_t count, size_t minGrain, Func func)
+	{
+		if (count == 0)
+			return;
+		size_t pieces = workers.size() * JOB_PIECES_PER_THREAD;
+		size_t grain = (count + pieces - 1) / pieces;
+		if (grain < minGrain) grain = minGrain;
+		if (grain < 1) grain = 1;
+		if (workers.size() == 1 || count <= grain)
+		{
+			func((size_t)0, count);
+			return;
+		}
+		Job* root = Create([]() {});
+		SplitRange(root, 0, count, grain, func);
+		Execute(root);
+		Wait(root);
+	}
+
+	unsigned int GetThreadCount();
+};
@@ -158,7 +158,30 @@ struct VertexShaderInput
     float3 localPosition : POSITION; 
     float2 uv : TEXCOORD;
     float3 normal : NORMAL;
-    float3 tangent : TANGENT;
+    float4 tangent : TANGENT; // w is the bitangent sign
+};
+
+// Matches PackedVertex in Vertex.h
+struct PackedVertexShaderInput
+{
+    float4 localPosition : POSITION; // xyz inside the mesh bounds (0-1), w is the bitangent sign (0-1)
+    float2 uv : TEXCOORD;
+    float2 normal : NORMAL; // Octahedral
+    float2 tangent : TANGENT; // Octahedral
+};
+
+// Matches InstanceData in InstanceBatcher.h, from the second vertex buffer.
+// Rows of the matrices as C++ stores them, so they're transposed like the constant buffer's are
+struct InstanceInput
+{
+    float4 world0 : WORLD_PER_INSTANCE0;
+    float4 world1 : WORLD_PER_INSTANCE1;
+    float4 world2 : WORLD_PER_INSTANCE2;
+    float4 world3 : WORLD_PER_INSTANCE3;
+    float4 worldIT0 : WORLDIT_PER_INSTANCE0;
+    float4 worldIT1 : WORLDIT_PER_INSTANCE1;
+    float4 worldIT2 : WORLDIT_PER_INSTANCE2;
+    float4 worldIT3 : WORLDIT_PER_INSTANCE3;
 };
 
 struct VertexToPixel
@@ -167,8 +190,35 @@ struct VertexToPixel
     float2 uv : TEXCOORD;
     float3 normal : NORMAL;
     float3 worldPosition : POSITION;
-    float3 tangent : TANGENT;
+    float4 tangent : TANGENT; // w is the bitangent sign
     float4 shadowMapPos : SHADOW_POSITION;
 };
 
+
+
+// VERTEX DECODING ================
+
+// Unfolds an octahedral encoded direction, the same math as VertexPacking.cpp
+float3 OctDecode(float2 e)
+{
+    float3 n = float3(e, 1 - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0 ? -t : t;
+    return normalize(n);
+}
+
+// Turns a packed vertex back into the full precision one the rest of the shader expects
+//
+// positionMin    - mesh bounds minimum
+// positionExtent - mesh bounds maximum minus minimum
+VertexShaderInput UnpackVertex(PackedVertexShaderInput input, float3 positionMin, float3 positionExtent)
+{
+    VertexShaderInput output;
+    output.localPosition = positionMin + input.localPosition.xyz * positionExtent;
+    output.uv = input.uv;
+    output.normal = OctDecode(input.normal);
+    output.tangent = float4(OctDecode(input.tangent), input.localPosition.w * 2 - 1);
+    return output;
+}
+
 #endif
\ No newline at end of file
@@ -1,6 +1,9 @@
 
 #include <Windows.h>
+#include <cstring>
+#include <cstdlib>
 #include "Game.h"
+#include "Benchmarks.h"
 
 // --------------------------------------------------------
 // Entry point for a graphical (non-console) Windows application
@@ -18,13 +21,35 @@ int WINAPI WinMain(
 	_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+	// "-bench <name> [args]" runs one of the CPU benchmarks and exits
+	// without creating the game, a window or a D3D device
+	const char* benchArg = strstr(lpCmdLine, "-bench");
+	if (benchArg)
+		return RunBenchmark(benchArg + strlen("-bench"));
+
 	// Create the Game object using
 	// the app handle we got from WinMain
-	Game dxGame(hInstance);
+	// "-packed" loads models with the compressed vertex format
+	// "-meshlets" culls meshlets on the CPU before drawing
+	Game dxGame(hInstance, strstr(lpCmdLine, "-packed") != 0, strstr(lpCmdLine, "-meshlets") != 0);
 
 	// Result variable for function calls below
 	HRESULT hr = S_OK;
 
+	// "-headless [frames]" runs the game loop without a window or GPU
+	// and prints CPU cost and draw stats instead of showing anything.
+	// It still needs Windows, resources are made on the WARP device
+	const char* headlessArg = strstr(lpCmdLine, "-headless");
+	if (headlessArg)
+	{
+		int frames = atoi(headlessArg + strlen("-headless"));
+		if (frames <= 0) frames = 1000;
+
+		hr = dxGame.InitHeadless();
+		if (FAILED(hr)) return hr;
+		return dxGame.RunHeadless(frames);
+	}
+
 	// Attempt to create the window for our program, and
 	// exit early if something failed
 	hr = dxGame.InitWindow();
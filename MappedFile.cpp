@@ -0,0 +1,79 @@
+#include "MappedFile.h"
+
+MappedFile::MappedFile()
+{
+	file = INVALID_HANDLE_VALUE;
+	mapping = 0;
+	data = 0;
+	size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+/// <summary>
+/// Map an entire file for reading, closing whatever was mapped before
+/// </summary>
+/// <param name="fileName">- path of the file to map</param>
+/// <returns>False if the file doesn't exist, is empty or can't be mapped</returns>
+bool MappedFile::Open(const wchar_t* fileName)
+{
+	Close();
+
+	file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Empty files can't be mapped
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (!mapping)
+	{
+		Close();
+		return false;
+	}
+
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+/// <summary>
+/// Unmap the view and release the file, any pointers from GetData() are invalid afterwards
+/// </summary>
+void MappedFile::Close()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+	mapping = 0;
+	data = 0;
+	size = 0;
+}
+
+/// <returns>The first byte of the file, or null if nothing is mapped</returns>
+const char* MappedFile::GetData()
+{
+	return data;
+}
+
+/// <returns>Size of the file in bytes</returns>
+size_t MappedFile::GetSize()
+{
+	return size;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <Windows.h>
+
+/// <summary>
+/// <para>Read-only view of a whole file mapped into memory</para>
+/// Lets loaders parse or upload file contents in place instead of copying them through a stream
+/// </summary>
+class MappedFile
+{
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const char* data;
+	size_t size;
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	bool Open(const wchar_t* fileName);
+	void Close();
+	const char* GetData();
+	size_t GetSize();
+};
@@ -60,3 +60,26 @@ void Material::PrepareMaterial()
 	for (auto& t : SRVs) ps->SetShaderResourceView(t.first.c_str(), t.second);
 	for (auto& s : samplers) ps->SetSamplerState(s.first.c_str(), s.second);
 }
+
+/// <summary>
+/// Bind the textures and samplers onto another device, like a CommandBuffer. Only reads the material and its pixel shader, so any thread can
+/// </summary>
+void Material::PrepareMaterial(RenderDevice& target)
+{
+	for (auto& t : SRVs)
+	{
+		const SimpleSRV* srv = ps->GetShaderResourceViewInfo(t.first);
+		if (srv) target.PSSetShaderResources(srv->BindIndex, 1, t.second.GetAddressOf());
+	}
+	for (auto& s : samplers)
+	{
+		const SimpleSampler* sampler = ps->GetSamplerInfo(s.first);
+		if (sampler) target.PSSetSamplers(sampler->BindIndex, 1, s.second.GetAddressOf());
+	}
+}
+
+/// <returns>Small id, unique among live ones and reused once this is destroyed, for render queue keys</returns>
+unsigned int Material::GetSortId()
+{
+	return sortId;
+}
@@ -3,6 +3,7 @@
 #include <memory>
 #include <unordered_map>
 #include "SimpleShader.h"
+#include "RenderQueue.h"
 class Material
 {
 private:
@@ -11,6 +12,7 @@ private:
 	std::shared_ptr<SimplePixelShader> ps;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> SRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+	SortId<Material, RENDER_QUEUE_MATERIAL_BITS> sortId;
 public:
 	Material(DirectX::XMFLOAT4, std::shared_ptr<SimpleVertexShader>, std::shared_ptr<SimplePixelShader>);
 	DirectX::XMFLOAT4 GetColorTint();
@@ -22,5 +24,7 @@ public:
 	void AddTextureSRV(std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>);
 	void AddSampler(std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>);
 	void PrepareMaterial();
+	void PrepareMaterial(RenderDevice& target);
+	unsigned int GetSortId();
 };
 
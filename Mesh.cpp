@@ -1,23 +1,50 @@
 #include "Mesh.h"
+#include "ObjImporter.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "TangentGenerator.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "InstanceBatcher.h"
+#include <cstring>
 
 using namespace DirectX;
 using namespace std;
 
-void Mesh::MakeVB(Vertex* vertices, int vertexCount, Microsoft::WRL::ComPtr<ID3D11Device> device)
+// A LOD is good enough while its error covers at most this many pixels on screen
+#define MESH_LOD_PIXEL_ERROR 1.0f
+// Only switch to a coarser LOD once its error is this far under the limit, so LODs don't flicker at the boundary
+#define MESH_LOD_HYSTERESIS 0.7f
+
+/// <summary>
+/// Upload the vertices, bounds has to be set first
+/// </summary>
+void Mesh::MakeVB(const Vertex* vertices, int vertexCount, Microsoft::WRL::ComPtr<ID3D11Device> device)
 {
+	// Packed meshes quantize on the way up, the shaders need the bounds to decode positions
+	vector<PackedVertex> packedVertices;
+	if (packed)
+	{
+		positionMin = bounds.boxMin;
+		XMStoreFloat3(&positionExtent, XMLoadFloat3(&bounds.boxMax) - XMLoadFloat3(&bounds.boxMin));
+		packedVertices.resize(vertexCount);
+		VertexPacking::Pack(vertices, vertexCount, bounds.boxMin, bounds.boxMax, packedVertices.data());
+	}
+
 	D3D11_BUFFER_DESC vbd = {};
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * vertexCount;
+	vbd.ByteWidth = (packed ? sizeof(PackedVertex) : sizeof(Vertex)) * vertexCount;
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
 	vbd.StructureByteStride = 0;
 	D3D11_SUBRESOURCE_DATA initialVertexData = {};
-	initialVertexData.pSysMem = vertices;
+	initialVertexData.pSysMem = packed ? (const void*)packedVertices.data() : vertices;
 	device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
 }
 
-void Mesh::MakeIB(unsigned int* indices, int indexCount, Microsoft::WRL::ComPtr<ID3D11Device> device)
+void Mesh::MakeIB(const unsigned int* indices, int indexCount, Microsoft::WRL::ComPtr<ID3D11Device> device)
 {
 	D3D11_BUFFER_DESC ibd = {};
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
@@ -31,336 +58,225 @@ void Mesh::MakeIB(unsigned int* indices, int indexCount, Microsoft::WRL::ComPtr<
 	device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
 }
 
-Mesh::Mesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext)
+/// <summary>
+/// Upload a mesh that was mapped from its cache, LODs and meshlets included
+/// </summary>
+void Mesh::MakeFromCache(MeshCache& cache, Microsoft::WRL::ComPtr<ID3D11Device> device)
 {
-	this->indexCount = indexCount;
-	this->deviceContext = deviceContext;
-	CalculateTangents(vertices, vertexCount, indices, indexCount);
-	MakeVB(vertices, vertexCount, device);
-	MakeIB(indices, indexCount, device);
+	// The mapped arrays go straight to D3D, nothing is copied on the CPU side unless packing
+	this->indexCount = cache.GetIndexCount();
+	lodCount = cache.GetLodCount();
+	memcpy(lods, cache.GetLods(), lodCount * sizeof(MeshLod));
+	meshlets.assign(cache.GetMeshlets(), cache.GetMeshlets() + cache.GetMeshletCount());
+	triangleBvh.Load(cache.GetBvhNodes(), cache.GetBvhNodeCount(), cache.GetBvhTriangles(), cache.GetBvhTriangleIndices(), cache.GetBvhTriangleCount());
+	bounds = cache.GetBounds();
+	MakeVB(cache.GetVertices(), cache.GetVertexCount(), device);
+	MakeIB(cache.GetIndices(), indexCount, device);
 }
 
-Mesh::Mesh(const wchar_t* fileName, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext)
+Mesh::Mesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount, Microsoft::WRL::ComPtr<ID3D11Device> device, shared_ptr<RenderDevice> renderDevice)
 {
-	// Author: Chris Cascioli 
-	// THE OBJECT LOADING CODE BELOW IS NOT MINE, IT WAS DESIGNED BY CHRIS CASCIOLI
-	// THE OBJECT LOADING CODE BELOW IS NOT MINE, IT WAS DESIGNED BY CHRIS CASCIOLI
-	// THE OBJECT LOADING CODE BELOW IS NOT MINE, IT WAS DESIGNED BY CHRIS CASCIOLI
-// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
-// 
-// - You are allowed to directly copy/paste this into your code base
-//   for assignments, given that you clearly cite that this is not
-//   code of your own design.
-//
-// - NOTE: You'll need to #include <fstream>
+	this->indexCount = indexCount;
+	this->renderDevice = renderDevice;
+
+	// Tangents can split vertices, so they work on copies and go first
+	vector<Vertex> verts(vertices, vertices + vertexCount);
+	vector<unsigned int> splitIndices(indices, indices + indexCount);
+	TangentGenerator::Generate(verts, splitIndices);
+	lods[0] = { 0, (unsigned int)indexCount, 0.0f };
+	MeshletBuilder::Build(&verts[0], verts.size(), &splitIndices[0], 0, indexCount, meshlets);
+	lods[0].meshletCount = (unsigned int)meshlets.size();
+	triangleBvh.Build(&verts[0], &splitIndices[0], indexCount);
+	bounds = BoundingVolumes::Compute(&verts[0], (int)verts.size());
+	MakeVB(&verts[0], (int)verts.size(), device);
+	MakeIB(&splitIndices[0], indexCount, device);
+}
 
+Mesh::Mesh(MeshCache& cache, Microsoft::WRL::ComPtr<ID3D11Device> device, shared_ptr<RenderDevice> renderDevice, bool packed)
+{
+	this->packed = packed;
+	this->renderDevice = renderDevice;
+	MakeFromCache(cache, device);
+}
 
-// File input object
-	std::ifstream obj(fileName);
+Mesh::Mesh(const wchar_t* fileName, Microsoft::WRL::ComPtr<ID3D11Device> device, shared_ptr<RenderDevice> renderDevice, bool packed)
+{
+	this->packed = packed;
+	this->renderDevice = renderDevice;
 
-	// Check for successful open
-	if (!obj.is_open())
+	// Use the binary cache next to the model if it's still up to date
+	wstring cacheName = wstring(fileName) + L".meshcache";
+	MeshCache cache;
+	if (cache.Open(cacheName.c_str(), fileName))
+	{
+		MakeFromCache(cache, device);
 		return;
+	}
 
-	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;	// Positions from the file
-	std::vector<XMFLOAT3> normals;		// Normals from the file
-	std::vector<XMFLOAT2> uvs;		// UVs from the file
-	std::vector<Vertex> verts;		// Verts we're assembling
-	std::vector<UINT> indices;		// Indices of these verts
-	int vertCounter = 0;			// Count of vertices
-	int indexCounter = 0;			// Count of indices
-	char chars[100];			// String for line reading
+	// Parsing and the LH conversion (Z flip, V flip, winding) happen in ObjImporter
+	vector<Vertex> verts;
+	vector<unsigned int> indices;
+	if (!ObjImporter::Load(fileName, verts, indices) || indices.empty())
+		return;
+	MeshOptimizer::Optimize(verts, indices);
 
-	// Still have data left?
-	while (obj.good())
+	// Tangents come from the full mesh only, the LODs share its vertices (split ones included)
+	TangentGenerator::Generate(verts, indices);
+	lodCount = MeshSimplifier::BuildLods(&verts[0], verts.size(), indices, lods);
+	for (int i = 0; i < lodCount; i++)
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
-
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't')
-		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f')
-		{
-			// Read the face indices into an array
-			// NOTE: This assumes the given obj file contains
-			//  vertex positions, uv coordinates AND normals.
-			unsigned int i[12];
-			int numbersRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// If we only got the first number, chances are the OBJ
-			// file has no UV coordinates.  This isn't great, but we
-			// still want to load the model without crashing, so we
-			// need to re-read a different pattern (in which we assume
-			// there are no UVs denoted for any of the vertices)
-			if (numbersRead == 1)
-			{
-				// Re-read with a different pattern
-				numbersRead = sscanf_s(
-					chars,
-					"f %d//%d %d//%d %d//%d %d//%d",
-					&i[0], &i[2],
-					&i[3], &i[5],
-					&i[6], &i[8],
-					&i[9], &i[11]);
-
-				// The following indices are where the UVs should 
-				// have been, so give them a valid value
-				i[1] = 1;
-				i[4] = 1;
-				i[7] = 1;
-				i[10] = 1;
-
-				// If we have no UVs, create a single UV coordinate
-				// that will be used for all vertices
-				if (uvs.size() == 0)
-					uvs.push_back(XMFLOAT2(0, 0));
-			}
-
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// The model is most likely in a right-handed space,
-			// especially if it came from Maya.  We want to convert
-			// to a left-handed space for DirectX.  This means we 
-			// need to:
-			//  - Invert the Z position
-			//  - Invert the normal's Z
-			//  - Flip the winding order
-			// We also need to flip the UV coordinate since DirectX
-			// defines (0,0) as the top left of the texture, and many
-			// 3D modeling packages use the bottom left as (0,0)
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal's Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-			vertCounter += 3;
-
-			// Add three more indices
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-
-			// Was there a 4th face?
-			// - 12 numbers read means 4 faces WITH uv's
-			// - 8 numbers read means 4 faces WITHOUT uv's
-			if (numbersRead == 12 || numbersRead == 8)
-			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal's Z
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-				vertCounter += 3;
-
-				// Add three more indices
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-			}
-		}
+		lods[i].meshletOffset = (unsigned int)meshlets.size();
+		MeshletBuilder::Build(&verts[0], verts.size(), &indices[0], lods[i].indexOffset, lods[i].indexCount, meshlets);
+		lods[i].meshletCount = (unsigned int)meshlets.size() - lods[i].meshletOffset;
 	}
+	triangleBvh.Build(&verts[0], &indices[lods[0].indexOffset], lods[0].indexCount);
 
-	// Close the file and create the actual buffers
-	obj.close();
+	this->indexCount = (int)indices.size();
+	bounds = BoundingVolumes::Compute(&verts[0], (int)verts.size());
+	MakeVB(&verts[0], (int)verts.size(), device);
+	MakeIB(&indices[0], indexCount, device);
 
-	// - At this point, "verts" is a vector of Vertex structs, and can be used
-	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
-	//
-	// - The vector "indices" is similar. It's a vector of unsigned ints and
-	//    can be used directly for the index buffer: &indices[0] is the address of the first int
-	//
-	// - "vertCounter" is the number of vertices
-	// - "indexCounter" is the number of indices
-	// - Yes, these are effectively the same since OBJs do not index entire vertices!  This means
-	//    an index buffer isn't doing much for us.  We could try to optimize the mesh ourselves
-	//    and detect duplicate vertices, but at that point it would be better to use a more
-	//    sophisticated model loading library like TinyOBJLoader or The Open Asset Importer Library
-	this->indexCount = indexCounter;
-	this->deviceContext = deviceContext;
-	CalculateTangents(&verts[0], vertCounter, &indices[0], indexCounter);
-	MakeVB(&verts[0], vertCounter, device);
-	MakeIB(&indices[0], indexCounter, device);
+	// Next launch can skip all of the above, a failed write just means importing again
+	MeshCache::Write(cacheName.c_str(), fileName, &verts[0], (int)verts.size(), &indices[0], indexCount, bounds, lods, lodCount,
+		meshlets.data(), (int)meshlets.size(), triangleBvh);
 };
 
-// --------------------------------------------------------
-// Author: Chris Cascioli
-// Purpose: Calculates the tangents of the vertices in a mesh
-// 
-// - You are allowed to directly copy/paste this into your code base
-//   for assignments, given that you clearly cite that this is not
-//   code of your own design.
-//
-// - Code originally adapted from: http://www.terathon.com/code/tangent.html
-//   - Updated version now found here: http://foundationsofgameenginedev.com/FGED2-sample.pdf
-//   - See listing 7.4 in section 7.5 (page 9 of the PDF)
-//
-// - Note: For this code to work, your Vertex format must
-//         contain an XMFLOAT3 called Tangent
-//
-// - Be sure to call this BEFORE creating your D3D vertex/index buffers
-// --------------------------------------------------------
-void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+/// <summary>
+/// Bind the vertex and index buffers every LOD shares
+/// </summary>
+/// <param name="device">- optional, binds onto this instead of the mesh's own device, like a CommandBuffer on a worker thread</param>
+void Mesh::Bind(RenderDevice* device)
 {
-	// Reset tangents
-	for (int i = 0; i < numVerts; i++)
-	{
-		verts[i].Tangent = XMFLOAT3(0, 0, 0);
-	}
-
-	// Calculate tangents one whole triangle at a time
-	for (int i = 0; i < numIndices;)
-	{
-		// Grab indices and vertices of first triangle
-		unsigned int i1 = indices[i++];
-		unsigned int i2 = indices[i++];
-		unsigned int i3 = indices[i++];
-		Vertex* v1 = &verts[i1];
-		Vertex* v2 = &verts[i2];
-		Vertex* v3 = &verts[i3];
+	if (!device) device = renderDevice.get();
+	UINT stride = packed ? sizeof(PackedVertex) : sizeof(Vertex);
+	UINT offset = 0;
+	device->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
+	device->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
 
-		// Calculate vectors relative to triangle positions
-		float x1 = v2->Position.x - v1->Position.x;
-		float y1 = v2->Position.y - v1->Position.y;
-		float z1 = v2->Position.z - v1->Position.z;
+/// <summary>
+/// Draw one of this mesh's LODs, they all share the vertex and index buffers
+/// </summary>
+/// <param name="lod">- 0 for full detail, clamped to the coarsest LOD</param>
+/// <param name="bind">- false if this mesh's buffers are still bound from the draw before</param>
+/// <param name="device">- optional, draws onto this instead of the mesh's own device</param>
+void Mesh::Draw(int lod, bool bind, RenderDevice* device)
+{
+	if (!device) device = renderDevice.get();
+	if (lod >= lodCount) lod = lodCount - 1;
+	if (lod < 0) lod = 0;
+	if (bind)
+		Bind(device);
+	device->DrawIndexed(lods[lod].indexCount, lods[lod].indexOffset, 0);
+};
 
-		float x2 = v3->Position.x - v1->Position.x;
-		float y2 = v3->Position.y - v1->Position.y;
-		float z2 = v3->Position.z - v1->Position.z;
+/// <summary>
+/// Draw the meshlets of one LOD that survive culling, neighbouring survivors share a draw
+/// </summary>
+/// <param name="lod">- 0 for full detail, clamped to the coarsest LOD</param>
+/// <param name="view">- the camera in this mesh's object space, from MeshletCuller::MakeView()</param>
+/// <param name="stats">- optional, culling counts are added to</param>
+/// <param name="bind">- false if this mesh's buffers are still bound from the draw before</param>
+void Mesh::DrawCulled(int lod, const MeshletCullView& view, MeshletCullStats* stats, bool bind)
+{
+	if (lod >= lodCount) lod = lodCount - 1;
+	if (lod < 0) lod = 0;
+	// Bound even if nothing survives, the next draw may count on it
+	if (bind)
+		Bind();
+	MeshletCuller::Cull(view, meshlets.data() + lods[lod].meshletOffset, lods[lod].meshletCount, visibleRanges, stats);
+	for (const IndexRange& range : visibleRanges)
+		renderDevice->DrawIndexed(range.indexCount, range.indexOffset, 0);
+}
 
-		// Do the same for vectors relative to triangle uv's
-		float s1 = v2->UV.x - v1->UV.x;
-		float t1 = v2->UV.y - v1->UV.y;
+/// <summary>
+/// Draw one LOD once per instance, with the instanced shaders reading each one's matrices from the second vertex buffer
+/// </summary>
+/// <param name="lod">- 0 for full detail, clamped to the coarsest LOD</param>
+/// <param name="instances">- InstanceData, from InstanceBatcher</param>
+/// <param name="firstInstance">- where this mesh's run of instances starts in the buffer</param>
+void Mesh::DrawInstanced(int lod, ID3D11Buffer* instances, unsigned int firstInstance, unsigned int instanceCount)
+{
+	if (lod >= lodCount) lod = lodCount - 1;
+	if (lod < 0) lod = 0;
+	ID3D11Buffer* buffers[2] = { vertexBuffer.Get(), instances };
+	UINT stride = packed ? sizeof(PackedVertex) : sizeof(Vertex);
+	UINT strides[2] = { stride, sizeof(InstanceData) };
+	UINT offsets[2] = { 0, 0 };
+	renderDevice->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	renderDevice->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	renderDevice->DrawIndexedInstanced(lods[lod].indexCount, instanceCount, lods[lod].indexOffset, 0, firstInstance);
+}
 
-		float s2 = v3->UV.x - v1->UV.x;
-		float t2 = v3->UV.y - v1->UV.y;
+/// <returns>True if the vertex buffer holds PackedVertex and needs the *Packed.hlsl shaders</returns>
+bool Mesh::IsPacked()
+{
+	return packed;
+}
 
-		// Create vectors for tangent calculation
-		float r = 1.0f / (s1 * t2 - s2 * t1);
+/// <returns>Small id, unique among live ones and reused once this is destroyed, for render queue keys</returns>
+unsigned int Mesh::GetSortId()
+{
+	return sortId;
+}
 
-		float tx = (t2 * x1 - t1 * x2) * r;
-		float ty = (t2 * y1 - t1 * y2) * r;
-		float tz = (t2 * z1 - t1 * z2) * r;
+/// <returns>Where packed positions start, (0, 0, 0) if not packed</returns>
+XMFLOAT3 Mesh::GetPositionMin()
+{
+	return positionMin;
+}
 
-		// Adjust tangents of each vert of the triangle
-		v1->Tangent.x += tx;
-		v1->Tangent.y += ty;
-		v1->Tangent.z += tz;
+/// <returns>Size of the box packed positions are spread over, (1, 1, 1) if not packed</returns>
+XMFLOAT3 Mesh::GetPositionExtent()
+{
+	return positionExtent;
+}
 
-		v2->Tangent.x += tx;
-		v2->Tangent.y += ty;
-		v2->Tangent.z += tz;
+/// <summary>
+/// <para>Pick the coarsest LOD whose error stays under a pixel</para>
+/// Finer LODs are picked as soon as they're needed, coarser ones only once they're clearly good enough
+/// </summary>
+/// <param name="pixelsPerUnit">- how many pixels one object space unit covers on screen, 0 or less picks the coarsest LOD</param>
+/// <param name="currentLod">- LOD drawn last frame</param>
+/// <returns>LOD to draw this frame</returns>
+int Mesh::SelectLod(float pixelsPerUnit, int currentLod)
+{
+	int lod = currentLod < 0 ? 0 : currentLod >= lodCount ? lodCount - 1 : currentLod;
+	if (pixelsPerUnit <= 0)
+		return lodCount - 1;
+
+	while (lod > 0 && lods[lod].error * pixelsPerUnit > MESH_LOD_PIXEL_ERROR)
+		lod--;
+	while (lod + 1 < lodCount && lods[lod + 1].error * pixelsPerUnit <= MESH_LOD_PIXEL_ERROR * MESH_LOD_HYSTERESIS)
+		lod++;
+	return lod;
+}
 
-		v3->Tangent.x += tx;
-		v3->Tangent.y += ty;
-		v3->Tangent.z += tz;
-	}
+int Mesh::GetLodCount()
+{
+	return lodCount;
+}
 
-	// Ensure all of the tangents are orthogonal to the normals
-	for (int i = 0; i < numVerts; i++)
-	{
-		// Grab the two vectors
-		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
-		XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
+/// <returns>Index range and error of a LOD, lod 0 is the full mesh</returns>
+MeshLod Mesh::GetLod(int lod)
+{
+	return lods[lod];
+}
 
-		// Use Gram-Schmidt orthonormalize to ensure
-		// the normal and tangent are exactly 90 degrees apart
-		tangent = XMVector3Normalize(
-			tangent - normal * XMVector3Dot(normal, tangent));
+/// <returns>Object space box and sphere around the vertices, BoundingVolumes::ToWorld() moves them into the world</returns>
+const Bounds& Mesh::GetBounds()
+{
+	return bounds;
+}
 
-		// Store the tangent
-		XMStoreFloat3(&verts[i].Tangent, tangent);
-	}
+/// <returns>Tree over the full detail LOD's triangles, in object space. Its triangle numbers count from LOD 0's first index</returns>
+const TriangleBvh& Mesh::GetTriangleBvh()
+{
+	return triangleBvh;
 }
 
-void Mesh::Draw()
+/// <returns>Meshlets of every LOD, each LOD's share is given by its meshletOffset and meshletCount</returns>
+const vector<Meshlet>& Mesh::GetMeshlets()
 {
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	deviceContext->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
-	deviceContext->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
-	deviceContext->DrawIndexed(indexCount, 0, 0);
-};
+	return meshlets;
+}
@@ -4,21 +4,54 @@
 #include <fstream>
 #include <DirectXMath.h>
 #include <vector>
+#include <memory>
 #include "Vertex.h"
+#include "RenderDevice.h"
+#include "MeshCache.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "MeshletCuller.h"
+#include "Bounds.h"
+#include "TriangleBvh.h"
+#include "RenderQueue.h"
 
 class Mesh
 {
 	private:
 		Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
 		Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
-		Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
+		std::shared_ptr<RenderDevice> renderDevice;
 		int indexCount = 0;
-		void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
-		void MakeVB(Vertex*, int, Microsoft::WRL::ComPtr<ID3D11Device>);
-		void MakeIB(unsigned int*, int, Microsoft::WRL::ComPtr<ID3D11Device>);
+		bool packed = false;
+		DirectX::XMFLOAT3 positionMin = DirectX::XMFLOAT3(0, 0, 0);
+		DirectX::XMFLOAT3 positionExtent = DirectX::XMFLOAT3(1, 1, 1);
+		MeshLod lods[MESH_MAX_LODS] = {};
+		int lodCount = 1;
+		Bounds bounds = {};
+		std::vector<Meshlet> meshlets;
+		TriangleBvh triangleBvh; // over LOD 0, for picking
+		std::vector<IndexRange> visibleRanges; // reused by DrawCulled() so culling doesn't allocate
+		SortId<Mesh, RENDER_QUEUE_MESH_BITS> sortId;
+		void MakeFromCache(MeshCache&, Microsoft::WRL::ComPtr<ID3D11Device>);
+		void MakeVB(const Vertex*, int, Microsoft::WRL::ComPtr<ID3D11Device>);
+		void MakeIB(const unsigned int*, int, Microsoft::WRL::ComPtr<ID3D11Device>);
 		
 	public:
-		Mesh(Vertex*, int, unsigned int*, int, Microsoft::WRL::ComPtr<ID3D11Device>, Microsoft::WRL::ComPtr<ID3D11DeviceContext>);
-		Mesh(const wchar_t*, Microsoft::WRL::ComPtr<ID3D11Device>, Microsoft::WRL::ComPtr<ID3D11DeviceContext>);
-		void Draw();
+		Mesh(Vertex*, int, unsigned int*, int, Microsoft::WRL::ComPtr<ID3D11Device>, std::shared_ptr<RenderDevice>);
+		Mesh(const wchar_t*, Microsoft::WRL::ComPtr<ID3D11Device>, std::shared_ptr<RenderDevice>, bool packed = false);
+		Mesh(MeshCache&, Microsoft::WRL::ComPtr<ID3D11Device>, std::shared_ptr<RenderDevice>, bool packed = false);
+		void Bind(RenderDevice* device = 0);
+		void Draw(int lod = 0, bool bind = true, RenderDevice* device = 0);
+		void DrawCulled(int lod, const MeshletCullView& view, MeshletCullStats* stats = 0, bool bind = true);
+		void DrawInstanced(int lod, ID3D11Buffer* instances, unsigned int firstInstance, unsigned int instanceCount);
+		int SelectLod(float pixelsPerUnit, int currentLod);
+		int GetLodCount();
+		MeshLod GetLod(int lod);
+		const Bounds& GetBounds();
+		const std::vector<Meshlet>& GetMeshlets();
+		const TriangleBvh& GetTriangleBvh();
+		bool IsPacked();
+		unsigned int GetSortId();
+		DirectX::XMFLOAT3 GetPositionMin();
+		DirectX::XMFLOAT3 GetPositionExtent();
 };
@@ -0,0 +1,249 @@
+#include "MeshCache.h"
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	/// <summary>
+	/// Get the size and last write time of a file, used to tell whether a cache is stale
+	/// </summary>
+	/// <returns>False if the file doesn't exist</returns>
+	bool GetFileStamp(const wchar_t* fileName, unsigned long long& size, unsigned long long& writeTime)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data = {};
+		if (!GetFileAttributesExW(fileName, GetFileExInfoStandard, &data))
+			return false;
+		size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		writeTime = ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+		return true;
+	}
+
+	bool WriteBytes(HANDLE file, const void* data, size_t size)
+	{
+		DWORD written = 0;
+		return WriteFile(file, data, (DWORD)size, &written, 0) && written == size;
+	}
+}
+
+MeshCache::MeshCache()
+{
+	header = 0;
+}
+
+/// <summary>
+/// Map a cache file and check that it's complete, matches this build's Vertex layout and is newer than its source
+/// </summary>
+/// <param name="cacheName">- path of the .meshcache file</param>
+/// <param name="sourceName">- model the cache was built from, or null to use the cache on its own without a staleness check</param>
+/// <returns>False if the cache is missing, damaged or out of date, or the source can't be stamped to tell</returns>
+bool MeshCache::Open(const wchar_t* cacheName, const wchar_t* sourceName)
+{
+	Close();
+	if (!file.Open(cacheName) || file.GetSize() < sizeof(MeshCacheHeader))
+	{
+		Close();
+		return false;
+	}
+
+	const MeshCacheHeader* h = (const MeshCacheHeader*)file.GetData();
+	size_t vertexEnd = (size_t)h->vertexOffset + (size_t)h->vertexCount * sizeof(Vertex);
+	size_t indexEnd = (size_t)h->indexOffset + (size_t)h->indexCount * sizeof(unsigned int);
+	size_t meshletEnd = (size_t)h->meshletOffset + (size_t)h->meshletCount * sizeof(Meshlet);
+	size_t nodeEnd = (size_t)h->bvhNodeOffset + (size_t)h->bvhNodeCount * sizeof(BvhNode);
+	size_t triangleEnd = (size_t)h->bvhTriangleOffset + (size_t)h->bvhTriangleCount * sizeof(TriangleBvh::Triangle);
+	size_t triangleIndexEnd = (size_t)h->bvhTriangleIndexOffset + (size_t)h->bvhTriangleCount * sizeof(unsigned int);
+	bool valid =
+		memcmp(h->magic, "MESH", 4) == 0 &&
+		h->version == MESH_CACHE_VERSION &&
+		h->vertexStride == sizeof(Vertex) &&
+		h->lodCount >= 1 && h->lodCount <= MESH_MAX_LODS &&
+		h->vertexOffset >= sizeof(MeshCacheHeader) &&
+		h->indexOffset >= vertexEnd &&
+		h->meshletOffset >= indexEnd &&
+		h->bvhNodeOffset >= meshletEnd &&
+		h->bvhTriangleOffset >= nodeEnd &&
+		h->bvhTriangleIndexOffset >= triangleEnd &&
+		vertexEnd <= file.GetSize() &&
+		indexEnd <= file.GetSize() &&
+		meshletEnd <= file.GetSize() &&
+		triangleIndexEnd <= file.GetSize();
+	for (unsigned int i = 0; valid && i < h->lodCount; i++)
+	{
+		valid = (size_t)h->lods[i].indexOffset + h->lods[i].indexCount <= h->indexCount &&
+			(size_t)h->lods[i].meshletOffset + h->lods[i].meshletCount <= h->meshletCount;
+	}
+
+	// Picking walks the nodes without checking them, so a damaged tree is caught here instead
+	const BvhNode* nodes = valid ? (const BvhNode*)(file.GetData() + h->bvhNodeOffset) : 0;
+	for (unsigned int i = 0; valid && i < h->bvhNodeCount; i++)
+	{
+		valid = nodes[i].count ? (size_t)nodes[i].index + nodes[i].count <= h->bvhTriangleCount :
+			nodes[i].index > i && nodes[i].index < h->bvhNodeCount;
+	}
+
+	if (valid && sourceName)
+	{
+		unsigned long long size = 0, writeTime = 0;
+		valid = GetFileStamp(sourceName, size, writeTime) &&
+			size == h->sourceSize && writeTime == h->sourceWriteTime;
+	}
+
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+	header = h;
+	return true;
+}
+
+/// <summary>
+/// Unmap the cache, pointers from GetVertices()/GetIndices() are invalid afterwards
+/// </summary>
+void MeshCache::Close()
+{
+	file.Close();
+	header = 0;
+}
+
+/// <summary>
+/// Save an imported mesh so later launches can map it instead of importing again
+/// </summary>
+/// <param name="cacheName">- path of the .meshcache file to (over)write</param>
+/// <param name="sourceName">- model the mesh was imported from, stamped into the cache</param>
+/// <param name="vertices">- final vertices, tangents included</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <param name="indices">- final indices of every LOD</param>
+/// <param name="indexCount">- number of indices, every LOD included</param>
+/// <param name="bounds">- BoundingVolumes::Compute() of the vertices</param>
+/// <param name="lods">- ranges of the index array, the first being the full mesh</param>
+/// <param name="lodCount">- number of LODs, 1 to MESH_MAX_LODS</param>
+/// <param name="meshlets">- meshlets of every LOD</param>
+/// <param name="meshletCount">- number of meshlets</param>
+/// <param name="triangleBvh">- built over LOD 0, for picking</param>
+/// <returns>False if the file couldn't be written</returns>
+bool MeshCache::Write(const wchar_t* cacheName, const wchar_t* sourceName, const Vertex* vertices, int vertexCount, const unsigned int* indices, int indexCount,
+	const Bounds& bounds, const MeshLod* lods, int lodCount, const Meshlet* meshlets, int meshletCount, const TriangleBvh& triangleBvh)
+{
+	MeshCacheHeader h = {};
+	memcpy(h.magic, "MESH", 4);
+	h.version = MESH_CACHE_VERSION;
+	h.vertexStride = sizeof(Vertex);
+	h.vertexCount = vertexCount;
+	h.indexCount = indexCount;
+	h.bounds = bounds;
+	h.vertexOffset = (sizeof(MeshCacheHeader) + 15) & ~15u;
+	h.indexOffset = h.vertexOffset + vertexCount * sizeof(Vertex);
+	h.lodCount = lodCount;
+	memcpy(h.lods, lods, lodCount * sizeof(MeshLod));
+	h.meshletCount = meshletCount;
+	h.meshletOffset = h.indexOffset + indexCount * sizeof(unsigned int);
+	const std::vector<BvhNode>& nodes = triangleBvh.GetNodes();
+	const std::vector<TriangleBvh::Triangle>& triangles = triangleBvh.GetTriangles();
+	h.bvhNodeCount = (unsigned int)nodes.size();
+	h.bvhNodeOffset = h.meshletOffset + meshletCount * sizeof(Meshlet);
+	h.bvhTriangleCount = (unsigned int)triangles.size();
+	h.bvhTriangleOffset = h.bvhNodeOffset + h.bvhNodeCount * sizeof(BvhNode);
+	h.bvhTriangleIndexOffset = h.bvhTriangleOffset + h.bvhTriangleCount * sizeof(TriangleBvh::Triangle);
+	if (!GetFileStamp(sourceName, h.sourceSize, h.sourceWriteTime))
+		return false;
+
+	HANDLE file = CreateFileW(cacheName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	const char padding[16] = {};
+	bool ok =
+		WriteBytes(file, &h, sizeof(h)) &&
+		WriteBytes(file, padding, h.vertexOffset - sizeof(h)) &&
+		WriteBytes(file, vertices, vertexCount * sizeof(Vertex)) &&
+		WriteBytes(file, indices, indexCount * sizeof(unsigned int)) &&
+		WriteBytes(file, meshlets, meshletCount * sizeof(Meshlet)) &&
+		WriteBytes(file, nodes.data(), nodes.size() * sizeof(BvhNode)) &&
+		WriteBytes(file, triangles.data(), triangles.size() * sizeof(TriangleBvh::Triangle)) &&
+		WriteBytes(file, triangleBvh.GetTriangleIndices().data(), triangles.size() * sizeof(unsigned int));
+	CloseHandle(file);
+
+	// Never leave a half written cache behind
+	if (!ok) DeleteFileW(cacheName);
+	return ok;
+}
+
+/// <returns>The mapped vertex array, valid until Close()</returns>
+const Vertex* MeshCache::GetVertices()
+{
+	return header ? (const Vertex*)(file.GetData() + header->vertexOffset) : 0;
+}
+
+/// <returns>The mapped index array, valid until Close()</returns>
+const unsigned int* MeshCache::GetIndices()
+{
+	return header ? (const unsigned int*)(file.GetData() + header->indexOffset) : 0;
+}
+
+int MeshCache::GetVertexCount()
+{
+	return header ? header->vertexCount : 0;
+}
+
+int MeshCache::GetIndexCount()
+{
+	return header ? header->indexCount : 0;
+}
+
+/// <returns>The bounds the mesh had when written, so they needn't be computed again</returns>
+Bounds MeshCache::GetBounds()
+{
+	return header ? header->bounds : Bounds();
+}
+
+int MeshCache::GetLodCount()
+{
+	return header ? header->lodCount : 0;
+}
+
+/// <returns>The LOD ranges of the index array, valid until Close()</returns>
+const MeshLod* MeshCache::GetLods()
+{
+	return header ? header->lods : 0;
+}
+
+int MeshCache::GetMeshletCount()
+{
+	return header ? header->meshletCount : 0;
+}
+
+/// <returns>The mapped meshlet array, valid until Close()</returns>
+const Meshlet* MeshCache::GetMeshlets()
+{
+	return header ? (const Meshlet*)(file.GetData() + header->meshletOffset) : 0;
+}
+
+int MeshCache::GetBvhNodeCount()
+{
+	return header ? header->bvhNodeCount : 0;
+}
+
+/// <returns>The mapped picking tree, valid until Close()</returns>
+const BvhNode* MeshCache::GetBvhNodes()
+{
+	return header ? (const BvhNode*)(file.GetData() + header->bvhNodeOffset) : 0;
+}
+
+int MeshCache::GetBvhTriangleCount()
+{
+	return header ? header->bvhTriangleCount : 0;
+}
+
+/// <returns>The mapped picking tree's triangles in slot order, valid until Close()</returns>
+const TriangleBvh::Triangle* MeshCache::GetBvhTriangles()
+{
+	return header ? (const TriangleBvh::Triangle*)(file.GetData() + header->bvhTriangleOffset) : 0;
+}
+
+/// <returns>Which of the mesh's triangles each slot of the picking tree is, valid until Close()</returns>
+const unsigned int* MeshCache::GetBvhTriangleIndices()
+{
+	return header ? (const unsigned int*)(file.GetData() + header->bvhTriangleIndexOffset) : 0;
+}
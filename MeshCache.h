@@ -0,0 +1,69 @@
+#pragma once
+#include <DirectXMath.h>
+#include "MappedFile.h"
+#include "Vertex.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "Bounds.h"
+#include "TriangleBvh.h"
+
+// Bump whenever the layout of the file, Vertex or the import pipeline changes
+#define MESH_CACHE_VERSION 7
+
+/// <summary>
+/// Start of a .meshcache file, followed by the vertex array, the index array (every LOD, back to back), the meshlets
+/// and the picking tree's nodes, triangles and triangle indices
+/// </summary>
+struct MeshCacheHeader
+{
+	char magic[4]; // "MESH"
+	unsigned int version;
+	unsigned int vertexStride; // sizeof(Vertex) when written
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int vertexOffset; // from the start of the file
+	unsigned int indexOffset;
+	Bounds bounds; // box and sphere around the vertices, so loading doesn't have to go over them
+	unsigned long long sourceSize; // size and write time of the model the cache was built from
+	unsigned long long sourceWriteTime;
+	unsigned int lodCount;
+	MeshLod lods[MESH_MAX_LODS]; // ranges of the index array, lods[0] is the full mesh
+	unsigned int meshletCount;
+	unsigned int meshletOffset;
+	unsigned int bvhNodeCount; // TriangleBvh over LOD 0
+	unsigned int bvhNodeOffset;
+	unsigned int bvhTriangleCount;
+	unsigned int bvhTriangleOffset;
+	unsigned int bvhTriangleIndexOffset;
+};
+
+/// <summary>
+/// <para>Binary copy of a fully imported mesh (welded, tangents built) that can be mapped and uploaded as is</para>
+/// Each cache remembers the size and write time of its source model, so editing the model invalidates it
+/// </summary>
+class MeshCache
+{
+private:
+	MappedFile file;
+	const MeshCacheHeader* header;
+public:
+	MeshCache();
+	bool Open(const wchar_t* cacheName, const wchar_t* sourceName);
+	void Close();
+	static bool Write(const wchar_t* cacheName, const wchar_t* sourceName, const Vertex* vertices, int vertexCount, const unsigned int* indices, int indexCount,
+		const Bounds& bounds, const MeshLod* lods, int lodCount, const Meshlet* meshlets, int meshletCount, const TriangleBvh& triangleBvh);
+	const Vertex* GetVertices();
+	const unsigned int* GetIndices();
+	int GetVertexCount();
+	int GetIndexCount();
+	Bounds GetBounds();
+	int GetLodCount();
+	const MeshLod* GetLods();
+	int GetMeshletCount();
+	const Meshlet* GetMeshlets();
+	int GetBvhNodeCount();
+	const BvhNode* GetBvhNodes();
+	int GetBvhTriangleCount();
+	const TriangleBvh::Triangle* GetBvhTriangles();
+	const unsigned int* GetBvhTriangleIndices();
+};
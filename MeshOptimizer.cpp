@@ -0,0 +1,318 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	/// <summary>
+	/// <para>FIFO post-transform cache simulated with timestamps</para>
+	/// A vertex is cached if fewer than size misses happened since it was inserted, hits don't refresh it
+	/// </summary>
+	struct FifoCache
+	{
+		vector<unsigned int> stamps;
+		unsigned int time;
+		unsigned int size;
+
+		FifoCache(size_t vertexCount, unsigned int size) : stamps(vertexCount, 0), time(size + 1), size(size) {}
+
+		/// <returns>True if v had to be transformed</returns>
+		bool Touch(unsigned int v)
+		{
+			if (time - stamps[v] > size)
+			{
+				stamps[v] = time++;
+				return true;
+			}
+			return false;
+		}
+
+		unsigned int TouchTriangle(const unsigned int* triangle)
+		{
+			return Touch(triangle[0]) + Touch(triangle[1]) + Touch(triangle[2]);
+		}
+
+		void Flush()
+		{
+			time += size + 1;
+		}
+	};
+
+	/// <summary>
+	/// A run of triangles that gets moved as a unit when sorting for overdraw
+	/// </summary>
+	struct Cluster
+	{
+		size_t start; // first triangle
+		size_t end; // one past the last triangle
+		float sortKey;
+	};
+}
+
+/// <summary>
+/// Run every pass on an imported mesh: cache order, overdraw order, then fetch order
+/// </summary>
+/// <param name="vertices">- vertices, reordered in place</param>
+/// <param name="indices">- triangle list, reordered and renumbered in place</param>
+void MeshOptimizer::Optimize(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	if (indices.empty() || vertices.empty())
+		return;
+	OptimizeVertexCache(indices.data(), indices.size(), vertices.size());
+	OptimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size());
+	OptimizeVertexFetch(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
+/// <summary>
+/// <para>Reorder triangles for the post-transform cache with Tipsify (Sander, Nehab and Barczak 2007)</para>
+/// Emits fans around a vertex, then moves to the neighbouring vertex that will stay in the cache
+/// longest, falling back to a stack of recently used vertices and finally a scan at dead ends
+/// </summary>
+/// <param name="indices">- triangle list, reordered in place</param>
+/// <param name="indexCount">- number of indices, a multiple of 3</param>
+/// <param name="vertexCount">- number of vertices the indices refer to</param>
+void MeshOptimizer::OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+	const unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE;
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+	vector<unsigned int> input(indices, indices + triangleCount * 3);
+
+	// Vertex -> triangles adjacency, in one flat array
+	vector<unsigned int> live(vertexCount, 0);
+	for (unsigned int v : input)
+		live[v]++;
+	vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	vector<unsigned int> adjacency(input.size());
+	vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < input.size(); i++)
+		adjacency[fill[input[i]]++] = (unsigned int)(i / 3);
+
+	vector<unsigned int> timestamps(vertexCount, 0);
+	vector<unsigned int> deadEnds;
+	deadEnds.reserve(input.size());
+	vector<unsigned int> candidates;
+	vector<bool> emitted(triangleCount, false);
+	unsigned int time = cacheSize + 1;
+	size_t cursor = 0;
+	size_t out = 0;
+
+	while (cursor < vertexCount && live[cursor] == 0) cursor++;
+	long long fan = cursor < vertexCount ? (long long)cursor : -1;
+	while (fan >= 0)
+	{
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t]) continue;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = input[t * 3 + k];
+				indices[out++] = v;
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - timestamps[v] > cacheSize)
+					timestamps[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// Prefer the candidate that's been in the cache longest, as long as
+		// its remaining triangles would still fit before it gets evicted
+		fan = -1;
+		long long bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (live[v] == 0) continue;
+			long long priority = 0;
+			if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+				priority = time - timestamps[v];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fan = v;
+			}
+		}
+
+		// Dead end: try recently used vertices, then scan for any vertex with triangles left
+		if (fan < 0)
+		{
+			while (!deadEnds.empty() && fan < 0)
+			{
+				unsigned int v = deadEnds.back();
+				deadEnds.pop_back();
+				if (live[v] > 0) fan = v;
+			}
+			while (fan < 0 && cursor < vertexCount)
+			{
+				if (live[cursor] > 0) fan = (long long)cursor;
+				else cursor++;
+			}
+		}
+	}
+}
+
+/// <summary>
+/// <para>Reorder clusters of triangles so those facing away from the mesh center draw first</para>
+/// Those are the most likely to occlude the rest, so fewer pixels get shaded twice. Clusters are
+/// split where the cache restarts and again wherever the running miss ratio is already within
+/// threshold of the cluster's, so the cache-optimized order survives the sort
+/// </summary>
+/// <param name="indices">- cache optimized triangle list, reordered in place</param>
+/// <param name="indexCount">- number of indices, a multiple of 3</param>
+/// <param name="vertices">- the vertices the indices refer to</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <param name="threshold">- how much worse than the cluster's miss ratio a split may be, 1.05 allows 5%</param>
+void MeshOptimizer::OptimizeOverdraw(unsigned int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold)
+{
+	const unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE;
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Hard boundaries: every triangle that misses on all 3 vertices starts a new run
+	vector<size_t> hard;
+	FifoCache cache(vertexCount, cacheSize);
+	for (size_t t = 0; t < triangleCount; t++)
+		if (cache.TouchTriangle(indices + t * 3) == 3)
+			hard.push_back(t);
+	hard.push_back(triangleCount);
+
+	// Soft boundaries: split a run as soon as its own miss ratio is close enough to the run's overall ratio
+	vector<Cluster> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		size_t start = hard[h], end = hard[h + 1];
+		cache.Flush();
+		unsigned int misses = 0;
+		for (size_t t = start; t < end; t++)
+			misses += cache.TouchTriangle(indices + t * 3);
+		float clusterThreshold = threshold * misses / (end - start);
+
+		cache.Flush();
+		size_t clusterStart = start;
+		unsigned int runningMisses = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			runningMisses += cache.TouchTriangle(indices + t * 3);
+			if (t + 1 < end && runningMisses <= clusterThreshold * (t + 1 - clusterStart))
+			{
+				clusters.push_back({ clusterStart, t + 1, 0.0f });
+				clusterStart = t + 1;
+				runningMisses = 0;
+				cache.Flush();
+			}
+		}
+		clusters.push_back({ clusterStart, end, 0.0f });
+	}
+
+	// Area weighted centroid of the whole mesh
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0.0f;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3 + 0]].Position);
+		XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].Position);
+		XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].Position);
+		float area = XMVectorGetX(XMVector3Length(XMVector3Cross(p1 - p0, p2 - p0)));
+		meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+		meshArea += area;
+	}
+	if (meshArea > 0.0f) meshCentroid = meshCentroid / meshArea;
+
+	// Clusters whose center sits furthest out along their own normal draw first.
+	// Vertex normals give the facing, so the key doesn't depend on winding
+	for (Cluster& c : clusters)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+		for (size_t t = c.start; t < c.end; t++)
+		{
+			const Vertex& v0 = vertices[indices[t * 3 + 0]];
+			const Vertex& v1 = vertices[indices[t * 3 + 1]];
+			const Vertex& v2 = vertices[indices[t * 3 + 2]];
+			XMVECTOR p0 = XMLoadFloat3(&v0.Position);
+			XMVECTOR p1 = XMLoadFloat3(&v1.Position);
+			XMVECTOR p2 = XMLoadFloat3(&v2.Position);
+			float triangleArea = XMVectorGetX(XMVector3Length(XMVector3Cross(p1 - p0, p2 - p0)));
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += (XMLoadFloat3(&v0.Normal) + XMLoadFloat3(&v1.Normal) + XMLoadFloat3(&v2.Normal)) * triangleArea;
+			area += triangleArea;
+		}
+		if (area > 0.0f) centroid = centroid / area;
+		c.sortKey = XMVectorGetX(XMVector3Dot(centroid - meshCentroid, XMVector3Normalize(normal)));
+	}
+	stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	vector<unsigned int> input(indices, indices + triangleCount * 3);
+	size_t out = 0;
+	for (const Cluster& c : clusters)
+		for (size_t i = c.start * 3; i < c.end * 3; i++)
+			indices[out++] = input[i];
+}
+
+/// <summary>
+/// Renumber vertices in the order the index buffer first uses them, so vertex fetches walk memory forwards
+/// </summary>
+/// <param name="vertices">- vertices, reordered in place (unused ones move to the end)</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <param name="indices">- triangle list, renumbered in place</param>
+/// <param name="indexCount">- number of indices</param>
+void MeshOptimizer::OptimizeVertexFetch(Vertex* vertices, size_t vertexCount, unsigned int* indices, size_t indexCount)
+{
+	const unsigned int unused = 0xFFFFFFFF;
+	vector<unsigned int> remap(vertexCount, unused);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int& r = remap[indices[i]];
+		if (r == unused) r = next++;
+		indices[i] = r;
+	}
+	for (unsigned int& r : remap)
+		if (r == unused) r = next++;
+
+	vector<Vertex> input(vertices, vertices + vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertices[remap[v]] = input[v];
+}
+
+/// <summary>
+/// Simulate a FIFO post-transform cache over an index buffer
+/// </summary>
+/// <param name="indices">- triangle list</param>
+/// <param name="indexCount">- number of indices</param>
+/// <param name="vertexCount">- number of vertices the indices refer to</param>
+/// <param name="cacheSize">- entries in the simulated cache</param>
+/// <returns>Transformed vertex count plus ACMR and ATVR</returns>
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats = {};
+	FifoCache cache(vertexCount, cacheSize);
+	vector<bool> referenced(vertexCount, false);
+	size_t uniqueVertices = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		stats.transformedVertices += cache.Touch(indices[i]);
+		if (!referenced[indices[i]])
+		{
+			referenced[indices[i]] = true;
+			uniqueVertices++;
+		}
+	}
+
+	size_t triangleCount = indexCount / 3;
+	stats.acmr = triangleCount ? (float)stats.transformedVertices / triangleCount : 0.0f;
+	stats.atvr = uniqueVertices ? (float)stats.transformedVertices / uniqueVertices : 0.0f;
+	return stats;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include "Vertex.h"
+
+// Post-transform cache size the optimizer targets, small enough to suit any GPU
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+
+/// <summary>
+/// How well an index buffer uses a FIFO post-transform vertex cache
+/// </summary>
+struct VertexCacheStats
+{
+	unsigned int transformedVertices; // cache misses
+	float acmr; // average cache miss ratio: transformed vertices per triangle, 0.5 is ideal, 3 is worst
+	float atvr; // average transform to vertex ratio: transformed vertices per referenced vertex, 1 is ideal
+};
+
+/// <summary>
+/// <para>Import-time reordering of index and vertex buffers</para>
+/// Runs Tipsify for post-transform cache locality, then orders the resulting clusters
+/// outside-in to cut overdraw, then renumbers vertices in first-use order for fetch locality
+/// </summary>
+class MeshOptimizer
+{
+public:
+	static void Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+	static void OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+	static void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold = 1.05f);
+	static void OptimizeVertexFetch(Vertex* vertices, size_t vertexCount, unsigned int* indices, size_t indexCount);
+	static VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE);
+};
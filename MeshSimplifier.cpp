@@ -0,0 +1,373 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Bounds.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cfloat>
+
+using namespace DirectX;
+using namespace std;
+
+// Each LOD aims for this fraction of the previous LOD's triangles
+#define MESH_LOD_RATIO 0.5f
+// A LOD that keeps more than this fraction of the previous one's triangles isn't worth its memory
+#define MESH_LOD_MIN_REDUCTION 0.85f
+// No LOD may move the surface further than this fraction of the mesh's bounding radius
+#define MESH_LOD_MAX_ERROR 0.1f
+
+namespace
+{
+	/// <summary>
+	/// What a vertex may do during simplification
+	/// </summary>
+	enum VertexKind : unsigned char
+	{
+		Manifold, // the only vertex at its position, free to move
+		Seam, // one of two vertices at its position, moves together with the other along the seam
+		Locked // on an open border or where three or more vertices meet, never moves
+	};
+
+	/// <returns>Key of the undirected edge between a and b</returns>
+	inline uint64_t EdgeKey(uint64_t a, uint64_t b)
+	{
+		return a < b ? (a << 32) | b : (b << 32) | a;
+	}
+
+	/// <summary>
+	/// Sorted keys of every triangle edge, an edge shows up once for every triangle using it
+	/// </summary>
+	/// <param name="indices">- triangle list</param>
+	/// <param name="indexCount">- number of indices</param>
+	/// <param name="map">- optional, maps the indices before the keys are made</param>
+	/// <param name="edges">- output</param>
+	void CollectEdges(const unsigned int* indices, size_t indexCount, const unsigned int* map, vector<uint64_t>& edges)
+	{
+		edges.clear();
+		for (size_t i = 0; i < indexCount; i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				unsigned int a = indices[i + e];
+				unsigned int b = indices[i + (e + 1) % 3];
+				edges.push_back(map ? EdgeKey(map[a], map[b]) : EdgeKey(a, b));
+			}
+		}
+		sort(edges.begin(), edges.end());
+	}
+
+	/// <returns>True if any triangle uses the edge, edges from CollectEdges()</returns>
+	inline bool HasEdge(const vector<uint64_t>& edges, uint64_t key)
+	{
+		return binary_search(edges.begin(), edges.end(), key);
+	}
+
+	/// <summary>
+	/// <para>Symmetric 4x4 plane quadric (Garland-Heckbert) plus the total area that went into it</para>
+	/// Evaluate() divides by the area, so the error is a mean squared distance in object space units
+	/// </summary>
+	struct Quadric
+	{
+		double a2, ab, ac, ad;
+		double b2, bc, bd;
+		double c2, cd;
+		double d2;
+		double weight;
+	};
+
+	void AddPlane(Quadric& q, double a, double b, double c, double d, double weight)
+	{
+		q.a2 += a * a * weight; q.ab += a * b * weight; q.ac += a * c * weight; q.ad += a * d * weight;
+		q.b2 += b * b * weight; q.bc += b * c * weight; q.bd += b * d * weight;
+		q.c2 += c * c * weight; q.cd += c * d * weight;
+		q.d2 += d * d * weight;
+		q.weight += weight;
+	}
+
+	Quadric Add(const Quadric& q, const Quadric& r)
+	{
+		return { q.a2 + r.a2, q.ab + r.ab, q.ac + r.ac, q.ad + r.ad, q.b2 + r.b2, q.bc + r.bc, q.bd + r.bd,
+			q.c2 + r.c2, q.cd + r.cd, q.d2 + r.d2, q.weight + r.weight };
+	}
+
+	/// <returns>Mean squared distance from p to the planes in q</returns>
+	double Evaluate(const Quadric& q, const XMFLOAT3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double error =
+			q.a2 * x * x + q.b2 * y * y + q.c2 * z * z +
+			2 * (q.ab * x * y + q.ac * x * z + q.bc * y * z) +
+			2 * (q.ad * x + q.bd * y + q.cd * z) + q.d2;
+		return q.weight > 0 ? fabs(error) / q.weight : 0;
+	}
+
+	/// <summary>
+	/// Moving vertex "from" onto vertex "to", and the error that would add
+	/// </summary>
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double cost;
+	};
+
+	/// <returns>True if moving "from" onto "to" would turn any of from's remaining triangles over</returns>
+	bool Flips(const Vertex* vertices, const unsigned int* indices, const unsigned int* triangles, size_t triangleCount, unsigned int from, unsigned int to)
+	{
+		XMVECTOR target = XMLoadFloat3(&vertices[to].Position);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			const unsigned int* triangle = &indices[triangles[t] * 3];
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+				continue; // Collapses away
+
+			XMVECTOR p[3];
+			for (int c = 0; c < 3; c++)
+				p[c] = XMLoadFloat3(&vertices[triangle[c]].Position);
+			XMVECTOR before = XMVector3Cross(XMVectorSubtract(p[1], p[0]), XMVectorSubtract(p[2], p[0]));
+			for (int c = 0; c < 3; c++)
+				if (triangle[c] == from) p[c] = target;
+			XMVECTOR after = XMVector3Cross(XMVectorSubtract(p[1], p[0]), XMVectorSubtract(p[2], p[0]));
+			if (XMVectorGetX(XMVector3Dot(before, after)) <= 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+/// <summary>
+/// <para>Collapse edges, cheapest first, until the index count reaches the target or the error limit is hit</para>
+/// Each pass collapses a batch of edges that don't share any triangles, then rebuilds its tables
+/// </summary>
+/// <param name="vertices">- vertex buffer the indices refer to, never modified</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <param name="indices">- triangle list to simplify</param>
+/// <param name="indexCount">- number of indices</param>
+/// <param name="targetIndexCount">- stop once there are this many indices or fewer</param>
+/// <param name="targetError">- never collapse an edge that moves the surface further than this, in object space units</param>
+/// <param name="destination">- receives the simplified triangle list, indexCount long is always enough</param>
+/// <param name="resultError">- optional, receives the largest error any collapse caused</param>
+/// <returns>Number of indices written to destination</returns>
+size_t MeshSimplifier::Simplify(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+	size_t targetIndexCount, float targetError, unsigned int* destination, float* resultError)
+{
+	vector<unsigned int> result(indices, indices + indexCount);
+	size_t count = indexCount - indexCount % 3;
+	double maxCost = 0;
+
+	// Vertices that only differ in uv or normal share a position. Each one gets the first vertex at its
+	// position as a stand-in and the next one in a ring of those vertices, its wedges
+	vector<unsigned int> order(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) order[i] = (unsigned int)i;
+	auto positionLess = [&](unsigned int a, unsigned int b)
+	{
+		const XMFLOAT3& p = vertices[a].Position;
+		const XMFLOAT3& q = vertices[b].Position;
+		return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+	};
+	sort(order.begin(), order.end(), positionLess);
+	vector<unsigned int> position(vertexCount);
+	vector<unsigned int> wedge(vertexCount);
+	vector<unsigned char> kind(vertexCount);
+	for (size_t i = 0; i < vertexCount;)
+	{
+		size_t j = i + 1;
+		while (j < vertexCount && !positionLess(order[i], order[j])) j++;
+		for (size_t k = i; k < j; k++)
+		{
+			position[order[k]] = order[i];
+			wedge[order[k]] = order[k + 1 < j ? k + 1 : i];
+			kind[order[k]] = j - i == 1 ? Manifold : j - i == 2 ? Seam : Locked;
+		}
+		i = j;
+	}
+
+	// Edges between positions used by only one triangle are on an open border, moving their ends would eat into the outline
+	vector<uint64_t> edges;
+	CollectEdges(result.data(), count, position.data(), edges);
+	for (size_t i = 0; i < edges.size();)
+	{
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i]) j++;
+		if (j - i == 1)
+		{
+			for (unsigned int end : { (unsigned int)(edges[i] >> 32), (unsigned int)(edges[i] & 0xffffffff) })
+			{
+				unsigned int v = end;
+				do { kind[v] = Locked; v = wedge[v]; } while (v != end);
+			}
+		}
+		i = j;
+	}
+
+	// Every position starts with the planes of the triangles around it, weighted by area
+	vector<Quadric> quadrics(vertexCount, Quadric{});
+	for (size_t i = 0; i < count; i += 3)
+	{
+		const XMFLOAT3& p0 = vertices[result[i]].Position;
+		const XMFLOAT3& p1 = vertices[result[i + 1]].Position;
+		const XMFLOAT3& p2 = vertices[result[i + 2]].Position;
+		double e1[3] = { (double)p1.x - p0.x, (double)p1.y - p0.y, (double)p1.z - p0.z };
+		double e2[3] = { (double)p2.x - p0.x, (double)p2.y - p0.y, (double)p2.z - p0.z };
+		double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0)
+			continue;
+		n[0] /= length; n[1] /= length; n[2] /= length;
+		double d = -(n[0] * p0.x + n[1] * p0.y + n[2] * p0.z);
+		for (int c = 0; c < 3; c++)
+			AddPlane(quadrics[position[result[i + c]]], n[0], n[1], n[2], d, length * 0.5);
+	}
+
+	double costLimit = (double)targetError * targetError;
+	vector<unsigned int> remap(vertexCount);
+	vector<unsigned char> touched(vertexCount);
+	vector<unsigned int> offsets(vertexCount + 1);
+	vector<unsigned int> adjacency;
+	vector<Collapse> collapses;
+	while (count > targetIndexCount)
+	{
+		// Triangles around each vertex, for the flip test
+		fill(offsets.begin(), offsets.end(), 0);
+		for (size_t i = 0; i < count; i++) offsets[result[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+		adjacency.resize(count);
+		vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < count; i++) adjacency[cursor[result[i]]++] = (unsigned int)(i / 3);
+
+		// A seam vertex may only slide along its seam, which is where its wedge has a twin edge
+		// to slide along too, so both sides of the seam (or both faces of a double sided surface) stay joined
+		CollectEdges(result.data(), count, 0, edges);
+		auto canCollapse = [&](unsigned int from, unsigned int to)
+		{
+			if (position[from] == position[to])
+				return false;
+			if (kind[from] == Manifold)
+				return true;
+			return kind[from] == Seam && kind[to] == Seam &&
+				HasEdge(edges, EdgeKey(from, to)) &&
+				HasEdge(edges, EdgeKey(wedge[from], wedge[to]));
+		};
+
+		// Every edge in whichever direction is cheaper
+		collapses.clear();
+		for (size_t i = 0; i < count; i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				unsigned int a = result[i + e];
+				unsigned int b = result[i + (e + 1) % 3];
+				bool toB = canCollapse(a, b);
+				bool toA = canCollapse(b, a);
+				if (!toB && !toA)
+					continue;
+				Quadric q = Add(quadrics[position[a]], quadrics[position[b]]);
+				double costB = toB ? Evaluate(q, vertices[b].Position) : DBL_MAX;
+				double costA = toA ? Evaluate(q, vertices[a].Position) : DBL_MAX;
+				collapses.push_back(costB <= costA ? Collapse{ a, b, costB } : Collapse{ b, a, costA });
+			}
+		}
+		sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+		for (size_t v = 0; v < vertexCount; v++) remap[v] = (unsigned int)v;
+		fill(touched.begin(), touched.end(), 0);
+		size_t trianglesToRemove = (count - targetIndexCount + 2) / 3;
+		size_t removed = 0;
+		for (const Collapse& c : collapses)
+		{
+			if (c.cost > costLimit)
+				break;
+			if (touched[position[c.from]] || touched[position[c.to]])
+				continue;
+
+			// A seam collapse moves both wedges
+			unsigned int moves[2][2] = { { c.from, c.to }, { wedge[c.from], wedge[c.to] } };
+			int moveCount = kind[c.from] == Seam ? 2 : 1;
+			bool flips = false;
+			for (int m = 0; m < moveCount && !flips; m++)
+			{
+				unsigned int from = moves[m][0];
+				flips = Flips(vertices, result.data(), &adjacency[offsets[from]], offsets[from + 1] - offsets[from], from, moves[m][1]);
+			}
+			if (flips)
+				continue;
+
+			// Nothing around this collapse can change again until the next pass, so the tables stay valid
+			for (int m = 0; m < moveCount; m++)
+			{
+				unsigned int from = moves[m][0];
+				unsigned int to = moves[m][1];
+				for (unsigned int t = offsets[from]; t < offsets[from + 1]; t++)
+				{
+					const unsigned int* triangle = &result[adjacency[t] * 3];
+					for (int k = 0; k < 3; k++) touched[position[triangle[k]]] = 1;
+					if (triangle[0] == to || triangle[1] == to || triangle[2] == to) removed++;
+				}
+				remap[from] = to;
+			}
+			quadrics[position[c.to]] = Add(quadrics[position[c.to]], quadrics[position[c.from]]);
+			maxCost = max(maxCost, c.cost);
+			if (removed >= trianglesToRemove)
+				break;
+		}
+		if (removed == 0)
+			break;
+
+		// Apply the pass and drop the triangles that collapsed to lines
+		size_t write = 0;
+		for (size_t i = 0; i < count; i += 3)
+		{
+			unsigned int a = remap[result[i]];
+			unsigned int b = remap[result[i + 1]];
+			unsigned int c = remap[result[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		count = write;
+	}
+
+	copy(result.begin(), result.begin() + count, destination);
+	if (resultError) *resultError = (float)sqrt(maxCost);
+	return count;
+}
+
+/// <summary>
+/// <para>Append progressively coarser LODs to a mesh's index buffer</para>
+/// Every LOD is simplified from the full mesh, so its error is measured against the full mesh too
+/// </summary>
+/// <param name="vertices">- the mesh's vertices</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <param name="indices">- full resolution triangle list, LODs get appended after it</param>
+/// <param name="lods">- receives up to MESH_MAX_LODS ranges, the first being the full mesh</param>
+/// <returns>How many LODs were made, at least 1</returns>
+int MeshSimplifier::BuildLods(const Vertex* vertices, size_t vertexCount, vector<unsigned int>& indices, MeshLod* lods)
+{
+	size_t baseCount = indices.size();
+	lods[0] = { 0, (unsigned int)baseCount, 0.0f };
+
+	// Cap the error relative to the mesh size so small and large models simplify alike
+	XMFLOAT3 boundsMin, boundsMax;
+	BoundingVolumes::ComputeBox(vertices, (int)vertexCount, boundsMin, boundsMax);
+	float radius = 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&boundsMax), XMLoadFloat3(&boundsMin))));
+
+	vector<unsigned int> lod(baseCount);
+	int lodCount = 1;
+	while (lodCount < MESH_MAX_LODS)
+	{
+		const MeshLod& previous = lods[lodCount - 1];
+		size_t target = (size_t)(previous.indexCount / 3 * MESH_LOD_RATIO) * 3;
+		float error = 0;
+		size_t count = MeshSimplifier::Simplify(vertices, vertexCount, indices.data(), baseCount, target, radius * MESH_LOD_MAX_ERROR, lod.data(), &error);
+		if (count == 0 || count > previous.indexCount * MESH_LOD_MIN_REDUCTION)
+			break;
+
+		MeshOptimizer::OptimizeVertexCache(lod.data(), count, vertexCount);
+		lods[lodCount] = { (unsigned int)indices.size(), (unsigned int)count, error };
+		indices.insert(indices.end(), lod.begin(), lod.begin() + count);
+		lodCount++;
+	}
+	return lodCount;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include "Vertex.h"
+
+// Most LODs a mesh keeps, counting the full resolution one
+#define MESH_MAX_LODS 4
+
+/// <summary>
+/// One level of detail, a range of a mesh's shared index buffer drawn with the shared vertex buffer
+/// </summary>
+struct MeshLod
+{
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	float error; // how far the surface moved from the full mesh, in object space units
+	unsigned int meshletOffset; // this LOD's meshlets, filled in by MeshletBuilder
+	unsigned int meshletCount;
+};
+
+/// <summary>
+/// <para>Quadric error metric edge-collapse simplification</para>
+/// Vertices only ever collapse onto neighbours, so every LOD indexes the original vertex buffer.
+/// Vertices on open borders stay put and uv/normal seams only collapse along themselves, keeping outlines and attributes intact
+/// </summary>
+class MeshSimplifier
+{
+public:
+	static size_t Simplify(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+		size_t targetIndexCount, float targetError, unsigned int* destination, float* resultError = 0);
+	static int BuildLods(const Vertex* vertices, size_t vertexCount, std::vector<unsigned int>& indices, MeshLod* lods);
+};
@@ -0,0 +1,208 @@
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	/// <summary>
+	/// Fill in the bounding sphere and normal cone of a meshlet whose index range is set
+	/// </summary>
+	void ComputeBounds(const Vertex* vertices, const unsigned int* indices, Meshlet& meshlet)
+	{
+		const unsigned int* first = &indices[meshlet.indexOffset];
+
+		// Sphere around the box, good enough for a few dozen vertices
+		XMVECTOR vMin = XMLoadFloat3(&vertices[first[0]].Position);
+		XMVECTOR vMax = vMin;
+		for (unsigned int i = 1; i < meshlet.indexCount; i++)
+		{
+			XMVECTOR p = XMLoadFloat3(&vertices[first[i]].Position);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+		XMVECTOR center = XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f);
+		XMVECTOR radiusSq = XMVectorZero();
+		for (unsigned int i = 0; i < meshlet.indexCount; i++)
+		{
+			XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&vertices[first[i]].Position), center);
+			radiusSq = XMVectorMax(radiusSq, XMVector3LengthSq(offset));
+		}
+		XMStoreFloat3(&meshlet.center, center);
+		meshlet.radius = sqrtf(XMVectorGetX(radiusSq));
+
+		// Winding is clockwise, so cross(p1 - p0, p2 - p0) points out of the front face
+		XMVECTOR normals[MESHLET_MAX_TRIANGLES];
+		unsigned int normalCount = 0;
+		XMVECTOR axis = XMVectorZero();
+		for (unsigned int i = 0; i < meshlet.indexCount; i += 3)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&vertices[first[i]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[first[i + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[first[i + 2]].Position);
+			XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+			if (XMVectorGetX(XMVector3LengthSq(normal)) == 0)
+				continue; // Degenerate, never drawn anyway
+			normals[normalCount] = XMVector3Normalize(normal);
+			axis = XMVectorAdd(axis, normals[normalCount]);
+			normalCount++;
+		}
+
+		meshlet.coneAxis = XMFLOAT3(0, 0, 0);
+		meshlet.coneCutoff = 0;
+		if (normalCount == 0 || XMVectorGetX(XMVector3LengthSq(axis)) == 0)
+			return;
+		axis = XMVector3Normalize(axis);
+		float cutoff = 1;
+		for (unsigned int i = 0; i < normalCount; i++)
+			cutoff = fminf(cutoff, XMVectorGetX(XMVector3Dot(axis, normals[i])));
+		XMStoreFloat3(&meshlet.coneAxis, axis);
+		meshlet.coneCutoff = cutoff;
+	}
+}
+
+/// <summary>
+/// <para>Split an index range into meshlets, appending them to a list</para>
+/// Each meshlet grows from a seed triangle, always taking the neighbouring triangle that adds the
+/// fewest vertices and bends its normal cone the least. Triangles in the range are reordered so every
+/// meshlet ends up as a contiguous run
+/// </summary>
+/// <param name="vertices">- the mesh's vertices</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <param name="indices">- the mesh's whole index buffer, only the range is changed</param>
+/// <param name="indexOffset">- first index of the range to split, such as a LOD</param>
+/// <param name="indexCount">- number of indices in the range</param>
+/// <param name="meshlets">- meshlets are added at the end</param>
+void MeshletBuilder::Build(const Vertex* vertices, size_t vertexCount, unsigned int* indices, unsigned int indexOffset, unsigned int indexCount,
+	vector<Meshlet>& meshlets)
+{
+	const unsigned int* range = &indices[indexOffset];
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles around each vertex
+	vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++) offsets[range[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+	vector<unsigned int> adjacency(triangleCount * 3);
+	vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++) adjacency[cursor[range[i]]++] = (unsigned int)(i / 3);
+
+	// Winding is clockwise, so cross(p1 - p0, p2 - p0) points out of the front face
+	vector<XMFLOAT3> normals(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&vertices[range[t * 3]].Position);
+		XMVECTOR p1 = XMLoadFloat3(&vertices[range[t * 3 + 1]].Position);
+		XMVECTOR p2 = XMLoadFloat3(&vertices[range[t * 3 + 2]].Position);
+		XMStoreFloat3(&normals[t], XMVector3Normalize(XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0))));
+	}
+
+	// Meshlet each vertex was last added to, so vertex sets never need clearing
+	vector<unsigned int> vertexIn(vertexCount, ~0u);
+	vector<unsigned char> emitted(triangleCount, 0);
+	vector<unsigned int> order;
+	order.reserve(triangleCount * 3);
+	vector<unsigned int> candidates;
+	size_t nextSeed = 0;
+	unsigned int id = 0;
+	while (order.size() < triangleCount * 3)
+	{
+		// Seeds go in the incoming order, which keeps the vertex cache order's locality between meshlets
+		while (emitted[nextSeed]) nextSeed++;
+		unsigned int meshletVertices = 0;
+		unsigned int meshletTriangles = 0;
+		XMVECTOR normalSum = XMVectorZero();
+		candidates.assign(1, (unsigned int)nextSeed);
+		unsigned int begin = (unsigned int)order.size();
+
+		while (meshletTriangles < MESHLET_MAX_TRIANGLES)
+		{
+			// Cheapest candidate that still fits, new vertices cost the most
+			XMVECTOR axis = XMVector3Normalize(normalSum);
+			float bestScore = FLT_MAX;
+			size_t best = 0;
+			for (size_t c = 0; c < candidates.size(); c++)
+			{
+				unsigned int t = candidates[c];
+				if (emitted[t])
+				{
+					candidates[c--] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				unsigned int newVertices = 0;
+				for (int k = 0; k < 3; k++)
+					if (vertexIn[range[t * 3 + k]] != id) newVertices++;
+				if (meshletVertices + newVertices > MESHLET_MAX_VERTICES)
+					continue;
+				float spread = meshletTriangles == 0 ? 0 : 1 - XMVectorGetX(XMVector3Dot(axis, XMLoadFloat3(&normals[t])));
+				float score = newVertices + MESHLET_CONE_WEIGHT * spread;
+				if (score < bestScore)
+				{
+					bestScore = score;
+					best = c;
+				}
+			}
+			if (bestScore == FLT_MAX)
+				break;
+
+			unsigned int t = candidates[best];
+			emitted[t] = 1;
+			meshletTriangles++;
+			normalSum = XMVectorAdd(normalSum, XMLoadFloat3(&normals[t]));
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = range[t * 3 + k];
+				order.push_back(v);
+				if (vertexIn[v] == id)
+					continue;
+				vertexIn[v] = id;
+				meshletVertices++;
+
+				// Everything around a new vertex becomes a candidate
+				for (unsigned int a = offsets[v]; a < offsets[v + 1]; a++)
+					if (!emitted[adjacency[a]]) candidates.push_back(adjacency[a]);
+			}
+		}
+
+		Meshlet meshlet = { indexOffset + begin, (unsigned int)order.size() - begin };
+		meshlets.push_back(meshlet);
+		id++;
+	}
+
+	// Growing meshlets scrambles the vertex cache order, so redo it within each meshlet. Renumbering
+	// the meshlet's vertices from 0 keeps the optimizer's per-vertex tables tiny
+	copy(order.begin(), order.end(), &indices[indexOffset]);
+	vector<unsigned int>& localIndex = cursor; // done with it, reused as each vertex's number within its meshlet
+	vector<unsigned int> local;
+	unsigned int globals[MESHLET_MAX_VERTICES];
+	size_t firstMeshlet = meshlets.size() - id;
+	for (size_t m = firstMeshlet; m < meshlets.size(); m++)
+	{
+		Meshlet& meshlet = meshlets[m];
+		unsigned int* first = &indices[meshlet.indexOffset];
+		unsigned int stamp = id + (unsigned int)(m - firstMeshlet); // past every id used while growing
+		unsigned int localCount = 0;
+		local.resize(meshlet.indexCount);
+		for (unsigned int i = 0; i < meshlet.indexCount; i++)
+		{
+			unsigned int v = first[i];
+			if (vertexIn[v] != stamp)
+			{
+				vertexIn[v] = stamp;
+				localIndex[v] = localCount;
+				globals[localCount++] = v;
+			}
+			local[i] = localIndex[v];
+		}
+		MeshOptimizer::OptimizeVertexCache(local.data(), local.size(), localCount);
+		for (unsigned int i = 0; i < meshlet.indexCount; i++)
+			first[i] = globals[local[i]];
+		ComputeBounds(vertices, indices, meshlet);
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "Vertex.h"
+
+// Most vertices and triangles in one meshlet, the usual mesh shader limits
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+// How many new vertices a fully sideways triangle is worth when growing a meshlet, higher gives tighter normal cones
+#define MESHLET_CONE_WEIGHT 2.0f
+
+/// <summary>
+/// A small run of a mesh's triangles with the bounds needed to cull it as a whole
+/// </summary>
+struct Meshlet
+{
+	unsigned int indexOffset; // into the mesh's index buffer
+	unsigned int indexCount;
+	DirectX::XMFLOAT3 center; // bounding sphere, object space
+	float radius;
+	DirectX::XMFLOAT3 coneAxis; // average facing of the triangles
+	float coneCutoff; // cos of the widest angle between coneAxis and a triangle normal, 0 or less if too wide to cull
+};
+
+/// <summary>
+/// <para>Splits index ranges into meshlets</para>
+/// Meshlets are runs of consecutive triangles, so every meshlet can be drawn as an index sub-range
+/// </summary>
+class MeshletBuilder
+{
+public:
+	static void Build(const Vertex* vertices, size_t vertexCount, unsigned int* indices, unsigned int indexOffset, unsigned int indexCount,
+		std::vector<Meshlet>& meshlets);
+};
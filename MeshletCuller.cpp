@@ -0,0 +1,94 @@
+#include "MeshletCuller.h"
+#include "FrustumCuller.h"
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+/// <summary>
+/// Bring a camera into an object's space so its meshlets can be tested without transforming them
+/// </summary>
+/// <param name="world">- the object's world matrix</param>
+/// <param name="view">- camera view matrix</param>
+/// <param name="proj">- camera projection matrix</param>
+/// <param name="camPos">- camera position in the world</param>
+/// <returns>Frustum planes and camera position in object space</returns>
+MeshletCullView MeshletCuller::MakeView(XMFLOAT4X4 world, XMFLOAT4X4 view, XMFLOAT4X4 proj, XMFLOAT3 camPos)
+{
+	// Normalizing in object space keeps plane distances in the same units as meshlet radii
+	XMMATRIX worldMatrix = XMLoadFloat4x4(&world);
+	Frustum frustum = FrustumCuller::ExtractPlanes(worldMatrix * XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+	MeshletCullView result;
+	for (int i = 0; i < 6; i++)
+		result.planes[i] = frustum.planes[i];
+	XMVECTOR determinant;
+	XMStoreFloat3(&result.camPos, XMVector3Transform(XMLoadFloat3(&camPos), XMMatrixInverse(&determinant, worldMatrix)));
+	return result;
+}
+
+/// <summary>
+/// Find the meshlets that might be visible, merging neighbours into as few draws as possible
+/// </summary>
+/// <param name="view">- camera in the meshlets' object space, from MakeView()</param>
+/// <param name="meshlets">- meshlets to test</param>
+/// <param name="meshletCount">- number of meshlets</param>
+/// <param name="visible">- overwritten with the index ranges to draw</param>
+/// <param name="stats">- optional, counts are added to</param>
+void MeshletCuller::Cull(const MeshletCullView& view, const Meshlet* meshlets, size_t meshletCount, vector<IndexRange>& visible, MeshletCullStats* stats)
+{
+	visible.clear();
+	XMVECTOR planes[6];
+	for (int i = 0; i < 6; i++)
+		planes[i] = XMLoadFloat4(&view.planes[i]);
+	XMVECTOR camPos = XMLoadFloat3(&view.camPos);
+
+	for (size_t m = 0; m < meshletCount; m++)
+	{
+		const Meshlet& meshlet = meshlets[m];
+		XMVECTOR center = XMLoadFloat3(&meshlet.center);
+		if (stats)
+		{
+			stats->meshlets++;
+			stats->triangles += meshlet.indexCount / 3;
+		}
+
+		// Entirely behind any one plane
+		bool outside = false;
+		for (int i = 0; i < 6 && !outside; i++)
+			outside = XMVectorGetX(XMPlaneDotCoord(planes[i], center)) < -meshlet.radius;
+		if (outside)
+		{
+			if (stats)
+			{
+				stats->frustumMeshlets++;
+				stats->frustumTriangles += meshlet.indexCount / 3;
+			}
+			continue;
+		}
+
+		// Backfacing: every normal is within acos(cutoff) of the axis, so the normal closest to facing the
+		// camera is at most that much closer than the axis. If even that one faces away from every point
+		// of the sphere, so do all the triangles inside it
+		if (meshlet.coneCutoff > 0)
+		{
+			XMVECTOR toCenter = XMVectorSubtract(center, camPos);
+			float along = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&meshlet.coneAxis), toCenter));
+			float across = sqrtf(fmaxf(XMVectorGetX(XMVector3LengthSq(toCenter)) - along * along, 0));
+			float sine = sqrtf(fmaxf(1 - meshlet.coneCutoff * meshlet.coneCutoff, 0));
+			if (along * meshlet.coneCutoff - across * sine > meshlet.radius)
+			{
+				if (stats)
+				{
+					stats->backfaceMeshlets++;
+					stats->backfaceTriangles += meshlet.indexCount / 3;
+				}
+				continue;
+			}
+		}
+
+		if (!visible.empty() && visible.back().indexOffset + visible.back().indexCount == meshlet.indexOffset)
+			visible.back().indexCount += meshlet.indexCount;
+		else
+			visible.push_back({ meshlet.indexOffset, meshlet.indexCount });
+	}
+}
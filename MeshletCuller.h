@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "MeshletBuilder.h"
+
+/// <summary>
+/// A camera as seen from one object's space, what that object's meshlets are tested against
+/// </summary>
+struct MeshletCullView
+{
+	DirectX::XMFLOAT4 planes[6]; // frustum planes, normalized and facing inwards
+	DirectX::XMFLOAT3 camPos;
+};
+
+/// <summary>
+/// What the culler rejected, only ever added to so one set can cover a whole frame
+/// </summary>
+struct MeshletCullStats
+{
+	unsigned int meshlets;
+	unsigned int triangles;
+	unsigned int frustumMeshlets; // rejected for being outside the frustum
+	unsigned int frustumTriangles;
+	unsigned int backfaceMeshlets; // rejected for facing away
+	unsigned int backfaceTriangles;
+};
+
+/// <summary>
+/// A run of indices to draw with one DrawIndexed
+/// </summary>
+struct IndexRange
+{
+	unsigned int indexOffset;
+	unsigned int indexCount;
+};
+
+/// <summary>
+/// <para>Rejects meshlets that are outside the view frustum or facing away from the camera</para>
+/// Both tests are conservative, a rejected meshlet never has a visible triangle
+/// </summary>
+class MeshletCuller
+{
+public:
+	static MeshletCullView MakeView(DirectX::XMFLOAT4X4 world, DirectX::XMFLOAT4X4 view, DirectX::XMFLOAT4X4 proj, DirectX::XMFLOAT3 camPos);
+	static void Cull(const MeshletCullView& view, const Meshlet* meshlets, size_t meshletCount, std::vector<IndexRange>& visible, MeshletCullStats* stats = 0);
+};
@@ -0,0 +1,167 @@
+#include "NullRenderDevice.h"
+
+NullRenderDevice::NullRenderDevice()
+{
+	recording = false;
+}
+
+/// <summary>
+/// Turn the in-order call log on or off (counters are always kept)
+/// </summary>
+/// <param name="recording">- whether to log calls from now on</param>
+void NullRenderDevice::SetRecording(bool recording)
+{
+	this->recording = recording;
+}
+
+/// <returns>Every call received while recording, in order</returns>
+const std::vector<RenderCallType>& NullRenderDevice::GetRecordedCalls()
+{
+	return recordedCalls;
+}
+
+void NullRenderDevice::ClearRecordedCalls()
+{
+	recordedCalls.clear();
+}
+
+/// <summary>
+/// Count the call and log it if recording
+/// </summary>
+/// <param name="type">- which call</param>
+void NullRenderDevice::Record(RenderCallType type)
+{
+	Count(type);
+	if (recording) recordedCalls.push_back(type);
+}
+
+ID3D11DeviceContext* NullRenderDevice::GetContext()
+{
+	return nullptr;
+}
+
+void NullRenderDevice::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	Record(RENDER_CALL_IA_SET_PRIMITIVE_TOPOLOGY);
+}
+
+void NullRenderDevice::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	Record(RENDER_CALL_IA_SET_INPUT_LAYOUT);
+}
+
+void NullRenderDevice::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	Record(RENDER_CALL_IA_SET_VERTEX_BUFFERS);
+}
+
+void NullRenderDevice::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	Record(RENDER_CALL_IA_SET_INDEX_BUFFER);
+}
+
+void NullRenderDevice::VSSetShader(ID3D11VertexShader* shader)
+{
+	Record(RENDER_CALL_VS_SET_SHADER);
+}
+
+void NullRenderDevice::PSSetShader(ID3D11PixelShader* shader)
+{
+	Record(RENDER_CALL_PS_SET_SHADER);
+}
+
+void NullRenderDevice::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	Record(RENDER_CALL_VS_SET_CONSTANT_BUFFERS);
+}
+
+void NullRenderDevice::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	Record(RENDER_CALL_PS_SET_CONSTANT_BUFFERS);
+}
+
+void NullRenderDevice::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+	Record(RENDER_CALL_VS_SET_SHADER_RESOURCES);
+}
+
+void NullRenderDevice::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+	Record(RENDER_CALL_PS_SET_SHADER_RESOURCES);
+}
+
+void NullRenderDevice::VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	Record(RENDER_CALL_VS_SET_SAMPLERS);
+}
+
+void NullRenderDevice::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	Record(RENDER_CALL_PS_SET_SAMPLERS);
+}
+
+/// <summary>
+/// Pretend to copy a constant buffer to the GPU, only the size is kept
+/// </summary>
+/// <param name="buffer">- constant buffer to overwrite</param>
+/// <param name="data">- new contents (never read)</param>
+/// <param name="size">- how many bytes data holds</param>
+void NullRenderDevice::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	Record(RENDER_CALL_UPDATE_CONSTANT_BUFFER);
+	stats.bytesUploaded += size;
+}
+
+void NullRenderDevice::UpdateBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	Record(RENDER_CALL_UPDATE_BUFFER);
+	stats.bytesUploaded += size;
+}
+
+void NullRenderDevice::RSSetState(ID3D11RasterizerState* state)
+{
+	Record(RENDER_CALL_RS_SET_STATE);
+}
+
+void NullRenderDevice::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports)
+{
+	Record(RENDER_CALL_RS_SET_VIEWPORTS);
+}
+
+void NullRenderDevice::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	Record(RENDER_CALL_OM_SET_RENDER_TARGETS);
+}
+
+void NullRenderDevice::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	Record(RENDER_CALL_OM_SET_DEPTH_STENCIL_STATE);
+}
+
+void NullRenderDevice::ClearRenderTargetView(ID3D11RenderTargetView* rtv, const float color[4])
+{
+	Record(RENDER_CALL_CLEAR_RENDER_TARGET_VIEW);
+}
+
+void NullRenderDevice::ClearDepthStencilView(ID3D11DepthStencilView* dsv, UINT clearFlags, float depth, UINT8 stencil)
+{
+	Record(RENDER_CALL_CLEAR_DEPTH_STENCIL_VIEW);
+}
+
+void NullRenderDevice::Draw(UINT vertexCount, UINT startVertex)
+{
+	Record(RENDER_CALL_DRAW);
+	stats.indices += vertexCount;
+}
+
+void NullRenderDevice::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	Record(RENDER_CALL_DRAW_INDEXED);
+	stats.indices += indexCount;
+}
+
+void NullRenderDevice::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+{
+	Record(RENDER_CALL_DRAW_INDEXED_INSTANCED);
+	stats.indices += indexCount * instanceCount;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include "RenderDevice.h"
+
+/// <summary>
+/// <para>Render device that never touches a GPU</para>
+/// Every call is counted (and optionally logged in order) and then dropped,
+/// so the frame loop can run headless and be measured on machines without a graphics card
+/// </summary>
+class NullRenderDevice : public RenderDevice
+{
+private:
+	bool recording;
+	std::vector<RenderCallType> recordedCalls;
+	void Record(RenderCallType);
+public:
+	NullRenderDevice();
+	void SetRecording(bool);
+	const std::vector<RenderCallType>& GetRecordedCalls();
+	void ClearRecordedCalls();
+	ID3D11DeviceContext* GetContext();
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY);
+	void IASetInputLayout(ID3D11InputLayout*);
+	void IASetVertexBuffers(UINT, UINT, ID3D11Buffer* const*, const UINT*, const UINT*);
+	void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT);
+	void VSSetShader(ID3D11VertexShader*);
+	void PSSetShader(ID3D11PixelShader*);
+	void VSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*);
+	void PSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*);
+	void VSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*);
+	void PSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*);
+	void VSSetSamplers(UINT, UINT, ID3D11SamplerState* const*);
+	void PSSetSamplers(UINT, UINT, ID3D11SamplerState* const*);
+	void UpdateConstantBuffer(ID3D11Buffer*, const void*, UINT);
+	void UpdateBuffer(ID3D11Buffer*, const void*, UINT);
+	void RSSetState(ID3D11RasterizerState*);
+	void RSSetViewports(UINT, const D3D11_VIEWPORT*);
+	void OMSetRenderTargets(UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*);
+	void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT);
+	void ClearRenderTargetView(ID3D11RenderTargetView*, const float[4]);
+	void ClearDepthStencilView(ID3D11DepthStencilView*, UINT, float, UINT8);
+	void Draw(UINT, UINT);
+	void DrawIndexed(UINT, UINT, INT);
+	void DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT);
+};
@@ -0,0 +1,522 @@
+#include "ObjImporter.h"
+#include "MappedFile.h"
+#include "Threading.h"
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <climits>
+#include <cstdio>
+
+using namespace DirectX;
+using namespace std;
+
+// Chunks smaller than this aren't worth a thread
+#define OBJ_MIN_CHUNK_BYTES (256 * 1024)
+
+namespace
+{
+	/// <summary>
+	/// A line-aligned slice of the file plus where its results go in the output arrays
+	/// </summary>
+	struct ObjChunk
+	{
+		const char* begin;
+		const char* end;
+		size_t positionCount;
+		size_t uvCount;
+		size_t normalCount;
+		size_t triangleCount;
+		size_t positionBase;
+		size_t uvBase;
+		size_t normalBase;
+		size_t triangleBase;
+		size_t trianglesParsed; // fewer than triangleCount when faces were skipped
+		size_t skippedLines;
+	};
+
+	inline bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p)) p++;
+		return p;
+	}
+
+	inline const char* NextLine(const char* p, const char* end)
+	{
+		const char* newline = (const char*)memchr(p, '\n', end - p);
+		return newline ? newline + 1 : end;
+	}
+
+	/// <summary>
+	/// Parse a decimal float (optional sign, fraction and exponent) without locale lookups or allocations
+	/// </summary>
+	/// <param name="p">- read position, leading spaces are skipped and it's moved past the number on success</param>
+	/// <param name="end">- end of the line</param>
+	/// <param name="out">- parsed value</param>
+	/// <returns>False if there was no number at p</returns>
+	bool ScanFloat(const char*& p, const char* end, float& out)
+	{
+		static const double powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		const char* s = SkipSpaces(p, end);
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+		{
+			negative = *s == '-';
+			s++;
+		}
+
+		// Up to 19 significant digits fit in 64 bits, the rest only move the exponent
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool any = false;
+		for (; s < end && IsDigit(*s); s++)
+		{
+			any = true;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*s - '0');
+				if (mantissa) digits++;
+			}
+			else exponent++;
+		}
+		if (s < end && *s == '.')
+		{
+			s++;
+			for (; s < end && IsDigit(*s); s++)
+			{
+				any = true;
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*s - '0');
+					if (mantissa) digits++;
+					exponent--;
+				}
+			}
+		}
+		if (!any)
+			return false;
+
+		if (s < end && (*s == 'e' || *s == 'E'))
+		{
+			const char* e = s + 1;
+			bool negativeExponent = false;
+			if (e < end && (*e == '-' || *e == '+'))
+			{
+				negativeExponent = *e == '-';
+				e++;
+			}
+			if (e < end && IsDigit(*e))
+			{
+				int value = 0;
+				for (; e < end && IsDigit(*e); e++)
+					if (value < 10000) value = value * 10 + (*e - '0');
+				exponent += negativeExponent ? -value : value;
+				s = e;
+			}
+		}
+
+		double result = (double)mantissa;
+		if (exponent > 0)
+			result = exponent <= 22 ? result * powers[exponent] : result * pow(10.0, exponent);
+		else if (exponent < 0)
+			result = exponent >= -22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+
+		out = (float)(negative ? -result : result);
+		p = s;
+		return true;
+	}
+
+	/// <summary>
+	/// Parse a signed decimal integer
+	/// </summary>
+	/// <returns>False if there was no number at p or it doesn't fit in an int</returns>
+	bool ScanInt(const char*& p, const char* end, int& out)
+	{
+		const char* s = p;
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+		{
+			negative = *s == '-';
+			s++;
+		}
+		if (s >= end || !IsDigit(*s))
+			return false;
+
+		int value = 0;
+		for (; s < end && IsDigit(*s); s++)
+		{
+			int digit = *s - '0';
+			if (value > (INT_MAX - digit) / 10)
+				return false;
+			value = value * 10 + digit;
+		}
+
+		out = negative ? -value : value;
+		p = s;
+		return true;
+	}
+
+	/// <summary>
+	/// Turn a 1-based (or negative, relative) OBJ index into a 0-based one
+	/// </summary>
+	/// <param name="index">- index as written in the file, 0 means it was left out</param>
+	/// <param name="countSoFar">- how many elements of that kind come before this line in the file</param>
+	/// <returns>-1 if the index was left out, INT_MIN if it's relative and reaches before the start of the file</returns>
+	inline int ResolveIndex(int index, size_t countSoFar)
+	{
+		if (index > 0) return index - 1;
+		if (index < 0) return (size_t)-(long long)index <= countSoFar ? (int)((long long)countSoFar + index) : INT_MIN;
+		return -1;
+	}
+
+	/// <summary>
+	/// Work out what kind of line starts at p
+	/// </summary>
+	/// <returns>'v', 't' (vt), 'n' (vn), 'f' or 0 for anything we don't read</returns>
+	inline char LineType(const char*& p, const char* end)
+	{
+		p = SkipSpaces(p, end);
+		if (end - p < 2) return 0;
+		if (p[0] == 'v')
+		{
+			if (IsSpace(p[1])) { p += 2; return 'v'; }
+			if (end - p >= 3 && (p[1] == 't' || p[1] == 'n') && IsSpace(p[2]))
+			{
+				char type = p[1];
+				p += 3;
+				return type;
+			}
+			return 0;
+		}
+		if (p[0] == 'f' && IsSpace(p[1]))
+		{
+			p += 2;
+			return 'f';
+		}
+		return 0;
+	}
+
+	/// <summary>
+	/// First pass: count everything in the chunk so each chunk knows where its output goes
+	/// </summary>
+	void CountChunk(ObjChunk& chunk)
+	{
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			const char* lineEnd = NextLine(p, chunk.end);
+			switch (LineType(p, lineEnd))
+			{
+			case 'v': chunk.positionCount++; break;
+			case 't': chunk.uvCount++; break;
+			case 'n': chunk.normalCount++; break;
+			case 'f':
+			{
+				size_t corners = 0;
+				for (;;)
+				{
+					p = SkipSpaces(p, lineEnd);
+					if (p >= lineEnd || *p == '\n' || *p == '#') break;
+					corners++;
+					while (p < lineEnd && !IsSpace(*p) && *p != '\n' && *p != '#') p++;
+				}
+				if (corners >= 3) chunk.triangleCount += corners - 2;
+				break;
+			}
+			default: break;
+			}
+			p = lineEnd;
+		}
+	}
+
+	/// <summary>
+	/// Parse one face corner ("v", "v/t", "v//n" or "v/t/n") and resolve it to 0-based indices
+	/// </summary>
+	bool ScanCorner(const char*& p, const char* end, size_t positions, size_t uvs, size_t normals, ObjCorner& corner)
+	{
+		int position = 0, uv = 0, normal = 0;
+		if (!ScanInt(p, end, position))
+			return false;
+		if (p < end && *p == '/')
+		{
+			p++;
+			if (p < end && *p != '/' && !ScanInt(p, end, uv))
+				return false;
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (!ScanInt(p, end, normal))
+					return false;
+			}
+		}
+		corner.position = ResolveIndex(position, positions);
+		corner.uv = ResolveIndex(uv, uvs);
+		corner.normal = ResolveIndex(normal, normals);
+		return true;
+	}
+
+	/// <summary>
+	/// <para>Second pass: parse the chunk straight into its slice of the output arrays</para>
+	/// Lines that don't parse are skipped like the old loader did. A vertex line still takes its slot, zeroed, so faces after it
+	/// point where the file meant them to, and a face adds no triangles, leaving the end of the chunk's slice unused
+	/// </summary>
+	void ParseChunk(ObjChunk& chunk, ObjData& obj)
+	{
+		XMFLOAT3* positions = obj.positions.data() + chunk.positionBase;
+		XMFLOAT2* uvs = obj.uvs.data() + chunk.uvBase;
+		XMFLOAT3* normals = obj.normals.data() + chunk.normalBase;
+		ObjCorner* corners = obj.corners.data() + chunk.triangleBase * 3;
+		size_t positionCount = 0, uvCount = 0, normalCount = 0;
+
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			const char* lineEnd = NextLine(p, chunk.end);
+			bool ok = true;
+			switch (LineType(p, lineEnd))
+			{
+			case 'v':
+			{
+				XMFLOAT3& pos = positions[positionCount++];
+				ok = ScanFloat(p, lineEnd, pos.x)
+					&& ScanFloat(p, lineEnd, pos.y)
+					&& ScanFloat(p, lineEnd, pos.z);
+
+				// Flip Z (LH vs. RH)
+				pos.z *= -1.0f;
+				if (!ok) pos = XMFLOAT3(0, 0, 0);
+				break;
+			}
+			case 't':
+			{
+				XMFLOAT2& uv = uvs[uvCount++];
+				uv.y = 0.0f;
+				ok = ScanFloat(p, lineEnd, uv.x);
+				ScanFloat(p, lineEnd, uv.y);
+
+				// Flip the V since it's probably "upside down"
+				uv.y = 1.0f - uv.y;
+				if (!ok) uv = XMFLOAT2(0, 0);
+				break;
+			}
+			case 'n':
+			{
+				XMFLOAT3& norm = normals[normalCount++];
+				ok = ScanFloat(p, lineEnd, norm.x)
+					&& ScanFloat(p, lineEnd, norm.y)
+					&& ScanFloat(p, lineEnd, norm.z);
+
+				// Flip normal's Z
+				norm.z *= -1.0f;
+				if (!ok) norm = XMFLOAT3(0, 0, 0);
+				break;
+			}
+			case 'f':
+			{
+				// Relative indices count from everything before this line in the whole file
+				size_t positionsSoFar = chunk.positionBase + positionCount;
+				size_t uvsSoFar = chunk.uvBase + uvCount;
+				size_t normalsSoFar = chunk.normalBase + normalCount;
+
+				// Fan the polygon into triangles, flipping the winding order as we go
+				ObjCorner* faceStart = corners;
+				ObjCorner first = {}, previous = {}, current = {};
+				int cornerCount = 0;
+				for (;;)
+				{
+					p = SkipSpaces(p, lineEnd);
+					if (p >= lineEnd || *p == '\n' || *p == '#') break;
+					// Corners must be split the same way the counting pass split them
+					if (!ScanCorner(p, lineEnd, positionsSoFar, uvsSoFar, normalsSoFar, current) ||
+						(p < lineEnd && !IsSpace(*p) && *p != '\n' && *p != '#'))
+					{
+						ok = false;
+						corners = faceStart;
+						break;
+					}
+					if (cornerCount == 0) first = current;
+					else if (cornerCount >= 2)
+					{
+						*corners++ = first;
+						*corners++ = current;
+						*corners++ = previous;
+					}
+					previous = current;
+					cornerCount++;
+				}
+				break;
+			}
+			default: break;
+			}
+			if (!ok)
+				chunk.skippedLines++;
+			p = lineEnd;
+		}
+		chunk.trianglesParsed = (corners - (obj.corners.data() + chunk.triangleBase * 3)) / 3;
+	}
+}
+
+/// <summary>
+/// Load an OBJ file into an indexed triangle list with duplicate vertices welded
+/// </summary>
+/// <param name="fileName">- path of the OBJ file</param>
+/// <param name="vertices">- filled with the vertices, tangents are left at zero</param>
+/// <param name="indices">- filled with the triangle list indices</param>
+/// <param name="threadCount">- threads to parse with, 0 picks one per core</param>
+/// <returns>False if the file couldn't be opened or a face points outside it, lines that don't parse are skipped with a warning</returns>
+bool ObjImporter::Load(const wchar_t* fileName, vector<Vertex>& vertices, vector<unsigned int>& indices, unsigned int threadCount)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+		return false;
+
+	ObjData obj;
+	Parse(file.GetData(), file.GetSize(), obj, threadCount);
+	if (obj.skippedLines)
+		printf("%ls: skipped %zu lines that couldn't be parsed\n", fileName, obj.skippedLines);
+	return WeldVertices(obj, vertices, indices);
+}
+
+/// <summary>
+/// Parse OBJ text that is already in memory
+/// </summary>
+/// <param name="text">- start of the file contents, doesn't need to be null terminated</param>
+/// <param name="length">- size of the contents in bytes</param>
+/// <param name="obj">- receives the positions, uvs, normals and triangle corners</param>
+/// <param name="threadCount">- threads to parse with, 0 picks one per core</param>
+void ObjImporter::Parse(const char* text, size_t length, ObjData& obj, unsigned int threadCount)
+{
+	const char* end = text + length;
+	unsigned int chunkCount = PickThreadCount(threadCount, length, OBJ_MIN_CHUNK_BYTES);
+
+	// Split into roughly equal chunks, moving every split to the start of a line
+	vector<ObjChunk> chunks(chunkCount);
+	const char* begin = text;
+	for (unsigned int i = 0; i < chunkCount; i++)
+	{
+		const char* split = i + 1 == chunkCount ? end : NextLine(text + length / chunkCount * (i + 1), end);
+		if (split < begin) split = begin;
+		chunks[i] = {};
+		chunks[i].begin = begin;
+		chunks[i].end = split;
+		begin = split;
+	}
+
+	RunOnThreads(chunkCount, [&](unsigned int i) { CountChunk(chunks[i]); });
+
+	// Prefix sums say where each chunk writes, so the merged output stays in file order
+	size_t positionCount = 0, uvCount = 0, normalCount = 0, triangleCount = 0;
+	for (ObjChunk& chunk : chunks)
+	{
+		chunk.positionBase = positionCount;
+		chunk.uvBase = uvCount;
+		chunk.normalBase = normalCount;
+		chunk.triangleBase = triangleCount;
+		positionCount += chunk.positionCount;
+		uvCount += chunk.uvCount;
+		normalCount += chunk.normalCount;
+		triangleCount += chunk.triangleCount;
+	}
+	obj.positions.resize(positionCount);
+	obj.uvs.resize(uvCount);
+	obj.normals.resize(normalCount);
+	obj.corners.resize(triangleCount * 3);
+
+	RunOnThreads(chunkCount, [&](unsigned int i) { ParseChunk(chunks[i], obj); });
+
+	// Skipped faces leave gaps at the ends of their chunks' slices, slide the triangles after them down
+	size_t parsed = 0;
+	obj.skippedLines = 0;
+	for (ObjChunk& chunk : chunks)
+	{
+		if (parsed != chunk.triangleBase)
+			memmove(&obj.corners[parsed * 3], &obj.corners[chunk.triangleBase * 3], chunk.trianglesParsed * 3 * sizeof(ObjCorner));
+		parsed += chunk.trianglesParsed;
+		obj.skippedLines += chunk.skippedLines;
+	}
+	obj.corners.resize(parsed * 3);
+}
+
+/// <summary>
+/// <para>Build an indexed vertex list from parsed corners</para>
+/// Corners with bit-identical position, uv and normal share one vertex, found through an
+/// open-addressing hash table, and vertices keep the order they're first used in
+/// </summary>
+/// <param name="obj">- parsed OBJ data</param>
+/// <param name="vertices">- filled with the unique vertices, tangents are left at zero</param>
+/// <param name="indices">- filled with one index per corner</param>
+/// <returns>False if a corner points outside the parsed data, relative indices from before the file's start included</returns>
+bool ObjImporter::WeldVertices(const ObjData& obj, vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	const unsigned int empty = 0xFFFFFFFF;
+	size_t cornerCount = obj.corners.size();
+	vertices.clear();
+	indices.resize(cornerCount);
+
+	// Keep the table under 80% full even if nothing welds
+	size_t capacity = 16;
+	while (capacity < cornerCount + cornerCount / 4) capacity <<= 1;
+	vector<unsigned int> table(capacity, empty);
+
+	for (size_t i = 0; i < cornerCount; i++)
+	{
+		const ObjCorner& c = obj.corners[i];
+		if (c.position < 0 || c.position >= (int)obj.positions.size() ||
+			c.uv < -1 || c.uv >= (int)obj.uvs.size() ||
+			c.normal < -1 || c.normal >= (int)obj.normals.size())
+			return false;
+
+		// Faces without UVs or normals get a shared placeholder instead of crashing
+		Vertex v;
+		v.Position = obj.positions[c.position];
+		v.UV = c.uv >= 0 ? obj.uvs[c.uv] : XMFLOAT2(0, 0);
+		v.Normal = c.normal >= 0 ? obj.normals[c.normal] : XMFLOAT3(0, 0, 0);
+		v.Tangent = XMFLOAT4(0, 0, 0, 1);
+
+		// Position, UV and Normal are 8 packed floats, adding 0 turns -0 into +0 so both hash the same
+		float* key = &v.Position.x;
+		uint64_t hash = 14695981039346656037ull;
+		for (int k = 0; k < 8; k++)
+		{
+			key[k] += 0.0f;
+			uint32_t bits;
+			memcpy(&bits, &key[k], sizeof(bits));
+			hash = (hash ^ bits) * 1099511628211ull;
+		}
+		hash ^= hash >> 29;
+
+		size_t slot = (size_t)hash & (capacity - 1);
+		for (;;)
+		{
+			unsigned int index = table[slot];
+			if (index == empty)
+			{
+				index = (unsigned int)vertices.size();
+				table[slot] = index;
+				vertices.push_back(v);
+				indices[i] = index;
+				break;
+			}
+			if (memcmp(&vertices[index].Position, key, sizeof(float) * 8) == 0)
+			{
+				indices[i] = index;
+				break;
+			}
+			slot = (slot + 1) & (capacity - 1);
+		}
+	}
+	return true;
+}
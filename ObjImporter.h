@@ -0,0 +1,43 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "Vertex.h"
+
+/// <summary>
+/// One corner of an OBJ face as 0-based indices into the file's position/uv/normal lists, -1 if the face left it out
+/// and below -1 if a relative index pointed before the start of the file
+/// </summary>
+struct ObjCorner
+{
+	int position;
+	int uv;
+	int normal;
+};
+
+/// <summary>
+/// <para>Everything pulled out of an OBJ file, already converted to D3D conventions</para>
+/// Z and normal Z are negated, UV V is flipped and every face is fanned into triangles
+/// with the winding reversed, three corners per triangle
+/// </summary>
+struct ObjData
+{
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT2> uvs;
+	std::vector<DirectX::XMFLOAT3> normals;
+	std::vector<ObjCorner> corners;
+	size_t skippedLines = 0; // lines that couldn't be parsed, a vertex line keeps its slot at zero so later indices line up
+};
+
+/// <summary>
+/// <para>OBJ loader that parses a memory-mapped file on several threads</para>
+/// The file is split into line-aligned chunks that are counted, then parsed straight into
+/// their final slots in the output arrays, so results stay in file order and nothing is
+/// allocated per line
+/// </summary>
+class ObjImporter
+{
+public:
+	static bool Load(const wchar_t* fileName, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int threadCount = 0);
+	static void Parse(const char* text, size_t length, ObjData& obj, unsigned int threadCount = 0);
+	static bool WeldVertices(const ObjData& obj, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+};
@@ -0,0 +1,511 @@
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#ifdef _XM_AVX_INTRINSICS_
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	static_assert(OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT == 32, "A tile's coverage has to fill an unsigned int");
+	const unsigned int fullMask = 0xffffffffu;
+
+	// Pixel centers across a tile, from its left edge
+	alignas(32) const float pixelCenters[OCCLUSION_TILE_WIDTH] = { 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f };
+
+	/// <summary>
+	/// Four pixels of a tile row at a time in DirectXMath's vectors
+	/// </summary>
+	struct Lanes4
+	{
+		typedef XMVECTOR V;
+		static const size_t Width = 4;
+		static V Load(const float* p) { return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(p)); }
+		static V Splat(float f) { return XMVectorReplicate(f); }
+		static V Add(V a, V b) { return XMVectorAdd(a, b); }
+		static V Mul(V a, V b) { return XMVectorMultiply(a, b); }
+		static V Less(V a, V b) { return XMVectorLess(a, b); }
+		static V Or(V a, V b) { return XMVectorOrInt(a, b); }
+
+		/// <returns>One bit per lane whose comparison came out true, lane 0 in bit 0</returns>
+		static unsigned int Mask(V v)
+		{
+#ifdef _XM_SSE_INTRINSICS_
+			return (unsigned int)_mm_movemask_ps(v);
+#else
+			uint32_t lanes[4];
+			XMStoreInt4(lanes, v);
+			return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+#endif
+		}
+	};
+
+#ifdef _XM_AVX_INTRINSICS_
+	/// <summary>
+	/// A whole tile row at a time in AVX registers, only built when the compiler targets AVX
+	/// </summary>
+	struct Lanes8
+	{
+		typedef __m256 V;
+		static const size_t Width = 8;
+		static V Load(const float* p) { return _mm256_loadu_ps(p); }
+		static V Splat(float f) { return _mm256_set1_ps(f); }
+		static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V Less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static V Or(V a, V b) { return _mm256_or_ps(a, b); }
+		static unsigned int Mask(V v) { return (unsigned int)_mm256_movemask_ps(v); }
+	};
+	typedef Lanes8 Lanes;
+#else
+	typedef Lanes4 Lanes;
+#endif
+
+	/// <summary>
+	/// Which pixels of a tile a triangle covers, a pixel is covered when its center is on the inside of all three edges
+	/// </summary>
+	/// <param name="left">- the tile's left edge, in pixels</param>
+	/// <param name="top">- the tile's top edge, in pixels</param>
+	/// <returns>One bit per pixel, row by row from the top left</returns>
+	template<typename L>
+	unsigned int CoverTile(const float* edgeA, const float* edgeB, const float* edgeC, float left, float top)
+	{
+		typedef typename L::V V;
+		V zero = L::Splat(0.0f);
+		unsigned int mask = 0;
+		for (size_t column = 0; column < OCCLUSION_TILE_WIDTH; column += L::Width)
+		{
+			V x = L::Add(L::Load(pixelCenters + column), L::Splat(left));
+			V across[3];
+			for (int e = 0; e < 3; e++)
+				across[e] = L::Mul(L::Splat(edgeA[e]), x);
+			for (unsigned int row = 0; row < OCCLUSION_TILE_HEIGHT; row++)
+			{
+				float y = top + row + 0.5f;
+				V outside = zero;
+				for (int e = 0; e < 3; e++)
+					outside = L::Or(outside, L::Less(L::Add(across[e], L::Splat(edgeB[e] * y + edgeC[e])), zero));
+				unsigned int inside = ~L::Mask(outside) & ((1u << L::Width) - 1);
+				mask |= inside << (row * OCCLUSION_TILE_WIDTH + column);
+			}
+		}
+		return mask;
+	}
+
+	/// <returns>How far inside a clip space plane a point is, negative when it's outside</returns>
+	inline float PlaneDistance(const XMFLOAT4& plane, const XMFLOAT4& p)
+	{
+		return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w * p.w;
+	}
+}
+
+/// <summary>
+/// Make an empty buffer, sizes are rounded up to whole tiles
+/// </summary>
+OcclusionCuller::OcclusionCuller(unsigned int width, unsigned int height)
+{
+	tilesX = max(1u, (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH);
+	tilesY = max(1u, (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT);
+	this->width = tilesX * OCCLUSION_TILE_WIDTH;
+	this->height = tilesY * OCCLUSION_TILE_HEIGHT;
+	tiles.resize(tilesX * tilesY, { 1.0f, 0.0f, 0 });
+	bands.resize((tilesY + OCCLUSION_BAND_ROWS - 1) / OCCLUSION_BAND_ROWS);
+	XMStoreFloat4x4(&viewProj, XMMatrixIdentity());
+}
+
+/// <summary>
+/// Clear the buffer and forget last frame's occluders, ready to draw this frame's from a new view
+/// </summary>
+void OcclusionCuller::Begin(const XMFLOAT4X4& view, const XMFLOAT4X4& proj)
+{
+	XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+	for (Tile& tile : tiles)
+		tile = { 1.0f, 0.0f, 0 };
+	triangles.clear();
+	for (vector<unsigned int>& band : bands)
+		band.clear();
+}
+
+void OcclusionCuller::AddOccluder(const OccluderMesh& mesh, const XMFLOAT4X4& world)
+{
+	AddOccluder(mesh.positions.data(), mesh.positions.size(), mesh.indices.data(), mesh.indices.size(), world);
+}
+
+/// <summary>
+/// <para>Set up an occluder's triangles and sort them into the bands they touch, Rasterize() draws them</para>
+/// Triangles are drawn in the order they're added, so adding the nearest occluders first fills the buffer quickest
+/// </summary>
+/// <param name="world">- where the occluder is, its positions are in its own space</param>
+void OcclusionCuller::AddOccluder(const XMFLOAT3* positions, size_t positionCount, const unsigned int* indices, size_t indexCount, const XMFLOAT4X4& world)
+{
+	XMMATRIX toClip = XMLoadFloat4x4(&world) * XMLoadFloat4x4(&viewProj);
+	clipPositions.resize(positionCount);
+	for (size_t i = 0; i < positionCount; i++)
+		XMStoreFloat4(&clipPositions[i], XMVector3Transform(XMLoadFloat3(&positions[i]), toClip));
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		XMFLOAT4 clip[3] = { clipPositions[indices[i]], clipPositions[indices[i + 1]], clipPositions[indices[i + 2]] };
+		AddTriangle(clip);
+	}
+}
+
+/// <summary>
+/// Drop a clip space triangle that's entirely off screen, clip one that crosses the near plane or leaves the
+/// guard band, and set up what's left
+/// </summary>
+void OcclusionCuller::AddTriangle(const XMFLOAT4* clip)
+{
+	unsigned int outside = 0x3f;
+	bool needsClipping = false;
+	for (int i = 0; i < 3; i++)
+	{
+		const XMFLOAT4& p = clip[i];
+		outside &= (p.x < -p.w ? 1 : 0) | (p.x > p.w ? 2 : 0) | (p.y < -p.w ? 4 : 0) | (p.y > p.w ? 8 : 0) | (p.z < 0 ? 16 : 0) | (p.z > p.w ? 32 : 0);
+		float guard = OCCLUSION_GUARD_BAND * p.w;
+		needsClipping = needsClipping || p.z < 0 || fabsf(p.x) > guard || fabsf(p.y) > guard;
+	}
+	if (outside)
+		return;
+
+	// Near plane, then the guard band's sides, each can add one corner
+	const XMFLOAT4 planes[5] = { XMFLOAT4(0, 0, 1, 0),
+		XMFLOAT4(1, 0, 0, OCCLUSION_GUARD_BAND), XMFLOAT4(-1, 0, 0, OCCLUSION_GUARD_BAND),
+		XMFLOAT4(0, 1, 0, OCCLUSION_GUARD_BAND), XMFLOAT4(0, -1, 0, OCCLUSION_GUARD_BAND) };
+	XMFLOAT4 polygon[2][8];
+	size_t count = 3;
+	copy(clip, clip + 3, polygon[0]);
+	int current = 0;
+	for (int p = 0; p < 5 && needsClipping; p++)
+	{
+		const XMFLOAT4* in = polygon[current];
+		XMFLOAT4* out = polygon[current ^ 1];
+		size_t written = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			const XMFLOAT4& a = in[i];
+			const XMFLOAT4& b = in[(i + 1) % count];
+			float da = PlaneDistance(planes[p], a);
+			float db = PlaneDistance(planes[p], b);
+			if (da >= 0)
+				out[written++] = a;
+			if ((da >= 0) != (db >= 0))
+			{
+				float t = da / (da - db);
+				out[written++] = XMFLOAT4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+			}
+		}
+		count = written;
+		current ^= 1;
+		if (count < 3)
+			return;
+	}
+
+	// Pixels with y going down the screen, and depth
+	XMFLOAT3 screen[8];
+	for (size_t i = 0; i < count; i++)
+	{
+		const XMFLOAT4& p = polygon[current][i];
+		float invW = 1.0f / p.w;
+		screen[i] = XMFLOAT3((p.x * invW * 0.5f + 0.5f) * width, (0.5f - p.y * invW * 0.5f) * height, p.z * invW);
+	}
+	for (size_t i = 2; i < count; i++)
+	{
+		XMFLOAT3 triangle[3] = { screen[0], screen[i - 1], screen[i] };
+		SetupTriangle(triangle);
+	}
+}
+
+/// <summary>
+/// Work out a screen space triangle's edges, depth plane and the pixels it can reach, and put it in the bands it touches
+/// </summary>
+void OcclusionCuller::SetupTriangle(const XMFLOAT3* screen)
+{
+	const XMFLOAT3& a = screen[0];
+	const XMFLOAT3& b = screen[1];
+	const XMFLOAT3& c = screen[2];
+
+	// Clockwise on screen is facing the camera, anything else faces away or has no area
+	float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+	if (!(area > 0.0f))
+		return;
+
+	Triangle t;
+	t.minX = max(0, (int)ceilf(min(min(a.x, b.x), c.x) - 0.5f));
+	t.minY = max(0, (int)ceilf(min(min(a.y, b.y), c.y) - 0.5f));
+	t.maxX = min((int)width - 1, (int)floorf(max(max(a.x, b.x), c.x) - 0.5f));
+	t.maxY = min((int)height - 1, (int)floorf(max(max(a.y, b.y), c.y) - 0.5f));
+	if (t.minX > t.maxX || t.minY > t.maxY)
+		return;
+
+	for (int e = 0; e < 3; e++)
+	{
+		const XMFLOAT3& from = screen[e];
+		const XMFLOAT3& to = screen[(e + 1) % 3];
+		t.edgeA[e] = from.y - to.y;
+		t.edgeB[e] = to.x - from.x;
+		t.edgeC[e] = -(t.edgeA[e] * from.x + t.edgeB[e] * from.y);
+	}
+
+	float toB = b.z - a.z, toC = c.z - a.z;
+	t.depthX = (toB * (c.y - a.y) - toC * (b.y - a.y)) / area;
+	t.depthY = (toC * (b.x - a.x) - toB * (c.x - a.x)) / area;
+	t.depthC = a.z - t.depthX * a.x - t.depthY * a.y;
+	t.maxDepth = max(max(a.z, b.z), c.z);
+
+	unsigned int index = (unsigned int)triangles.size();
+	triangles.push_back(t);
+	const int bandHeight = OCCLUSION_TILE_HEIGHT * OCCLUSION_BAND_ROWS;
+	for (int band = t.minY / bandHeight; band <= t.maxY / bandHeight; band++)
+		bands[band].push_back(index);
+}
+
+/// <summary>
+/// <para>Draw one band's triangles into its tiles</para>
+/// A tile only learns which pixels a triangle covers and the furthest the triangle gets across the tile. Covered
+/// pixels join the tile's layer at that depth, and once the layer covers every pixel it becomes the far depth
+/// </summary>
+void OcclusionCuller::RasterizeBand(unsigned int band)
+{
+	int rowFirst = (int)band * OCCLUSION_BAND_ROWS;
+	int rowLast = min(rowFirst + OCCLUSION_BAND_ROWS, (int)tilesY) - 1;
+	for (unsigned int index : bands[band])
+	{
+		const Triangle& t = triangles[index];
+		int tyFirst = max(rowFirst, t.minY / OCCLUSION_TILE_HEIGHT);
+		int tyLast = min(rowLast, t.maxY / OCCLUSION_TILE_HEIGHT);
+		for (int ty = tyFirst; ty <= tyLast; ty++)
+		{
+			float top = (float)(ty * OCCLUSION_TILE_HEIGHT);
+			for (int tx = t.minX / OCCLUSION_TILE_WIDTH; tx <= t.maxX / OCCLUSION_TILE_WIDTH; tx++)
+			{
+				float left = (float)(tx * OCCLUSION_TILE_WIDTH);
+
+				// The edges at the tile's corner pixels tell if it's entirely outside or inside, only the rest need every pixel
+				float x0 = left + 0.5f, x1 = left + OCCLUSION_TILE_WIDTH - 0.5f;
+				float y0 = top + 0.5f, y1 = top + OCCLUSION_TILE_HEIGHT - 0.5f;
+				bool outside = false, inside = true;
+				for (int e = 0; e < 3; e++)
+				{
+					float upper = t.edgeB[e] * y0 + t.edgeC[e], lower = t.edgeB[e] * y1 + t.edgeC[e];
+					float ax0 = t.edgeA[e] * x0, ax1 = t.edgeA[e] * x1;
+					float most = max(max(ax0 + upper, ax1 + upper), max(ax0 + lower, ax1 + lower));
+					float least = min(min(ax0 + upper, ax1 + upper), min(ax0 + lower, ax1 + lower));
+					outside = outside || most < 0.0f;
+					inside = inside && least >= 0.0f;
+				}
+				if (outside)
+					continue;
+				unsigned int mask = inside ? fullMask : CoverTile<Lanes>(t.edgeA, t.edgeB, t.edgeC, left, top);
+				if (mask == 0)
+					continue;
+
+				// The depth plane is furthest at a corner of the pixels both the tile and the triangle reach
+				float fromX = (float)max((int)left, t.minX) + 0.5f, toX = (float)min((int)left + OCCLUSION_TILE_WIDTH - 1, t.maxX) + 0.5f;
+				float fromY = (float)max((int)top, t.minY) + 0.5f, toY = (float)min((int)top + OCCLUSION_TILE_HEIGHT - 1, t.maxY) + 0.5f;
+				float depth = t.depthC + t.depthX * (t.depthX > 0 ? toX : fromX) + t.depthY * (t.depthY > 0 ? toY : fromY);
+				depth = min(depth, t.maxDepth);
+
+				Tile& tile = tiles[ty * tilesX + tx];
+				if (depth >= tile.farDepth)
+					continue;
+				if (mask == fullMask)
+				{
+					// The whole tile is at least this near now, the layer only stays if it's nearer still
+					tile.farDepth = depth;
+					if (tile.layerDepth >= depth)
+						tile = { depth, 0.0f, 0 };
+					continue;
+				}
+
+				// A triangle far nearer than the layer, when the layer gains little over the far depth, starts the layer again
+				if (tile.layerDepth - depth > tile.farDepth - tile.layerDepth)
+				{
+					tile.layerDepth = 0.0f;
+					tile.layerMask = 0;
+				}
+				tile.layerMask |= mask;
+				tile.layerDepth = max(tile.layerDepth, depth);
+				if (tile.layerMask == fullMask)
+					tile = { tile.layerDepth, 0.0f, 0 };
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Draw every occluder added since Begin(), a band of tile rows per job
+/// </summary>
+/// <param name="jobs">- spreads the bands across its workers, or 0 to draw them all on this thread</param>
+void OcclusionCuller::Rasterize(JobSystem* jobs)
+{
+	auto draw = [this](size_t begin, size_t end)
+	{
+		for (size_t band = begin; band < end; band++)
+			RasterizeBand((unsigned int)band);
+	};
+	if (jobs)
+		jobs->ParallelFor(bands.size(), 1, draw);
+	else
+		draw(0, bands.size());
+}
+
+/// <summary>
+/// <para>Whether any of a world space box could be in front of the occluders</para>
+/// The box's nearest depth is tested across the pixels its screen rectangle touches, against the layer depth where
+/// the rectangle is inside a tile's layer and the far depth everywhere else
+/// </summary>
+bool OcclusionCuller::IsVisible(float centerX, float centerY, float centerZ, float extentX, float extentY, float extentZ) const
+{
+	XMMATRIX m = XMLoadFloat4x4(&viewProj);
+	XMVECTOR center = XMVector3Transform(XMVectorSet(centerX, centerY, centerZ, 1), m);
+	XMVECTOR axisX = XMVectorScale(m.r[0], extentX);
+	XMVECTOR axisY = XMVectorScale(m.r[1], extentY);
+	XMVECTOR axisZ = XMVectorScale(m.r[2], extentZ);
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		XMVECTOR p = corner & 1 ? XMVectorAdd(center, axisX) : XMVectorSubtract(center, axisX);
+		p = corner & 2 ? XMVectorAdd(p, axisY) : XMVectorSubtract(p, axisY);
+		p = corner & 4 ? XMVectorAdd(p, axisZ) : XMVectorSubtract(p, axisZ);
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, p);
+
+		// Reaching past the near plane, the box could be covering any of the screen
+		if (clip.z < 0.0f || clip.w <= 0.0f)
+			return true;
+		float invW = 1.0f / clip.w;
+		float x = (clip.x * invW * 0.5f + 0.5f) * width;
+		float y = (0.5f - clip.y * invW * 0.5f) * height;
+		minX = min(minX, x), maxX = max(maxX, x);
+		minY = min(minY, y), maxY = max(maxY, y);
+		nearest = min(nearest, clip.z * invW);
+	}
+
+	// Every pixel the rectangle touches at all, not only the ones whose centers it covers
+	minX = max(minX, 0.0f), minY = max(minY, 0.0f);
+	maxX = min(maxX, (float)width), maxY = min(maxY, (float)height);
+	if (minX >= maxX || minY >= maxY)
+		return false;
+	int pxFirst = (int)minX, pyFirst = (int)minY;
+	int pxLast = max(pxFirst, (int)ceilf(maxX) - 1), pyLast = max(pyFirst, (int)ceilf(maxY) - 1);
+
+	for (int ty = pyFirst / OCCLUSION_TILE_HEIGHT; ty <= pyLast / OCCLUSION_TILE_HEIGHT; ty++)
+	{
+		int rowFirst = max(pyFirst - ty * OCCLUSION_TILE_HEIGHT, 0);
+		int rowLast = min(pyLast - ty * OCCLUSION_TILE_HEIGHT, OCCLUSION_TILE_HEIGHT - 1);
+		for (int tx = pxFirst / OCCLUSION_TILE_WIDTH; tx <= pxLast / OCCLUSION_TILE_WIDTH; tx++)
+		{
+			const Tile& tile = tiles[ty * tilesX + tx];
+			if (nearest <= tile.layerDepth)
+				return true;
+			if (nearest > tile.farDepth)
+				continue;
+
+			// Only nearer than the far depth, so it's hidden if the rectangle stays inside the layer
+			int columnFirst = max(pxFirst - tx * OCCLUSION_TILE_WIDTH, 0);
+			int columnLast = min(pxLast - tx * OCCLUSION_TILE_WIDTH, OCCLUSION_TILE_WIDTH - 1);
+			unsigned int columns = ((1u << (columnLast - columnFirst + 1)) - 1) << columnFirst;
+			unsigned int rectangle = 0;
+			for (int row = rowFirst; row <= rowLast; row++)
+				rectangle |= columns << (row * OCCLUSION_TILE_WIDTH);
+			if (rectangle & ~tile.layerMask)
+				return true;
+		}
+	}
+	return false;
+}
+
+bool OcclusionCuller::IsVisible(const Bounds& bounds) const
+{
+	return IsVisible((bounds.boxMin.x + bounds.boxMax.x) * 0.5f, (bounds.boxMin.y + bounds.boxMax.y) * 0.5f, (bounds.boxMin.z + bounds.boxMax.z) * 0.5f,
+		(bounds.boxMax.x - bounds.boxMin.x) * 0.5f, (bounds.boxMax.y - bounds.boxMin.y) * 0.5f, (bounds.boxMax.z - bounds.boxMin.z) * 0.5f);
+}
+
+/// <summary>
+/// Take the boxes the occluders hide out of a list, keeping the rest in order
+/// </summary>
+/// <param name="visible">- indices into boxes, usually what frustum culling let through</param>
+/// <param name="jobs">- tests blocks of boxes across its workers, or 0 to test them all on this thread</param>
+/// <param name="stats">- added to if given</param>
+void OcclusionCuller::Cull(const CullBoxes& boxes, vector<unsigned int>& visible, JobSystem* jobs, OcclusionStats* stats)
+{
+	size_t count = visible.size();
+	hidden.resize(count);
+	auto test = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			unsigned int b = visible[i];
+			hidden[i] = !IsVisible(boxes.centerX[b], boxes.centerY[b], boxes.centerZ[b], boxes.extentX[b], boxes.extentY[b], boxes.extentZ[b]);
+		}
+	};
+	if (jobs)
+		jobs->ParallelFor(count, OCCLUSION_TEST_BLOCK, test);
+	else
+		test(0, count);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		visible[kept] = visible[i];
+		kept += !hidden[i];
+	}
+	visible.resize(kept);
+
+	if (stats)
+	{
+		stats->triangles += (unsigned int)triangles.size();
+		stats->tested += (unsigned int)count;
+		stats->visible += (unsigned int)kept;
+	}
+}
+
+/// <returns>The depth the buffer has at a pixel, every occluder covering it is at least this near</returns>
+float OcclusionCuller::GetDepth(unsigned int x, unsigned int y) const
+{
+	const Tile& tile = tiles[(y / OCCLUSION_TILE_HEIGHT) * tilesX + x / OCCLUSION_TILE_WIDTH];
+	unsigned int bit = (y % OCCLUSION_TILE_HEIGHT) * OCCLUSION_TILE_WIDTH + x % OCCLUSION_TILE_WIDTH;
+	return (tile.layerMask >> bit) & 1 ? tile.layerDepth : tile.farDepth;
+}
+
+unsigned int OcclusionCuller::GetWidth() const
+{
+	return width;
+}
+
+unsigned int OcclusionCuller::GetHeight() const
+{
+	return height;
+}
+
+/// <returns>Triangles set up since Begin(), after clipping and dropping back faces</returns>
+size_t OcclusionCuller::GetTriangleCount() const
+{
+	return triangles.size();
+}
+
+/// <summary>
+/// A closed box to occlude with, for things that are boxes or have one inside them
+/// </summary>
+OccluderMesh OcclusionCuller::MakeBox(XMFLOAT3 boxMin, XMFLOAT3 boxMax)
+{
+	OccluderMesh mesh;
+	for (int corner = 0; corner < 8; corner++)
+		mesh.positions.push_back(XMFLOAT3(corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y, corner & 4 ? boxMax.z : boxMin.z));
+
+	// Corners of each face, clockwise seen from outside: -z, +z, -x, +x, -y, +y
+	const unsigned int faces[6][4] = { { 0, 2, 3, 1 }, { 5, 7, 6, 4 }, { 4, 6, 2, 0 }, { 1, 3, 7, 5 }, { 1, 5, 4, 0 }, { 2, 6, 7, 3 } };
+	for (const unsigned int* face : faces)
+	{
+		unsigned int triangles[6] = { face[0], face[1], face[2], face[0], face[2], face[3] };
+		mesh.indices.insert(mesh.indices.end(), triangles, triangles + 6);
+	}
+	return mesh;
+}
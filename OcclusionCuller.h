@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <DirectXMath.h>
+#include "Bounds.h"
+#include "FrustumCuller.h"
+
+class JobSystem;
+
+// Size of the depth buffer occluders are drawn into, a whole number of tiles each way
+#define OCCLUSION_WIDTH 320
+#define OCCLUSION_HEIGHT 192
+// Pixels across and down a tile, its coverage is one bit per pixel of an unsigned int
+#define OCCLUSION_TILE_WIDTH 8
+#define OCCLUSION_TILE_HEIGHT 4
+// Rows of tiles one job rasterizes, every job owns its rows so no two ever write the same tile
+#define OCCLUSION_BAND_ROWS 2
+// Occluder triangles are clipped this many screen widths out from the middle, keeping pixel coordinates small enough for float edge functions
+#define OCCLUSION_GUARD_BAND 4.0f
+// Boxes one job tests against the buffer
+#define OCCLUSION_TEST_BLOCK 256
+
+/// <summary>
+/// <para>Simple stand-in geometry an entity hides things with, in its own space</para>
+/// It has to fit inside what's actually drawn, or things peeking past the drawn edges get culled. Front faces wind
+/// clockwise on screen like the rasterizer's default, back faces are skipped
+/// </summary>
+struct OccluderMesh
+{
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<unsigned int> indices;
+};
+
+/// <summary>
+/// Component for entities big enough to be worth drawing into the occlusion buffer
+/// </summary>
+struct Occluder
+{
+	std::shared_ptr<OccluderMesh> mesh;
+};
+
+/// <summary>
+/// Occluder triangles drawn, and boxes tested and let through, counts are added to so one set can cover a whole frame
+/// </summary>
+struct OcclusionStats
+{
+	unsigned int triangles;
+	unsigned int tested;
+	unsigned int visible;
+};
+
+/// <summary>
+/// <para>Masked software occlusion culling: a few big occluders are drawn into a small depth buffer on the CPU and boxes are tested against it</para>
+/// Each tile keeps a far depth every pixel is nearer than, and a second layer with a nearer depth for the pixels in its
+/// coverage mask. Triangles only ever push those depths further out than the real surface, so boxes are only culled
+/// when something really is in front of them. Rasterizing splits the screen into bands of tiles, one job each
+/// </summary>
+class OcclusionCuller
+{
+private:
+	struct Tile
+	{
+		float farDepth; // every pixel's occluder is at least this near
+		float layerDepth; // pixels in layerMask are at least this near
+		unsigned int layerMask;
+	};
+	struct Triangle
+	{
+		float edgeA[3], edgeB[3], edgeC[3]; // a pixel center (x, y) is inside where A * x + B * y + C >= 0 for all three edges
+		float depthX, depthY, depthC; // depth across the triangle's plane, in pixels
+		float maxDepth;
+		int minX, minY, maxX, maxY; // pixels whose centers the triangle's bounds cover, inclusive
+	};
+	std::vector<Tile> tiles;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<unsigned int>> bands; // triangles reaching each band of tile rows, in the order they were added
+	std::vector<DirectX::XMFLOAT4> clipPositions; // AddOccluder()'s current mesh, in clip space
+	std::vector<unsigned char> hidden; // Cull()'s answer for each box before the list is packed
+	DirectX::XMFLOAT4X4 viewProj;
+	unsigned int width, height;
+	unsigned int tilesX, tilesY;
+
+	void AddTriangle(const DirectX::XMFLOAT4* clip);
+	void SetupTriangle(const DirectX::XMFLOAT3* screen);
+	void RasterizeBand(unsigned int band);
+	bool IsVisible(float centerX, float centerY, float centerZ, float extentX, float extentY, float extentZ) const;
+
+public:
+	OcclusionCuller(unsigned int width = OCCLUSION_WIDTH, unsigned int height = OCCLUSION_HEIGHT);
+	void Begin(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& proj);
+	void AddOccluder(const OccluderMesh& mesh, const DirectX::XMFLOAT4X4& world);
+	void AddOccluder(const DirectX::XMFLOAT3* positions, size_t positionCount, const unsigned int* indices, size_t indexCount, const DirectX::XMFLOAT4X4& world);
+	void Rasterize(JobSystem* jobs = 0);
+	bool IsVisible(const Bounds& bounds) const;
+	void Cull(const CullBoxes& boxes, std::vector<unsigned int>& visible, JobSystem* jobs = 0, OcclusionStats* stats = 0);
+
+	float GetDepth(unsigned int x, unsigned int y) const;
+	unsigned int GetWidth() const;
+	unsigned int GetHeight() const;
+	size_t GetTriangleCount() const;
+
+	static OccluderMesh MakeBox(DirectX::XMFLOAT3 boxMin, DirectX::XMFLOAT3 boxMax);
+};
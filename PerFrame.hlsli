@@ -0,0 +1,18 @@
+#ifndef __GGP_SHADER_PER_FRAME_INCLUDES__
+#define __GGP_SHADER_PER_FRAME_INCLUDES__
+
+#include "Lighting.hlsli"
+
+// Everything that's the same for every draw of a frame. Matches FrameData in FrameConstants.h, uploaded once a frame
+// and bound to this register of every stage, so no shader's own buffers carry it
+cbuffer PerFrame : register(b13)
+{
+    matrix view;
+    matrix proj;
+    matrix lightView;
+    matrix lightProjection;
+    float3 camPos;
+    Light dir;
+}
+
+#endif
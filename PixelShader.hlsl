@@ -1,4 +1,4 @@
-#include "Lighting.hlsli"
+#include "PerFrame.hlsli"
 
 Texture2D Albedo : register(t0);
 Texture2D NormalMap : register(t1);
@@ -9,15 +9,12 @@ SamplerState Sampler : register(s0);
 SamplerComparisonState ShadowSampler : register(s1);
 
 //must set proper compiler options for every new shader added
-cbuffer ExternalData : register(b1)
+// Only the material's own data, the camera and lights come from PerFrame
+cbuffer PerMaterial : register(b1)
 {
 	// declare variables that hold the external data (data sent in from c++)
 	// order at which they're declared matters (they define where in the buffer these variables will get their data)
 	float4 tint;
-	float3 camPos;
-    Light dir;
-    //Light pt;
-    //Light spot;
 }
 
 // Calculate light amount from one directional light
@@ -104,10 +101,11 @@ float4 main(VertexToPixel input) : SV_TARGET
     // Gram-Schmidt orthonormalize process for making the normal and tanget orthogonal
 	// must re-normalize any interpolated vectors that were produced from rasterizer
 	input.normal = normalize(input.normal);
-    input.tangent = normalize(input.tangent);
-    input.tangent = normalize(input.tangent - input.normal * dot(input.tangent, input.normal));
-    float3 biTan = cross(input.tangent, input.normal);
-    float3x3 TBN = float3x3(input.tangent, biTan, input.normal);
+    float3 tangent = normalize(input.tangent.xyz);
+    tangent = normalize(tangent - input.normal * dot(tangent, input.normal));
+    // w flips the bitangent where the uvs are mirrored, +1 keeps the usual one
+    float3 biTan = cross(tangent, input.normal) * input.tangent.w;
+    float3x3 TBN = float3x3(tangent, biTan, input.normal);
     
     // Now rotate the unpacked normal to transform normal map normal from tangent space to world space
     // Assumes that input.normal is the normal later in the shader
@@ -0,0 +1,311 @@
+#include "Registry.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+using namespace std;
+
+// Index of an archetype no entity is in, for free records
+#define REGISTRY_NO_ARCHETYPE 0xffffffffu
+
+static_assert(REGISTRY_MAX_COMPONENTS <= 64, "Archetype masks are a uint64_t, one bit per component type");
+
+namespace
+{
+	// Never moved once written, so Get() needn't lock
+	ComponentType types[REGISTRY_MAX_COMPONENTS];
+	unsigned int typeCount = 0;
+	mutex typesLock;
+
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+/// <summary>
+/// Remember how to handle a component type, ComponentTypes::Id() calls this once per type
+/// </summary>
+/// <returns>The type's id, its bit in archetype masks. Running out of ids stops the program, every mask would be wrong</returns>
+unsigned int ComponentTypes::Register(const ComponentType& type)
+{
+	lock_guard<mutex> guard(typesLock);
+	if (typeCount == REGISTRY_MAX_COMPONENTS)
+	{
+		printf("More than REGISTRY_MAX_COMPONENTS (%d) component types registered\n", REGISTRY_MAX_COMPONENTS);
+		abort();
+	}
+	types[typeCount] = type;
+	return typeCount++;
+}
+
+const ComponentType& ComponentTypes::Get(unsigned int id)
+{
+	return types[id];
+}
+
+Registry::Registry() {
+}
+
+/// <summary>
+/// Destroy every component that's left
+/// </summary>
+Registry::~Registry()
+{
+	Clear();
+}
+
+/// <summary>
+/// Find the archetype with exactly these component types, laying out a new one the first time
+/// </summary>
+/// <param name="mask">- one bit per component id</param>
+/// <returns>Index into archetypes</returns>
+unsigned int Registry::FindArchetype(uint64_t mask)
+{
+	auto found = archetypeIndex.find(mask);
+	if (found != archetypeIndex.end())
+		return found->second;
+
+	Archetype archetype = {};
+	archetype.mask = mask;
+	memset(archetype.columns, 0xff, sizeof(archetype.columns));
+	for (unsigned int& toggled : archetype.toggled)
+		toggled = REGISTRY_NO_ARCHETYPE;
+	size_t rowBytes = sizeof(Entity);
+	for (unsigned int id = 0; id < REGISTRY_MAX_COMPONENTS; id++)
+	{
+		if (!(mask & (uint64_t(1) << id)))
+			continue;
+		archetype.columns[id] = (unsigned char)archetype.components.size();
+		archetype.components.push_back(id);
+		archetype.types.push_back(ComponentTypes::Get(id));
+		rowBytes += ComponentTypes::Get(id).size;
+	}
+
+	// As many rows as fit once every column is aligned, at least one for components bigger than a chunk
+	archetype.capacity = REGISTRY_CHUNK_BYTES / rowBytes;
+	if (archetype.capacity == 0) archetype.capacity = 1;
+	while (true)
+	{
+		size_t bytes = sizeof(Entity) * archetype.capacity;
+		archetype.offsets.clear();
+		for (const ComponentType& type : archetype.types)
+		{
+			bytes = AlignUp(bytes, type.alignment);
+			archetype.offsets.push_back(bytes);
+			bytes += type.size * archetype.capacity;
+		}
+		archetype.chunkBytes = bytes;
+		if (bytes <= REGISTRY_CHUNK_BYTES || archetype.capacity == 1)
+			break;
+		archetype.capacity--;
+	}
+
+	archetypes.push_back(move(archetype));
+	archetypeIndex[mask] = (unsigned int)archetypes.size() - 1;
+	return (unsigned int)archetypes.size() - 1;
+}
+
+/// <summary>
+/// The archetype an entity moves to when it gains or loses one component, remembered so Add/Remove skip the hash lookup
+/// </summary>
+/// <param name="archetype">- the archetype the entity is in</param>
+/// <param name="id">- the component added or removed</param>
+unsigned int Registry::ToggleComponent(unsigned int archetype, unsigned int id)
+{
+	if (archetypes[archetype].toggled[id] == REGISTRY_NO_ARCHETYPE)
+	{
+		unsigned int other = FindArchetype(archetypes[archetype].mask ^ (uint64_t(1) << id));
+		archetypes[archetype].toggled[id] = other;
+		archetypes[other].toggled[id] = archetype;
+	}
+	return archetypes[archetype].toggled[id];
+}
+
+/// <summary>
+/// Take a free index, or a new one, and give it a row at the end of an archetype
+/// </summary>
+/// <returns>The handle, its components still have to be constructed</returns>
+Entity Registry::NewEntity(unsigned int archetype)
+{
+	Entity entity;
+	if (!freeIndices.empty())
+	{
+		entity.index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		entity.index = (unsigned int)records.size();
+		records.push_back({ 1, REGISTRY_NO_ARCHETYPE, 0 });
+	}
+	entity.generation = records[entity.index].generation;
+	Place(entity.index, archetype);
+	entityCount++;
+	return entity;
+}
+
+/// <summary>
+/// Put an entity in the next free row of an archetype, adding a chunk when the last one is full
+/// </summary>
+void Registry::Place(unsigned int index, unsigned int archetype)
+{
+	Archetype& to = archetypes[archetype];
+	if (to.count == to.chunks.size() * to.capacity)
+		to.chunks.push_back(unique_ptr<unsigned char[]>(new unsigned char[to.chunkBytes]));
+	size_t position = to.count++;
+	Entities(to, position / to.capacity)[position % to.capacity] = { index, records[index].generation };
+	records[index].archetype = archetype;
+	records[index].position = position;
+}
+
+/// <returns>Where an entity's component of type id is, 0 if its archetype has none</returns>
+void* Registry::Component(unsigned int index, unsigned int id)
+{
+	const Record& record = records[index];
+	const Archetype& archetype = archetypes[record.archetype];
+	unsigned char column = archetype.columns[id];
+	if (column == 0xff)
+		return 0;
+	return archetype.chunks[record.position / archetype.capacity].get() + archetype.offsets[column] +
+		(record.position % archetype.capacity) * archetype.types[column].size;
+}
+
+/// <summary>
+/// Move the archetype's last entity into a row whose components were already destroyed or moved out
+/// </summary>
+/// <param name="archetype">- the archetype the row is in</param>
+/// <param name="position">- the row, counted across chunks</param>
+void Registry::FillHole(unsigned int archetype, size_t position)
+{
+	Archetype& from = archetypes[archetype];
+	size_t last = --from.count;
+	if (position != last)
+	{
+		unsigned char* hole = from.chunks[position / from.capacity].get();
+		unsigned char* moved = from.chunks[last / from.capacity].get();
+		size_t holeRow = position % from.capacity, movedRow = last % from.capacity;
+		for (size_t c = 0; c < from.components.size(); c++)
+		{
+			const ComponentType& type = from.types[c];
+			type.move(hole + from.offsets[c] + holeRow * type.size, moved + from.offsets[c] + movedRow * type.size);
+		}
+		Entity entity = Entities(from, last / from.capacity)[movedRow];
+		Entities(from, position / from.capacity)[holeRow] = entity;
+		records[entity.index].position = position;
+	}
+
+	// Keep a spare chunk so an entity coming and going right at a chunk boundary doesn't allocate every time
+	if (from.chunks.size() * from.capacity - from.count >= (REGISTRY_SPARE_CHUNKS + 1) * from.capacity)
+		from.chunks.pop_back();
+}
+
+/// <summary>
+/// Move an entity to another archetype, components both have are moved, ones only the old one has are destroyed.
+/// Components only the new archetype has are left for the caller to construct
+/// </summary>
+void Registry::Move(unsigned int index, unsigned int archetype)
+{
+	unsigned int fromIndex = records[index].archetype;
+	size_t fromPosition = records[index].position;
+	Place(index, archetype);
+
+	const Archetype& from = archetypes[fromIndex];
+	const Archetype& to = archetypes[archetype];
+	unsigned char* source = from.chunks[fromPosition / from.capacity].get();
+	unsigned char* destination = to.chunks[records[index].position / to.capacity].get();
+	size_t sourceRow = fromPosition % from.capacity, destinationRow = records[index].position % to.capacity;
+	for (size_t c = 0; c < from.components.size(); c++)
+	{
+		unsigned int id = from.components[c];
+		const ComponentType& type = from.types[c];
+		void* component = source + from.offsets[c] + sourceRow * type.size;
+		if (to.columns[id] != 0xff)
+			type.move(destination + to.offsets[to.columns[id]] + destinationRow * type.size, component);
+		else
+			type.destroy(component);
+	}
+	FillHole(fromIndex, fromPosition);
+}
+
+/// <summary>
+/// Destroy an entity's components and retire its handle, the index is reused with the next generation
+/// </summary>
+/// <returns>False if the entity was already dead</returns>
+bool Registry::Destroy(Entity entity)
+{
+	if (!IsAlive(entity))
+		return false;
+	Record& record = records[entity.index];
+	Archetype& archetype = archetypes[record.archetype];
+	unsigned char* chunk = archetype.chunks[record.position / archetype.capacity].get();
+	size_t row = record.position % archetype.capacity;
+	for (size_t c = 0; c < archetype.components.size(); c++)
+	{
+		const ComponentType& type = archetype.types[c];
+		type.destroy(chunk + archetype.offsets[c] + row * type.size);
+	}
+	FillHole(record.archetype, record.position);
+
+	record.archetype = REGISTRY_NO_ARCHETYPE;
+	if (++record.generation == 0)
+		record.generation = 1;
+	freeIndices.push_back(entity.index);
+	entityCount--;
+	return true;
+}
+
+/// <summary>
+/// Destroy every entity, walking the chunks front to back instead of filling holes one entity at a time
+/// </summary>
+void Registry::Clear()
+{
+	for (Archetype& archetype : archetypes)
+	{
+		for (size_t c = 0; c < archetype.components.size(); c++)
+		{
+			const ComponentType& type = archetype.types[c];
+			for (size_t i = 0; i < archetype.count; i++)
+				type.destroy(archetype.chunks[i / archetype.capacity].get() + archetype.offsets[c] + (i % archetype.capacity) * type.size);
+		}
+		archetype.count = 0;
+		archetype.chunks.clear();
+	}
+	for (unsigned int index = 0; index < records.size(); index++)
+	{
+		Record& record = records[index];
+		if (record.archetype == REGISTRY_NO_ARCHETYPE)
+			continue;
+		record.archetype = REGISTRY_NO_ARCHETYPE;
+		if (++record.generation == 0)
+			record.generation = 1;
+		freeIndices.push_back(index);
+	}
+	entityCount = 0;
+}
+
+/// <returns>Whether the handle still refers to a living entity</returns>
+bool Registry::IsAlive(Entity entity) const
+{
+	return entity.generation != 0 && entity.index < records.size() && records[entity.index].generation == entity.generation &&
+		records[entity.index].archetype != REGISTRY_NO_ARCHETYPE;
+}
+
+size_t Registry::GetEntityCount()
+{
+	return entityCount;
+}
+
+size_t Registry::GetArchetypeCount()
+{
+	return archetypes.size();
+}
+
+size_t Registry::GetChunkCount()
+{
+	size_t count = 0;
+	for (const Archetype& archetype : archetypes)
+		count += archetype.chunks.size();
+	return count;
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Bytes of each archetype chunk, small enough that a query walks one chunk out of L1/L2
+#define REGISTRY_CHUNK_BYTES 16384
+// Component types a program can have, each is one bit of an archetype's mask
+#define REGISTRY_MAX_COMPONENTS 64
+// An archetype keeps this many empty chunks around so entities coming and going at a chunk boundary don't allocate
+#define REGISTRY_SPARE_CHUNKS 1
+
+/// <summary>
+/// Handle to an entity in a Registry. The generation tells a destroyed entity apart from a new one reusing its index
+/// </summary>
+struct Entity
+{
+	unsigned int index = 0;
+	unsigned int generation = 0; // 0 is never alive, so a default Entity is always a null handle
+	bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+/// <summary>
+/// How to move and destroy a component type without knowing what it is
+/// </summary>
+struct ComponentType
+{
+	size_t size;
+	size_t alignment;
+	void (*move)(void* to, void* from); // move constructs into to, then destroys from
+	void (*destroy)(void* component);
+};
+
+/// <summary>
+/// Gives every component type an id the first time it is used, the same id in every Registry
+/// </summary>
+class ComponentTypes
+{
+public:
+	static unsigned int Register(const ComponentType& type);
+	static const ComponentType& Get(unsigned int id);
+
+	/// <returns>The id of component type T, at most REGISTRY_MAX_COMPONENTS types get one</returns>
+	template<typename T>
+	static unsigned int Id()
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Chunks are only aligned to max_align_t");
+		static const unsigned int id = Register({ sizeof(T), alignof(T),
+			[](void* to, void* from) { new (to) T(std::move(*static_cast<T*>(from))); static_cast<T*>(from)->~T(); },
+			[](void* component) { static_cast<T*>(component)->~T(); } });
+		return id;
+	}
+};
+
+/// <summary>
+/// <para>Entities and their components, grouped by archetype: the set of component types an entity has</para>
+/// Each archetype keeps its entities densely in fixed size chunks, one contiguous column per component type,
+/// so a query walks arrays of exactly the components it asked for and skips archetypes that lack one.
+/// Creating, destroying and adding or removing a component are O(1), the last entity of the archetype fills the hole.
+/// That moves components around: pointers from Get() and Add() only last until the next structural change,
+/// and entities can't be created, destroyed or change components from inside Each()/EachChunk()
+/// </summary>
+class Registry
+{
+private:
+	struct Archetype
+	{
+		uint64_t mask;
+		std::vector<unsigned int> components; // ids, ascending
+		std::vector<ComponentType> types; // of each component, copied here to stay next to the rest
+		std::vector<size_t> offsets; // where each component's column starts in a chunk, the entity column is at 0
+		unsigned char columns[REGISTRY_MAX_COMPONENTS]; // component id to index in components, 0xff if absent
+		unsigned int toggled[REGISTRY_MAX_COMPONENTS]; // archetype with the component id added or removed, once looked up
+		size_t capacity; // entities per chunk
+		size_t chunkBytes;
+		std::vector<std::unique_ptr<unsigned char[]>> chunks; // entity i is row i % capacity of chunk i / capacity
+		size_t count;
+	};
+	struct Record
+	{
+		unsigned int generation;
+		unsigned int archetype;
+		size_t position; // in the archetype
+	};
+	std::vector<Archetype> archetypes;
+	std::unordered_map<uint64_t, unsigned int> archetypeIndex;
+	std::vector<Record> records;
+	std::vector<unsigned int> freeIndices;
+	size_t entityCount = 0;
+
+	unsigned int FindArchetype(uint64_t mask);
+	unsigned int ToggleComponent(unsigned int archetype, unsigned int id);
+	Entity NewEntity(unsigned int archetype);
+	void Place(unsigned int index, unsigned int archetype);
+	void* Component(unsigned int index, unsigned int id);
+	void FillHole(unsigned int archetype, size_t position);
+	void Move(unsigned int index, unsigned int archetype);
+
+	template<typename T>
+	static uint64_t Bit() { return uint64_t(1) << ComponentTypes::Id<T>(); }
+
+	/// <returns>The bits of all of Ts</returns>
+	template<typename... Ts>
+	static uint64_t Mask()
+	{
+		uint64_t bits[] = { uint64_t(0), Bit<Ts>()... };
+		uint64_t mask = 0;
+		for (uint64_t bit : bits)
+			mask |= bit;
+		return mask;
+	}
+
+	template<typename T>
+	static T* Column(const Archetype& archetype, size_t chunk)
+	{
+		return reinterpret_cast<T*>(archetype.chunks[chunk].get() + archetype.offsets[archetype.columns[ComponentTypes::Id<T>()]]);
+	}
+
+	static Entity* Entities(const Archetype& archetype, size_t chunk)
+	{
+		return reinterpret_cast<Entity*>(archetype.chunks[chunk].get());
+	}
+
+	template<typename Func, typename... Ts>
+	static void EachRow(size_t count, const Entity* entities, Func& func, Ts*... columns)
+	{
+		for (size_t i = 0; i < count; i++)
+			func(entities[i], columns[i]...);
+	}
+
+	/// <summary>
+	/// Every chunk of every archetype that has all of Ts, with its entity count
+	/// </summary>
+	template<typename... Ts, typename Func>
+	void EachMatchingChunk(Func func)
+	{
+		uint64_t mask = Mask<Ts...>();
+		for (Archetype& archetype : archetypes)
+		{
+			if ((archetype.mask & mask) != mask)
+				continue;
+			for (size_t c = 0; c * archetype.capacity < archetype.count; c++)
+			{
+				size_t left = archetype.count - c * archetype.capacity;
+				func(archetype, c, left < archetype.capacity ? left : archetype.capacity);
+			}
+		}
+	}
+public:
+	Registry();
+	Registry(const Registry&) = delete;
+	Registry& operator=(const Registry&) = delete;
+	~Registry();
+
+	/// <summary>
+	/// Make an entity with exactly these components, each type at most once
+	/// </summary>
+	template<typename... Ts>
+	Entity Create(Ts&&... components)
+	{
+		Entity entity = NewEntity(FindArchetype(Mask<std::decay_t<Ts>...>()));
+		// Constructs each component in its column, in order
+		int constructed[] = { 0, ((void)new (Component(entity.index, ComponentTypes::Id<std::decay_t<Ts>>())) std::decay_t<Ts>(std::forward<Ts>(components)), 0)... };
+		(void)constructed;
+		return entity;
+	}
+
+	bool Destroy(Entity entity);
+	void Clear();
+	bool IsAlive(Entity entity) const;
+
+	/// <returns>The entity's T, or 0 if it is dead or has none</returns>
+	template<typename T>
+	T* Get(Entity entity)
+	{
+		return IsAlive(entity) ? static_cast<T*>(Component(entity.index, ComponentTypes::Id<T>())) : 0;
+	}
+
+	template<typename T>
+	bool Has(Entity entity)
+	{
+		return Get<T>(entity) != 0;
+	}
+
+	/// <summary>
+	/// Give an entity a T, moving it to the archetype with T, or replace the T it already has
+	/// </summary>
+	/// <returns>The entity's T, or 0 if the entity is dead</returns>
+	template<typename T>
+	T* Add(Entity entity, T component)
+	{
+		if (!IsAlive(entity))
+			return 0;
+		unsigned int id = ComponentTypes::Id<T>();
+		if (T* existing = static_cast<T*>(Component(entity.index, id)))
+		{
+			*existing = std::move(component);
+			return existing;
+		}
+		Move(entity.index, ToggleComponent(records[entity.index].archetype, id));
+		return new (Component(entity.index, id)) T(std::move(component));
+	}
+
+	/// <summary>
+	/// Take an entity's T away, moving it to the archetype without T
+	/// </summary>
+	/// <returns>False if the entity is dead or had no T</returns>
+	template<typename T>
+	bool Remove(Entity entity)
+	{
+		if (!Has<T>(entity))
+			return false;
+		Move(entity.index, ToggleComponent(records[entity.index].archetype, ComponentTypes::Id<T>()));
+		return true;
+	}
+
+	/// <summary>
+	/// Call func(Entity, Ts&...) for every entity that has all of Ts, chunk by chunk
+	/// </summary>
+	template<typename... Ts, typename Func>
+	void Each(Func func)
+	{
+		EachMatchingChunk<Ts...>([&](Archetype& archetype, size_t chunk, size_t count)
+		{
+			EachRow(count, Entities(archetype, chunk), func, Column<Ts>(archetype, chunk)...);
+		});
+	}
+
+	/// <summary>
+	/// Call func(count, const Entity*, Ts*...) once per chunk of entities that have all of Ts, for work done on whole arrays
+	/// </summary>
+	template<typename... Ts, typename Func>
+	void EachChunk(Func func)
+	{
+		EachMatchingChunk<Ts...>([&](Archetype& archetype, size_t chunk, size_t count)
+		{
+			func(count, static_cast<const Entity*>(Entities(archetype, chunk)), Column<Ts>(archetype, chunk)...);
+		});
+	}
+
+	size_t GetEntityCount();
+	size_t GetArchetypeCount();
+	size_t GetChunkCount();
+};
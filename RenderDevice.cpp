@@ -0,0 +1,57 @@
+#include "RenderDevice.h"
+#include "CommandBuffer.h"
+#include <cstring>
+
+RenderDevice::RenderDevice()
+{
+	ResetStats();
+}
+
+RenderDevice::~RenderDevice()
+{
+}
+
+/// <returns>Everything this device was asked to do since the last reset</returns>
+RenderStats RenderDevice::GetStats()
+{
+	return stats;
+}
+
+/// <summary>
+/// Zero the counters, usually once at the start of every frame
+/// </summary>
+void RenderDevice::ResetStats()
+{
+	memset(&stats, 0, sizeof(RenderStats));
+}
+
+/// <summary>
+/// Record that a call of the given type reached this device
+/// </summary>
+/// <param name="type">- which call</param>
+void RenderDevice::Count(RenderCallType type)
+{
+	stats.calls[type]++;
+	switch (type)
+	{
+	case RENDER_CALL_DRAW:
+	case RENDER_CALL_DRAW_INDEXED:
+	case RENDER_CALL_DRAW_INDEXED_INSTANCED:
+		stats.drawCalls++;
+		break;
+	default:
+		break;
+	}
+}
+
+/// <summary>
+/// Replay recorded command buffers onto this device, one after the other on this thread.
+/// Devices that can build them in parallel override this
+/// </summary>
+/// <param name="buffers">- replayed in this order</param>
+/// <param name="jobs">- unused here, for devices that build the buffers on worker threads</param>
+void RenderDevice::ExecuteCommandBuffers(const CommandBuffer* const* buffers, size_t count, JobSystem* jobs)
+{
+	for (size_t i = 0; i < count; i++)
+		buffers[i]->Replay(*this);
+}
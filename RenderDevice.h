@@ -0,0 +1,95 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+
+class CommandBuffer;
+class JobSystem;
+
+/// <summary>
+/// Every kind of call a render device can receive, used to index the per-call counters in RenderStats
+/// </summary>
+enum RenderCallType
+{
+	RENDER_CALL_IA_SET_PRIMITIVE_TOPOLOGY,
+	RENDER_CALL_IA_SET_INPUT_LAYOUT,
+	RENDER_CALL_IA_SET_VERTEX_BUFFERS,
+	RENDER_CALL_IA_SET_INDEX_BUFFER,
+	RENDER_CALL_VS_SET_SHADER,
+	RENDER_CALL_PS_SET_SHADER,
+	RENDER_CALL_VS_SET_CONSTANT_BUFFERS,
+	RENDER_CALL_PS_SET_CONSTANT_BUFFERS,
+	RENDER_CALL_VS_SET_SHADER_RESOURCES,
+	RENDER_CALL_PS_SET_SHADER_RESOURCES,
+	RENDER_CALL_VS_SET_SAMPLERS,
+	RENDER_CALL_PS_SET_SAMPLERS,
+	RENDER_CALL_UPDATE_CONSTANT_BUFFER,
+	RENDER_CALL_UPDATE_BUFFER,
+	RENDER_CALL_RS_SET_STATE,
+	RENDER_CALL_RS_SET_VIEWPORTS,
+	RENDER_CALL_OM_SET_RENDER_TARGETS,
+	RENDER_CALL_OM_SET_DEPTH_STENCIL_STATE,
+	RENDER_CALL_CLEAR_RENDER_TARGET_VIEW,
+	RENDER_CALL_CLEAR_DEPTH_STENCIL_VIEW,
+	RENDER_CALL_DRAW,
+	RENDER_CALL_DRAW_INDEXED,
+	RENDER_CALL_DRAW_INDEXED_INSTANCED,
+	RENDER_CALL_COUNT
+};
+
+/// <summary>
+/// What a render device was asked to do since the last ResetStats()
+/// </summary>
+struct RenderStats
+{
+	unsigned int drawCalls; // Draw + DrawIndexed + DrawIndexedInstanced
+	unsigned int indices; // vertices/indices submitted by all draws, once per instance
+	unsigned int bytesUploaded; // bytes copied into constant and dynamic buffers
+	unsigned int calls[RENDER_CALL_COUNT];
+	unsigned int filtered[RENDER_CALL_COUNT]; // calls a StateCacheRenderDevice dropped because they'd change nothing
+};
+
+/// <summary>
+/// <para>Thin layer between the engine and ID3D11DeviceContext</para>
+/// Only covers the per-frame calls the engine makes (binding, uploading, drawing),
+/// resource creation still goes through ID3D11Device at load time
+/// </summary>
+class RenderDevice
+{
+protected:
+	RenderStats stats;
+	void Count(RenderCallType);
+public:
+	RenderDevice();
+	virtual ~RenderDevice();
+	RenderStats GetStats();
+	void ResetStats();
+
+	/// <returns>The wrapped D3D context, or null if this device doesn't talk to D3D at all</returns>
+	virtual ID3D11DeviceContext* GetContext() = 0;
+
+	virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY) = 0;
+	virtual void IASetInputLayout(ID3D11InputLayout*) = 0;
+	virtual void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets) = 0;
+	virtual void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT offset) = 0;
+	virtual void VSSetShader(ID3D11VertexShader*) = 0;
+	virtual void PSSetShader(ID3D11PixelShader*) = 0;
+	virtual void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers) = 0;
+	virtual void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers) = 0;
+	virtual void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views) = 0;
+	virtual void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views) = 0;
+	virtual void VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) = 0;
+	virtual void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) = 0;
+	virtual void UpdateConstantBuffer(ID3D11Buffer*, const void* data, UINT size) = 0;
+	virtual void UpdateBuffer(ID3D11Buffer*, const void* data, UINT size) = 0; // dynamic buffers, the old contents are discarded
+	virtual void RSSetState(ID3D11RasterizerState*) = 0;
+	virtual void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports) = 0;
+	virtual void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv) = 0;
+	virtual void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT stencilRef) = 0;
+	virtual void ClearRenderTargetView(ID3D11RenderTargetView*, const float color[4]) = 0;
+	virtual void ClearDepthStencilView(ID3D11DepthStencilView*, UINT clearFlags, float depth, UINT8 stencil) = 0;
+	virtual void Draw(UINT vertexCount, UINT startVertex) = 0;
+	virtual void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) = 0;
+	virtual void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance) = 0;
+
+	virtual void ExecuteCommandBuffers(const CommandBuffer* const* buffers, size_t count, JobSystem* jobs = 0);
+};
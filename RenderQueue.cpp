@@ -0,0 +1,140 @@
+#include "RenderQueue.h"
+#include <chrono>
+
+using namespace std;
+
+/// <summary>
+/// Pack a draw's state into a sort key, each id masked to its field
+/// </summary>
+/// <param name="pass">- a RenderPass</param>
+/// <param name="shader">- which shaders draw it, 0 if the pass has only one</param>
+/// <param name="material">- Material::GetSortId(), 0 if the pass doesn't use materials</param>
+/// <param name="mesh">- Mesh::GetSortId()</param>
+/// <param name="lod">- the mesh LOD it's drawn at</param>
+/// <param name="depth">- 0 at the camera to 1 at the far plane, clamped</param>
+/// <returns>The key, sorting smallest first draws in pass, shader, material, mesh, LOD and then front to back order</returns>
+uint64_t RenderQueue::MakeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, int lod, float depth)
+{
+	const uint64_t depthSteps = (1ull << RENDER_QUEUE_DEPTH_BITS) - 1;
+	uint64_t quantized = depth > 0 ? depth < 1 ? (uint64_t)(depth * depthSteps) : depthSteps : 0;
+	uint64_t key = pass & ((1u << RENDER_QUEUE_PASS_BITS) - 1);
+	key = (key << RENDER_QUEUE_SHADER_BITS) | (shader & ((1u << RENDER_QUEUE_SHADER_BITS) - 1));
+	key = (key << RENDER_QUEUE_MATERIAL_BITS) | (material & ((1u << RENDER_QUEUE_MATERIAL_BITS) - 1));
+	key = (key << RENDER_QUEUE_MESH_BITS) | (mesh & ((1u << RENDER_QUEUE_MESH_BITS) - 1));
+	key = (key << RENDER_QUEUE_LOD_BITS) | ((unsigned int)lod & ((1u << RENDER_QUEUE_LOD_BITS) - 1));
+	return (key << RENDER_QUEUE_DEPTH_BITS) | quantized;
+}
+
+/// <summary>
+/// <para>Stable LSD radix sort by key, RENDER_QUEUE_RADIX_BITS per pass</para>
+/// Every digit's histogram comes from one read of the keys, and digits that are the same for every entry, like the
+/// pass and shader bits of a frame with a few of each, aren't sorted by at all
+/// </summary>
+/// <param name="entries">- sorted in place</param>
+/// <param name="scratch">- resized to match, kept by the caller so sorting doesn't allocate every frame</param>
+void RenderQueue::RadixSort(vector<RenderQueueEntry>& entries, vector<RenderQueueEntry>& scratch)
+{
+	const unsigned int buckets = 1u << RENDER_QUEUE_RADIX_BITS;
+	const unsigned int digits = (64 + RENDER_QUEUE_RADIX_BITS - 1) / RENDER_QUEUE_RADIX_BITS;
+	size_t count = entries.size();
+	if (count < 2)
+		return;
+	scratch.resize(count);
+
+	unsigned int counts[digits][buckets] = {};
+	for (const RenderQueueEntry& entry : entries)
+	{
+		for (unsigned int d = 0; d < digits; d++)
+			counts[d][(entry.key >> (d * RENDER_QUEUE_RADIX_BITS)) & (buckets - 1)]++;
+	}
+
+	RenderQueueEntry* from = entries.data();
+	RenderQueueEntry* to = scratch.data();
+	for (unsigned int d = 0; d < digits; d++)
+	{
+		unsigned int shift = d * RENDER_QUEUE_RADIX_BITS;
+		if (counts[d][(from[0].key >> shift) & (buckets - 1)] == count)
+			continue;
+
+		// Counts become where each bucket starts
+		unsigned int offsets[buckets];
+		unsigned int start = 0;
+		for (unsigned int b = 0; b < buckets; b++)
+		{
+			offsets[b] = start;
+			start += counts[d][b];
+		}
+		for (size_t i = 0; i < count; i++)
+			to[offsets[(from[i].key >> shift) & (buckets - 1)]++] = from[i];
+		swap(from, to);
+	}
+	if (from != entries.data())
+		entries.swap(scratch);
+}
+
+/// <summary>
+/// Start a new frame, forgetting last frame's draws and stats
+/// </summary>
+void RenderQueue::Clear()
+{
+	entries.clear();
+	stats = {};
+}
+
+/// <param name="key">- from MakeKey()</param>
+/// <param name="item">- handed back by Submit(), like an index into the caller's entities</param>
+void RenderQueue::Add(uint64_t key, unsigned int item)
+{
+	entries.push_back({ key, item });
+}
+
+/// <summary>
+/// Put every draw added since Clear() in key order, timing it for the stats
+/// </summary>
+void RenderQueue::Sort()
+{
+	auto start = chrono::steady_clock::now();
+	RadixSort(entries, scratch);
+	stats.sortTime += chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/// <summary>
+/// Find a pass's draws, they're one run once sorted
+/// </summary>
+/// <param name="pass">- a RenderPass</param>
+/// <param name="begin">- output, index of its first draw</param>
+/// <param name="end">- output, one past its last, the same as begin if it has none</param>
+void RenderQueue::GetPass(unsigned int pass, size_t& begin, size_t& end) const
+{
+	const unsigned int passShift = 64 - RENDER_QUEUE_PASS_BITS;
+	begin = 0;
+	while (begin < entries.size() && (entries[begin].key >> passShift) < pass)
+		begin++;
+	end = begin;
+	while (end < entries.size() && (entries[end].key >> passShift) == pass)
+		end++;
+}
+
+/// <summary>
+/// Count what SubmitRange() handed out toward GetStats()
+/// </summary>
+void RenderQueue::AddStats(const RenderQueueStats& submitted)
+{
+	stats.draws += submitted.draws;
+	stats.shaderChanges += submitted.shaderChanges;
+	stats.materialChanges += submitted.materialChanges;
+	stats.meshChanges += submitted.meshChanges;
+	stats.sortTime += submitted.sortTime;
+}
+
+/// <returns>The draws added since Clear(), in key order once sorted</returns>
+const vector<RenderQueueEntry>& RenderQueue::GetEntries() const
+{
+	return entries;
+}
+
+/// <returns>What was submitted since Clear() and how long sorting took</returns>
+RenderQueueStats RenderQueue::GetStats() const
+{
+	return stats;
+}
@@ -0,0 +1,182 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <mutex>
+
+// Bits of each field of a key, most significant first: pass, shader, material, mesh, LOD and depth. They add up to 64
+#define RENDER_QUEUE_PASS_BITS 4
+#define RENDER_QUEUE_SHADER_BITS 8
+#define RENDER_QUEUE_MATERIAL_BITS 12
+#define RENDER_QUEUE_MESH_BITS 12
+#define RENDER_QUEUE_LOD_BITS 4
+#define RENDER_QUEUE_DEPTH_BITS 24
+// Bits of the key each radix sort pass sorts by, digits every entry shares are skipped
+#define RENDER_QUEUE_RADIX_BITS 8
+
+/// <summary>
+/// Passes a frame draws in, in the order they're submitted
+/// </summary>
+enum RenderPass
+{
+	RENDER_PASS_SHADOW,
+	RENDER_PASS_OPAQUE
+};
+
+/// <summary>
+/// What differs from the draw before, handed to the submit function so it only binds those
+/// </summary>
+enum RenderQueueChange
+{
+	RENDER_CHANGE_SHADER = 1,
+	RENDER_CHANGE_MATERIAL = 2,
+	RENDER_CHANGE_MESH = 4,
+	RENDER_CHANGE_LOD = 8
+};
+
+/// <summary>
+/// <para>Id of a mesh, material or anything else a key sorts by, always small enough for its field</para>
+/// Ids of destroyed owners are handed out again, so they fit in Bits as long as fewer than 1 &lt;&lt; Bits owners are
+/// alive at once, which is asserted. A copy gets an id of its own
+/// </summary>
+template<typename Owner, unsigned int Bits>
+class SortId
+{
+private:
+	struct Pool
+	{
+		std::mutex lock;
+		std::vector<unsigned int> free;
+		unsigned int next = 0;
+	};
+	unsigned int id;
+
+	// Never freed, owners destroyed during shutdown still give their ids back to it
+	static Pool& GetPool()
+	{
+		static Pool* pool = new Pool();
+		return *pool;
+	}
+
+	static unsigned int Acquire()
+	{
+		Pool& pool = GetPool();
+		std::lock_guard<std::mutex> hold(pool.lock);
+		if (pool.free.empty())
+		{
+			assert(pool.next < (1u << Bits) && "More owners alive than their key field has ids for");
+			return pool.next++;
+		}
+		unsigned int reused = pool.free.back();
+		pool.free.pop_back();
+		return reused;
+	}
+
+public:
+	SortId() : id(Acquire()) {}
+	SortId(const SortId&) : id(Acquire()) {}
+	SortId& operator=(const SortId&) { return *this; }
+	~SortId()
+	{
+		Pool& pool = GetPool();
+		std::lock_guard<std::mutex> hold(pool.lock);
+		pool.free.push_back(id);
+	}
+	operator unsigned int() const { return id; }
+};
+
+struct RenderQueueEntry
+{
+	uint64_t key;
+	unsigned int item; // whatever the caller draws from, entities keep the order they were added in when their keys match
+};
+
+/// <summary>
+/// Draws and state changes submitted since the last Clear(), and how long sorting took
+/// </summary>
+struct RenderQueueStats
+{
+	unsigned int draws;
+	unsigned int shaderChanges;
+	unsigned int materialChanges;
+	unsigned int meshChanges;
+	float sortTime; // milliseconds
+};
+
+/// <summary>
+/// <para>Every draw of a frame as a 64 bit key, sorted so draws needing the same state end up next to each other</para>
+/// Keys hold, most significant first, the pass, shader, material, mesh, LOD and quantized depth, so after sorting each pass
+/// is one run, within it draws are grouped by shader and then material, and each mesh's draws go front to back.
+/// Sorting is an LSD radix sort, stable, so draws with the same key stay in the order they were added
+/// </summary>
+class RenderQueue
+{
+private:
+	std::vector<RenderQueueEntry> entries;
+	std::vector<RenderQueueEntry> scratch;
+	RenderQueueStats stats = {};
+
+public:
+	static uint64_t MakeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, int lod, float depth);
+	static void RadixSort(std::vector<RenderQueueEntry>& entries, std::vector<RenderQueueEntry>& scratch);
+
+	void Clear();
+	void Add(uint64_t key, unsigned int item);
+	void Sort();
+	const std::vector<RenderQueueEntry>& GetEntries() const;
+	RenderQueueStats GetStats() const;
+
+	void GetPass(unsigned int pass, size_t& begin, size_t& end) const;
+	void AddStats(const RenderQueueStats& submitted);
+
+	/// <summary>
+	/// Hand each sorted draw in a range to submit, with what changed since the draw before it. The range's first draw
+	/// has everything changed, so ranges can be recorded on different threads, each starting from nothing
+	/// </summary>
+	/// <param name="begin">- index of the first draw, from GetPass(), Sort() first</param>
+	/// <param name="submit">- called as submit(item, changes), changes being RenderQueueChange flags</param>
+	/// <returns>The draws and state changes, for AddStats() once every range is done</returns>
+	template<typename Func>
+	RenderQueueStats SubmitRange(size_t begin, size_t end, Func submit) const
+	{
+		const unsigned int lodShift = RENDER_QUEUE_DEPTH_BITS;
+		const unsigned int meshShift = lodShift + RENDER_QUEUE_LOD_BITS;
+		const unsigned int materialShift = meshShift + RENDER_QUEUE_MESH_BITS;
+		const unsigned int shaderShift = materialShift + RENDER_QUEUE_MATERIAL_BITS;
+
+		RenderQueueStats submitted = {};
+		for (size_t i = begin; i < end; i++)
+		{
+			uint64_t key = entries[i].key;
+			uint64_t previous = i > begin ? entries[i - 1].key : 0;
+			unsigned int changes = 0;
+			if (i == begin || (key >> shaderShift) != (previous >> shaderShift))
+				changes |= RENDER_CHANGE_SHADER;
+			if (i == begin || (key >> materialShift) != (previous >> materialShift))
+				changes |= RENDER_CHANGE_MATERIAL;
+			if (i == begin || (key >> meshShift) != (previous >> meshShift))
+				changes |= RENDER_CHANGE_MESH;
+			if (i == begin || (key >> lodShift) != (previous >> lodShift))
+				changes |= RENDER_CHANGE_LOD;
+			submitted.draws++;
+			submitted.shaderChanges += (changes & RENDER_CHANGE_SHADER) != 0;
+			submitted.materialChanges += (changes & RENDER_CHANGE_MATERIAL) != 0;
+			submitted.meshChanges += (changes & RENDER_CHANGE_MESH) != 0;
+			submit(entries[i].item, changes);
+		}
+		return submitted;
+	}
+
+	/// <summary>
+	/// Hand each of a pass's draws to submit in sorted order, like SubmitRange(), adding to the stats
+	/// </summary>
+	/// <param name="pass">- a RenderPass, Sort() first</param>
+	/// <param name="submit">- called as submit(item, changes), changes being RenderQueueChange flags</param>
+	template<typename Func>
+	void Submit(unsigned int pass, Func submit)
+	{
+		size_t begin, end;
+		GetPass(pass, begin, end);
+		AddStats(SubmitRange(begin, end, submit));
+	}
+};
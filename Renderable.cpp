@@ -0,0 +1,107 @@
+#include "Renderable.h"
+
+using namespace DirectX;
+using namespace std;
+using namespace Microsoft::WRL;
+
+Renderable::Renderable() {
+}
+
+/// <summary>
+/// Set what an entity is drawn with
+/// </summary>
+/// <param name="mesh">- shape</param>
+/// <param name="mat">- appearance</param>
+Renderable::Renderable(shared_ptr<Mesh> mesh, shared_ptr<Material> mat)
+{
+    this->mesh = mesh;
+	this->mat = mat;
+}
+
+std::shared_ptr<Mesh> Renderable::GetMesh()
+{
+	return mesh;
+}
+
+/// <returns>This entity's material</returns>
+std::shared_ptr<Material> Renderable::GetMat()
+{
+	return mat;
+}
+
+/// <returns>The LOD this entity's mesh is drawn with, 0 being full detail</returns>
+int Renderable::GetLod()
+{
+	return lod;
+}
+
+/// <param name="tf">- the entity's transform</param>
+/// <returns>World space box and sphere around this entity's mesh, as of the last UpdateMatrices()</returns>
+Bounds Renderable::GetWorldBounds(Transform& tf)
+{
+	// Most entities never move, so the bounds are only redone when the transform has changed
+	if (!hasWorldBounds || tf.HasChangedSince(worldBoundsFrame))
+	{
+		worldBounds = BoundingVolumes::ToWorld(mesh->GetBounds(), tf.GetWorldMatrix());
+		worldBoundsFrame = tf.GetFrame();
+		hasWorldBounds = true;
+	}
+	return worldBounds;
+}
+
+/// <summary>
+/// How big this entity's mesh looks from a camera, measured at the nearest point of its bounding sphere
+/// </summary>
+/// <param name="tf">- the entity's transform</param>
+/// <param name="cam">- the camera the entity will be drawn with</param>
+/// <param name="screenHeight">- height of the render target in pixels</param>
+/// <returns>Pixels covered by one object space unit of the mesh</returns>
+float Renderable::GetPixelsPerUnit(Transform& tf, shared_ptr<Cam> cam, float screenHeight)
+{
+	return GetPixelsPerUnit(tf, GetWorldBounds(tf), cam, screenHeight);
+}
+
+/// <summary>
+/// GetPixelsPerUnit() with world bounds already worked out, such as by the batched BoundingVolumes::ToWorld()
+/// </summary>
+/// <param name="tf">- the entity's transform</param>
+/// <param name="bounds">- this entity's world bounds as of its transform's last update</param>
+/// <param name="cam">- the camera the entity will be drawn with</param>
+/// <param name="screenHeight">- height of the render target in pixels</param>
+/// <returns>Pixels covered by one object space unit of the mesh</returns>
+float Renderable::GetPixelsPerUnit(Transform& tf, const Bounds& bounds, shared_ptr<Cam> cam, float screenHeight)
+{
+	// The largest axis scale turns object space units into world units
+	XMFLOAT3 scale = tf.GetScale();
+	float maxScale = fmaxf(fabsf(scale.x), fmaxf(fabsf(scale.y), fabsf(scale.z)));
+	XMFLOAT3 camPos = cam->GetPos();
+	float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&bounds.center), XMLoadFloat3(&camPos)))) - bounds.radius;
+
+	// proj._22 is 1 / tan(fov / 2), so half the screen height covers tan(fov / 2) * distance world units
+	return maxScale * fabsf(cam->GetProj()._22) * screenHeight * 0.5f / fmaxf(distance, 0.01f);
+}
+
+/// <summary>
+/// Pick this entity's LOD from how big its mesh looks from the camera
+/// </summary>
+/// <param name="tf">- the entity's transform</param>
+/// <param name="cam">- the camera the entity will be drawn with</param>
+/// <param name="screenHeight">- height of the render target in pixels</param>
+void Renderable::UpdateLod(Transform& tf, shared_ptr<Cam> cam, float screenHeight)
+{
+	if (mesh->GetLodCount() > 1)
+		lod = mesh->SelectLod(GetPixelsPerUnit(tf, cam, screenHeight), lod);
+}
+
+/// <summary>
+/// UpdateLod() with world bounds already worked out, so the entity's own cached copy is left alone
+/// </summary>
+/// <param name="tf">- the entity's transform</param>
+/// <param name="worldBounds">- this entity's world bounds as of its transform's last update</param>
+/// <param name="cam">- the camera the entity will be drawn with</param>
+/// <param name="screenHeight">- height of the render target in pixels</param>
+void Renderable::UpdateLod(Transform& tf, const Bounds& worldBounds, shared_ptr<Cam> cam, float screenHeight)
+{
+	if (mesh->GetLodCount() > 1)
+		lod = mesh->SelectLod(GetPixelsPerUnit(tf, worldBounds, cam, screenHeight), lod);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Transform.h"
+#include "Mesh.h"
+#include "Cam.h"
+#include "Material.h"
+
+/// <summary>
+/// <para>Component for entities that get drawn: the mesh, its material and the LOD it's drawn at</para>
+/// The entity's Transform is a component of its own, passed in wherever it's needed
+/// </summary>
+class Renderable
+{
+private:
+	std::shared_ptr<Mesh> mesh;
+	std::shared_ptr<Material> mat;
+	int lod = 0;
+	Bounds worldBounds = {};
+	bool hasWorldBounds = false;
+	unsigned int worldBoundsFrame = 0; // transform frame worldBounds was made on
+public:
+	Renderable();
+	Renderable(std::shared_ptr<Mesh>, std::shared_ptr<Material>);
+	std::shared_ptr<Mesh> GetMesh();
+	std::shared_ptr<Material> GetMat();
+	int GetLod();
+	Bounds GetWorldBounds(Transform& tf);
+	float GetPixelsPerUnit(Transform& tf, std::shared_ptr<Cam>, float screenHeight);
+	float GetPixelsPerUnit(Transform& tf, const Bounds& bounds, std::shared_ptr<Cam>, float screenHeight);
+	void UpdateLod(Transform& tf, std::shared_ptr<Cam>, float screenHeight);
+	void UpdateLod(Transform& tf, const Bounds& worldBounds, std::shared_ptr<Cam>, float screenHeight);
+};
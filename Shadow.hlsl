@@ -1,22 +1,43 @@
-#include "Lighting.hlsli"
+#include "PerFrame.hlsli"
 
 //struct VertexShaderInput
 //{
 //    float3 localPosition : POSITION;
 //};
 
-cbuffer externalData : register(b0)
+// Drawn from the light, with PerFrame's lightView and lightProjection
+#if !defined(INSTANCED) || defined(PACKED_VERTICES)
+cbuffer PerObject : register(b0)
 {
+#ifndef INSTANCED
     matrix world;
-    matrix view;
-    matrix projection;
-    matrix lightView;
-    matrix lightProjection;
+#endif
+#ifdef PACKED_VERTICES
+    float3 positionMin;
+    float3 positionExtent;
+#endif
 };
+#endif
 
 
-float4 main(VertexShaderInput input) : SV_POSITION
+#ifdef INSTANCED
+#define INSTANCE_INPUT , InstanceInput instance
+#else
+#define INSTANCE_INPUT
+#endif
+#ifdef PACKED_VERTICES
+float4 main(PackedVertexShaderInput packedInput INSTANCE_INPUT) : SV_POSITION
 {
-    matrix wvp = mul(projection, mul(view, world));
-    return mul(wvp, float4(input.localPosition, 1.0f));
+    // Only the position matters here, skip decoding the rest
+    float3 localPosition = positionMin + packedInput.localPosition.xyz * positionExtent;
+#else
+float4 main(VertexShaderInput input INSTANCE_INPUT) : SV_POSITION
+{
+    float3 localPosition = input.localPosition;
+#endif
+#ifdef INSTANCED
+    matrix world = transpose(matrix(instance.world0, instance.world1, instance.world2, instance.world3));
+#endif
+    matrix wvp = mul(lightProjection, mul(lightView, world));
+    return mul(wvp, float4(localPosition, 1.0f));
 }
\ No newline at end of file
@@ -0,0 +1,4 @@
+// Same as Shadow.hlsl, but the world matrix comes per instance
+// from the second vertex buffer (see InstanceBatcher.h)
+#define INSTANCED
+#include "Shadow.hlsl"
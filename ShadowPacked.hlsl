@@ -0,0 +1,4 @@
+// Same as Shadow.hlsl, but reads the 20 byte PackedVertex
+// (see VertexPacking.h for the input layout)
+#define PACKED_VERTICES
+#include "Shadow.hlsl"
@@ -0,0 +1,5 @@
+// Same as ShadowPacked.hlsl, but the world matrix comes per instance
+// from the second vertex buffer (see InstanceBatcher.h)
+#define PACKED_VERTICES
+#define INSTANCED
+#include "Shadow.hlsl"
@@ -17,13 +17,20 @@ bool ISimpleShader::ReportWarnings = false;
 ///////////////////////////////////////////////////////////////////////////////
 
 // --------------------------------------------------------
-// Constructor accepts Direct3D device & context
+// Constructor accepts Direct3D device & render device
+//
+// Vertex & pixel shaders bind and upload through the render
+// device; the other stages still need its raw D3D context.
+// Buffers at sharedBufferRegister (-1 for none) belong to
+// someone else, like FrameConstants
 // --------------------------------------------------------
-ISimpleShader::ISimpleShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+ISimpleShader::ISimpleShader(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice, int sharedBufferRegister)
 {
 	// Save the device
 	this->device = device;
-	this->deviceContext = context;
+	this->renderDevice = renderDevice;
+	this->deviceContext = renderDevice->GetContext();
+	this->sharedBufferRegister = sharedBufferRegister;
 
 	// Set up fields
 	this->constantBufferCount = 0;
@@ -188,6 +195,12 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		constantBuffers[b].Name = bufferDesc.Name;
 		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
 
+		// Buffers at the shared register are made, filled and bound by whoever owns them,
+		// so this shader gets no buffer, local data or settable variables for them
+		constantBuffers[b].Size = bufferDesc.Size;
+		if (sharedBufferRegister >= 0 && bindDesc.BindPoint == (unsigned int)sharedBufferRegister)
+			continue;
+
 		// Create this constant buffer
 		D3D11_BUFFER_DESC newBuffDesc = {};
 		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
@@ -199,7 +212,6 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
 
 		// Set up the data buffer for this constant buffer
-		constantBuffers[b].Size = bufferDesc.Size;
 		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
 		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
 
@@ -348,10 +360,15 @@ void ISimpleShader::CopyAllBufferData()
 	// Loop through the constant buffers and copy all data
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
+		// Shared buffers are copied by their owner
+		if (!constantBuffers[i].ConstantBuffer)
+			continue;
+
 		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
+		renderDevice->UpdateConstantBuffer(
+			constantBuffers[i].ConstantBuffer.Get(),
+			constantBuffers[i].LocalDataBuffer,
+			constantBuffers[i].Size);
 	}
 }
 
@@ -377,12 +394,13 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
-	if (!cb) return;
+	if (!cb || !cb->ConstantBuffer) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	renderDevice->UpdateConstantBuffer(
+		cb->ConstantBuffer.Get(),
+		cb->LocalDataBuffer,
+		cb->Size);
 }
 
 // --------------------------------------------------------
@@ -399,12 +417,13 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
-	if (!cb) return;
+	if (!cb || !cb->ConstantBuffer) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	renderDevice->UpdateConstantBuffer(
+		cb->ConstantBuffer.Get(),
+		cb->LocalDataBuffer,
+		cb->Size);
 }
 
 
@@ -691,8 +710,8 @@ const SimpleConstantBuffer * ISimpleShader::GetBufferInfo(unsigned int index)
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
-SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile)
-	: ISimpleShader(device, context) 
+SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice, LPCWSTR shaderFile, int sharedBufferRegister)
+	: ISimpleShader(device, renderDevice, sharedBufferRegister) 
 { 
 	// Ensure we set to zero to successfully trigger
 	// the Input Layout creation during LoadShaderFile()
@@ -708,8 +727,8 @@ SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> devi
 // Passing in a valid input layout will stop LoadShaderFile()
 // from creating an input layout from shader reflection
 // --------------------------------------------------------
-SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile, Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout, bool perInstanceCompatible)
-	: ISimpleShader(device, context)
+SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice, LPCWSTR shaderFile, Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout, bool perInstanceCompatible, int sharedBufferRegister)
+	: ISimpleShader(device, renderDevice, sharedBufferRegister)
 {
 	// Save the custom input layout
 	this->inputLayout = inputLayout;
@@ -864,23 +883,32 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 // for future  Direct3D drawing
 // --------------------------------------------------------
 void SimpleVertexShader::SetShaderAndCBs()
+{
+	SetShader(*renderDevice);
+}
+
+// --------------------------------------------------------
+// Sets the vertex shader, input layout and constant buffers
+// onto the given device instead of this shader's own
+// --------------------------------------------------------
+void SimpleVertexShader::SetShader(RenderDevice& target)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	target.IASetInputLayout(inputLayout.Get());
+	target.VSSetShader(shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers, and shared ones this shader doesn't own
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || !constantBuffers[i].ConstantBuffer)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
+		target.VSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -911,7 +939,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	renderDevice->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -941,7 +969,7 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	renderDevice->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -955,8 +983,8 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
-SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile)
-	: ISimpleShader(device, context) 
+SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice, LPCWSTR shaderFile, int sharedBufferRegister)
+	: ISimpleShader(device, renderDevice, sharedBufferRegister) 
 { 
 	// Load the actual compiled shader file
 	this->LoadShaderFile(shaderFile);
@@ -1007,22 +1035,31 @@ bool SimplePixelShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob
 // future  Direct3D drawing
 // --------------------------------------------------------
 void SimplePixelShader::SetShaderAndCBs()
+{
+	SetShader(*renderDevice);
+}
+
+// --------------------------------------------------------
+// Sets the pixel shader and constant buffers onto the
+// given device instead of this shader's own
+// --------------------------------------------------------
+void SimplePixelShader::SetShader(RenderDevice& target)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	target.PSSetShader(shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers, and shared ones this shader doesn't own
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || !constantBuffers[i].ConstantBuffer)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
+		target.PSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1053,7 +1090,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	renderDevice->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1083,7 +1120,7 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	renderDevice->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1099,8 +1136,8 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
-SimpleDomainShader::SimpleDomainShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile)
-	: ISimpleShader(device, context) 
+SimpleDomainShader::SimpleDomainShader(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice, LPCWSTR shaderFile)
+	: ISimpleShader(device, renderDevice) 
 { 
 	// Load the actual compiled shader file
 	this->LoadShaderFile(shaderFile);
@@ -1161,8 +1198,8 @@ void SimpleDomainShader::SetShaderAndCBs()
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers, and shared ones this shader doesn't own
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || !constantBuffers[i].ConstantBuffer)
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -1242,8 +1279,8 @@ bool SimpleDomainShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
-SimpleHullShader::SimpleHullShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile)
-	: ISimpleShader(device, context) 
+SimpleHullShader::SimpleHullShader(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice, LPCWSTR shaderFile)
+	: ISimpleShader(device, renderDevice) 
 { 
 	// Load the actual compiled shader file
 	this->LoadShaderFile(shaderFile);
@@ -1304,8 +1341,8 @@ void SimpleHullShader::SetShaderAndCBs()
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers, and shared ones this shader doesn't own
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || !constantBuffers[i].ConstantBuffer)
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -1386,8 +1423,8 @@ bool SimpleHullShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<
 // --------------------------------------------------------
 // Constructor calls the base and sets up potential stream-out options
 // --------------------------------------------------------
-SimpleGeometryShader::SimpleGeometryShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile, bool useStreamOut, bool allowStreamOutRasterization)
-	: ISimpleShader(device, context) 
+SimpleGeometryShader::SimpleGeometryShader(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice, LPCWSTR shaderFile, bool useStreamOut, bool allowStreamOutRasterization)
+	: ISimpleShader(device, renderDevice) 
 { 
 	this->streamOutVertexSize = 0;
 	this->useStreamOut = useStreamOut;
@@ -1578,8 +1615,8 @@ void SimpleGeometryShader::SetShaderAndCBs()
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers, and shared ones this shader doesn't own
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || !constantBuffers[i].ConstantBuffer)
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -1676,8 +1713,8 @@ unsigned int SimpleGeometryShader::CalcComponentCount(unsigned int mask)
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
-SimpleComputeShader::SimpleComputeShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile)
-	: ISimpleShader(device, context) 
+SimpleComputeShader::SimpleComputeShader(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<RenderDevice> renderDevice, LPCWSTR shaderFile)
+	: ISimpleShader(device, renderDevice) 
 { 
 	this->threadsTotal = 0;
 	this->threadsX = 0;
@@ -1788,8 +1825,8 @@ void SimpleComputeShader::SetShaderAndCBs()
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers, and shared ones this shader doesn't own
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || !constantBuffers[i].ConstantBuffer)
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -126,25 +126,23 @@ void Sky::CreateCubemap(
 	//shaderResourceView = cubeSRV;
 }
 
-void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::vector<std::shared_ptr<Cam>> cams, int activeCam)
+void Sky::Draw(std::shared_ptr<RenderDevice> renderDevice)
 {
-	context->RSSetState(rasterizerState.Get()); // draw inside faces
-	context->OMSetDepthStencilState(depthStencilState.Get(), 0); // accept pixels with a depth less than AND equal to 1
+	renderDevice->RSSetState(rasterizerState.Get()); // draw inside faces
+	renderDevice->OMSetDepthStencilState(depthStencilState.Get(), 0); // accept pixels with a depth less than AND equal to 1
 
 	//Draw sky
 	simpleVertexShader->SetShader();
 	simplePixelShader->SetShader();
 	simplePixelShader->SetShaderResourceView("Cube", shaderResourceView);
 	simplePixelShader->SetSamplerState("CubeSampler", samplerState);
-	simpleVertexShader->SetMatrix4x4("view", cams[activeCam]->GetView());
-	simpleVertexShader->SetMatrix4x4("proj", cams[activeCam]->GetProj());
-	simpleVertexShader->CopyAllBufferData();
+	// The camera comes from FrameConstants, the sky has no constants of its own
 
 	mesh->Draw();
 
 	// These states are only for the sky, so stop using them when you're done drawing the sky
-	context->RSSetState(0);
-	context->OMSetDepthStencilState(0, 0);
+	renderDevice->RSSetState(0);
+	renderDevice->OMSetDepthStencilState(0, 0);
 }
 
 Sky::Sky()
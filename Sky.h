@@ -34,6 +34,6 @@ public:
 		const wchar_t* back,
 		Microsoft::WRL::ComPtr<ID3D11Device> device,
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext>, std::vector<std::shared_ptr<Cam>>, int);
+	void Draw(std::shared_ptr<RenderDevice>);
 };
 
@@ -1,12 +1,5 @@
-#include "Lighting.hlsli"
-
-cbuffer ExternalData : register(b2)
-{
-	// declare variables that hold the external data (data sent in from c++)
-	// order at which they're declared matters (they define where in the buffer these variables will get their data)
-    matrix view;
-    matrix proj;
-}
+// The camera's view and proj come from PerFrame
+#include "PerFrame.hlsli"
 
 struct SkyVertexToPixel
 {
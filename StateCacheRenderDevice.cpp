@@ -0,0 +1,306 @@
+#include "StateCacheRenderDevice.h"
+#include <cstring>
+
+/// <param name="target">- the device calls that change something are forwarded to</param>
+StateCacheRenderDevice::StateCacheRenderDevice(std::shared_ptr<RenderDevice> target)
+{
+	this->target = target;
+	Invalidate();
+}
+
+/// <returns>The device behind the cache</returns>
+RenderDevice* StateCacheRenderDevice::GetTarget()
+{
+	return target.get();
+}
+
+/// <summary>
+/// Forget everything known about the target's state, so the next call of every kind goes through
+/// </summary>
+void StateCacheRenderDevice::Invalidate()
+{
+	vs.shader.known.reset();
+	vs.constantBuffers.known.reset();
+	vs.resources.known.reset();
+	vs.samplers.known.reset();
+	ps.shader.known.reset();
+	ps.constantBuffers.known.reset();
+	ps.resources.known.reset();
+	ps.samplers.known.reset();
+	inputLayout.known.reset();
+	rasterizerState.known.reset();
+	topologyKnown = false;
+	vertexBuffersKnown.reset();
+	indexBufferKnown = false;
+	viewportsKnown = false;
+	renderTargetsKnown = false;
+	depthStencilKnown = false;
+	constantData.clear();
+}
+
+/// <summary>
+/// Turn filtering on or off, while off every call goes through and nothing is tracked
+/// </summary>
+void StateCacheRenderDevice::SetEnabled(bool enabled)
+{
+	if (enabled && !this->enabled)
+		Invalidate();
+	this->enabled = enabled;
+}
+
+bool StateCacheRenderDevice::IsEnabled()
+{
+	return enabled;
+}
+
+/// <summary>
+/// Count a call as going through, or as dropped if it changes nothing
+/// </summary>
+/// <param name="type">- which call</param>
+/// <param name="changes">- whether it changes anything, always true while disabled</param>
+/// <returns>True if the call should be dropped</returns>
+bool StateCacheRenderDevice::Drop(RenderCallType type, bool changes)
+{
+	if (!changes)
+	{
+		stats.filtered[type]++;
+		return true;
+	}
+	Count(type);
+	return false;
+}
+
+ID3D11DeviceContext* StateCacheRenderDevice::GetContext()
+{
+	return target->GetContext();
+}
+
+/// <summary>
+/// Hand command buffers to the target as they are, they bind whatever they bind without the cache seeing it
+/// </summary>
+void StateCacheRenderDevice::ExecuteCommandBuffers(const CommandBuffer* const* buffers, size_t count, JobSystem* jobs)
+{
+	target->ResetStats();
+	target->ExecuteCommandBuffers(buffers, count, jobs);
+	RenderStats replayed = target->GetStats();
+	stats.drawCalls += replayed.drawCalls;
+	stats.indices += replayed.indices;
+	stats.bytesUploaded += replayed.bytesUploaded;
+	for (int call = 0; call < RENDER_CALL_COUNT; call++)
+		stats.calls[call] += replayed.calls[call];
+	Invalidate();
+}
+
+void StateCacheRenderDevice::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	bool changes = !enabled || !topologyKnown || this->topology != topology;
+	topologyKnown = true;
+	this->topology = topology;
+	if (Drop(RENDER_CALL_IA_SET_PRIMITIVE_TOPOLOGY, changes)) return;
+	target->IASetPrimitiveTopology(topology);
+}
+
+void StateCacheRenderDevice::IASetInputLayout(ID3D11InputLayout* layout)
+{
+	if (Drop(RENDER_CALL_IA_SET_INPUT_LAYOUT, !enabled || inputLayout.Change(layout))) return;
+	target->IASetInputLayout(layout);
+}
+
+/// <summary>
+/// Vertex buffers go through whole if any slot's buffer, stride or offset differs
+/// </summary>
+void StateCacheRenderDevice::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	bool changes = !enabled;
+	if (enabled && (startSlot >= STATE_CACHE_VERTEX_BUFFERS || numBuffers > STATE_CACHE_VERTEX_BUFFERS - startSlot))
+	{
+		vertexBuffersKnown.reset();
+		changes = true;
+	}
+	else if (enabled)
+	{
+		for (UINT i = 0; i < numBuffers; i++)
+		{
+			UINT slot = startSlot + i;
+			if (vertexBuffersKnown[slot] && vertexBuffers[slot] == buffers[i] && vertexStrides[slot] == strides[i] && vertexOffsets[slot] == offsets[i])
+				continue;
+			vertexBuffers[slot] = buffers[i];
+			vertexStrides[slot] = strides[i];
+			vertexOffsets[slot] = offsets[i];
+			vertexBuffersKnown[slot] = true;
+			changes = true;
+		}
+	}
+	if (Drop(RENDER_CALL_IA_SET_VERTEX_BUFFERS, changes)) return;
+	target->IASetVertexBuffers(startSlot, numBuffers, buffers, strides, offsets);
+}
+
+void StateCacheRenderDevice::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	bool changes = !enabled || !indexBufferKnown || indexBuffer != buffer || indexFormat != format || indexOffset != offset;
+	indexBufferKnown = true;
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	if (Drop(RENDER_CALL_IA_SET_INDEX_BUFFER, changes)) return;
+	target->IASetIndexBuffer(buffer, format, offset);
+}
+
+void StateCacheRenderDevice::VSSetShader(ID3D11VertexShader* shader)
+{
+	if (Drop(RENDER_CALL_VS_SET_SHADER, !enabled || vs.shader.Change(shader))) return;
+	target->VSSetShader(shader);
+}
+
+void StateCacheRenderDevice::PSSetShader(ID3D11PixelShader* shader)
+{
+	if (Drop(RENDER_CALL_PS_SET_SHADER, !enabled || ps.shader.Change(shader))) return;
+	target->PSSetShader(shader);
+}
+
+void StateCacheRenderDevice::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	if (Drop(RENDER_CALL_VS_SET_CONSTANT_BUFFERS, !enabled || vs.constantBuffers.Change(startSlot, numBuffers, buffers))) return;
+	target->VSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void StateCacheRenderDevice::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	if (Drop(RENDER_CALL_PS_SET_CONSTANT_BUFFERS, !enabled || ps.constantBuffers.Change(startSlot, numBuffers, buffers))) return;
+	target->PSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void StateCacheRenderDevice::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+	if (Drop(RENDER_CALL_VS_SET_SHADER_RESOURCES, !enabled || vs.resources.Change(startSlot, numViews, views))) return;
+	target->VSSetShaderResources(startSlot, numViews, views);
+}
+
+void StateCacheRenderDevice::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+	if (Drop(RENDER_CALL_PS_SET_SHADER_RESOURCES, !enabled || ps.resources.Change(startSlot, numViews, views))) return;
+	target->PSSetShaderResources(startSlot, numViews, views);
+}
+
+void StateCacheRenderDevice::VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	if (Drop(RENDER_CALL_VS_SET_SAMPLERS, !enabled || vs.samplers.Change(startSlot, numSamplers, samplers))) return;
+	target->VSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+void StateCacheRenderDevice::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	if (Drop(RENDER_CALL_PS_SET_SAMPLERS, !enabled || ps.samplers.Change(startSlot, numSamplers, samplers))) return;
+	target->PSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+/// <summary>
+/// Dropped if the buffer was last given exactly these bytes, like a material's constants uploaded again for its next draw
+/// </summary>
+void StateCacheRenderDevice::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	bool changes = !enabled;
+	if (enabled)
+	{
+		std::vector<unsigned char>& last = constantData[buffer];
+		if (last.size() != size || memcmp(last.data(), data, size) != 0)
+		{
+			last.assign((const unsigned char*)data, (const unsigned char*)data + size);
+			changes = true;
+		}
+	}
+	if (Drop(RENDER_CALL_UPDATE_CONSTANT_BUFFER, changes)) return;
+	stats.bytesUploaded += size;
+	target->UpdateConstantBuffer(buffer, data, size);
+}
+
+void StateCacheRenderDevice::UpdateBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	Count(RENDER_CALL_UPDATE_BUFFER);
+	stats.bytesUploaded += size;
+	target->UpdateBuffer(buffer, data, size);
+}
+
+void StateCacheRenderDevice::RSSetState(ID3D11RasterizerState* state)
+{
+	if (Drop(RENDER_CALL_RS_SET_STATE, !enabled || rasterizerState.Change(state))) return;
+	target->RSSetState(state);
+}
+
+void StateCacheRenderDevice::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports)
+{
+	bool changes = !enabled || numViewports > STATE_CACHE_VIEWPORTS || !viewportsKnown || viewportCount != numViewports ||
+		memcmp(this->viewports, viewports, numViewports * sizeof(D3D11_VIEWPORT)) != 0;
+	viewportsKnown = numViewports <= STATE_CACHE_VIEWPORTS;
+	if (viewportsKnown)
+	{
+		viewportCount = numViewports;
+		memcpy(this->viewports, viewports, numViewports * sizeof(D3D11_VIEWPORT));
+	}
+	if (Drop(RENDER_CALL_RS_SET_VIEWPORTS, changes)) return;
+	target->RSSetViewports(numViewports, viewports);
+}
+
+/// <summary>
+/// New targets make D3D unbind resources that were bound as them, and refuse resources bound while they were, so
+/// which resources are bound isn't known anymore
+/// </summary>
+void StateCacheRenderDevice::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	bool changes = !enabled || numViews > STATE_CACHE_RENDER_TARGETS || !renderTargetsKnown || renderTargetCount != numViews ||
+		depthStencilView != dsv || memcmp(renderTargets, rtvs, numViews * sizeof(ID3D11RenderTargetView*)) != 0;
+	renderTargetsKnown = numViews <= STATE_CACHE_RENDER_TARGETS;
+	if (renderTargetsKnown)
+	{
+		renderTargetCount = numViews;
+		memcpy(renderTargets, rtvs, numViews * sizeof(ID3D11RenderTargetView*));
+		depthStencilView = dsv;
+	}
+	if (Drop(RENDER_CALL_OM_SET_RENDER_TARGETS, changes)) return;
+	vs.resources.known.reset();
+	ps.resources.known.reset();
+	target->OMSetRenderTargets(numViews, rtvs, dsv);
+}
+
+void StateCacheRenderDevice::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	bool changes = !enabled || !depthStencilKnown || depthStencilState != state || this->stencilRef != stencilRef;
+	depthStencilKnown = true;
+	depthStencilState = state;
+	this->stencilRef = stencilRef;
+	if (Drop(RENDER_CALL_OM_SET_DEPTH_STENCIL_STATE, changes)) return;
+	target->OMSetDepthStencilState(state, stencilRef);
+}
+
+void StateCacheRenderDevice::ClearRenderTargetView(ID3D11RenderTargetView* rtv, const float color[4])
+{
+	Count(RENDER_CALL_CLEAR_RENDER_TARGET_VIEW);
+	target->ClearRenderTargetView(rtv, color);
+}
+
+void StateCacheRenderDevice::ClearDepthStencilView(ID3D11DepthStencilView* dsv, UINT clearFlags, float depth, UINT8 stencil)
+{
+	Count(RENDER_CALL_CLEAR_DEPTH_STENCIL_VIEW);
+	target->ClearDepthStencilView(dsv, clearFlags, depth, stencil);
+}
+
+void StateCacheRenderDevice::Draw(UINT vertexCount, UINT startVertex)
+{
+	Count(RENDER_CALL_DRAW);
+	stats.indices += vertexCount;
+	target->Draw(vertexCount, startVertex);
+}
+
+void StateCacheRenderDevice::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	Count(RENDER_CALL_DRAW_INDEXED);
+	stats.indices += indexCount;
+	target->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void StateCacheRenderDevice::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+{
+	Count(RENDER_CALL_DRAW_INDEXED_INSTANCED);
+	stats.indices += indexCount * instanceCount;
+	target->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <bitset>
+#include <unordered_map>
+#include "RenderDevice.h"
+
+// Vertex buffer slots, viewports and render targets the cache tracks, calls past them go through untouched
+#define STATE_CACHE_VERTEX_BUFFERS 4
+#define STATE_CACHE_VIEWPORTS 4
+#define STATE_CACHE_RENDER_TARGETS 8
+
+/// <summary>
+/// <para>Render device that sits in front of another and drops calls that would bind what's already bound</para>
+/// It keeps what each stage has in every shader, constant buffer, resource and sampler slot, the input assembler's
+/// buffers, and the rasterizer and output merger states, and forwards only calls that change something. A call
+/// binding a range of slots is cut down to the slots that differ. Constant buffer updates with the same bytes the
+/// buffer was last given are dropped too. Dropped calls are counted per type in RenderStats::filtered.
+/// Anything that changes the context behind the cache's back (ImGui, Present(), resizing, replaying command lists)
+/// has to be followed by Invalidate()
+/// </summary>
+class StateCacheRenderDevice : public RenderDevice
+{
+private:
+	/// <summary>
+	/// What's bound to each slot of one kind of object, and which slots are known at all
+	/// </summary>
+	template<typename T, unsigned int N>
+	struct BoundSlots
+	{
+		T* bound[N];
+		std::bitset<N> known;
+
+		/// <summary>
+		/// Take a call binding a range of slots, remembering what it binds
+		/// </summary>
+		/// <param name="start">- first slot, moved up to the first one that changes</param>
+		/// <param name="count">- slots bound, cut down to end at the last one that changes</param>
+		/// <param name="values">- what goes in them, moved along with start</param>
+		/// <returns>False if every slot already held its value</returns>
+		bool Change(UINT& start, UINT& count, T* const*& values)
+		{
+			if (start >= N || count > N - start)
+			{
+				known.reset();
+				return true;
+			}
+			UINT first = count, last = 0;
+			for (UINT i = 0; i < count; i++)
+			{
+				UINT slot = start + i;
+				if (known[slot] && bound[slot] == values[i])
+					continue;
+				if (first == count) first = i;
+				last = i;
+				bound[slot] = values[i];
+				known[slot] = true;
+			}
+			if (first == count)
+				return false;
+			start += first;
+			values += first;
+			count = last - first + 1;
+			return true;
+		}
+
+		/// <returns>False if the one slot already held value</returns>
+		bool Change(T* value)
+		{
+			UINT start = 0, count = 1;
+			T* const* values = &value;
+			return Change(start, count, values);
+		}
+	};
+
+	/// <summary>
+	/// Everything bound to one shader stage
+	/// </summary>
+	template<typename Shader>
+	struct StageState
+	{
+		BoundSlots<Shader, 1> shader;
+		BoundSlots<ID3D11Buffer, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT> constantBuffers;
+		BoundSlots<ID3D11ShaderResourceView, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT> resources;
+		BoundSlots<ID3D11SamplerState, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT> samplers;
+	};
+
+	std::shared_ptr<RenderDevice> target;
+	bool enabled = true;
+
+	StageState<ID3D11VertexShader> vs;
+	StageState<ID3D11PixelShader> ps;
+	BoundSlots<ID3D11InputLayout, 1> inputLayout;
+	BoundSlots<ID3D11RasterizerState, 1> rasterizerState;
+	bool topologyKnown = false;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	std::bitset<STATE_CACHE_VERTEX_BUFFERS> vertexBuffersKnown;
+	ID3D11Buffer* vertexBuffers[STATE_CACHE_VERTEX_BUFFERS];
+	UINT vertexStrides[STATE_CACHE_VERTEX_BUFFERS];
+	UINT vertexOffsets[STATE_CACHE_VERTEX_BUFFERS];
+	bool indexBufferKnown = false;
+	ID3D11Buffer* indexBuffer;
+	DXGI_FORMAT indexFormat;
+	UINT indexOffset;
+	bool viewportsKnown = false;
+	UINT viewportCount;
+	D3D11_VIEWPORT viewports[STATE_CACHE_VIEWPORTS];
+	bool renderTargetsKnown = false;
+	UINT renderTargetCount;
+	ID3D11RenderTargetView* renderTargets[STATE_CACHE_RENDER_TARGETS];
+	ID3D11DepthStencilView* depthStencilView;
+	bool depthStencilKnown = false;
+	ID3D11DepthStencilState* depthStencilState;
+	UINT stencilRef;
+	std::unordered_map<ID3D11Buffer*, std::vector<unsigned char>> constantData; // what each constant buffer was last given
+
+	bool Drop(RenderCallType type, bool changes);
+
+public:
+	StateCacheRenderDevice(std::shared_ptr<RenderDevice> target);
+	RenderDevice* GetTarget();
+	void Invalidate();
+	void SetEnabled(bool);
+	bool IsEnabled();
+
+	ID3D11DeviceContext* GetContext();
+	void ExecuteCommandBuffers(const CommandBuffer* const* buffers, size_t count, JobSystem* jobs = 0);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY);
+	void IASetInputLayout(ID3D11InputLayout*);
+	void IASetVertexBuffers(UINT, UINT, ID3D11Buffer* const*, const UINT*, const UINT*);
+	void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT);
+	void VSSetShader(ID3D11VertexShader*);
+	void PSSetShader(ID3D11PixelShader*);
+	void VSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*);
+	void PSSetConstantBuffers(UINT, UINT, ID3D11Buffer* const*);
+	void VSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*);
+	void PSSetShaderResources(UINT, UINT, ID3D11ShaderResourceView* const*);
+	void VSSetSamplers(UINT, UINT, ID3D11SamplerState* const*);
+	void PSSetSamplers(UINT, UINT, ID3D11SamplerState* const*);
+	void UpdateConstantBuffer(ID3D11Buffer*, const void*, UINT);
+	void UpdateBuffer(ID3D11Buffer*, const void*, UINT);
+	void RSSetState(ID3D11RasterizerState*);
+	void RSSetViewports(UINT, const D3D11_VIEWPORT*);
+	void OMSetRenderTargets(UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*);
+	void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT);
+	void ClearRenderTargetView(ID3D11RenderTargetView*, const float[4]);
+	void ClearDepthStencilView(ID3D11DepthStencilView*, UINT, float, UINT8);
+	void Draw(UINT, UINT);
+	void DrawIndexed(UINT, UINT, INT);
+	void DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT);
+};
@@ -0,0 +1,295 @@
+#include "TangentGenerator.h"
+#include "Threading.h"
+#include <DirectXMath.h>
+#include <algorithm>
+#include <stdint.h>
+
+using namespace DirectX;
+using namespace std;
+
+// Splitting fewer triangles/vertices than this across threads costs more than it saves
+#define TANGENT_MIN_TRIANGLES_PER_THREAD 65536
+#define TANGENT_MIN_VERTICES_PER_THREAD 65536
+
+namespace
+{
+	/// <summary>
+	/// Where one thread adds up its triangles' tangents, the vertices' own Tangent or a separate array
+	/// </summary>
+	struct TangentSums
+	{
+		char* first;
+		size_t stride;
+
+		XMFLOAT4& operator[](size_t vertex) const { return *(XMFLOAT4*)(first + vertex * stride); }
+	};
+
+	/// <summary>
+	/// <para>Load 4 floats starting at the same member of 4 vertices and transpose them</para>
+	/// Row 0 gets the first float of every vertex, row 1 the second and so on
+	/// </summary>
+	inline XMMATRIX LoadTransposed(const float* v0, const float* v1, const float* v2, const float* v3)
+	{
+		return XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat4((const XMFLOAT4*)v0),
+			XMLoadFloat4((const XMFLOAT4*)v1),
+			XMLoadFloat4((const XMFLOAT4*)v2),
+			XMLoadFloat4((const XMFLOAT4*)v3)));
+	}
+
+	/// <summary>
+	/// Position and u of 4 vertices as SoA rows (x, y, z, u), Position and UV sit next to each other in Vertex
+	/// </summary>
+	inline XMMATRIX LoadPositionU(const Vertex* vertices, const unsigned int* index)
+	{
+		return LoadTransposed(&vertices[index[0]].Position.x, &vertices[index[1]].Position.x,
+			&vertices[index[2]].Position.x, &vertices[index[3]].Position.x);
+	}
+
+	/// <summary>
+	/// Normals of 4 vertices as SoA rows (x, y, z, unused)
+	/// </summary>
+	inline XMMATRIX LoadNormals(const Vertex* vertices, const unsigned int* index)
+	{
+		return LoadTransposed(&vertices[index[0]].Normal.x, &vertices[index[1]].Normal.x,
+			&vertices[index[2]].Normal.x, &vertices[index[3]].Normal.x);
+	}
+
+	/// <returns>v of 4 vertices in one vector</returns>
+	inline XMVECTOR LoadV(const Vertex* vertices, const unsigned int* index)
+	{
+		return XMVectorSet(vertices[index[0]].UV.y, vertices[index[1]].UV.y, vertices[index[2]].UV.y, vertices[index[3]].UV.y);
+	}
+
+	/// <returns>The tangent of one triangle before normalizing, what AccumulateTriangles() works out four at a time</returns>
+	XMVECTOR TriangleTangent(const Vertex& a, const Vertex& b, const Vertex& c)
+	{
+		float x1 = b.Position.x - a.Position.x;
+		float y1 = b.Position.y - a.Position.y;
+		float z1 = b.Position.z - a.Position.z;
+		float x2 = c.Position.x - a.Position.x;
+		float y2 = c.Position.y - a.Position.y;
+		float z2 = c.Position.z - a.Position.z;
+		float s1 = b.UV.x - a.UV.x;
+		float t1 = b.UV.y - a.UV.y;
+		float s2 = c.UV.x - a.UV.x;
+		float t2 = c.UV.y - a.UV.y;
+
+		float r = 1.0f / (s1 * t2 - s2 * t1);
+		return XMVectorSet((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r, 0);
+	}
+
+	/// <summary>
+	/// Add the tangent of every triangle in [firstTriangle, lastTriangle) to its three vertices
+	/// </summary>
+	/// <param name="vertices">- positions, uvs and normals are read</param>
+	/// <param name="indices">- three per triangle</param>
+	/// <param name="firstTriangle">- first triangle to add</param>
+	/// <param name="lastTriangle">- one past the last triangle to add</param>
+	/// <param name="sums">- per-vertex tangent sums (x, y, z, unused)</param>
+	/// <param name="signs">- output, one per triangle, 1 where its bitangent sign is -1</param>
+	void AccumulateTriangles(const Vertex* vertices, const unsigned int* indices, size_t firstTriangle, size_t lastTriangle, TangentSums sums, unsigned char* signs)
+	{
+		for (size_t first = firstTriangle; first < lastTriangle; first += 4)
+		{
+			// The last group repeats its final triangle in the unused lanes, which are never written back
+			size_t lanes = lastTriangle - first < 4 ? lastTriangle - first : 4;
+			unsigned int i1[4], i2[4], i3[4];
+			for (size_t lane = 0; lane < 4; lane++)
+			{
+				const unsigned int* triangle = &indices[(first + (lane < lanes ? lane : lanes - 1)) * 3];
+				i1[lane] = triangle[0];
+				i2[lane] = triangle[1];
+				i3[lane] = triangle[2];
+			}
+
+			// One lane per triangle from here on
+			XMMATRIX c1 = LoadPositionU(vertices, i1);
+			XMMATRIX c2 = LoadPositionU(vertices, i2);
+			XMMATRIX c3 = LoadPositionU(vertices, i3);
+			XMVECTOR v1 = LoadV(vertices, i1);
+
+			// Vectors relative to the first corner, in both position and uv space
+			XMVECTOR x1 = XMVectorSubtract(c2.r[0], c1.r[0]);
+			XMVECTOR y1 = XMVectorSubtract(c2.r[1], c1.r[1]);
+			XMVECTOR z1 = XMVectorSubtract(c2.r[2], c1.r[2]);
+			XMVECTOR x2 = XMVectorSubtract(c3.r[0], c1.r[0]);
+			XMVECTOR y2 = XMVectorSubtract(c3.r[1], c1.r[1]);
+			XMVECTOR z2 = XMVectorSubtract(c3.r[2], c1.r[2]);
+			XMVECTOR s1 = XMVectorSubtract(c2.r[3], c1.r[3]);
+			XMVECTOR t1 = XMVectorSubtract(LoadV(vertices, i2), v1);
+			XMVECTOR s2 = XMVectorSubtract(c3.r[3], c1.r[3]);
+			XMVECTOR t2 = XMVectorSubtract(LoadV(vertices, i3), v1);
+
+			// Same operation order as the scalar version so the sums come out the same
+			XMVECTOR det = XMVectorSubtract(XMVectorMultiply(s1, t2), XMVectorMultiply(s2, t1));
+			XMVECTOR r = XMVectorDivide(g_XMOne, det);
+			XMMATRIX tangents = XMMatrixTranspose(XMMATRIX(
+				XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, x1), XMVectorMultiply(t1, x2)), r),
+				XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, y1), XMVectorMultiply(t1, y2)), r),
+				XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, z1), XMVectorMultiply(t1, z2)), r),
+				XMVectorZero()));
+
+			// MikkTSpace's bitangent sign is sign(dot(N, T x B)), and T x B is (e1 x e2) / det, so it's the
+			// sign of det * dot(N, e1 x e2). The first corner's normal stands in for the triangle's,
+			// flat or NaN uvs count as +1
+			XMMATRIX n = LoadNormals(vertices, i1);
+			XMVECTOR dot = XMVectorAdd(XMVectorAdd(
+				XMVectorMultiply(n.r[0], XMVectorSubtract(XMVectorMultiply(y1, z2), XMVectorMultiply(z1, y2))),
+				XMVectorMultiply(n.r[1], XMVectorSubtract(XMVectorMultiply(z1, x2), XMVectorMultiply(x1, z2)))),
+				XMVectorMultiply(n.r[2], XMVectorSubtract(XMVectorMultiply(x1, y2), XMVectorMultiply(y1, x2))));
+			uint32_t negative[4];
+			XMStoreInt4(negative, XMVectorLess(XMVectorMultiply(dot, det), XMVectorZero()));
+
+			// Back to one row per triangle, scattering stays serial since triangles in a group can share vertices
+			for (size_t lane = 0; lane < lanes; lane++)
+			{
+				signs[first + lane] = negative[lane] & 1;
+				XMVECTOR t = tangents.r[lane];
+				XMStoreFloat4(&sums[i1[lane]], XMVectorAdd(XMLoadFloat4(&sums[i1[lane]]), t));
+				XMStoreFloat4(&sums[i2[lane]], XMVectorAdd(XMLoadFloat4(&sums[i2[lane]]), t));
+				XMStoreFloat4(&sums[i3[lane]], XMVectorAdd(XMLoadFloat4(&sums[i3[lane]]), t));
+			}
+		}
+	}
+}
+
+/// <summary>
+/// <para>Replace every vertex's tangent with the uv-aligned direction averaged over its triangles,
+/// made orthogonal to the vertex normal, and the bitangent sign in w</para>
+/// Vertices used with both signs get a copy at the end of the array for their -1 triangles, whose
+/// indices are changed to point at it. A vertex only has one uv, so uv seams are already split
+/// </summary>
+/// <param name="vertices">- positions, uvs and normals are read, tangents are overwritten, may grow</param>
+/// <param name="indices">- three per triangle, corners moved to a split copy are rewritten</param>
+/// <param name="threadCount">- threads to split the work across, 0 picks one per core</param>
+void TangentGenerator::Generate(vector<Vertex>& vertices, vector<unsigned int>& indices, unsigned int threadCount)
+{
+	size_t vertexCount = vertices.size();
+	if (vertexCount == 0)
+		return;
+
+	size_t triangleCount = indices.size() / 3;
+	unsigned int triangleThreads = PickThreadCount(threadCount, triangleCount, TANGENT_MIN_TRIANGLES_PER_THREAD);
+	unsigned int vertexThreads = PickThreadCount(threadCount, vertexCount, TANGENT_MIN_VERTICES_PER_THREAD);
+
+	// The first triangle thread sums into the tangents themselves, like the scalar version, so one thread
+	// needs no scratch memory. Every other one gets its own array so no two threads add to the same vertex
+	vector<XMFLOAT4> partialSums(vertexCount * (triangleThreads - 1), XMFLOAT4(0, 0, 0, 0));
+	auto sumsOf = [&](unsigned int worker)
+	{
+		if (worker == 0)
+			return TangentSums{ (char*)&vertices[0].Tangent, sizeof(Vertex) };
+		return TangentSums{ (char*)&partialSums[vertexCount * (worker - 1)], sizeof(XMFLOAT4) };
+	};
+	RunOnThreads(vertexThreads, [&](unsigned int worker)
+	{
+		size_t begin = vertexCount * worker / vertexThreads;
+		size_t end = vertexCount * (worker + 1) / vertexThreads;
+		for (size_t i = begin; i < end; i++)
+			vertices[i].Tangent = XMFLOAT4(0, 0, 0, 0);
+	});
+
+	// Triangle ranges are multiples of 4 so only the very last group is partial
+	vector<unsigned char> signs(triangleCount);
+	size_t triangleGroups = (triangleCount + 3) / 4;
+	RunOnThreads(triangleThreads, [&](unsigned int worker)
+	{
+		size_t first = triangleGroups * worker / triangleThreads * 4;
+		size_t last = triangleGroups * (worker + 1) / triangleThreads * 4;
+		if (last > triangleCount) last = triangleCount;
+		AccumulateTriangles(vertices.data(), indices.data(), first, last, sumsOf(worker), signs.data());
+	});
+
+	// Bit 0 set if a vertex has +1 triangles, bit 1 if it has -1 triangles
+	vector<unsigned char> used(vertexCount, 0);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int corner = 0; corner < 3; corner++)
+			used[indices[t * 3 + corner]] |= 1 << signs[t];
+
+	// Vertices used with both signs, in order, each gets a copy at the end for its -1 triangles
+	vector<unsigned int> splits;
+	for (size_t i = 0; i < vertexCount; i++)
+		if (used[i] == 3)
+			splits.push_back((unsigned int)i);
+	if (!splits.empty())
+	{
+		// Both halves are added up again from scratch, few vertices are split so this stays scalar
+		for (unsigned int v : splits)
+			for (unsigned int worker = 0; worker < triangleThreads; worker++)
+				sumsOf(worker)[v] = XMFLOAT4(0, 0, 0, 0);
+		vertices.resize(vertexCount + splits.size());
+		for (size_t s = 0; s < splits.size(); s++)
+			vertices[vertexCount + s] = vertices[splits[s]];
+
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			unsigned int* triangle = &indices[t * 3];
+			if (used[triangle[0]] != 3 && used[triangle[1]] != 3 && used[triangle[2]] != 3)
+				continue;
+			XMVECTOR tangent = TriangleTangent(vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]]);
+			for (int corner = 0; corner < 3; corner++)
+			{
+				unsigned int& index = triangle[corner];
+				if (used[index] != 3)
+					continue;
+				if (signs[t])
+					index = (unsigned int)(vertexCount + (lower_bound(splits.begin(), splits.end(), index) - splits.begin()));
+				XMStoreFloat4(&vertices[index].Tangent, XMVectorAdd(XMLoadFloat4(&vertices[index].Tangent), tangent));
+			}
+		}
+	}
+
+	// Vertex ranges are multiples of 4 as well, split copies only have the first thread's sums
+	size_t finalCount = vertices.size();
+	vertexThreads = PickThreadCount(threadCount, finalCount, TANGENT_MIN_VERTICES_PER_THREAD);
+	size_t vertexGroups = (finalCount + 3) / 4;
+	RunOnThreads(vertexThreads, [&](unsigned int worker)
+	{
+		size_t begin = vertexGroups * worker / vertexThreads * 4;
+		size_t end = vertexGroups * (worker + 1) / vertexThreads * 4;
+		if (end > finalCount) end = finalCount;
+		for (size_t i = begin; i < end; i += 4)
+		{
+			// A partial last group repeats its final vertex like AccumulateTriangles() does
+			size_t lanes = end - i < 4 ? end - i : 4;
+			unsigned int index[4];
+			float sign[4];
+			XMMATRIX total;
+			for (size_t lane = 0; lane < 4; lane++)
+			{
+				index[lane] = (unsigned int)(i + (lane < lanes ? lane : lanes - 1));
+				sign[lane] = index[lane] >= vertexCount || used[index[lane]] == 2 ? -1.0f : 1.0f;
+
+				// Add up the per-thread partial sums, then switch to one lane per vertex
+				total.r[lane] = XMLoadFloat4(&vertices[index[lane]].Tangent);
+				for (unsigned int t = 1; index[lane] < vertexCount && t < triangleThreads; t++)
+					total.r[lane] = XMVectorAdd(total.r[lane], XMLoadFloat4(&sumsOf(t)[index[lane]]));
+			}
+			total = XMMatrixTranspose(total);
+			XMVECTOR tx = total.r[0], ty = total.r[1], tz = total.r[2];
+			XMMATRIX normals = LoadNormals(vertices.data(), index);
+			XMVECTOR nx = normals.r[0], ny = normals.r[1], nz = normals.r[2];
+
+			// Gram-Schmidt against the normal, then normalize the way XMVector3Normalize does
+			// (zero length gives zero, infinite length gives NaN)
+			XMVECTOR dot = XMVectorAdd(XMVectorAdd(XMVectorMultiply(nx, tx), XMVectorMultiply(ny, ty)), XMVectorMultiply(nz, tz));
+			tx = XMVectorSubtract(tx, XMVectorMultiply(nx, dot));
+			ty = XMVectorSubtract(ty, XMVectorMultiply(ny, dot));
+			tz = XMVectorSubtract(tz, XMVectorMultiply(nz, dot));
+
+			XMVECTOR lengthSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(tx, tx), XMVectorMultiply(ty, ty)), XMVectorMultiply(tz, tz));
+			XMVECTOR length = XMVectorSqrt(lengthSq);
+			XMVECTOR nonZero = XMVectorNotEqual(length, XMVectorZero());
+			XMVECTOR finite = XMVectorNotEqual(lengthSq, g_XMInfinity);
+			XMMATRIX tangents = XMMatrixTranspose(XMMATRIX(
+				XMVectorSelect(g_XMQNaN, XMVectorAndInt(XMVectorDivide(tx, length), nonZero), finite),
+				XMVectorSelect(g_XMQNaN, XMVectorAndInt(XMVectorDivide(ty, length), nonZero), finite),
+				XMVectorSelect(g_XMQNaN, XMVectorAndInt(XMVectorDivide(tz, length), nonZero), finite),
+				XMLoadFloat4((const XMFLOAT4*)sign)));
+
+			for (size_t lane = 0; lane < lanes; lane++)
+				XMStoreFloat4(&vertices[i + lane].Tangent, tangents.r[lane]);
+		}
+	});
+}
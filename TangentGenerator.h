@@ -0,0 +1,15 @@
+#pragma once
+#include "Vertex.h"
+#include <vector>
+
+/// <summary>
+/// <para>Builds per-vertex tangents four triangles or vertices at a time on SoA copies of the mesh</para>
+/// Uses the same per-triangle tangents, accumulation and Gram-Schmidt step as the Lengyel/Cascioli
+/// code it replaced, plus MikkTSpace's bitangent sign in w. A vertex whose triangles disagree on that
+/// sign, such as one on a mirrored uv seam, is split in two so each copy has one sign
+/// </summary>
+class TangentGenerator
+{
+public:
+	static void Generate(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int threadCount = 0);
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// Small helpers for splitting CPU work across threads
+// --------------------------------------------------------
+
+/// <summary>
+/// Run func(0) .. func(count - 1) as jobs on the shared JobSystem, on as many workers as are free, and wait for all of them
+/// </summary>
+template<typename Func>
+void RunOnThreads(unsigned int count, Func func)
+{
+	if (count <= 1)
+	{
+		func(0u);
+		return;
+	}
+	JobSystem::Shared().ParallelFor(count, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			func((unsigned int)i);
+	});
+}
+
+/// <returns>How many pieces to split work into, keeping at least minPerThread units of work in each, 0 asks for one per worker</returns>
+inline unsigned int PickThreadCount(unsigned int requested, size_t work, size_t minPerThread)
+{
+	unsigned int count = requested ? requested : JobSystem::Shared().GetThreadCount();
+	size_t useful = work / minPerThread;
+	if (useful < count) count = (unsigned int)(useful > 0 ? useful : 1);
+	return count;
+}
@@ -1,14 +1,76 @@
 #include "Transform.h"
 #include <iostream>
+#include <utility>
 
 using namespace DirectX;
 
-Transform::Transform() {
-	position = XMFLOAT3(0.0f, 0.0f, 0.0f);
-	XMStoreFloat4(&orientation, XMQuaternionIdentity());
-	scale = XMFLOAT3(1.0f, 1.0f, 1.0f);
-	XMStoreFloat4x4(&world, XMMatrixIdentity());
-	XMStoreFloat4x4(&worldInverseTranspose, XMMatrixIdentity());
+Transform::Transform() : Transform(TransformStore::Shared()) {
+}
+
+/// <summary>
+/// Make an identity transform in a particular store
+/// </summary>
+/// <param name="store">- where the transform's values and matrices are kept</param>
+Transform::Transform(TransformStore& store) {
+	this->store = &store;
+	slot = store.Add();
+}
+
+/// <summary>
+/// Copy another transform's values and matrices into a slot of our own
+/// </summary>
+Transform::Transform(const Transform& other) : Transform(*other.store) {
+	*this = other;
+}
+
+/// <summary>
+/// Take over another transform's slot, leaving it empty
+/// </summary>
+Transform::Transform(Transform&& other) noexcept {
+	store = other.store;
+	slot = other.slot;
+	other.store = 0;
+}
+
+Transform& Transform::operator=(const Transform& other)
+{
+	if (this == &other)
+		return *this;
+	TransformStore& to = *store;
+	const TransformStore& from = *other.store;
+	to.positionX[slot] = from.positionX[other.slot];
+	to.positionY[slot] = from.positionY[other.slot];
+	to.positionZ[slot] = from.positionZ[other.slot];
+	to.orientationX[slot] = from.orientationX[other.slot];
+	to.orientationY[slot] = from.orientationY[other.slot];
+	to.orientationZ[slot] = from.orientationZ[other.slot];
+	to.orientationW[slot] = from.orientationW[other.slot];
+	to.scaleX[slot] = from.scaleX[other.slot];
+	to.scaleY[slot] = from.scaleY[other.slot];
+	to.scaleZ[slot] = from.scaleZ[other.slot];
+	to.world[slot] = from.world[other.slot];
+	to.worldInverseTranspose[slot] = from.worldInverseTranspose[other.slot];
+	to.MarkDirty(slot);
+
+	// Same parent, but not the children, they stay with the original
+	if (store == other.store)
+		to.SetParent(slot, from.parents[other.slot]);
+	return *this;
+}
+
+Transform& Transform::operator=(Transform&& other) noexcept
+{
+	std::swap(store, other.store);
+	std::swap(slot, other.slot);
+	return *this;
+}
+
+/// <summary>
+/// Hand the slot back to the store
+/// </summary>
+Transform::~Transform() {
+	if (store)
+		store->Remove(slot);
 }
 
 /// <summary>
@@ -19,9 +81,10 @@ Transform::Transform() {
 /// <param name="z">The z coordinate of the new position</param>
 void Transform::SetPosition(float x, float y, float z)
 {
-	position.x = x;
-	position.y = y;
-	position.z = z;
+	store->positionX[slot] = x;
+	store->positionY[slot] = y;
+	store->positionZ[slot] = z;
+	store->MarkDirty(slot);
 }
 
 /// <summary>
@@ -32,7 +95,9 @@ void Transform::SetPosition(float x, float y, float z)
 /// <param name="roll">the roll of the new position</param>
 void Transform::SetOrientation(float pitch, float yaw, float roll)
 {
+	XMFLOAT4 orientation;
 	XMStoreFloat4(&orientation, XMQuaternionNormalize(XMQuaternionRotationRollPitchYaw(pitch, yaw, roll)));
+	SetOrientation(orientation);
 }
 
 /// <summary>
@@ -41,7 +106,11 @@ void Transform::SetOrientation(float pitch, float yaw, float roll)
 /// <param name="orientation">The new orientation</param>
 void Transform::SetOrientation(DirectX::XMFLOAT4 orientation)
 {
-	XMStoreFloat4(&this->orientation, XMLoadFloat4(&orientation));
+	store->orientationX[slot] = orientation.x;
+	store->orientationY[slot] = orientation.y;
+	store->orientationZ[slot] = orientation.z;
+	store->orientationW[slot] = orientation.w;
+	store->MarkDirty(slot);
 }
 
 /// <summary>
@@ -52,9 +121,10 @@ void Transform::SetOrientation(DirectX::XMFLOAT4 orientation)
 /// <param name="z">The z value of the new scale</param>
 void Transform::SetScale(float x, float y, float z)
 {
-	scale.x = x;
-	scale.y = y;
-	scale.z = z;
+	store->scaleX[slot] = x;
+	store->scaleY[slot] = y;
+	store->scaleZ[slot] = z;
+	store->MarkDirty(slot);
 }
 
 /// <summary>
@@ -63,7 +133,7 @@ void Transform::SetScale(float x, float y, float z)
 /// <returns>the entity's position</returns>
 DirectX::XMFLOAT3 Transform::GetPosition()
 {
-	return position;
+	return XMFLOAT3(store->positionX[slot], store->positionY[slot], store->positionZ[slot]);
 }
 
 /// <summary>
@@ -72,7 +142,7 @@ DirectX::XMFLOAT3 Transform::GetPosition()
 /// <returns>the entity's orientation</returns>
 DirectX::XMFLOAT4 Transform::GetOrientation()
 {
-	return orientation;
+	return XMFLOAT4(store->orientationX[slot], store->orientationY[slot], store->orientationZ[slot], store->orientationW[slot]);
 }
 
 /// <summary>
@@ -81,7 +151,7 @@ DirectX::XMFLOAT4 Transform::GetOrientation()
 /// <returns>the entity's scale</returns>
 DirectX::XMFLOAT3 Transform::GetScale()
 {
-	return scale;
+	return XMFLOAT3(store->scaleX[slot], store->scaleY[slot], store->scaleZ[slot]);
 }
 
 /// <summary>
@@ -90,7 +160,7 @@ DirectX::XMFLOAT3 Transform::GetScale()
 /// <returns>the entity's world matrix</returns>
 DirectX::XMFLOAT4X4 Transform::GetWorldMatrix()
 {
-	return world;
+	return store->world[slot];
 }
 
 /// <summary>
@@ -99,7 +169,7 @@ DirectX::XMFLOAT4X4 Transform::GetWorldMatrix()
 /// <returns>the inverse transpose version of the entity's world matrix</returns>
 DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
 {
-	return worldInverseTranspose;
+	return store->worldInverseTranspose[slot];
 }
 
 /// <summary>
@@ -110,9 +180,10 @@ DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
 /// <param name="z">how much to move the entity by in the z direction</param>
 void Transform::MoveAbsolute(float x, float y, float z)
 {
-	position.x += x;
-	position.y += y;
-	position.z += z;
+	store->positionX[slot] += x;
+	store->positionY[slot] += y;
+	store->positionZ[slot] += z;
+	store->MarkDirty(slot);
 }
 
 /// <summary>
@@ -125,14 +196,17 @@ void Transform::MoveRelative(float x, float y, float z)
 {
 	XMFLOAT3 eulers = XMFLOAT3(x, y, z);
 	XMVECTOR eulersCopy = XMLoadFloat3(&eulers);
+	XMFLOAT4 orientation = GetOrientation();
 	XMVECTOR quat = XMLoadFloat4(&orientation);
 	XMVECTOR eulersRotated = XMVector3Rotate(eulersCopy, quat);
-	XMVECTOR positionCopy = XMLoadFloat3(&this->position);
+	XMFLOAT3 position = GetPosition();
+	XMVECTOR positionCopy = XMLoadFloat3(&position);
 	//position = XMVectorAdd(eulersRotated, position);
 	//XMStoreFloat3(&this->position, position);
 	//eulersRotated += positionCopy;
 	XMVECTOR newPosition = eulersRotated + positionCopy;
-	XMStoreFloat3(&this->position, newPosition);
+	XMStoreFloat3(&position, newPosition);
+	SetPosition(position.x, position.y, position.z);
 }
 
 
@@ -144,17 +218,21 @@ void Transform::MoveRelative(float x, float y, float z)
 /// <param name="roll">how much to rotate the entity by in the z direction</param>
 void Transform::Rotate(float pitch, float yaw, float roll)
 {
+	XMFLOAT4 orientation = GetOrientation();
 	XMVECTOR orientationCopy = XMQuaternionNormalize(XMLoadFloat4(&orientation));
 	XMVECTOR rotQuat = XMQuaternionNormalize(XMQuaternionRotationRollPitchYaw(pitch, yaw, roll));
 	XMStoreFloat4(&orientation, XMQuaternionMultiply(rotQuat, orientationCopy));
+	SetOrientation(orientation);
 }
 
 void Transform::RotAx(DirectX::XMFLOAT3 axis, float angle)
 {
+	XMFLOAT4 orientation = GetOrientation();
 	XMVECTOR orientationMath = XMQuaternionNormalize(XMLoadFloat4(&orientation));
 	XMVECTOR axisMath = XMLoadFloat3(&axis);
 	XMVECTOR rotQuat = XMQuaternionNormalize(XMQuaternionRotationAxis(axisMath, angle));
 	XMStoreFloat4(&orientation, XMQuaternionNormalize(XMQuaternionMultiply(orientationMath, rotQuat)));
+	SetOrientation(orientation);
 }
 
 
@@ -166,9 +244,10 @@ void Transform::RotAx(DirectX::XMFLOAT3 axis, float angle)
 /// <param name="z">how much to scale the entity by in the z direction</param>
 void Transform::Scale(float x, float y, float z)
 {
-	scale.x += x;
-	scale.y += y;
-	scale.z += z;
+	store->scaleX[slot] += x;
+	store->scaleY[slot] += y;
+	store->scaleZ[slot] += z;
+	store->MarkDirty(slot);
 }
 
 /// <summary>
@@ -179,7 +258,8 @@ XMFLOAT3 Transform::GetRight()
 {
 	XMFLOAT3 worldRight = XMFLOAT3(1.0f, 0.0f, 0.0f);
 	XMVECTOR worldRightCopy = XMLoadFloat3(&worldRight);
-	XMVECTOR quat = XMLoadFloat4(&this->orientation);
+	XMFLOAT4 orientation = GetOrientation();
+	XMVECTOR quat = XMLoadFloat4(&orientation);
 	XMVECTOR worldRightCopyRotated = XMVector3Rotate(worldRightCopy, quat);
 	XMFLOAT3 relativeRight;
 	XMStoreFloat3(&relativeRight, worldRightCopyRotated);
@@ -194,7 +274,8 @@ XMFLOAT3 Transform::GetUp()
 {
 	XMFLOAT3 eulers = XMFLOAT3(0.0f, 1.0f, 0.0f);
 	XMVECTOR eulersCopy = XMLoadFloat3(&eulers);
-	XMVECTOR quat = XMLoadFloat4(&this->orientation);
+	XMFLOAT4 orientation = GetOrientation();
+	XMVECTOR quat = XMLoadFloat4(&orientation);
 	XMVECTOR eulersRotated = XMVector3Rotate(eulersCopy, quat);
 	XMFLOAT3 finalEulers;
 	XMStoreFloat3(&finalEulers, eulersRotated);
@@ -209,7 +290,8 @@ XMFLOAT3 Transform::GetForward()
 {
 	XMFLOAT3 eulers = XMFLOAT3(0.0f, 0.0f, 1.0f);
 	XMVECTOR eulersCopy = XMLoadFloat3(&eulers);
-	XMVECTOR quat = XMLoadFloat4(&this->orientation);
+	XMFLOAT4 orientation = GetOrientation();
+	XMVECTOR quat = XMLoadFloat4(&orientation);
 	XMVECTOR eulersRotated = XMVector3Rotate(eulersCopy, quat);
 	XMFLOAT3 finalEulers;
 	XMStoreFloat3(&finalEulers, eulersRotated);
@@ -217,14 +299,18 @@ XMFLOAT3 Transform::GetForward()
 }
 
 /// <summary>
-/// update entity's world matrix
+/// <para>update entity's world matrix</para>
+/// Only for a transform that needs its matrices right away, TransformStore::UpdateMatrices() does every transform at once and much faster
 /// </summary>
 void Transform::UpdateMatrices()
 {
+	XMFLOAT3 position = GetPosition();
 	XMMATRIX translation = XMMatrixTranslation(position.x, position.y, position.z);
+	XMFLOAT4 orientation = GetOrientation();
 	XMVECTOR orientationCopy = XMLoadFloat4(&orientation);
 	XMMATRIX rotation = XMMatrixRotationQuaternion(orientationCopy);//XMMatrixRotationQuaternion(orientationCopy);
-	XMMATRIX scale = XMMatrixScaling(this->scale.x, this->scale.y, this->scale.z);
+	XMFLOAT3 scaleValues = GetScale();
+	XMMATRIX scale = XMMatrixScaling(scaleValues.x, scaleValues.y, scaleValues.z);
 
 	// Overloaded operators are defined in the DirectX namespace
 	// Alternatively, you can call XMMatrixMultiply(XMMatrixMultiply(s,r), t)
@@ -235,6 +321,44 @@ void Transform::UpdateMatrices()
 	XMMATRIX world = scale * rotation * translation;
 	//XMMATRIX world = rotation  * scale * translation;
 
-	XMStoreFloat4x4(&this->world, world);
-	XMStoreFloat4x4(&worldInverseTranspose, XMMatrixInverse(0, XMMatrixTranspose(world)));
+	// Children are relative to their parent's matrices as they are right now
+	unsigned int parent = store->parents[slot];
+	if (parent != TRANSFORM_STORE_NONE)
+		world = world * XMLoadFloat4x4(&store->world[parent]);
+
+	XMStoreFloat4x4(&store->world[slot], world);
+	XMStoreFloat4x4(&store->worldInverseTranspose[slot], XMMatrixInverse(0, XMMatrixTranspose(world)));
+
+	// Counts as changed in the coming frame, a cache refreshed before then just refreshes once more
+	store->changedFrame[slot] = store->frame + 1;
+}
+
+/// <summary>
+/// Attach this transform to another one, its position, orientation and scale become relative to the parent's
+/// </summary>
+/// <param name="parent">- transform in the same store, 0 to detach</param>
+/// <returns>False if the parent is in another store, is this transform or is one of its children</returns>
+bool Transform::SetParent(Transform* parent)
+{
+	if (!parent)
+		return store->SetParent(slot, TRANSFORM_STORE_NONE);
+	if (parent->store != store)
+		return false;
+	return store->SetParent(slot, parent->slot);
+}
+
+/// <returns>The store's frame count, to hand back to HasChangedSince() later</returns>
+unsigned int Transform::GetFrame()
+{
+	return store->frame;
+}
+
+/// <summary>
+/// Check whether anything depending on this transform's matrices needs redoing
+/// </summary>
+/// <param name="frame">- GetFrame() from when the dependent data was last made</param>
+/// <returns>True if the matrices changed after that frame</returns>
+bool Transform::HasChangedSince(unsigned int frame)
+{
+	return store->changedFrame[slot] > frame;
 }
@@ -1,20 +1,25 @@
 #pragma once
 #include <DirectXMath.h>
+#include "TransformStore.h"
 
 /// <summary>
 /// <para>Transformation class</para>
-/// Gonna create a transformation hierarchy out of this class when I need to
+/// The values live in a TransformStore slot, copying a Transform copies them into a new slot.
+/// With a parent, position, orientation and scale are relative to it and the matrices are world space
 /// </summary>
 class Transform
 {
 private:
-	DirectX::XMFLOAT3 position;
-	DirectX::XMFLOAT4 orientation;
-	DirectX::XMFLOAT3 scale;
-	DirectX::XMFLOAT4X4 world;
-	DirectX::XMFLOAT4X4 worldInverseTranspose;
+	TransformStore* store;
+	unsigned int slot;
 public:
 	Transform();
+	Transform(TransformStore& store);
+	Transform(const Transform& other);
+	Transform(Transform&& other) noexcept;
+	Transform& operator=(const Transform& other);
+	Transform& operator=(Transform&& other) noexcept;
+	~Transform();
 	void SetPosition(float, float, float);
 	void SetOrientation(float, float, float);
 	void SetOrientation(DirectX::XMFLOAT4);
@@ -33,4 +38,7 @@ public:
 	DirectX::XMFLOAT3 GetUp();
 	DirectX::XMFLOAT3 GetForward();
 	void UpdateMatrices();
+	bool SetParent(Transform* parent);
+	unsigned int GetFrame();
+	bool HasChangedSince(unsigned int frame);
 };
\ No newline at end of file
@@ -0,0 +1,582 @@
+#include "TransformStore.h"
+#include "JobSystem.h"
+#ifdef _XM_AVX_INTRINSICS_
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+using namespace std;
+
+// Past this share of dirty groups, rebuilding every group is faster than skipping, reading straight through lets the prefetcher keep up
+#define TRANSFORM_STORE_DENSE_SHARE 0.25f
+// Scales closer to zero than this get a 0 in the inverse transpose instead of dividing by zero
+#define TRANSFORM_STORE_MIN_SCALE 1e-20f
+
+namespace
+{
+	/// <summary>
+	/// Four transforms at a time in XMVECTORs, works wherever DirectXMath does
+	/// </summary>
+	struct Lanes4
+	{
+		typedef XMVECTOR V;
+		static const size_t Width = 4;
+		static V Load(const float* p) { return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(p)); }
+		static V Splat(float f) { return XMVectorReplicate(f); }
+		static V Add(V a, V b) { return XMVectorAdd(a, b); }
+		static V Sub(V a, V b) { return XMVectorSubtract(a, b); }
+		static V Mul(V a, V b) { return XMVectorMultiply(a, b); }
+		static V InverseOrZero(V a)
+		{
+			XMVECTOR tiny = XMVectorLess(XMVectorAbs(a), XMVectorReplicate(TRANSFORM_STORE_MIN_SCALE));
+			return XMVectorSelect(XMVectorReciprocal(a), XMVectorZero(), tiny);
+		}
+
+		/// <summary>
+		/// Turn 16 vectors of one matrix element each into 4 whole matrices
+		/// </summary>
+		static void Store(const V* elements, XMFLOAT4X4* matrices)
+		{
+			for (int row = 0; row < 4; row++)
+			{
+				XMMATRIX rows = XMMatrixTranspose(XMMATRIX(elements[row * 4], elements[row * 4 + 1], elements[row * 4 + 2], elements[row * 4 + 3]));
+				for (int i = 0; i < 4; i++)
+					XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&matrices[i].m[row][0]), rows.r[i]);
+			}
+		}
+	};
+
+#ifdef _XM_AVX_INTRINSICS_
+	/// <summary>
+	/// Eight transforms at a time in AVX registers, only built when the compiler targets AVX
+	/// </summary>
+	struct Lanes8
+	{
+		typedef __m256 V;
+		static const size_t Width = 8;
+		static V Load(const float* p) { return _mm256_loadu_ps(p); }
+		static V Splat(float f) { return _mm256_set1_ps(f); }
+		static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V InverseOrZero(V a)
+		{
+			V magnitude = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+			V usable = _mm256_cmp_ps(magnitude, _mm256_set1_ps(TRANSFORM_STORE_MIN_SCALE), _CMP_GE_OQ);
+			return _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), a), usable);
+		}
+
+		/// <summary>
+		/// Swap rows and columns of an 8x8 block of floats
+		/// </summary>
+		static void Transpose(V* r)
+		{
+			V t0 = _mm256_unpacklo_ps(r[0], r[1]);
+			V t1 = _mm256_unpackhi_ps(r[0], r[1]);
+			V t2 = _mm256_unpacklo_ps(r[2], r[3]);
+			V t3 = _mm256_unpackhi_ps(r[2], r[3]);
+			V t4 = _mm256_unpacklo_ps(r[4], r[5]);
+			V t5 = _mm256_unpackhi_ps(r[4], r[5]);
+			V t6 = _mm256_unpacklo_ps(r[6], r[7]);
+			V t7 = _mm256_unpackhi_ps(r[6], r[7]);
+			V s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+			V s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			V s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			V s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+			V s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+			V s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+			V s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+			V s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+			r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+			r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+			r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+			r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+			r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+			r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+			r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+			r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+		}
+
+		/// <summary>
+		/// Turn 16 vectors of one matrix element each into 8 whole matrices, two rows per store
+		/// </summary>
+		static void Store(const V* elements, XMFLOAT4X4* matrices)
+		{
+			for (int half = 0; half < 2; half++)
+			{
+				V block[8];
+				for (int i = 0; i < 8; i++) block[i] = elements[half * 8 + i];
+				Transpose(block);
+				for (int i = 0; i < 8; i++)
+					_mm256_storeu_ps(&matrices[i].m[half * 2][0], block[i]);
+			}
+		}
+	};
+	typedef Lanes8 Lanes;
+#else
+	typedef Lanes4 Lanes;
+#endif
+
+	/// <summary>
+	/// <para>Build world and inverse transpose matrices for one group of transforms</para>
+	/// World is scale * rotation * translation, so its rows are the rotation's rows times the scale plus the
+	/// translation. That makes the inverse transpose the rotation's rows divided by the scale, with the
+	/// translation's projection onto them in the last column, with no general inverse needed. A zero scale
+	/// has no inverse, its rows of the inverse transpose are left zero rather than infinite
+	/// </summary>
+	template<typename L>
+	void UpdateGroup(const float* const* fields, size_t first, XMFLOAT4X4* world, XMFLOAT4X4* worldInverseTranspose)
+	{
+		typedef typename L::V V;
+		V tx = L::Load(fields[0] + first), ty = L::Load(fields[1] + first), tz = L::Load(fields[2] + first);
+		V qx = L::Load(fields[3] + first), qy = L::Load(fields[4] + first), qz = L::Load(fields[5] + first), qw = L::Load(fields[6] + first);
+		V sx = L::Load(fields[7] + first), sy = L::Load(fields[8] + first), sz = L::Load(fields[9] + first);
+
+		// Same rotation matrix XMMatrixRotationQuaternion makes
+		V two = L::Splat(2.0f), one = L::Splat(1.0f), zero = L::Splat(0.0f);
+		V x2 = L::Mul(qx, two), y2 = L::Mul(qy, two), z2 = L::Mul(qz, two);
+		V xx = L::Mul(qx, x2), yy = L::Mul(qy, y2), zz = L::Mul(qz, z2);
+		V xy = L::Mul(qx, y2), xz = L::Mul(qx, z2), yz = L::Mul(qy, z2);
+		V wx = L::Mul(qw, x2), wy = L::Mul(qw, y2), wz = L::Mul(qw, z2);
+		V r[3][3] =
+		{
+			{ L::Sub(one, L::Add(yy, zz)), L::Add(xy, wz), L::Sub(xz, wy) },
+			{ L::Sub(xy, wz), L::Sub(one, L::Add(xx, zz)), L::Add(yz, wx) },
+			{ L::Add(xz, wy), L::Sub(yz, wx), L::Sub(one, L::Add(xx, yy)) },
+		};
+		V s[3] = { sx, sy, sz };
+		V inverseS[3] = { L::InverseOrZero(sx), L::InverseOrZero(sy), L::InverseOrZero(sz) };
+		V t[3] = { tx, ty, tz };
+
+		V w[16], it[16];
+		for (int row = 0; row < 3; row++)
+		{
+			V along = L::Add(L::Add(L::Mul(r[row][0], tx), L::Mul(r[row][1], ty)), L::Mul(r[row][2], tz));
+			for (int col = 0; col < 3; col++)
+			{
+				w[row * 4 + col] = L::Mul(r[row][col], s[row]);
+				it[row * 4 + col] = L::Mul(r[row][col], inverseS[row]);
+			}
+			w[row * 4 + 3] = zero;
+			it[row * 4 + 3] = L::Mul(L::Sub(zero, along), inverseS[row]);
+			w[12 + row] = t[row];
+			it[12 + row] = zero;
+		}
+		w[15] = one;
+		it[15] = one;
+		L::Store(w, &world[first]);
+		L::Store(it, &worldInverseTranspose[first]);
+	}
+}
+
+namespace
+{
+	/// <summary>
+	/// Move the live entries of a node array to their new places, dropping the rest
+	/// </summary>
+	template<typename T>
+	void Permute(vector<T>& values, const vector<unsigned int>& newIndex, size_t newCount)
+	{
+		vector<T> moved(newCount);
+		for (size_t i = 0; i < newIndex.size(); i++)
+			if (newIndex[i] != TRANSFORM_STORE_NONE) moved[newIndex[i]] = values[i];
+		values.swap(moved);
+	}
+}
+
+/// <summary>
+/// An empty store, spreading its updates across the shared job system
+/// </summary>
+TransformStore::TransformStore() : jobs(&JobSystem::Shared()) {
+}
+
+/// <returns>The store every Transform lives in unless given another</returns>
+TransformStore& TransformStore::Shared()
+{
+	static TransformStore store;
+	return store;
+}
+
+/// <summary>
+/// Put a slot back to no translation, no rotation and a scale of 1
+/// </summary>
+void TransformStore::Reset(unsigned int slot)
+{
+	positionX[slot] = positionY[slot] = positionZ[slot] = 0;
+	orientationX[slot] = orientationY[slot] = orientationZ[slot] = 0;
+	orientationW[slot] = 1;
+	scaleX[slot] = scaleY[slot] = scaleZ[slot] = 1;
+	parents[slot] = TRANSFORM_STORE_NONE;
+	XMStoreFloat4x4(&world[slot], XMMatrixIdentity());
+	XMStoreFloat4x4(&worldInverseTranspose[slot], XMMatrixIdentity());
+}
+
+/// <summary>
+/// Queue a slot's matrices to be rebuilt by the next UpdateMatrices()
+/// </summary>
+void TransformStore::MarkDirty(unsigned int slot)
+{
+	if (dirty[slot])
+		return;
+	dirty[slot] = 1;
+	dirtyCount++;
+	unsigned char& group = dirtyGroups[slot / TRANSFORM_STORE_GROUP];
+	if (!group)
+	{
+		group = 1;
+		dirtyGroupCount++;
+	}
+}
+
+/// <summary>
+/// Make room for one more transform, reusing a removed one's slot if there is one
+/// </summary>
+/// <returns>The new slot, set to the identity transform</returns>
+unsigned int TransformStore::Add()
+{
+	if (freeSlots.empty())
+	{
+		// Grow by a whole group, the spare slots go on the free list
+		size_t count = positionX.size() + TRANSFORM_STORE_GROUP;
+		for (vector<float>* field : { &positionX, &positionY, &positionZ, &orientationX, &orientationY, &orientationZ, &orientationW, &scaleX, &scaleY, &scaleZ })
+			field->resize(count);
+		world.resize(count);
+		worldInverseTranspose.resize(count);
+		dirty.resize(count, 0);
+		changedFrame.resize(count, 0);
+		dirtyGroups.resize(count / TRANSFORM_STORE_GROUP, 0);
+		parents.resize(count, TRANSFORM_STORE_NONE);
+		nodes.resize(count, TRANSFORM_STORE_NONE);
+		for (size_t slot = count; slot-- > count - TRANSFORM_STORE_GROUP;)
+		{
+			Reset((unsigned int)slot);
+			freeSlots.push_back((unsigned int)slot);
+		}
+	}
+	unsigned int slot = freeSlots.back();
+	freeSlots.pop_back();
+
+	// New to whoever is watching for changes
+	MarkDirty(slot);
+	return slot;
+}
+
+/// <summary>
+/// Give a slot back, it stays an identity transform until it's reused
+/// </summary>
+/// <param name="slot">- from Add()</param>
+void TransformStore::Remove(unsigned int slot)
+{
+	// Children are left where their local values put them, as roots
+	if (nodes[slot] != TRANSFORM_STORE_NONE)
+	{
+		for (unsigned int child : nodeSlots)
+		{
+			if (parents[child] == slot)
+			{
+				parents[child] = TRANSFORM_STORE_NONE;
+				MarkDirty(child);
+			}
+		}
+		nodes[slot] = TRANSFORM_STORE_NONE;
+		hierarchyDirty = true;
+	}
+	Reset(slot);
+	freeSlots.push_back(slot);
+}
+
+/// <returns>Number of slots, used or not, always a whole number of groups</returns>
+size_t TransformStore::GetSlotCount()
+{
+	return positionX.size();
+}
+
+/// <summary>
+/// <para>Rebuild the matrices of every slot whose values changed since the last call, and start a new frame</para>
+/// Slots are rebuilt a whole group at a time, so a clean slot sharing a group with a dirty one is redone too,
+/// but only the dirty ones are reported as changed
+/// </summary>
+void TransformStore::UpdateMatrices()
+{
+	frame++;
+	changedSlots.clear();
+	if (hierarchyDirty)
+		SortHierarchy();
+	if (dirtyCount == 0)
+		return;
+
+	// Groups are walked in order rather than in the order they were dirtied, so memory is read front to back
+	const float* fields[] = { positionX.data(), positionY.data(), positionZ.data(),
+		orientationX.data(), orientationY.data(), orientationZ.data(), orientationW.data(), scaleX.data(), scaleY.data(), scaleZ.data() };
+	bool everyGroup = dirtyGroupCount > dirtyGroups.size() * TRANSFORM_STORE_DENSE_SHARE;
+	auto updateGroups = [&](size_t firstGroup, size_t lastGroup)
+	{
+		for (size_t group = firstGroup; group < lastGroup; group++)
+		{
+			if (!dirtyGroups[group] && !everyGroup)
+				continue;
+			size_t begin = group * TRANSFORM_STORE_GROUP;
+			for (size_t first = begin; first < begin + TRANSFORM_STORE_GROUP; first += Lanes::Width)
+				UpdateGroup<Lanes>(fields, first, world.data(), worldInverseTranspose.data());
+		}
+	};
+	if (jobs)
+		jobs->ParallelFor(dirtyGroups.size(), TRANSFORM_STORE_MIN_GROUPS_PER_JOB, updateGroups);
+	else
+		updateGroups(0, dirtyGroups.size());
+
+	// So far every slot holds its local matrices, nodes with a parent still need theirs composed in
+	if (!nodeSlots.empty())
+		PropagateHierarchy(everyGroup);
+
+	for (size_t group = 0; group < dirtyGroups.size(); group++)
+	{
+		if (!dirtyGroups[group])
+			continue;
+		dirtyGroups[group] = 0;
+		size_t begin = group * TRANSFORM_STORE_GROUP;
+		for (size_t slot = begin; slot < begin + TRANSFORM_STORE_GROUP; slot++)
+		{
+			if (!dirty[slot])
+				continue;
+			dirty[slot] = 0;
+			changedFrame[slot] = frame;
+			changedSlots.push_back((unsigned int)slot);
+		}
+	}
+	dirtyCount = 0;
+	dirtyGroupCount = 0;
+}
+
+/// <summary>
+/// Rebuild the matrices of every slot whether it changed or not, and start a new frame
+/// </summary>
+void TransformStore::UpdateAllMatrices()
+{
+	for (unsigned int slot = 0; slot < dirty.size(); slot++)
+		MarkDirty(slot);
+	UpdateMatrices();
+}
+
+/// <returns>How many updates have run, remember it and pass it to Transform::HasChangedSince() later</returns>
+unsigned int TransformStore::GetFrame()
+{
+	return frame;
+}
+
+/// <returns>Slots the last update rebuilt because their values changed, for caches that only want to redo those</returns>
+const vector<unsigned int>& TransformStore::GetChangedSlots()
+{
+	return changedSlots;
+}
+
+/// <summary>
+/// Give a slot a place in the node arrays, it's sorted into its level on the next update
+/// </summary>
+void TransformStore::AddNode(unsigned int slot)
+{
+	nodes[slot] = (unsigned int)nodeSlots.size();
+	nodeSlots.push_back(slot);
+	nodeParents.push_back(TRANSFORM_STORE_NONE);
+	nodeDepths.push_back(0);
+	nodeLocal.push_back(world[slot]);
+	nodeLocalInverseTranspose.push_back(worldInverseTranspose[slot]);
+	nodeWorld.push_back(world[slot]);
+	nodeWorldInverseTranspose.push_back(worldInverseTranspose[slot]);
+	nodeChanged.push_back(0);
+
+	// Its local matrices get captured by the next update
+	MarkDirty(slot);
+	hierarchyDirty = true;
+}
+
+/// <summary>
+/// <para>Put the nodes back in breadth-first order after they were added, removed or moved to another level</para>
+/// A stable counting sort by depth, so nodes that stayed on their level keep their order and the
+/// arrays are only moved around as much as the changes need, no comparison sort involved
+/// </summary>
+void TransformStore::SortHierarchy()
+{
+	hierarchyDirty = false;
+	size_t count = nodeSlots.size();
+
+	// Depth of every live node, walking up parent links and reusing every depth found on the way
+	vector<unsigned int> depths(count, TRANSFORM_STORE_NONE);
+	vector<unsigned int> chain;
+	unsigned int levelCount = 0;
+	for (size_t n = 0; n < count; n++)
+	{
+		if (nodes[nodeSlots[n]] != n || depths[n] != TRANSFORM_STORE_NONE)
+			continue;
+		chain.clear();
+		unsigned int m = (unsigned int)n;
+		while (m != TRANSFORM_STORE_NONE && depths[m] == TRANSFORM_STORE_NONE)
+		{
+			chain.push_back(m);
+			unsigned int parent = parents[nodeSlots[m]];
+			m = parent == TRANSFORM_STORE_NONE ? TRANSFORM_STORE_NONE : nodes[parent];
+		}
+		unsigned int depth = m == TRANSFORM_STORE_NONE ? 0 : depths[m] + 1;
+		for (size_t i = chain.size(); i-- > 0;)
+			depths[chain[i]] = depth++;
+		if (depth > levelCount) levelCount = depth;
+	}
+
+	levelStarts.assign(levelCount + 1, 0);
+	for (size_t n = 0; n < count; n++)
+		if (depths[n] != TRANSFORM_STORE_NONE) levelStarts[depths[n] + 1]++;
+	for (unsigned int level = 0; level < levelCount; level++)
+		levelStarts[level + 1] += levelStarts[level];
+	vector<unsigned int> cursor(levelStarts.begin(), levelStarts.end() - 1);
+	vector<unsigned int> newIndex(count, TRANSFORM_STORE_NONE);
+	for (size_t n = 0; n < count; n++)
+		if (depths[n] != TRANSFORM_STORE_NONE) newIndex[n] = cursor[depths[n]]++;
+
+	size_t liveCount = levelStarts[levelCount];
+	Permute(nodeSlots, newIndex, liveCount);
+	Permute(nodeLocal, newIndex, liveCount);
+	Permute(nodeLocalInverseTranspose, newIndex, liveCount);
+	Permute(nodeWorld, newIndex, liveCount);
+	Permute(nodeWorldInverseTranspose, newIndex, liveCount);
+	Permute(depths, newIndex, liveCount);
+	nodeDepths.swap(depths);
+	nodeChanged.assign(liveCount, 0);
+	nodeParents.resize(liveCount);
+	for (unsigned int n = 0; n < liveCount; n++)
+		nodes[nodeSlots[n]] = n;
+	for (unsigned int n = 0; n < liveCount; n++)
+	{
+		unsigned int parent = parents[nodeSlots[n]];
+		nodeParents[n] = parent == TRANSFORM_STORE_NONE ? TRANSFORM_STORE_NONE : nodes[parent];
+	}
+}
+
+/// <summary>
+/// Compose a run of nodes from one level into the world, their parents' levels already done
+/// </summary>
+void TransformStore::ComposeNodes(size_t first, size_t last, bool everyGroup)
+{
+	for (size_t n = first; n < last; n++)
+	{
+		unsigned int slot = nodeSlots[n];
+		bool own = dirty[slot] != 0;
+		if (own)
+		{
+			nodeLocal[n] = world[slot];
+			nodeLocalInverseTranspose[n] = worldInverseTranspose[slot];
+		}
+
+		// A moved parent moves everything under it
+		unsigned int parent = nodeParents[n];
+		bool changed = own || (parent != TRANSFORM_STORE_NONE && nodeChanged[parent]);
+		nodeChanged[n] = changed;
+
+		// A clean node still needs redoing if its group was rebuilt, that overwrote it with its local matrices
+		if (!changed && !everyGroup && !dirtyGroups[slot / TRANSFORM_STORE_GROUP])
+			continue;
+		if (parent == TRANSFORM_STORE_NONE)
+		{
+			nodeWorld[n] = nodeLocal[n];
+			nodeWorldInverseTranspose[n] = nodeLocalInverseTranspose[n];
+		}
+		else
+		{
+			// The inverse transpose of a product is the product of the inverse transposes, in the same order
+			XMStoreFloat4x4(&nodeWorld[n], XMMatrixMultiply(XMLoadFloat4x4(&nodeLocal[n]), XMLoadFloat4x4(&nodeWorld[parent])));
+			XMStoreFloat4x4(&nodeWorldInverseTranspose[n],
+				XMMatrixMultiply(XMLoadFloat4x4(&nodeLocalInverseTranspose[n]), XMLoadFloat4x4(&nodeWorldInverseTranspose[parent])));
+		}
+		world[slot] = nodeWorld[n];
+		worldInverseTranspose[slot] = nodeWorldInverseTranspose[n];
+		if (changed && !own)
+			changedFrame[slot] = frame;
+	}
+}
+
+/// <summary>
+/// Compose every node's world matrices level by level, splitting big levels into jobs
+/// </summary>
+/// <param name="everyGroup">- whether every group was just rebuilt rather than only the dirty ones</param>
+void TransformStore::PropagateHierarchy(bool everyGroup)
+{
+	for (size_t level = 0; level + 1 < levelStarts.size(); level++)
+	{
+		size_t begin = levelStarts[level];
+		size_t count = levelStarts[level + 1] - begin;
+		auto compose = [&](size_t first, size_t last) { ComposeNodes(begin + first, begin + last, everyGroup); };
+		if (jobs)
+			jobs->ParallelFor(count, TRANSFORM_HIERARCHY_MIN_PER_JOB, compose);
+		else
+			compose(0, count);
+	}
+
+	// Moved along with a parent, so changed even though they weren't dirty
+	for (size_t n = 0; n < nodeSlots.size(); n++)
+		if (nodeChanged[n] && !dirty[nodeSlots[n]]) changedSlots.push_back(nodeSlots[n]);
+}
+
+/// <summary>
+/// <para>Attach a slot to a parent, its position, orientation and scale become relative to the parent's</para>
+/// Moving a node to a parent on the same level as its old one only relinks it, anything else
+/// re-sorts the nodes on the next update
+/// </summary>
+/// <param name="slot">- the child</param>
+/// <param name="parent">- the new parent, TRANSFORM_STORE_NONE to detach</param>
+/// <returns>False if the parent is the slot itself or one of its descendants</returns>
+bool TransformStore::SetParent(unsigned int slot, unsigned int parent)
+{
+	for (unsigned int above = parent; above != TRANSFORM_STORE_NONE; above = parents[above])
+		if (above == slot) return false;
+	if (parents[slot] == parent)
+		return true;
+
+	parents[slot] = parent;
+	MarkDirty(slot);
+	if (parent != TRANSFORM_STORE_NONE && nodes[parent] == TRANSFORM_STORE_NONE)
+		AddNode(parent);
+	if (nodes[slot] == TRANSFORM_STORE_NONE)
+		AddNode(slot);
+	if (hierarchyDirty)
+		return true;
+
+	unsigned int node = nodes[slot];
+	unsigned int depth = parent == TRANSFORM_STORE_NONE ? 0 : nodeDepths[nodes[parent]] + 1;
+	if (depth == nodeDepths[node])
+		nodeParents[node] = parent == TRANSFORM_STORE_NONE ? TRANSFORM_STORE_NONE : nodes[parent];
+	else
+		hierarchyDirty = true;
+	return true;
+}
+
+/// <returns>The slot's parent, TRANSFORM_STORE_NONE if it has none</returns>
+unsigned int TransformStore::GetParent(unsigned int slot)
+{
+	return parents[slot];
+}
+
+/// <returns>Levels in the hierarchy as of the last update, 0 if no slot has a parent or children</returns>
+size_t TransformStore::GetLevelCount()
+{
+	return levelStarts.empty() ? 0 : levelStarts.size() - 1;
+}
+
+/// <summary>
+/// Pick the job system big updates and hierarchy levels are spread across
+/// </summary>
+/// <param name="jobs">- 0 to do everything on the thread calling UpdateMatrices()</param>
+void TransformStore::SetJobs(JobSystem* jobs)
+{
+	this->jobs = jobs;
+}
+
+/// <returns>World matrices by slot, valid until the next Add()</returns>
+const XMFLOAT4X4* TransformStore::GetWorldMatrices()
+{
+	return world.data();
+}
+
+/// <returns>Inverse transpose world matrices by slot, valid until the next Add()</returns>
+const XMFLOAT4X4* TransformStore::GetWorldInverseTransposeMatrices()
+{
+	return worldInverseTranspose.data();
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+
+// Slots are added this many at a time so the batched update never has a partial group to deal with
+#define TRANSFORM_STORE_GROUP 8
+// No parent, or not part of a hierarchy
+#define TRANSFORM_STORE_NONE 0xffffffffu
+// Fewest groups worth a job of their own when the update is spread across workers
+#define TRANSFORM_STORE_MIN_GROUPS_PER_JOB 256
+// Fewest nodes of one hierarchy level worth a job of their own
+#define TRANSFORM_HIERARCHY_MIN_PER_JOB 4096
+
+class JobSystem;
+
+/// <summary>
+/// <para>Every Transform's position, orientation, scale and matrices, kept as structure-of-arrays</para>
+/// One UpdateMatrices() call builds the world and inverse transpose matrices of every slot that changed,
+/// several transforms per SIMD instruction. Transforms are handles to a slot in here.
+/// Slots with a parent or children are also kept as hierarchy nodes, breadth-first, so parents' world
+/// matrices are composed into their children one whole level at a time
+/// </summary>
+class TransformStore
+{
+	friend class Transform;
+private:
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> orientationX, orientationY, orientationZ, orientationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	std::vector<DirectX::XMFLOAT4X4> world;
+	std::vector<DirectX::XMFLOAT4X4> worldInverseTranspose;
+	std::vector<unsigned int> freeSlots;
+	std::vector<unsigned char> dirty; // values changed since the matrices were built
+	std::vector<unsigned char> dirtyGroups; // any slot of the group is dirty
+	size_t dirtyCount = 0;
+	size_t dirtyGroupCount = 0;
+	std::vector<unsigned int> changedFrame; // frame each slot's matrices last changed on
+	std::vector<unsigned int> changedSlots; // slots the last UpdateMatrices() rebuilt
+	unsigned int frame = 0;
+
+	std::vector<unsigned int> parents; // by slot
+	std::vector<unsigned int> nodes; // by slot, where the slot is in the node arrays
+	std::vector<unsigned int> nodeSlots; // node arrays, breadth-first so each level is one run
+	std::vector<unsigned int> nodeParents;
+	std::vector<unsigned int> nodeDepths;
+	std::vector<DirectX::XMFLOAT4X4> nodeLocal, nodeLocalInverseTranspose;
+	std::vector<DirectX::XMFLOAT4X4> nodeWorld, nodeWorldInverseTranspose;
+	std::vector<unsigned char> nodeChanged;
+	std::vector<unsigned int> levelStarts; // first node of each level, then the node count
+	bool hierarchyDirty = false; // nodes were added, removed or moved to another level
+	JobSystem* jobs; // spreads updates across workers, 0 keeps them on the calling thread
+
+	void Reset(unsigned int slot);
+	void MarkDirty(unsigned int slot);
+	void AddNode(unsigned int slot);
+	void SortHierarchy();
+	void ComposeNodes(size_t first, size_t last, bool everyGroup);
+	void PropagateHierarchy(bool everyGroup);
+public:
+	TransformStore();
+	static TransformStore& Shared();
+	unsigned int Add();
+	void Remove(unsigned int slot);
+	size_t GetSlotCount();
+	void UpdateMatrices();
+	void UpdateAllMatrices();
+	unsigned int GetFrame();
+	const std::vector<unsigned int>& GetChangedSlots();
+	bool SetParent(unsigned int slot, unsigned int parent);
+	unsigned int GetParent(unsigned int slot);
+	size_t GetLevelCount();
+	void SetJobs(JobSystem* jobs);
+	const DirectX::XMFLOAT4X4* GetWorldMatrices();
+	const DirectX::XMFLOAT4X4* GetWorldInverseTransposeMatrices();
+};
@@ -0,0 +1,629 @@
+#include "TriangleBvh.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#ifdef _XM_AVX_INTRINSICS_
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	/// <summary>
+	/// Four rays at a time in DirectXMath's vectors
+	/// </summary>
+	struct Lanes4
+	{
+		typedef XMVECTOR V;
+		static const size_t Width = 4;
+		static V Load(const float* p) { return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(p)); }
+		static void Store(float* p, V v) { XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(p), v); }
+		static V Splat(float f) { return XMVectorReplicate(f); }
+		static V Add(V a, V b) { return XMVectorAdd(a, b); }
+		static V Sub(V a, V b) { return XMVectorSubtract(a, b); }
+		static V Mul(V a, V b) { return XMVectorMultiply(a, b); }
+		static V Div(V a, V b) { return XMVectorDivide(a, b); }
+		static V Min(V a, V b) { return XMVectorMin(a, b); }
+		static V Max(V a, V b) { return XMVectorMax(a, b); }
+		static V Less(V a, V b) { return XMVectorLess(a, b); }
+		static V LessEqual(V a, V b) { return XMVectorLessOrEqual(a, b); }
+		static V GreaterEqual(V a, V b) { return XMVectorGreaterOrEqual(a, b); }
+		static V And(V a, V b) { return XMVectorAndInt(a, b); }
+		static V Select(V a, V b, V control) { return XMVectorSelect(a, b, control); } // b where control is set
+
+		/// <returns>One bit per lane whose comparison came out true, lane 0 in bit 0</returns>
+		static unsigned int Mask(V v)
+		{
+#ifdef _XM_SSE_INTRINSICS_
+			return (unsigned int)_mm_movemask_ps(v);
+#else
+			uint32_t lanes[4];
+			XMStoreInt4(lanes, v);
+			return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+#endif
+		}
+	};
+
+#ifdef _XM_AVX_INTRINSICS_
+	/// <summary>
+	/// Eight rays at a time in AVX registers, only built when the compiler targets AVX
+	/// </summary>
+	struct Lanes8
+	{
+		typedef __m256 V;
+		static const size_t Width = 8;
+		static V Load(const float* p) { return _mm256_loadu_ps(p); }
+		static void Store(float* p, V v) { _mm256_storeu_ps(p, v); }
+		static V Splat(float f) { return _mm256_set1_ps(f); }
+		static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+		static V Min(V a, V b) { return _mm256_min_ps(a, b); }
+		static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+		static V Less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static V LessEqual(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static V GreaterEqual(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static V And(V a, V b) { return _mm256_and_ps(a, b); }
+		static V Select(V a, V b, V control) { return _mm256_blendv_ps(a, b, control); }
+		static unsigned int Mask(V v) { return (unsigned int)_mm256_movemask_ps(v); }
+	};
+	typedef Lanes8 Lanes;
+#else
+	typedef Lanes4 Lanes;
+#endif
+
+	/// <summary>
+	/// A ray per lane, with how far each has to look. Lanes that are done, or were never used, look no further than -1
+	/// </summary>
+	template<typename L>
+	struct Packet
+	{
+		typedef L LaneOps;
+		typename L::V originX, originY, originZ;
+		typename L::V directionX, directionY, directionZ;
+		typename L::V inverseX, inverseY, inverseZ;
+		typename L::V distance; // to the nearest hit so far, or the end of the ray
+		unsigned int triangle[L::Width]; // nearest hit so far, BVH_NO_ITEM if none
+		bool anyHit; // lanes stop at the first thing they hit
+	};
+
+	inline unsigned int CountBits(unsigned int bits)
+	{
+		unsigned int count = 0;
+		for (; bits; bits &= bits - 1)
+			count++;
+		return count;
+	}
+
+	inline XMFLOAT3 Inverse(const XMFLOAT3& direction)
+	{
+		return XMFLOAT3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	}
+
+	// Compares rather than fminf/fmaxf, which are calls that handle NaNs, so single rays take the same sides as the packets' min/max
+	inline float Min(float a, float b) { return a < b ? a : b; }
+	inline float Max(float a, float b) { return a > b ? a : b; }
+
+	/// <summary>
+	/// Slab test, with the ray's direction already inverted. Axes the ray runs parallel to come out as infinities
+	/// </summary>
+	/// <param name="enter">- output, how far along the ray it enters the box, 0 if it starts inside</param>
+	/// <returns>Whether the ray enters the box before maxDistance</returns>
+	inline bool RayHitsBox(const XMFLOAT3& origin, const XMFLOAT3& inverse, float maxDistance, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, float& enter)
+	{
+		float x1 = (boxMin.x - origin.x) * inverse.x, x2 = (boxMax.x - origin.x) * inverse.x;
+		float y1 = (boxMin.y - origin.y) * inverse.y, y2 = (boxMax.y - origin.y) * inverse.y;
+		float z1 = (boxMin.z - origin.z) * inverse.z, z2 = (boxMax.z - origin.z) * inverse.z;
+		float entry = Max(Max(Min(x1, x2), Min(y1, y2)), Max(Min(z1, z2), 0.0f));
+		float exit = Min(Min(Max(x1, x2), Max(y1, y2)), Min(Max(z1, z2), maxDistance));
+		enter = entry;
+		return entry <= exit;
+	}
+
+	/// <summary>
+	/// Moller-Trumbore, both faces count. Rays parallel to the triangle divide by zero and fail every comparison
+	/// </summary>
+	/// <param name="distance">- output, where the ray meets the triangle's plane</param>
+	/// <returns>Whether the ray hits the triangle before maxDistance</returns>
+	inline bool RayHitsTriangle(const XMFLOAT3& origin, const XMFLOAT3& direction, const XMFLOAT3& corner, const XMFLOAT3& edge1, const XMFLOAT3& edge2,
+		float maxDistance, float& distance)
+	{
+		float px = direction.y * edge2.z - direction.z * edge2.y;
+		float py = direction.z * edge2.x - direction.x * edge2.z;
+		float pz = direction.x * edge2.y - direction.y * edge2.x;
+		float inverseDet = 1.0f / (edge1.x * px + edge1.y * py + edge1.z * pz);
+		float sx = origin.x - corner.x, sy = origin.y - corner.y, sz = origin.z - corner.z;
+		float u = (sx * px + sy * py + sz * pz) * inverseDet;
+		float qx = sy * edge1.z - sz * edge1.y;
+		float qy = sz * edge1.x - sx * edge1.z;
+		float qz = sx * edge1.y - sy * edge1.x;
+		float v = (direction.x * qx + direction.y * qy + direction.z * qz) * inverseDet;
+		distance = (edge2.x * qx + edge2.y * qy + edge2.z * qz) * inverseDet;
+		return u >= 0 && v >= 0 && u + v <= 1 && distance >= 0 && distance < maxDistance;
+	}
+
+	/// <summary>
+	/// Walk a flattened tree nearest child first, calling leaf(node) for each leaf the ray reaches before distance
+	/// </summary>
+	/// <param name="distance">- how far to look, leaf() can bring it nearer as it finds things</param>
+	template<typename Leaf>
+	void WalkRay(const vector<BvhNode>& nodes, const XMFLOAT3& origin, const XMFLOAT3& inverse, const float& distance, Leaf leaf)
+	{
+		float enter;
+		if (nodes.empty() || !RayHitsBox(origin, inverse, distance, nodes[0].boxMin, nodes[0].boxMax, enter))
+			return;
+		struct Entry { unsigned int node; float enter; };
+		Entry stack[BVH_STACK_SIZE];
+		int top = 0;
+		stack[top++] = { 0, enter };
+		while (top > 0)
+		{
+			Entry entry = stack[--top];
+			if (entry.enter > distance)
+				continue;
+			const BvhNode& node = nodes[entry.node];
+			if (node.count)
+			{
+				leaf(node);
+				continue;
+			}
+
+			float firstEnter, secondEnter;
+			bool first = RayHitsBox(origin, inverse, distance, nodes[entry.node + 1].boxMin, nodes[entry.node + 1].boxMax, firstEnter);
+			bool second = RayHitsBox(origin, inverse, distance, nodes[node.index].boxMin, nodes[node.index].boxMax, secondEnter);
+			if (first && second)
+			{
+				// Nearer child on top so it's walked first
+				if (firstEnter <= secondEnter)
+				{
+					stack[top++] = { node.index, secondEnter };
+					stack[top++] = { entry.node + 1, firstEnter };
+				}
+				else
+				{
+					stack[top++] = { entry.node + 1, firstEnter };
+					stack[top++] = { node.index, secondEnter };
+				}
+			}
+			else if (first)
+				stack[top++] = { entry.node + 1, firstEnter };
+			else if (second)
+				stack[top++] = { node.index, secondEnter };
+		}
+	}
+
+	/// <summary>
+	/// The slab test for every lane at once
+	/// </summary>
+	/// <param name="enter">- output, where each lane enters the box, infinity for lanes that miss</param>
+	/// <returns>One bit per lane that enters the box before its distance</returns>
+	template<typename L>
+	unsigned int HitBox(const Packet<L>& packet, const BvhNode& node, typename L::V& enter)
+	{
+		typedef typename L::V V;
+		V x1 = L::Mul(L::Sub(L::Splat(node.boxMin.x), packet.originX), packet.inverseX);
+		V x2 = L::Mul(L::Sub(L::Splat(node.boxMax.x), packet.originX), packet.inverseX);
+		V y1 = L::Mul(L::Sub(L::Splat(node.boxMin.y), packet.originY), packet.inverseY);
+		V y2 = L::Mul(L::Sub(L::Splat(node.boxMax.y), packet.originY), packet.inverseY);
+		V z1 = L::Mul(L::Sub(L::Splat(node.boxMin.z), packet.originZ), packet.inverseZ);
+		V z2 = L::Mul(L::Sub(L::Splat(node.boxMax.z), packet.originZ), packet.inverseZ);
+		V entry = L::Max(L::Max(L::Min(x1, x2), L::Min(y1, y2)), L::Max(L::Min(z1, z2), L::Splat(0.0f)));
+		V exit = L::Min(L::Min(L::Max(x1, x2), L::Max(y1, y2)), L::Min(L::Max(z1, z2), packet.distance));
+		V hit = L::LessEqual(entry, exit);
+		enter = L::Select(L::Splat(numeric_limits<float>::infinity()), entry, hit);
+		return L::Mask(hit);
+	}
+
+	/// <summary>
+	/// Moller-Trumbore for every lane at once, the same sums as RayHitsTriangle() in the same order
+	/// </summary>
+	template<typename L>
+	void HitTriangle(Packet<L>& packet, const XMFLOAT3& corner, const XMFLOAT3& edge1, const XMFLOAT3& edge2, unsigned int index)
+	{
+		typedef typename L::V V;
+		V e1x = L::Splat(edge1.x), e1y = L::Splat(edge1.y), e1z = L::Splat(edge1.z);
+		V e2x = L::Splat(edge2.x), e2y = L::Splat(edge2.y), e2z = L::Splat(edge2.z);
+		V px = L::Sub(L::Mul(packet.directionY, e2z), L::Mul(packet.directionZ, e2y));
+		V py = L::Sub(L::Mul(packet.directionZ, e2x), L::Mul(packet.directionX, e2z));
+		V pz = L::Sub(L::Mul(packet.directionX, e2y), L::Mul(packet.directionY, e2x));
+		V inverseDet = L::Div(L::Splat(1.0f), L::Add(L::Add(L::Mul(e1x, px), L::Mul(e1y, py)), L::Mul(e1z, pz)));
+		V sx = L::Sub(packet.originX, L::Splat(corner.x));
+		V sy = L::Sub(packet.originY, L::Splat(corner.y));
+		V sz = L::Sub(packet.originZ, L::Splat(corner.z));
+		V u = L::Mul(L::Add(L::Add(L::Mul(sx, px), L::Mul(sy, py)), L::Mul(sz, pz)), inverseDet);
+		V qx = L::Sub(L::Mul(sy, e1z), L::Mul(sz, e1y));
+		V qy = L::Sub(L::Mul(sz, e1x), L::Mul(sx, e1z));
+		V qz = L::Sub(L::Mul(sx, e1y), L::Mul(sy, e1x));
+		V v = L::Mul(L::Add(L::Add(L::Mul(packet.directionX, qx), L::Mul(packet.directionY, qy)), L::Mul(packet.directionZ, qz)), inverseDet);
+		V distance = L::Mul(L::Add(L::Add(L::Mul(e2x, qx), L::Mul(e2y, qy)), L::Mul(e2z, qz)), inverseDet);
+
+		V zero = L::Splat(0.0f);
+		V hit = L::And(L::And(L::GreaterEqual(u, zero), L::GreaterEqual(v, zero)),
+			L::And(L::LessEqual(L::Add(u, v), L::Splat(1.0f)), L::And(L::GreaterEqual(distance, zero), L::Less(distance, packet.distance))));
+		unsigned int lanes = L::Mask(hit);
+		if (!lanes)
+			return;
+		packet.distance = L::Select(packet.distance, packet.anyHit ? L::Splat(-1.0f) : distance, hit);
+		for (size_t lane = 0; lane < L::Width; lane++)
+			if ((lanes >> lane) & 1)
+				packet.triangle[lane] = index;
+	}
+
+	/// <summary>
+	/// <para>Walk a flattened tree with a whole packet, calling leaf(node) for each leaf any lane reaches before its distance</para>
+	/// A node is walked while any lane still reaches it, children in the order most of the packet enters them
+	/// </summary>
+	template<typename L, typename Leaf>
+	void WalkPacket(const vector<BvhNode>& nodes, Packet<L>& packet, Leaf leaf)
+	{
+		typedef typename L::V V;
+		V enter;
+		if (nodes.empty() || !HitBox(packet, nodes[0], enter))
+			return;
+		struct Entry { V enter; unsigned int node; };
+		Entry stack[BVH_STACK_SIZE];
+		int top = 0;
+		stack[top++] = { enter, 0 };
+		while (top > 0)
+		{
+			Entry entry = stack[--top];
+			if (!L::Mask(L::LessEqual(entry.enter, packet.distance)))
+				continue;
+			const BvhNode& node = nodes[entry.node];
+			if (node.count)
+			{
+				leaf(node);
+				continue;
+			}
+
+			V firstEnter, secondEnter;
+			unsigned int first = HitBox(packet, nodes[entry.node + 1], firstEnter);
+			unsigned int second = HitBox(packet, nodes[node.index], secondEnter);
+			if (first && second)
+			{
+				unsigned int both = first & second;
+				unsigned int firstNearer = L::Mask(L::Less(firstEnter, secondEnter)) & both;
+				bool firstFirst = both ? CountBits(firstNearer) * 2 >= CountBits(both) : CountBits(first) >= CountBits(second);
+				if (firstFirst)
+				{
+					stack[top++] = { secondEnter, node.index };
+					stack[top++] = { firstEnter, entry.node + 1 };
+				}
+				else
+				{
+					stack[top++] = { firstEnter, entry.node + 1 };
+					stack[top++] = { secondEnter, node.index };
+				}
+			}
+			else if (first)
+				stack[top++] = { firstEnter, entry.node + 1 };
+			else if (second)
+				stack[top++] = { secondEnter, node.index };
+		}
+	}
+
+	/// <summary>
+	/// Gather up to a packet of rays into lanes, lanes past the last ray copy it so they follow the same path but look no distance
+	/// </summary>
+	template<typename L>
+	Packet<L> LoadPacket(const BvhRay* rays, size_t count, bool anyHit)
+	{
+		float ox[L::Width], oy[L::Width], oz[L::Width], dx[L::Width], dy[L::Width], dz[L::Width], distance[L::Width];
+		Packet<L> packet;
+		for (size_t lane = 0; lane < L::Width; lane++)
+		{
+			const BvhRay& ray = rays[min(lane, count - 1)];
+			ox[lane] = ray.origin.x, oy[lane] = ray.origin.y, oz[lane] = ray.origin.z;
+			dx[lane] = ray.direction.x, dy[lane] = ray.direction.y, dz[lane] = ray.direction.z;
+			distance[lane] = lane < count ? ray.maxDistance : -1.0f;
+			packet.triangle[lane] = BVH_NO_ITEM;
+		}
+		packet.originX = L::Load(ox), packet.originY = L::Load(oy), packet.originZ = L::Load(oz);
+		packet.directionX = L::Load(dx), packet.directionY = L::Load(dy), packet.directionZ = L::Load(dz);
+		typename L::V one = L::Splat(1.0f);
+		packet.inverseX = L::Div(one, packet.directionX);
+		packet.inverseY = L::Div(one, packet.directionY);
+		packet.inverseZ = L::Div(one, packet.directionZ);
+		packet.distance = L::Load(distance);
+		packet.anyHit = anyHit;
+		return packet;
+	}
+
+	/// <summary>
+	/// The same packet moved into an object's space. Distances are in multiples of the direction, so they carry over unchanged
+	/// </summary>
+	template<typename L>
+	Packet<L> ToObject(const Packet<L>& packet, const XMFLOAT4X4& m)
+	{
+		typedef typename L::V V;
+		Packet<L> local = packet;
+		auto transform = [&](V x, V y, V z, int column, bool point)
+		{
+			V result = L::Add(L::Add(L::Mul(x, L::Splat(m.m[0][column])), L::Mul(y, L::Splat(m.m[1][column]))), L::Mul(z, L::Splat(m.m[2][column])));
+			return point ? L::Add(result, L::Splat(m.m[3][column])) : result;
+		};
+		local.originX = transform(packet.originX, packet.originY, packet.originZ, 0, true);
+		local.originY = transform(packet.originX, packet.originY, packet.originZ, 1, true);
+		local.originZ = transform(packet.originX, packet.originY, packet.originZ, 2, true);
+		local.directionX = transform(packet.directionX, packet.directionY, packet.directionZ, 0, false);
+		local.directionY = transform(packet.directionX, packet.directionY, packet.directionZ, 1, false);
+		local.directionZ = transform(packet.directionX, packet.directionY, packet.directionZ, 2, false);
+		V one = L::Splat(1.0f);
+		local.inverseX = L::Div(one, local.directionX);
+		local.inverseY = L::Div(one, local.directionY);
+		local.inverseZ = L::Div(one, local.directionZ);
+		return local;
+	}
+
+	/// <summary>
+	/// One ray moved into an object's space, the same sums in the same order as the packet version so both find the same hits
+	/// </summary>
+	inline BvhRay ToObject(const BvhRay& ray, const XMFLOAT4X4& m)
+	{
+		const XMFLOAT3& o = ray.origin;
+		const XMFLOAT3& d = ray.direction;
+		BvhRay local = ray;
+		local.origin.x = o.x * m.m[0][0] + o.y * m.m[1][0] + o.z * m.m[2][0] + m.m[3][0];
+		local.origin.y = o.x * m.m[0][1] + o.y * m.m[1][1] + o.z * m.m[2][1] + m.m[3][1];
+		local.origin.z = o.x * m.m[0][2] + o.y * m.m[1][2] + o.z * m.m[2][2] + m.m[3][2];
+		local.direction.x = d.x * m.m[0][0] + d.y * m.m[1][0] + d.z * m.m[2][0];
+		local.direction.y = d.x * m.m[0][1] + d.y * m.m[1][1] + d.z * m.m[2][1];
+		local.direction.z = d.x * m.m[0][2] + d.y * m.m[1][2] + d.z * m.m[2][2];
+		return local;
+	}
+
+	/// <summary>
+	/// Split rays into packets and trace(packet, firstRay, rayCount) each, spread over the job system
+	/// </summary>
+	template<typename L, typename Trace>
+	void TraceBatch(const BvhRay* rays, size_t count, bool anyHit, JobSystem* jobs, Trace trace)
+	{
+		size_t packets = (count + L::Width - 1) / L::Width;
+		auto tracePackets = [&](size_t begin, size_t end)
+		{
+			for (size_t p = begin; p < end; p++)
+			{
+				size_t first = p * L::Width;
+				size_t lanes = min(L::Width, count - first);
+				Packet<L> packet = LoadPacket<L>(rays + first, lanes, anyHit);
+				trace(packet, first, lanes);
+			}
+		};
+		if (jobs)
+			jobs->ParallelFor(packets, TRIANGLE_BVH_PACKETS_PER_JOB, tracePackets);
+		else
+			tracePackets(0, packets);
+	}
+}
+
+/// <summary>
+/// Build the tree over a mesh's triangles
+/// </summary>
+/// <param name="indices">- three per triangle, a triangle's number is its first index over three</param>
+void TriangleBvh::Build(const Vertex* vertices, const unsigned int* indices, size_t indexCount)
+{
+	size_t count = indexCount / 3;
+	vector<Bounds> bounds(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		XMVECTOR a = XMLoadFloat3(&vertices[indices[i * 3]].Position);
+		XMVECTOR b = XMLoadFloat3(&vertices[indices[i * 3 + 1]].Position);
+		XMVECTOR c = XMLoadFloat3(&vertices[indices[i * 3 + 2]].Position);
+		XMStoreFloat3(&bounds[i].boxMin, XMVectorMin(XMVectorMin(a, b), c));
+		XMStoreFloat3(&bounds[i].boxMax, XMVectorMax(XMVectorMax(a, b), c));
+	}
+
+	// Bvh puts the triangles in slots, then they're copied out in that order so a leaf reads its triangles in a row
+	Bvh bvh;
+	bvh.Build(bounds.data(), count);
+	nodes = bvh.GetNodes();
+	triangleIndices = bvh.GetItems();
+	triangles.resize(count);
+	for (size_t slot = 0; slot < count; slot++)
+	{
+		const unsigned int* corners = indices + triangleIndices[slot] * 3;
+		XMVECTOR corner = XMLoadFloat3(&vertices[corners[0]].Position);
+		XMStoreFloat3(&triangles[slot].corner, corner);
+		XMStoreFloat3(&triangles[slot].edge1, XMVectorSubtract(XMLoadFloat3(&vertices[corners[1]].Position), corner));
+		XMStoreFloat3(&triangles[slot].edge2, XMVectorSubtract(XMLoadFloat3(&vertices[corners[2]].Position), corner));
+	}
+}
+
+/// <summary>
+/// Take a tree built earlier, like one stored in a MeshCache, instead of building it again
+/// </summary>
+/// <param name="nodes">- GetNodes() of the built tree</param>
+/// <param name="triangles">- GetTriangles(), in slot order</param>
+/// <param name="triangleIndices">- GetTriangleIndices(), one per triangle</param>
+void TriangleBvh::Load(const BvhNode* nodes, size_t nodeCount, const Triangle* triangles, const unsigned int* triangleIndices, size_t triangleCount)
+{
+	this->nodes.assign(nodes, nodes + nodeCount);
+	this->triangles.assign(triangles, triangles + triangleCount);
+	this->triangleIndices.assign(triangleIndices, triangleIndices + triangleCount);
+}
+
+template<typename Packet>
+void TriangleBvh::Trace(Packet& packet) const
+{
+	WalkPacket(nodes, packet, [&](const BvhNode& leaf)
+	{
+		for (unsigned int slot = leaf.index; slot < leaf.index + leaf.count; slot++)
+			HitTriangle(packet, triangles[slot].corner, triangles[slot].edge1, triangles[slot].edge2, triangleIndices[slot]);
+	});
+}
+
+/// <summary>
+/// Walk the scene's tree with a packet and, for every target a lane reaches, the target's triangles with the packet moved into its space
+/// </summary>
+/// <param name="hitTargets">- output, the target each lane's nearest hit is on, only written for lanes that hit something</param>
+template<typename Packet>
+void TriangleBvh::TraceScene(const Bvh& scene, const RayTarget* targets, Packet& packet, unsigned int* hitTargets)
+{
+	typedef typename Packet::LaneOps L;
+	const vector<unsigned int>& items = scene.GetItems();
+	WalkPacket(scene.GetNodes(), packet, [&](const BvhNode& leaf)
+	{
+		for (unsigned int slot = leaf.index; slot < leaf.index + leaf.count; slot++)
+		{
+			const RayTarget& target = targets[items[slot]];
+			if (!target.triangles)
+				continue;
+			Packet local = ToObject(packet, target.worldToObject);
+			target.triangles->Trace(local);
+			typename L::V nearer = L::Less(local.distance, packet.distance);
+			unsigned int lanes = L::Mask(nearer);
+			if (!lanes)
+				continue;
+			packet.distance = L::Select(packet.distance, local.distance, nearer);
+			for (size_t lane = 0; lane < L::Width; lane++)
+			{
+				if ((lanes >> lane) & 1)
+				{
+					packet.triangle[lane] = local.triangle[lane];
+					hitTargets[lane] = items[slot];
+				}
+			}
+		}
+	});
+}
+
+/// <summary>
+/// The nearest triangle a ray hits, one ray on its own. Batches of rays go faster through the other Raycast()
+/// </summary>
+/// <returns>The triangle and how far along the ray it is, or BVH_NO_ITEM and the ray's maxDistance</returns>
+BvhHit TriangleBvh::Raycast(const BvhRay& ray) const
+{
+	BvhHit hit = { BVH_NO_ITEM, ray.maxDistance };
+	XMFLOAT3 inverse = Inverse(ray.direction);
+	WalkRay(nodes, ray.origin, inverse, hit.distance, [&](const BvhNode& leaf)
+	{
+		for (unsigned int slot = leaf.index; slot < leaf.index + leaf.count; slot++)
+		{
+			float distance;
+			const Triangle& triangle = triangles[slot];
+			if (RayHitsTriangle(ray.origin, ray.direction, triangle.corner, triangle.edge1, triangle.edge2, hit.distance, distance))
+			{
+				hit.item = triangleIndices[slot];
+				hit.distance = distance;
+			}
+		}
+	});
+	return hit;
+}
+
+/// <summary>
+/// <para>The nearest triangle each of many rays hits, traced a packet of neighbouring rays at a time</para>
+/// Packets go fastest when their rays start close together and head the same way, like a block of pixels' rays
+/// </summary>
+/// <param name="hits">- output, one per ray</param>
+/// <param name="jobs">- optional, 0 traces every ray on the calling thread</param>
+void TriangleBvh::Raycast(const BvhRay* rays, size_t count, BvhHit* hits, JobSystem* jobs) const
+{
+	TraceBatch<Lanes>(rays, count, false, jobs, [&](Packet<Lanes>& packet, size_t first, size_t lanes)
+	{
+		Trace(packet);
+		float distances[Lanes::Width];
+		Lanes::Store(distances, packet.distance);
+		for (size_t lane = 0; lane < lanes; lane++)
+			hits[first + lane] = { packet.triangle[lane], distances[lane] };
+	});
+}
+
+/// <summary>
+/// The nearest triangle of any target a ray hits, like picking what's under the cursor
+/// </summary>
+/// <param name="scene">- over the targets' world bounds, its items index targets</param>
+RayHit TriangleBvh::RaycastScene(const Bvh& scene, const RayTarget* targets, const BvhRay& ray)
+{
+	RayHit hit = { BVH_NO_ITEM, BVH_NO_ITEM, ray.maxDistance };
+	const vector<unsigned int>& items = scene.GetItems();
+	WalkRay(scene.GetNodes(), ray.origin, Inverse(ray.direction), hit.distance, [&](const BvhNode& leaf)
+	{
+		for (unsigned int slot = leaf.index; slot < leaf.index + leaf.count; slot++)
+		{
+			const RayTarget& target = targets[items[slot]];
+			if (!target.triangles)
+				continue;
+			BvhRay local = ToObject(ray, target.worldToObject);
+			local.maxDistance = hit.distance;
+			BvhHit found = target.triangles->Raycast(local);
+			if (found.item != BVH_NO_ITEM)
+				hit = { items[slot], found.item, found.distance };
+		}
+	});
+	return hit;
+}
+
+/// <summary>
+/// RaycastScene() for many rays, traced a packet at a time
+/// </summary>
+/// <param name="hits">- output, one per ray</param>
+/// <param name="jobs">- optional, 0 traces every ray on the calling thread</param>
+void TriangleBvh::RaycastScene(const Bvh& scene, const RayTarget* targets, const BvhRay* rays, size_t count, RayHit* hits, JobSystem* jobs)
+{
+	TraceBatch<Lanes>(rays, count, false, jobs, [&](Packet<Lanes>& packet, size_t first, size_t lanes)
+	{
+		unsigned int hitTargets[Lanes::Width];
+		fill(hitTargets, hitTargets + Lanes::Width, BVH_NO_ITEM);
+		TraceScene(scene, targets, packet, hitTargets);
+		float distances[Lanes::Width];
+		Lanes::Store(distances, packet.distance);
+		for (size_t lane = 0; lane < lanes; lane++)
+			hits[first + lane] = { hitTargets[lane], packet.triangle[lane], distances[lane] };
+	});
+}
+
+/// <summary>
+/// Whether anything is in the way along each ray, stopping at the first triangle found instead of looking for the nearest
+/// </summary>
+/// <param name="clear">- output, one per ray, true if it reaches its maxDistance without hitting anything</param>
+/// <param name="jobs">- optional, 0 traces every ray on the calling thread</param>
+void TriangleBvh::LineOfSight(const Bvh& scene, const RayTarget* targets, const BvhRay* rays, size_t count, bool* clear, JobSystem* jobs)
+{
+	TraceBatch<Lanes>(rays, count, true, jobs, [&](Packet<Lanes>& packet, size_t first, size_t lanes)
+	{
+		unsigned int hitTargets[Lanes::Width];
+		fill(hitTargets, hitTargets + Lanes::Width, BVH_NO_ITEM);
+		TraceScene(scene, targets, packet, hitTargets);
+		for (size_t lane = 0; lane < lanes; lane++)
+			clear[first + lane] = hitTargets[lane] == BVH_NO_ITEM;
+	});
+}
+
+size_t TriangleBvh::GetNodeCount() const
+{
+	return nodes.size();
+}
+
+size_t TriangleBvh::GetTriangleCount() const
+{
+	return triangles.size();
+}
+
+/// <returns>The flattened tree, leaves indexing runs of GetTriangles()</returns>
+const vector<BvhNode>& TriangleBvh::GetNodes() const
+{
+	return nodes;
+}
+
+/// <returns>Every triangle in slot order</returns>
+const vector<TriangleBvh::Triangle>& TriangleBvh::GetTriangles() const
+{
+	return triangles;
+}
+
+/// <returns>Which of the mesh's triangles each slot is</returns>
+const vector<unsigned int>& TriangleBvh::GetTriangleIndices() const
+{
+	return triangleIndices;
+}
+
+/// <returns>Rays in a packet, 8 when built for AVX and 4 otherwise</returns>
+unsigned int TriangleBvh::GetPacketWidth()
+{
+	return (unsigned int)Lanes::Width;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "Vertex.h"
+#include "Bvh.h"
+
+class JobSystem;
+class TriangleBvh;
+
+// Packets of rays each job of a batch traces, a packet being one ray per SIMD lane
+#define TRIANGLE_BVH_PACKETS_PER_JOB 16
+
+/// <summary>
+/// One thing a scene ray can hit: a mesh's triangles and where the mesh is
+/// </summary>
+struct RayTarget
+{
+	const TriangleBvh* triangles; // 0 for things rays go through
+	DirectX::XMFLOAT4X4 worldToObject; // inverse of the world matrix
+};
+
+struct RayHit
+{
+	unsigned int target; // item of the scene BVH, BVH_NO_ITEM if the ray hit nothing
+	unsigned int triangle; // within the target's mesh, its indices start at three times this
+	float distance; // along the ray, in multiples of its direction
+};
+
+/// <summary>
+/// <para>Bounding volume hierarchy over a mesh's triangles, in object space, for picking and line of sight</para>
+/// Built with Bvh's SAH builder and kept flattened the same way, the triangles copied into leaf order. Batches are
+/// traced as packets of 4 or 8 rays, every node and triangle tested against the whole packet at once. Scene casts
+/// walk a Bvh over the targets' world bounds, then each target's triangles with the rays moved into its space.
+/// A built tree is plain arrays, so MeshCache stores it and Load() takes it back without building again
+/// </summary>
+class TriangleBvh
+{
+public:
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 corner;
+		DirectX::XMFLOAT3 edge1; // to the second corner
+		DirectX::XMFLOAT3 edge2; // to the third
+	};
+
+private:
+	std::vector<BvhNode> nodes;
+	std::vector<Triangle> triangles; // in slot order, each leaf's triangles are a run of slots
+	std::vector<unsigned int> triangleIndices; // which of the mesh's triangles each slot is
+
+	template<typename Packet>
+	void Trace(Packet& packet) const;
+	template<typename Packet>
+	static void TraceScene(const Bvh& scene, const RayTarget* targets, Packet& packet, unsigned int* hitTargets);
+
+public:
+	void Build(const Vertex* vertices, const unsigned int* indices, size_t indexCount);
+	void Load(const BvhNode* nodes, size_t nodeCount, const Triangle* triangles, const unsigned int* triangleIndices, size_t triangleCount);
+	BvhHit Raycast(const BvhRay& ray) const;
+	void Raycast(const BvhRay* rays, size_t count, BvhHit* hits, JobSystem* jobs = 0) const;
+
+	static RayHit RaycastScene(const Bvh& scene, const RayTarget* targets, const BvhRay& ray);
+	static void RaycastScene(const Bvh& scene, const RayTarget* targets, const BvhRay* rays, size_t count, RayHit* hits, JobSystem* jobs = 0);
+	static void LineOfSight(const Bvh& scene, const RayTarget* targets, const BvhRay* rays, size_t count, bool* clear, JobSystem* jobs = 0);
+
+	size_t GetNodeCount() const;
+	size_t GetTriangleCount() const;
+	const std::vector<BvhNode>& GetNodes() const;
+	const std::vector<Triangle>& GetTriangles() const;
+	const std::vector<unsigned int>& GetTriangleIndices() const;
+	static unsigned int GetPacketWidth();
+};
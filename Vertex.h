@@ -12,5 +12,19 @@ struct Vertex
 	DirectX::XMFLOAT3 Position;	    // The local position of the vertex
 	DirectX::XMFLOAT2 UV;
 	DirectX::XMFLOAT3 Normal;
-	DirectX::XMFLOAT3 Tangent;
-};
\ No newline at end of file
+	DirectX::XMFLOAT4 Tangent;		// w is MikkTSpace's bitangent sign, -1 where the uvs are mirrored
+};
+
+// --------------------------------------------------------
+// Compressed version of Vertex, 20 bytes instead of 48
+//
+// Made by VertexPacking and decoded by the *Packed.hlsl shaders,
+// see VertexPacking.h for the matching input layout
+// --------------------------------------------------------
+struct PackedVertex
+{
+	unsigned short Position[4];	// UNORM16 xyz inside the mesh bounds, w is the bitangent sign (0 = -1, 65535 = +1)
+	unsigned short UV[2];		// Half floats
+	short Normal[2];			// Octahedral, SNORM16
+	short Tangent[2];			// Octahedral, SNORM16
+};
@@ -0,0 +1,155 @@
+#include "VertexPacking.h"
+#include "InstanceBatcher.h"
+#include <DirectXPackedVector.h>
+#include <d3dcompiler.h>
+#include <cstring>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+const D3D11_INPUT_ELEMENT_DESC VertexPacking::InputLayout[PACKED_VERTEX_ELEMENT_COUNT] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+namespace
+{
+	/// <returns>+1 or -1 per component, +1 for zero so folded directions stay on the octahedron</returns>
+	XMVECTOR SignNotZero(FXMVECTOR v)
+	{
+		return XMVectorSelect(g_XMOne, g_XMNegativeOne, XMVectorLess(v, XMVectorZero()));
+	}
+
+	/// <summary>
+	/// Map a unit vector onto the octahedron and unfold it into the [-1, 1] square
+	/// </summary>
+	/// <returns>The square coordinates in x and y</returns>
+	XMVECTOR OctEncode(FXMVECTOR n)
+	{
+		XMVECTOR l1 = XMVector3Dot(XMVectorAbs(n), g_XMOne);
+		XMVECTOR p = XMVectorDivide(n, XMVectorMax(l1, XMVectorReplicate(1e-20f)));
+
+		// The lower half folds out over the diagonals
+		XMVECTOR folded = XMVectorMultiply(
+			XMVectorSubtract(g_XMOne, XMVectorAbs(XMVectorSwizzle<1, 0, 3, 2>(p))),
+			SignNotZero(p));
+		return XMVectorSelect(p, folded, XMVectorLess(XMVectorSplatZ(p), XMVectorZero()));
+	}
+
+	/// <summary>
+	/// Inverse of OctEncode, matches OctDecode() in Lighting.hlsli
+	/// </summary>
+	XMVECTOR OctDecode(FXMVECTOR e)
+	{
+		XMVECTOR z = XMVectorSubtract(g_XMOne, XMVector2Dot(XMVectorAbs(e), g_XMOne));
+		XMVECTOR n = XMVectorSelect(e, z, g_XMSelect0010);
+		n = XMVectorSetW(n, 0);
+
+		// Undo the fold for the lower half, t is 0 for the upper half
+		XMVECTOR t = XMVectorMax(XMVectorNegate(z), XMVectorZero());
+		n = XMVectorSubtract(n, XMVectorMultiply(XMVectorAndInt(SignNotZero(n), g_XMSelect1100), t));
+		return XMVector3Normalize(n);
+	}
+
+	/// <summary>
+	/// Normalize a direction, zero length or NaN ones (degenerate UVs or faces) become the fallback
+	/// </summary>
+	XMVECTOR NormalizeOr(FXMVECTOR v, FXMVECTOR fallback)
+	{
+		XMVECTOR valid = XMVectorGreater(XMVector3LengthSq(v), XMVectorReplicate(PACKED_VERTEX_MIN_LENGTH_SQ));
+		return XMVectorSelect(fallback, XMVector3Normalize(v), valid);
+	}
+
+	/// <returns>A unit vector perpendicular to the unit vector n, crossed with whichever axis is furthest from it</returns>
+	XMVECTOR Perpendicular(FXMVECTOR n)
+	{
+		XMVECTOR axis = fabsf(XMVectorGetX(n)) < 0.9f ? g_XMIdentityR0 : g_XMIdentityR1;
+		return XMVector3Normalize(XMVector3Cross(axis, n));
+	}
+}
+
+/// <summary>
+/// Quantize vertices for the packed input layout
+/// </summary>
+/// <param name="vertices">- full precision vertices</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <param name="boundsMin">- corner the positions are stored relative to</param>
+/// <param name="boundsMax">- opposite corner, positions outside the bounds are clamped</param>
+/// <param name="packed">- output, vertexCount long</param>
+void VertexPacking::Pack(const Vertex* vertices, int vertexCount, XMFLOAT3 boundsMin, XMFLOAT3 boundsMax, PackedVertex* packed)
+{
+	// A flat axis gets a scale of 0 so everything lands on boundsMin instead of dividing by zero
+	XMVECTOR vMin = XMLoadFloat3(&boundsMin);
+	XMVECTOR extent = XMVectorSubtract(XMLoadFloat3(&boundsMax), vMin);
+	XMVECTOR invExtent = XMVectorSelect(XMVectorReciprocal(extent), XMVectorZero(), XMVectorLessOrEqual(extent, XMVectorZero()));
+
+	for (int i = 0; i < vertexCount; i++)
+	{
+		const Vertex& v = vertices[i];
+		PackedVertex& out = packed[i];
+
+		XMVECTOR normal = NormalizeOr(XMLoadFloat3(&v.Normal), g_XMIdentityR2);
+		XMVECTOR tangent = NormalizeOr(XMLoadFloat3((const XMFLOAT3*)&v.Tangent), Perpendicular(normal));
+		XMVECTOR position = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&v.Position), vMin), invExtent);
+
+		// w only has to tell the two bitangent signs apart
+		XMStoreUShortN4((XMUSHORTN4*)out.Position, XMVectorSetW(position, v.Tangent.w < 0 ? 0.0f : 1.0f));
+		XMStoreHalf2((XMHALF2*)out.UV, XMLoadFloat2(&v.UV));
+		XMStoreShortN2((XMSHORTN2*)out.Normal, OctEncode(normal));
+		XMStoreShortN2((XMSHORTN2*)out.Tangent, OctEncode(tangent));
+	}
+}
+
+/// <summary>
+/// Decode packed vertices the same way the packed vertex shaders do, used to measure the error
+/// </summary>
+/// <param name="packed">- vertices made by Pack()</param>
+/// <param name="vertexCount">- number of vertices</param>
+/// <param name="boundsMin">- same bounds given to Pack()</param>
+/// <param name="boundsMax">- same bounds given to Pack()</param>
+/// <param name="vertices">- output, vertexCount long</param>
+void VertexPacking::Unpack(const PackedVertex* packed, int vertexCount, XMFLOAT3 boundsMin, XMFLOAT3 boundsMax, Vertex* vertices)
+{
+	XMVECTOR vMin = XMLoadFloat3(&boundsMin);
+	XMVECTOR extent = XMVectorSubtract(XMLoadFloat3(&boundsMax), vMin);
+
+	for (int i = 0; i < vertexCount; i++)
+	{
+		const PackedVertex& p = packed[i];
+		Vertex& out = vertices[i];
+
+		XMVECTOR position = XMLoadUShortN4((const XMUSHORTN4*)p.Position);
+		XMStoreFloat3(&out.Position, XMVectorMultiplyAdd(position, extent, vMin));
+		XMStoreFloat2(&out.UV, XMLoadHalf2((const XMHALF2*)p.UV));
+		XMStoreFloat3(&out.Normal, OctDecode(XMLoadShortN2((const XMSHORTN2*)p.Normal)));
+		XMStoreFloat4(&out.Tangent, XMVectorSetW(OctDecode(XMLoadShortN2((const XMSHORTN2*)p.Tangent)), XMVectorGetW(position) * 2 - 1));
+	}
+}
+
+/// <summary>
+/// Make an input layout for PackedVertex, SimpleShader can't reflect one since it only knows about 32 bit formats
+/// </summary>
+/// <param name="device">- device to create the layout with</param>
+/// <param name="shaderFile">- compiled vertex shader whose input signature the layout is validated against</param>
+/// <param name="inputLayout">- output</param>
+/// <param name="instanced">- also read InstanceData from vertex buffer slot 1, for the *Instanced.hlsl shaders</param>
+/// <returns>The first failing HRESULT, if any</returns>
+HRESULT VertexPacking::CreateInputLayout(Microsoft::WRL::ComPtr<ID3D11Device> device, const wchar_t* shaderFile, Microsoft::WRL::ComPtr<ID3D11InputLayout>& inputLayout, bool instanced)
+{
+	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
+	HRESULT hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
+	if (FAILED(hr)) return hr;
+
+	D3D11_INPUT_ELEMENT_DESC elements[PACKED_VERTEX_ELEMENT_COUNT + INSTANCE_ELEMENT_COUNT];
+	memcpy(elements, InputLayout, sizeof(InputLayout));
+	memcpy(elements + PACKED_VERTEX_ELEMENT_COUNT, InstanceBatcher::InputLayout, sizeof(InstanceBatcher::InputLayout));
+	return device->CreateInputLayout(
+		elements,
+		instanced ? PACKED_VERTEX_ELEMENT_COUNT + INSTANCE_ELEMENT_COUNT : PACKED_VERTEX_ELEMENT_COUNT,
+		shaderBlob->GetBufferPointer(),
+		shaderBlob->GetBufferSize(),
+		inputLayout.GetAddressOf());
+}
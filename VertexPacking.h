@@ -0,0 +1,27 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include "Vertex.h"
+
+// Elements in the PackedVertex input layout
+#define PACKED_VERTEX_ELEMENT_COUNT 4
+
+// Normals and tangents with a squared length below this are replaced before encoding
+#define PACKED_VERTEX_MIN_LENGTH_SQ 1e-12f
+
+// --------------------------------------------------------
+// Converts between Vertex and the 20 byte PackedVertex
+//
+// Positions are stored relative to the mesh bounds, so the
+// shaders need positionMin/positionExtent to decode them
+// --------------------------------------------------------
+class VertexPacking
+{
+public:
+	static const D3D11_INPUT_ELEMENT_DESC InputLayout[PACKED_VERTEX_ELEMENT_COUNT];
+
+	static void Pack(const Vertex* vertices, int vertexCount, DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax, PackedVertex* packed);
+	static void Unpack(const PackedVertex* packed, int vertexCount, DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax, Vertex* vertices);
+	static HRESULT CreateInputLayout(Microsoft::WRL::ComPtr<ID3D11Device> device, const wchar_t* shaderFile, Microsoft::WRL::ComPtr<ID3D11InputLayout>& inputLayout, bool instanced = false);
+};
@@ -1,24 +1,30 @@
-#include "Lighting.hlsli"
+#include "PerFrame.hlsli"
 
 // define constant buffer at the top
 // important that every line of code is typed correctly and in this order
 
-// ExternalData is an identifier used to signify the programmer's intent for this buffer, good for organization
+// PerObject is an identifier used to signify the programmer's intent for this buffer, good for organization.
+// The camera and light come from PerFrame, only what changes from draw to draw is here
 
 // : register(b0) tells the shader which slot we're referring to when accessing the variables in this cbuffer
 // binds resource or buffer to pipeline
 // b0 = the buffer register at index 0
-cbuffer ExternalData : register(b0) 
+// Instanced draws of unpacked vertices have nothing left to put in it
+#if !defined(INSTANCED) || defined(PACKED_VERTICES)
+cbuffer PerObject : register(b0) 
 {
 	// declare variables that hold the external data (data sent in from c++)
 	// order at which they're declared matters (they define where in the buffer these variables will get their data)
+#ifndef INSTANCED
 	matrix world;
-	matrix view;
-	matrix proj;
     matrix worldIT;
-    matrix lightView;
-    matrix lightProjection;
+#endif
+#ifdef PACKED_VERTICES
+    float3 positionMin;
+    float3 positionExtent;
+#endif
 }
+#endif
 
 
 
@@ -29,8 +35,24 @@ cbuffer ExternalData : register(b0)
 // - Output is a single struct of data to pass down the pipeline
 // - Named "main" because that's the default the shader compiler looks for
 // --------------------------------------------------------
-VertexToPixel main( VertexShaderInput input )
+#ifdef INSTANCED
+#define INSTANCE_INPUT , InstanceInput instance
+#else
+#define INSTANCE_INPUT
+#endif
+#ifdef PACKED_VERTICES
+VertexToPixel main( PackedVertexShaderInput packedInput INSTANCE_INPUT )
 {
+	VertexShaderInput input = UnpackVertex(packedInput, positionMin, positionExtent);
+#else
+VertexToPixel main( VertexShaderInput input INSTANCE_INPUT )
+{
+#endif
+#ifdef INSTANCED
+	// Each instance brings its own matrices instead of the constant buffer's
+	matrix world = transpose(matrix(instance.world0, instance.world1, instance.world2, instance.world3));
+	matrix worldIT = transpose(matrix(instance.worldIT0, instance.worldIT1, instance.worldIT2, instance.worldIT3));
+#endif
 	// Set up output struct
 	VertexToPixel output;
 
@@ -63,7 +85,7 @@ VertexToPixel main( VertexShaderInput input )
 	// to account for non-uniform scales, use a worldInvTranspose matrix
     output.normal = mul((float3x3) worldIT, input.normal);
 	
-    output.tangent = mul((float3x3) world, input.tangent);
+    output.tangent = float4(mul((float3x3) world, input.tangent.xyz), input.tangent.w);
 	
 	// calculate world position of pixel, and only grab the first three components
     output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
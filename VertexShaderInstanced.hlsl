@@ -0,0 +1,4 @@
+// Same as VertexShader.hlsl, but the world matrices come per instance
+// from the second vertex buffer (see InstanceBatcher.h)
+#define INSTANCED
+#include "VertexShader.hlsl"
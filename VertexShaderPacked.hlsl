@@ -0,0 +1,4 @@
+// Same as VertexShader.hlsl, but reads the 20 byte PackedVertex
+// (see VertexPacking.h for the input layout)
+#define PACKED_VERTICES
+#include "VertexShader.hlsl"
@@ -0,0 +1,5 @@
+// Same as VertexShaderPacked.hlsl, but the world matrices come per instance
+// from the second vertex buffer (see InstanceBatcher.h)
+#define PACKED_VERTICES
+#define INSTANCED
+#include "VertexShader.hlsl"